@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+
+namespace bench {
+
+// Information about an allocation beyond its size and alignment, which
+// allocators may use to decide where to place it.
+struct AllocHint {
+  // A hash of the call stack making the allocation (see `TraceLine.site_id`),
+  // or 0 if unknown. Allocations from the same site tend to have similar
+  // sizes and lifetimes, so grouping them improves locality and lets whole
+  // spans of memory be freed at once.
+  uint64_t site_id = 0;
+  // How long the allocation will live (see `TraceLine.lifetime_class`), or 0
+  // if unknown. Only passed when the executor is asked to, as real allocators
+  // can at best predict it.
+  uint32_t lifetime_class = 0;
+};
+
+}  // namespace bench
@@ -5,6 +5,7 @@
 #include <cstring>
 #include <mutex>
 
+#include "src/alloc_hint.h"
 #include "src/heap_factory.h"
 #include "src/heap_interface.h"
 
@@ -16,7 +17,9 @@ extern Heap* g_heap;
 
 extern std::mutex g_lock;
 
-// Called before any allocations are made.
+// Called before any allocations are made. Metadata kept outside of the heaps
+// should go in heaps from `heap_factory.NewMetadataInstance()`, so that it
+// counts toward utilization.
 inline void initialize_heap(HeapFactory& heap_factory) {
   auto res = heap_factory.NewInstance(kHeapSize);
   if (!res.ok()) {
@@ -67,6 +70,24 @@ inline void free(void* ptr, size_t size = 0, size_t alignment = 0) {
   // TODO: implement
 }
 
+// Variants of the above taking a hint about the allocation, which are called
+// for trace ops carrying hints (see `AllocHint`). By default hints are
+// ignored.
+inline void* malloc(size_t size, size_t alignment, const AllocHint& hint) {
+  (void) hint;
+  return malloc(size, alignment);
+}
+
+inline void* calloc(size_t nmemb, size_t size, const AllocHint& hint) {
+  (void) hint;
+  return calloc(nmemb, size);
+}
+
+inline void* realloc(void* ptr, size_t size, const AllocHint& hint) {
+  (void) hint;
+  return realloc(ptr, size);
+}
+
 inline size_t get_size(void* ptr) {
   // TODO: implement
   (void) ptr;
@@ -0,0 +1,190 @@
+#include "src/best_fit_reference.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <set>
+#include <utility>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_format.h"
+#include "util/absl_util.h"
+
+#include "proto/tracefile.pb.h"
+
+namespace bench {
+
+namespace {
+
+// Gaps searched for one satisfying a large alignment before giving up and
+// extending the heap.
+constexpr uint32_t kMaxAlignedCandidates = 64;
+
+uint64_t AlignUp(uint64_t offset, uint64_t alignment) {
+  return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+// A best-fit placement of blocks in a heap of unbounded size, by offset from
+// the start of the heap.
+class BestFitPlacer {
+ public:
+  uint64_t Allocate(uint64_t size, uint64_t alignment) {
+    uint32_t candidates = 0;
+    for (auto it = gaps_by_size_.lower_bound({ size, 0 });
+         it != gaps_by_size_.end() && candidates < kMaxAlignedCandidates;
+         ++it, candidates++) {
+      const auto [gap_size, gap_offset] = *it;
+      const uint64_t offset = AlignUp(gap_offset, alignment);
+      if (offset + size <= gap_offset + gap_size) {
+        RemoveGap(gap_offset, gap_size);
+        AddGap(gap_offset, offset - gap_offset);
+        AddGap(offset + size, gap_offset + gap_size - (offset + size));
+        return offset;
+      }
+    }
+
+    const uint64_t offset = AlignUp(top_, alignment);
+    AddGap(top_, offset - top_);
+    top_ = offset + size;
+    heap_size_ = std::max(heap_size_, top_);
+    return offset;
+  }
+
+  void Free(uint64_t offset, uint64_t size) {
+    uint64_t end = offset + size;
+    auto next = gaps_by_offset_.find(end);
+    if (next != gaps_by_offset_.end()) {
+      end += next->second;
+      RemoveGap(next->first, next->second);
+    }
+    auto prev = gaps_by_offset_.lower_bound(offset);
+    if (prev != gaps_by_offset_.begin() &&
+        std::prev(prev)->first + std::prev(prev)->second == offset) {
+      --prev;
+      offset = prev->first;
+      RemoveGap(prev->first, prev->second);
+    }
+
+    if (end == top_) {
+      top_ = offset;
+    } else {
+      AddGap(offset, end - offset);
+    }
+  }
+
+  // The furthest extent of the heap so far.
+  uint64_t HeapSize() const {
+    return heap_size_;
+  }
+
+ private:
+  void AddGap(uint64_t offset, uint64_t size) {
+    if (size != 0) {
+      gaps_by_offset_.emplace(offset, size);
+      gaps_by_size_.emplace(size, offset);
+    }
+  }
+
+  void RemoveGap(uint64_t offset, uint64_t size) {
+    gaps_by_offset_.erase(offset);
+    gaps_by_size_.erase({ size, offset });
+  }
+
+  // Free gaps below `top_`, which never touch each other or `top_`.
+  std::map<uint64_t, uint64_t> gaps_by_offset_;
+  std::set<std::pair<uint64_t, uint64_t>> gaps_by_size_;
+  // The end of the last live block.
+  uint64_t top_ = 0;
+  uint64_t heap_size_ = 0;
+};
+
+// The alignment `malloc` guarantees a block of `size` bytes.
+uint64_t MinAlignment(uint64_t size) {
+  return size <= 8 ? 8 : 16;
+}
+
+struct Block {
+  uint64_t offset;
+  uint64_t size;
+};
+
+}  // namespace
+
+absl::StatusOr<BestFitReference> ComputeBestFitReference(
+    const Tracefile& tracefile) {
+  BestFitPlacer placer;
+  absl::flat_hash_map<uint64_t, Block> live;
+  uint64_t live_bytes = 0;
+  uint64_t max_live_bytes = 0;
+
+  auto allocate = [&](uint64_t id, uint64_t size, uint64_t alignment) {
+    const uint64_t offset =
+        size != 0 ? placer.Allocate(
+                        size, std::max(alignment, MinAlignment(size)))
+                  : 0;
+    live[id] = Block{ .offset = offset, .size = size };
+    live_bytes += size;
+    max_live_bytes = std::max(max_live_bytes, live_bytes);
+  };
+  auto release = [&](uint64_t id) -> absl::Status {
+    auto it = live.find(id);
+    if (it == live.end()) {
+      return absl::FailedPreconditionError(
+          absl::StrFormat("Unknown ID being freed: %v", id));
+    }
+    if (it->second.size != 0) {
+      placer.Free(it->second.offset, it->second.size);
+    }
+    live_bytes -= it->second.size;
+    live.erase(it);
+    return absl::OkStatus();
+  };
+
+  for (const TraceLine& line : tracefile.lines()) {
+    switch (line.op_case()) {
+      case TraceLine::kMalloc: {
+        const TraceLine::Malloc& malloc = line.malloc();
+        if (malloc.has_result_id()) {
+          allocate(malloc.result_id(), malloc.input_size(),
+                   malloc.input_alignment());
+        }
+        break;
+      }
+      case TraceLine::kCalloc: {
+        const TraceLine::Calloc& calloc = line.calloc();
+        if (calloc.has_result_id()) {
+          allocate(calloc.result_id(),
+                   calloc.input_nmemb() * calloc.input_size(), 0);
+        }
+        break;
+      }
+      case TraceLine::kRealloc: {
+        const TraceLine::Realloc& realloc = line.realloc();
+        if (realloc.has_input_id()) {
+          RETURN_IF_ERROR(release(realloc.input_id()));
+        }
+        allocate(realloc.result_id(), realloc.input_size(), 0);
+        break;
+      }
+      case TraceLine::kFree: {
+        if (line.free().has_input_id()) {
+          RETURN_IF_ERROR(release(line.free().input_id()));
+        }
+        break;
+      }
+      case TraceLine::OP_NOT_SET: {
+        break;
+      }
+    }
+  }
+
+  return BestFitReference{
+    .max_live_bytes = max_live_bytes,
+    .heap_size = placer.HeapSize(),
+  };
+}
+
+}  // namespace bench
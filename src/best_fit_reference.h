@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+
+#include "absl/status/statusor.h"
+
+#include "proto/tracefile.pb.h"
+
+namespace bench {
+
+using proto::Tracefile;
+using proto::TraceLine;
+
+// How small a heap a trace fits in under a reference best-fit placement, to
+// put an allocator's utilization in context.
+struct BestFitReference {
+  // The most bytes live at once. No heap can be smaller.
+  uint64_t max_live_bytes;
+  // The heap size of the best-fit placement of the trace, which some heap can
+  // match. This is not a lower bound: an allocator may do better.
+  uint64_t heap_size;
+
+  // The utilization of the best-fit placement, or nullopt if the trace never
+  // allocates anything.
+  std::optional<double> Utilization() const {
+    if (heap_size == 0) {
+      return std::nullopt;
+    }
+    return static_cast<double>(max_live_bytes) / heap_size;
+  }
+};
+
+// Places every allocation of `tracefile` in order, as an allocator with no
+// metadata would: blocks take exactly their requested size with only the
+// alignment `malloc` guarantees, are placed in the smallest free gap they fit
+// in (best fit), and free neighbors coalesce immediately. Reallocs may grow in
+// place. The placement is online, not clairvoyant, so it is a reference point
+// rather than a bound; exact dynamic storage allocation is NP-hard, but best
+// fit with perfect coalescing comes within a few percent of optimal on the
+// traces of real programs (Johnstone and Wilson, "The Memory Fragmentation
+// Problem: Solved?").
+//
+// Fails if a line frees an id which isn't live.
+absl::StatusOr<BestFitReference> ComputeBestFitReference(
+    const Tracefile& tracefile);
+
+}  // namespace bench
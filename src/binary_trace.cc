@@ -0,0 +1,288 @@
+#include "src/binary_trace.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <utility>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_format.h"
+#include "util/absl_util.h"
+
+#include "proto/tracefile.pb.h"
+
+namespace bench {
+
+/* static */
+BinaryTraceRecord BinaryTraceRecord::FromTraceLine(const TraceLine& line) {
+  BinaryTraceRecord record = {};
+  if (line.has_thread_id()) {
+    record.flags |= kHasThreadId;
+    record.thread_id = line.thread_id();
+  }
+  if (line.has_timestamp_ns()) {
+    record.flags |= kHasTimestamp;
+    record.timestamp_ns = line.timestamp_ns();
+  }
+  if (line.has_site_id()) {
+    record.flags |= kHasSiteId;
+    record.site_id = line.site_id();
+  }
+  if (line.has_lifetime_class()) {
+    record.flags |= kHasLifetimeClass;
+    record.lifetime_class = static_cast<uint8_t>(line.lifetime_class());
+  }
+
+  auto set = [&record](uint64_t& field, uint8_t flag, bool has,
+                       uint64_t value) {
+    if (has) {
+      record.flags |= flag;
+      field = value;
+    }
+  };
+  switch (line.op_case()) {
+    case TraceLine::kMalloc: {
+      const TraceLine::Malloc& malloc = line.malloc();
+      record.op = BinaryTraceOp::kMalloc;
+      set(record.id, kHasId, malloc.has_result_id(), malloc.result_id());
+      set(record.size, kHasSize, malloc.has_input_size(), malloc.input_size());
+      set(record.arg, kHasArg, malloc.has_input_alignment(),
+          malloc.input_alignment());
+      break;
+    }
+    case TraceLine::kCalloc: {
+      const TraceLine::Calloc& calloc = line.calloc();
+      record.op = BinaryTraceOp::kCalloc;
+      set(record.id, kHasId, calloc.has_result_id(), calloc.result_id());
+      set(record.size, kHasSize, calloc.has_input_size(), calloc.input_size());
+      set(record.arg, kHasArg, calloc.has_input_nmemb(), calloc.input_nmemb());
+      break;
+    }
+    case TraceLine::kRealloc: {
+      const TraceLine::Realloc& realloc = line.realloc();
+      record.op = BinaryTraceOp::kRealloc;
+      set(record.id, kHasId, realloc.has_result_id(), realloc.result_id());
+      set(record.size, kHasSize, realloc.has_input_size(),
+          realloc.input_size());
+      set(record.arg, kHasArg, realloc.has_input_id(), realloc.input_id());
+      break;
+    }
+    case TraceLine::kFree: {
+      const TraceLine::Free& free = line.free();
+      record.op = BinaryTraceOp::kFree;
+      set(record.id, kHasId, free.has_input_id(), free.input_id());
+      set(record.size, kHasSize, free.has_input_size_hint(),
+          free.input_size_hint());
+      set(record.arg, kHasArg, free.has_input_alignment_hint(),
+          free.input_alignment_hint());
+      break;
+    }
+    case TraceLine::OP_NOT_SET: {
+      break;
+    }
+  }
+  return record;
+}
+
+absl::Status BinaryTraceRecord::ToTraceLine(TraceLine& line) const {
+  line.Clear();
+  if (Has(kHasThreadId)) {
+    line.set_thread_id(thread_id);
+  }
+  if (Has(kHasTimestamp)) {
+    line.set_timestamp_ns(timestamp_ns);
+  }
+  if (Has(kHasSiteId)) {
+    line.set_site_id(site_id);
+  }
+  if (Has(kHasLifetimeClass)) {
+    line.set_lifetime_class(lifetime_class);
+  }
+
+  switch (op) {
+    case BinaryTraceOp::kMalloc: {
+      TraceLine::Malloc& malloc = *line.mutable_malloc();
+      if (Has(kHasId)) {
+        malloc.set_result_id(id);
+      }
+      if (Has(kHasSize)) {
+        malloc.set_input_size(size);
+      }
+      if (Has(kHasArg)) {
+        malloc.set_input_alignment(arg);
+      }
+      return absl::OkStatus();
+    }
+    case BinaryTraceOp::kCalloc: {
+      TraceLine::Calloc& calloc = *line.mutable_calloc();
+      if (Has(kHasId)) {
+        calloc.set_result_id(id);
+      }
+      if (Has(kHasSize)) {
+        calloc.set_input_size(size);
+      }
+      if (Has(kHasArg)) {
+        calloc.set_input_nmemb(arg);
+      }
+      return absl::OkStatus();
+    }
+    case BinaryTraceOp::kRealloc: {
+      TraceLine::Realloc& realloc = *line.mutable_realloc();
+      if (Has(kHasId)) {
+        realloc.set_result_id(id);
+      }
+      if (Has(kHasSize)) {
+        realloc.set_input_size(size);
+      }
+      if (Has(kHasArg)) {
+        realloc.set_input_id(arg);
+      }
+      return absl::OkStatus();
+    }
+    case BinaryTraceOp::kFree: {
+      TraceLine::Free& free = *line.mutable_free();
+      if (Has(kHasId)) {
+        free.set_input_id(id);
+      }
+      if (Has(kHasSize)) {
+        free.set_input_size_hint(size);
+      }
+      if (Has(kHasArg)) {
+        free.set_input_alignment_hint(arg);
+      }
+      return absl::OkStatus();
+    }
+  }
+  return absl::InvalidArgumentError(
+      absl::StrFormat("Invalid binary trace op %u", static_cast<uint8_t>(op)));
+}
+
+BinaryTrace::BinaryTrace(BinaryTrace&& other) noexcept
+    : data_(std::exchange(other.data_, nullptr)),
+      size_(std::exchange(other.size_, 0)) {}
+
+BinaryTrace::~BinaryTrace() {
+  if (data_ != nullptr) {
+    munmap(const_cast<void*>(data_), size_);
+  }
+}
+
+/* static */
+absl::StatusOr<bool> BinaryTrace::IsBinaryTrace(const std::string& filename) {
+  std::ifstream file(filename, std::ios::binary);
+  if (!file.is_open()) {
+    return absl::InternalError(
+        absl::StrFormat("Failed to open file %s", filename));
+  }
+
+  char magic[sizeof(kBinaryTraceMagic)];
+  if (!file.read(magic, sizeof(magic))) {
+    return false;
+  }
+  return memcmp(magic, kBinaryTraceMagic, sizeof(magic)) == 0;
+}
+
+/* static */
+absl::StatusOr<BinaryTrace> BinaryTrace::Open(const std::string& filename) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1) {
+    return absl::InternalError(absl::StrFormat("Failed to open file %s: %s",
+                                               filename, strerror(errno)));
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    close(fd);
+    return absl::InternalError(
+        absl::StrFormat("Failed to stat %s: %s", filename, strerror(errno)));
+  }
+  const size_t size = st.st_size;
+  if (size < sizeof(BinaryTraceHeader)) {
+    close(fd);
+    return absl::InvalidArgumentError(
+        absl::StrFormat("%s is too short to be a binary trace", filename));
+  }
+
+  void* data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return absl::InternalError(
+        absl::StrFormat("Failed to mmap %s: %s", filename, strerror(errno)));
+  }
+  BinaryTrace trace(data, size);
+
+  const BinaryTraceHeader& header = trace.Header();
+  if (memcmp(header.magic, kBinaryTraceMagic, sizeof(header.magic)) != 0) {
+    return absl::InvalidArgumentError(
+        absl::StrFormat("%s is not a binary trace", filename));
+  }
+  if (header.version != kBinaryTraceVersion ||
+      header.record_size != sizeof(BinaryTraceRecord)) {
+    return absl::InvalidArgumentError(absl::StrFormat(
+        "%s has unsupported binary trace version %u (record size %u)",
+        filename, header.version, header.record_size));
+  }
+  if (header.num_records >
+      (size - sizeof(BinaryTraceHeader)) / sizeof(BinaryTraceRecord)) {
+    return absl::InvalidArgumentError(absl::StrFormat(
+        "%s is truncated, expected %v records", filename, header.num_records));
+  }
+
+  // Records are read sequentially, so let the kernel read ahead aggressively.
+  madvise(data, size, MADV_SEQUENTIAL);
+  return trace;
+}
+
+/* static */
+absl::Status BinaryTrace::Write(const Tracefile& tracefile,
+                                const std::string& filename) {
+  std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+  if (!file.is_open()) {
+    return absl::InternalError(
+        absl::StrFormat("Failed to open %s for writing", filename));
+  }
+
+  BinaryTraceHeader header = {};
+  memcpy(header.magic, kBinaryTraceMagic, sizeof(header.magic));
+  header.version = kBinaryTraceVersion;
+  header.record_size = sizeof(BinaryTraceRecord);
+  header.num_records = tracefile.lines_size();
+  header.max_simultaneous_allocs = tracefile.max_simultaneous_allocs();
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  for (const TraceLine& line : tracefile.lines()) {
+    const BinaryTraceRecord record = BinaryTraceRecord::FromTraceLine(line);
+    file.write(reinterpret_cast<const char*>(&record), sizeof(record));
+  }
+
+  file.close();
+  if (!file) {
+    return absl::InternalError(absl::StrFormat("Failed to write %s", filename));
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<Tracefile> BinaryTrace::ToTracefile() const {
+  Tracefile tracefile;
+  if (Header().max_simultaneous_allocs != 0) {
+    tracefile.set_max_simultaneous_allocs(Header().max_simultaneous_allocs);
+  }
+
+  const absl::Span<const BinaryTraceRecord> records = Records();
+  tracefile.mutable_lines()->Reserve(records.size());
+  for (const BinaryTraceRecord& record : records) {
+    RETURN_IF_ERROR(record.ToTraceLine(*tracefile.add_lines()));
+  }
+  return tracefile;
+}
+
+}  // namespace bench
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+
+#include "proto/tracefile.pb.h"
+
+namespace bench {
+
+using proto::Tracefile;
+using proto::TraceLine;
+
+// A fixed-layout trace format which can be memory-mapped and iterated in
+// place: a `BinaryTraceHeader` followed by `num_records` `BinaryTraceRecord`s.
+// All fields are stored in native (little-endian) byte order.
+
+constexpr char kBinaryTraceMagic[8] = { 'B', 'E', 'N', 'C',
+                                        'H', 'T', 'R', 'C' };
+constexpr uint32_t kBinaryTraceVersion = 4;
+
+struct BinaryTraceHeader {
+  char magic[8];
+  uint32_t version;
+  // `sizeof(BinaryTraceRecord)`, to catch layout mismatches.
+  uint32_t record_size;
+  uint64_t num_records;
+  // `Tracefile.max_simultaneous_allocs`, or 0 if not set.
+  uint64_t max_simultaneous_allocs;
+  uint64_t reserved[4];
+};
+static_assert(sizeof(BinaryTraceHeader) == 64);
+
+enum class BinaryTraceOp : uint8_t {
+  kMalloc = 1,
+  kCalloc = 2,
+  kRealloc = 3,
+  kFree = 4,
+};
+
+// One op. The requested size is always found in `size`, so records can be
+// bucketed by size without looking at the op:
+//
+// | op      | id        | size             | arg               |
+// |---------|-----------|------------------|-------------------|
+// | malloc  | result id | size             | alignment         |
+// | calloc  | result id | element size     | number of members |
+// | realloc | result id | size             | input id          |
+// | free    | input id  | size hint        | alignment hint    |
+struct BinaryTraceRecord {
+  // Which of the optional fields are set.
+  static constexpr uint8_t kHasId = 0x1;
+  static constexpr uint8_t kHasSize = 0x2;
+  static constexpr uint8_t kHasArg = 0x4;
+  static constexpr uint8_t kHasThreadId = 0x8;
+  static constexpr uint8_t kHasTimestamp = 0x10;
+  static constexpr uint8_t kHasSiteId = 0x20;
+  static constexpr uint8_t kHasLifetimeClass = 0x40;
+
+  BinaryTraceOp op;
+  uint8_t flags;
+  uint8_t lifetime_class;
+  uint8_t reserved;
+  uint32_t thread_id;
+  uint64_t id;
+  uint64_t size;
+  uint64_t arg;
+  uint64_t timestamp_ns;
+  uint64_t site_id;
+
+  bool Has(uint8_t field) const {
+    return (flags & field) != 0;
+  }
+
+  static BinaryTraceRecord FromTraceLine(const TraceLine& line);
+
+  // Fails if `op` isn't a valid `BinaryTraceOp`.
+  absl::Status ToTraceLine(TraceLine& line) const;
+};
+static_assert(sizeof(BinaryTraceRecord) == 48);
+
+// A read-only memory mapping of a binary tracefile. Mappings are shared, so
+// concurrent benchmark processes reading the same trace share its pages in the
+// page cache.
+class BinaryTrace {
+ public:
+  BinaryTrace(BinaryTrace&& other) noexcept;
+  BinaryTrace& operator=(BinaryTrace&&) = delete;
+  ~BinaryTrace();
+
+  // Returns true if `filename` starts with `kBinaryTraceMagic`.
+  static absl::StatusOr<bool> IsBinaryTrace(const std::string& filename);
+
+  // Maps `filename` and validates its header.
+  static absl::StatusOr<BinaryTrace> Open(const std::string& filename);
+
+  // Writes `tracefile` to `filename` in the binary format.
+  static absl::Status Write(const Tracefile& tracefile,
+                            const std::string& filename);
+
+  const BinaryTraceHeader& Header() const {
+    return *reinterpret_cast<const BinaryTraceHeader*>(data_);
+  }
+
+  absl::Span<const BinaryTraceRecord> Records() const {
+    return absl::MakeConstSpan(
+        reinterpret_cast<const BinaryTraceRecord*>(
+            static_cast<const char*>(data_) + sizeof(BinaryTraceHeader)),
+        Header().num_records);
+  }
+
+  // Converts the trace to the proto representation.
+  absl::StatusOr<Tracefile> ToTracefile() const;
+
+ private:
+  BinaryTrace(const void* data, size_t size) : data_(data), size_(size) {}
+
+  const void* data_;
+  size_t size_;
+};
+
+}  // namespace bench
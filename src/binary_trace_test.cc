@@ -0,0 +1,116 @@
+#include "src/binary_trace.h"
+
+#include <unistd.h>
+
+#include <cstdint>
+#include <string>
+
+#include "absl/status/statusor.h"
+#include "gtest/gtest.h"
+#include "util/gtest_util.h"
+
+#include "proto/tracefile.pb.h"
+#include "src/tracefile_reader.h"
+
+namespace bench {
+
+class TestBinaryTrace : public ::testing::Test {
+ public:
+  static Tracefile MakeTracefile() {
+    Tracefile tracefile;
+    tracefile.set_max_simultaneous_allocs(2);
+
+    TraceLine::Malloc* malloc = tracefile.add_lines()->mutable_malloc();
+    malloc->set_result_id(0);
+    malloc->set_input_size(24);
+
+    TraceLine* aligned_line = tracefile.add_lines();
+    aligned_line->set_thread_id(3);
+    aligned_line->set_timestamp_ns(1500);
+    aligned_line->set_site_id(0x9e3779b97f4a7c15);
+    aligned_line->set_lifetime_class(12);
+    TraceLine::Malloc* aligned = aligned_line->mutable_malloc();
+    aligned->set_result_id(1);
+    aligned->set_input_size(100);
+    aligned->set_input_alignment(64);
+
+    TraceLine::Realloc* realloc = tracefile.add_lines()->mutable_realloc();
+    realloc->set_result_id(2);
+    realloc->set_input_id(0);
+    realloc->set_input_size(48);
+
+    TraceLine::Free* free = tracefile.add_lines()->mutable_free();
+    free->set_input_id(2);
+    free->set_input_size_hint(48);
+
+    TraceLine::Calloc* calloc = tracefile.add_lines()->mutable_calloc();
+    calloc->set_result_id(3);
+    calloc->set_input_nmemb(5);
+    calloc->set_input_size(8);
+
+    // A realloc from null leaves `input_id` unset.
+    TraceLine::Realloc* realloc_null = tracefile.add_lines()->mutable_realloc();
+    realloc_null->set_result_id(4);
+    realloc_null->set_input_size(16);
+
+    for (uint64_t id : { 1, 3, 4 }) {
+      tracefile.add_lines()->mutable_free()->set_input_id(id);
+    }
+    return tracefile;
+  }
+
+  static std::string TempFile(const std::string& name) {
+    return ::testing::TempDir() + "/" + name;
+  }
+};
+
+TEST_F(TestBinaryTrace, RoundTrip) {
+  const Tracefile tracefile = MakeTracefile();
+  const std::string path = TempFile("round_trip.bin");
+  ASSERT_THAT(BinaryTrace::Write(tracefile, path), util::IsOk());
+
+  absl::StatusOr<BinaryTrace> result = BinaryTrace::Open(path);
+  ASSERT_THAT(result, util::IsOk());
+  const BinaryTrace& binary_trace = *result;
+  EXPECT_EQ(binary_trace.Header().max_simultaneous_allocs, 2);
+  ASSERT_EQ(binary_trace.Records().size(), tracefile.lines_size());
+
+  const BinaryTraceRecord& aligned = binary_trace.Records()[1];
+  EXPECT_EQ(aligned.op, BinaryTraceOp::kMalloc);
+  EXPECT_TRUE(aligned.Has(BinaryTraceRecord::kHasThreadId));
+  EXPECT_EQ(aligned.thread_id, 3);
+  EXPECT_TRUE(aligned.Has(BinaryTraceRecord::kHasTimestamp));
+  EXPECT_EQ(aligned.timestamp_ns, 1500);
+  EXPECT_TRUE(aligned.Has(BinaryTraceRecord::kHasSiteId));
+  EXPECT_EQ(aligned.site_id, 0x9e3779b97f4a7c15);
+  EXPECT_EQ(aligned.lifetime_class, 12);
+  EXPECT_EQ(aligned.size, 100);
+  EXPECT_EQ(aligned.arg, 64);
+
+  absl::StatusOr<Tracefile> decoded = binary_trace.ToTracefile();
+  ASSERT_THAT(decoded, util::IsOk());
+  EXPECT_EQ(decoded->SerializeAsString(), tracefile.SerializeAsString());
+}
+
+TEST_F(TestBinaryTrace, TracefileReaderDetectsFormat) {
+  const Tracefile tracefile = MakeTracefile();
+  const std::string path = TempFile("reader.bin");
+  ASSERT_THAT(BinaryTrace::Write(tracefile, path), util::IsOk());
+
+  absl::StatusOr<TracefileReader> reader = TracefileReader::Open(path);
+  ASSERT_THAT(reader, util::IsOk());
+  EXPECT_EQ(reader->Tracefile().SerializeAsString(),
+            tracefile.SerializeAsString());
+}
+
+TEST_F(TestBinaryTrace, RejectsTruncatedTrace) {
+  const std::string path = TempFile("truncated.bin");
+  ASSERT_THAT(BinaryTrace::Write(MakeTracefile(), path), util::IsOk());
+  ASSERT_EQ(truncate(path.c_str(), sizeof(BinaryTraceHeader) +
+                                       sizeof(BinaryTraceRecord)),
+            0);
+
+  EXPECT_FALSE(BinaryTrace::Open(path).ok());
+}
+
+}  // namespace bench
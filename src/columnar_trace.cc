@@ -0,0 +1,456 @@
+#include "src/columnar_trace.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
+#include "util/absl_util.h"
+
+#include "proto/tracefile.pb.h"
+#include "src/binary_trace.h"
+
+namespace bench {
+
+namespace {
+
+constexpr char kColumnarTraceMagic[8] = { 'B', 'E', 'N', 'C',
+                                          'H', 'C', 'O', 'L' };
+constexpr uint32_t kColumnarTraceVersion = 4;
+
+enum Column {
+  // The size dictionary.
+  kDictionary,
+  kOps,
+  kIds,
+  kSizes,
+  kArgs,
+  kThreads,
+  kTimestamps,
+  // Site ids, in the order they first appear.
+  kSiteDictionary,
+  kSites,
+  kLifetimes,
+  kNumColumns,
+};
+
+struct ColumnarTraceHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t num_lines;
+  // `Tracefile.max_simultaneous_allocs`, or 0 if not set.
+  uint64_t max_simultaneous_allocs;
+  uint64_t dictionary_size;
+  // The length in bytes of each column, which follow the header in order.
+  uint64_t column_bytes[kNumColumns];
+};
+
+// Each op varint holds the `BinaryTraceOp`, less one, in its low bits and the
+// `BinaryTraceRecord` field flags above it.
+constexpr uint8_t kOpMask = 0x3;
+constexpr uint32_t kFlagsShift = 2;
+
+// Dictionary indices past this would take more than two bytes, at which point
+// sizes might as well be stored directly.
+constexpr size_t kMaxDictionarySize = 1 << 14;
+
+uint64_t ZigZagEncode(int64_t value) {
+  return (static_cast<uint64_t>(value) << 1) ^
+         static_cast<uint64_t>(value >> 63);
+}
+
+int64_t ZigZagDecode(uint64_t value) {
+  return static_cast<int64_t>((value >> 1) ^ -(value & 1));
+}
+
+void PutVarint(std::string& out, uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<char>(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<char>(value));
+}
+
+// Codes an id relative to `next_fresh_id`.
+uint64_t EncodeId(uint64_t id, uint64_t next_fresh_id) {
+  return ZigZagEncode(static_cast<int64_t>(id - next_fresh_id));
+}
+
+uint64_t DecodeId(uint64_t coded, uint64_t next_fresh_id) {
+  return next_fresh_id + static_cast<uint64_t>(ZigZagDecode(coded));
+}
+
+bool AllocatesId(BinaryTraceOp op) {
+  return op != BinaryTraceOp::kFree;
+}
+
+// Decodes a column of varints. Varints of up to 8 bytes are decoded from one
+// unaligned 64-bit load without branching on each byte, which is where nearly
+// all of the time goes for the multi-byte ids and sizes in a trace.
+class VarintReader {
+ public:
+  explicit VarintReader(absl::string_view data)
+      : pos_(reinterpret_cast<const uint8_t*>(data.data())),
+        end_(pos_ + data.size()) {}
+
+  bool Done() const {
+    return pos_ == end_;
+  }
+
+  // Returns false if the column is exhausted or truncated.
+  bool Next(uint64_t& value) {
+    if (pos_ == end_) {
+      return false;
+    }
+    if (*pos_ < 0x80) {
+      value = *pos_++;
+      return true;
+    }
+    if (end_ - pos_ >= 8) {
+      uint64_t word;
+      memcpy(&word, pos_, sizeof(word));
+      // The high bit of the last byte of the varint is clear.
+      const uint64_t stops = ~word & 0x8080808080808080;
+      if (stops != 0) {
+        const uint32_t len = (std::countr_zero(stops) + 1) / 8;
+        uint64_t x = word & 0x7f7f7f7f7f7f7f7f;
+        if (len < 8) {
+          x &= (uint64_t{ 1 } << (8 * len)) - 1;
+        }
+        // Squeeze out the continuation bits, merging adjacent 7-bit groups
+        // into 14, then 28, then 56-bit groups.
+        x = ((x & 0x7f007f007f007f00) >> 1) | (x & 0x007f007f007f007f);
+        x = ((x & 0x3fff00003fff0000) >> 2) | (x & 0x00003fff00003fff);
+        x = ((x & 0x0fffffff00000000) >> 4) | (x & 0x000000000fffffff);
+        value = x;
+        pos_ += len;
+        return true;
+      }
+    }
+    return NextSlow(value);
+  }
+
+ private:
+  bool NextSlow(uint64_t& value) {
+    uint64_t result = 0;
+    for (uint32_t shift = 0; shift < 64 && pos_ != end_; shift += 7) {
+      const uint8_t byte = *pos_++;
+      result |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if (byte < 0x80) {
+        value = result;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  const uint8_t* pos_;
+  const uint8_t* const end_;
+};
+
+std::vector<uint64_t> BuildSizeDictionary(const Tracefile& tracefile) {
+  absl::flat_hash_map<uint64_t, uint64_t> counts;
+  for (const TraceLine& line : tracefile.lines()) {
+    const BinaryTraceRecord record = BinaryTraceRecord::FromTraceLine(line);
+    if (record.Has(BinaryTraceRecord::kHasSize)) {
+      counts[record.size]++;
+    }
+  }
+
+  std::vector<std::pair<uint64_t, uint64_t>> by_count(counts.begin(),
+                                                      counts.end());
+  std::sort(by_count.begin(), by_count.end(), [](const auto& a, const auto& b) {
+    return a.second != b.second ? a.second > b.second : a.first < b.first;
+  });
+
+  // Sizes seen only once are cheaper to store directly.
+  std::vector<uint64_t> dictionary;
+  for (const auto& [size, count] : by_count) {
+    if (count < 2 || dictionary.size() == kMaxDictionarySize) {
+      break;
+    }
+    dictionary.push_back(size);
+  }
+  return dictionary;
+}
+
+}  // namespace
+
+/* static */
+absl::StatusOr<bool> ColumnarTrace::IsColumnarTrace(
+    const std::string& filename) {
+  std::ifstream file(filename, std::ios::binary);
+  if (!file.is_open()) {
+    return absl::InternalError(
+        absl::StrFormat("Failed to open file %s", filename));
+  }
+
+  char magic[sizeof(kColumnarTraceMagic)];
+  if (!file.read(magic, sizeof(magic))) {
+    return false;
+  }
+  return memcmp(magic, kColumnarTraceMagic, sizeof(magic)) == 0;
+}
+
+/* static */
+std::string ColumnarTrace::Encode(const Tracefile& tracefile) {
+  const std::vector<uint64_t> dictionary = BuildSizeDictionary(tracefile);
+  absl::flat_hash_map<uint64_t, uint64_t> dictionary_index;
+  std::array<std::string, kNumColumns> columns;
+  for (uint64_t size : dictionary) {
+    dictionary_index.emplace(size, dictionary_index.size());
+    PutVarint(columns[kDictionary], size);
+  }
+
+  absl::flat_hash_map<uint64_t, uint64_t> site_index;
+  uint64_t next_fresh_id = 0;
+  uint64_t prev_timestamp_ns = 0;
+  for (const TraceLine& line : tracefile.lines()) {
+    const BinaryTraceRecord record = BinaryTraceRecord::FromTraceLine(line);
+    PutVarint(columns[kOps], (static_cast<uint8_t>(record.op) - 1) |
+                                 (uint64_t{ record.flags } << kFlagsShift));
+
+    if (record.Has(BinaryTraceRecord::kHasId)) {
+      PutVarint(columns[kIds], EncodeId(record.id, next_fresh_id));
+    }
+    if (record.Has(BinaryTraceRecord::kHasSize)) {
+      auto it = dictionary_index.find(record.size);
+      PutVarint(columns[kSizes], it != dictionary_index.end()
+                                     ? it->second
+                                     : dictionary.size() + record.size);
+    }
+    if (record.Has(BinaryTraceRecord::kHasArg)) {
+      PutVarint(columns[kArgs], record.op == BinaryTraceOp::kRealloc
+                                    ? EncodeId(record.arg, next_fresh_id)
+                                    : record.arg);
+    }
+    if (record.Has(BinaryTraceRecord::kHasThreadId)) {
+      PutVarint(columns[kThreads], record.thread_id);
+    }
+    if (record.Has(BinaryTraceRecord::kHasTimestamp)) {
+      PutVarint(columns[kTimestamps],
+                ZigZagEncode(static_cast<int64_t>(record.timestamp_ns -
+                                                  prev_timestamp_ns)));
+      prev_timestamp_ns = record.timestamp_ns;
+    }
+    if (record.Has(BinaryTraceRecord::kHasSiteId)) {
+      // An index one past the sites seen so far introduces a new site.
+      auto [it, inserted] =
+          site_index.emplace(record.site_id, site_index.size());
+      PutVarint(columns[kSites], it->second);
+      if (inserted) {
+        PutVarint(columns[kSiteDictionary], record.site_id);
+      }
+    }
+    if (record.Has(BinaryTraceRecord::kHasLifetimeClass)) {
+      PutVarint(columns[kLifetimes], record.lifetime_class);
+    }
+
+    if (record.Has(BinaryTraceRecord::kHasId) && AllocatesId(record.op) &&
+        record.id >= next_fresh_id) {
+      next_fresh_id = record.id + 1;
+    }
+  }
+
+  ColumnarTraceHeader header = {};
+  memcpy(header.magic, kColumnarTraceMagic, sizeof(header.magic));
+  header.version = kColumnarTraceVersion;
+  header.num_lines = tracefile.lines_size();
+  header.max_simultaneous_allocs = tracefile.max_simultaneous_allocs();
+  header.dictionary_size = dictionary.size();
+  for (size_t i = 0; i < kNumColumns; i++) {
+    header.column_bytes[i] = columns[i].size();
+  }
+
+  std::string encoded(reinterpret_cast<const char*>(&header), sizeof(header));
+  for (const std::string& column : columns) {
+    encoded.append(column);
+  }
+  return encoded;
+}
+
+/* static */
+absl::StatusOr<Tracefile> ColumnarTrace::Decode(absl::string_view encoded) {
+  ColumnarTraceHeader header;
+  if (encoded.size() < sizeof(header)) {
+    return absl::InvalidArgumentError("Columnar trace header is truncated");
+  }
+  memcpy(&header, encoded.data(), sizeof(header));
+  if (memcmp(header.magic, kColumnarTraceMagic, sizeof(header.magic)) != 0) {
+    return absl::InvalidArgumentError("Not a columnar trace");
+  }
+  if (header.version != kColumnarTraceVersion) {
+    return absl::InvalidArgumentError(absl::StrFormat(
+        "Unsupported columnar trace version %u", header.version));
+  }
+
+  std::array<VarintReader, kNumColumns> columns = [&]() {
+    size_t offset = sizeof(header);
+    auto column = [&](Column c) {
+      absl::string_view data = encoded.substr(
+          std::min(offset, encoded.size()), header.column_bytes[c]);
+      offset += header.column_bytes[c];
+      return VarintReader(data);
+    };
+    return std::array<VarintReader, kNumColumns>{
+      column(kDictionary), column(kOps),  column(kIds),
+      column(kSizes),      column(kArgs), column(kThreads),
+      column(kTimestamps), column(kSiteDictionary), column(kSites),
+      column(kLifetimes),
+    };
+  }();
+
+  uint64_t total_bytes = sizeof(header);
+  for (uint64_t column_bytes : header.column_bytes) {
+    total_bytes += column_bytes;
+  }
+  if (total_bytes != encoded.size() ||
+      header.dictionary_size > header.column_bytes[kDictionary] ||
+      header.num_lines > header.column_bytes[kOps]) {
+    return absl::InvalidArgumentError("Columnar trace is truncated");
+  }
+
+  std::vector<uint64_t> dictionary(header.dictionary_size);
+  for (uint64_t& size : dictionary) {
+    if (!columns[kDictionary].Next(size)) {
+      return absl::InvalidArgumentError("Malformed size dictionary");
+    }
+  }
+
+  Tracefile tracefile;
+  if (header.max_simultaneous_allocs != 0) {
+    tracefile.set_max_simultaneous_allocs(header.max_simultaneous_allocs);
+  }
+  tracefile.mutable_lines()->Reserve(header.num_lines);
+
+  std::vector<uint64_t> sites;
+  uint64_t next_fresh_id = 0;
+  uint64_t prev_timestamp_ns = 0;
+  for (uint64_t i = 0; i < header.num_lines; i++) {
+    BinaryTraceRecord record = {};
+    uint64_t op;
+    bool ok = columns[kOps].Next(op);
+    record.op = static_cast<BinaryTraceOp>((op & kOpMask) + 1);
+    record.flags = static_cast<uint8_t>(op >> kFlagsShift);
+
+    if (record.Has(BinaryTraceRecord::kHasId)) {
+      uint64_t coded;
+      ok &= columns[kIds].Next(coded);
+      record.id = DecodeId(coded, next_fresh_id);
+    }
+    if (record.Has(BinaryTraceRecord::kHasSize)) {
+      uint64_t coded;
+      ok &= columns[kSizes].Next(coded);
+      record.size = coded < dictionary.size() ? dictionary[coded]
+                                              : coded - dictionary.size();
+    }
+    if (record.Has(BinaryTraceRecord::kHasArg)) {
+      ok &= columns[kArgs].Next(record.arg);
+      if (record.op == BinaryTraceOp::kRealloc) {
+        record.arg = DecodeId(record.arg, next_fresh_id);
+      }
+    }
+    if (record.Has(BinaryTraceRecord::kHasThreadId)) {
+      uint64_t thread_id;
+      ok &= columns[kThreads].Next(thread_id);
+      record.thread_id = static_cast<uint32_t>(thread_id);
+    }
+    if (record.Has(BinaryTraceRecord::kHasTimestamp)) {
+      uint64_t coded;
+      ok &= columns[kTimestamps].Next(coded);
+      record.timestamp_ns =
+          prev_timestamp_ns + static_cast<uint64_t>(ZigZagDecode(coded));
+      prev_timestamp_ns = record.timestamp_ns;
+    }
+    if (record.Has(BinaryTraceRecord::kHasSiteId)) {
+      uint64_t index;
+      ok &= columns[kSites].Next(index);
+      if (ok && index == sites.size()) {
+        ok &= columns[kSiteDictionary].Next(record.site_id);
+        sites.push_back(record.site_id);
+      } else if (ok && index < sites.size()) {
+        record.site_id = sites[index];
+      } else {
+        ok = false;
+      }
+    }
+    if (record.Has(BinaryTraceRecord::kHasLifetimeClass)) {
+      uint64_t lifetime_class;
+      ok &= columns[kLifetimes].Next(lifetime_class);
+      record.lifetime_class = static_cast<uint8_t>(lifetime_class);
+    }
+    if (!ok) {
+      return absl::InvalidArgumentError(
+          absl::StrFormat("Columnar trace is truncated at line %v", i));
+    }
+
+    if (record.Has(BinaryTraceRecord::kHasId) && AllocatesId(record.op) &&
+        record.id >= next_fresh_id) {
+      next_fresh_id = record.id + 1;
+    }
+    RETURN_IF_ERROR(record.ToTraceLine(*tracefile.add_lines()));
+  }
+
+  for (const VarintReader& column : columns) {
+    if (!column.Done()) {
+      return absl::InvalidArgumentError(
+          "Columnar trace has trailing data in a column");
+    }
+  }
+  return tracefile;
+}
+
+/* static */
+absl::Status ColumnarTrace::Write(const Tracefile& tracefile,
+                                  const std::string& filename) {
+  std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+  if (!file.is_open()) {
+    return absl::InternalError(
+        absl::StrFormat("Failed to open %s for writing", filename));
+  }
+
+  const std::string encoded = Encode(tracefile);
+  file.write(encoded.data(), encoded.size());
+  file.close();
+  if (!file) {
+    return absl::InternalError(absl::StrFormat("Failed to write %s", filename));
+  }
+  return absl::OkStatus();
+}
+
+/* static */
+absl::StatusOr<Tracefile> ColumnarTrace::Read(const std::string& filename) {
+  std::ifstream file(filename, std::ios::binary);
+  if (!file.is_open()) {
+    return absl::InternalError(
+        absl::StrFormat("Failed to open file %s", filename));
+  }
+
+  const std::string encoded((std::istreambuf_iterator<char>(file)),
+                            std::istreambuf_iterator<char>());
+  if (file.bad()) {
+    return absl::InternalError(absl::StrFormat("Failed to read %s", filename));
+  }
+
+  auto tracefile = Decode(encoded);
+  if (!tracefile.ok()) {
+    return absl::InvalidArgumentError(absl::StrFormat(
+        "Failed to decode %s: %s", filename, tracefile.status().message()));
+  }
+  return tracefile;
+}
+
+}  // namespace bench
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+
+#include "proto/tracefile.pb.h"
+
+namespace bench {
+
+using proto::Tracefile;
+using proto::TraceLine;
+
+// A compact trace encoding which splits the fields of each `TraceLine` into
+// separate columns of varints, so that each column compresses and decodes
+// independently:
+//
+// - ops: one varint per line, the op and which of its fields are set.
+// - ids: ids, zig-zag encoded relative to the next fresh id (one past the
+//   largest id allocated so far). Allocations almost always take the next
+//   fresh id, and frees mostly refer to recent allocations, so most ids fit in
+//   one or two bytes.
+// - sizes: requested sizes, coded by index into a dictionary of the trace's
+//   most frequent sizes. Sizes not in the dictionary are stored after it,
+//   offset by the dictionary size.
+// - args: alignments, calloc member counts, and realloc input ids (coded like
+//   ids).
+// - threads: thread ids.
+// - timestamps: zig-zag encoded differences from the previous timestamp.
+// - sites: site ids, coded by index into the distinct site ids in order of
+//   first appearance. An index one past the sites seen so far takes the next
+//   id from the site dictionary column.
+// - lifetimes: lifetime classes.
+//
+// All varints are little-endian base-128.
+class ColumnarTrace {
+ public:
+  // Returns true if `filename` starts with the columnar trace magic.
+  static absl::StatusOr<bool> IsColumnarTrace(const std::string& filename);
+
+  static std::string Encode(const Tracefile& tracefile);
+  static absl::StatusOr<Tracefile> Decode(absl::string_view encoded);
+
+  static absl::Status Write(const Tracefile& tracefile,
+                            const std::string& filename);
+  static absl::StatusOr<Tracefile> Read(const std::string& filename);
+};
+
+}  // namespace bench
@@ -0,0 +1,106 @@
+#include "src/columnar_trace.h"
+
+#include <cstdint>
+#include <limits>
+#include <string>
+
+#include "absl/status/statusor.h"
+#include "gtest/gtest.h"
+#include "util/gtest_util.h"
+
+#include "proto/tracefile.pb.h"
+
+namespace bench {
+
+class TestColumnarTrace : public ::testing::Test {
+ public:
+  static void ExpectRoundTrips(const Tracefile& tracefile) {
+    absl::StatusOr<Tracefile> decoded =
+        ColumnarTrace::Decode(ColumnarTrace::Encode(tracefile));
+    ASSERT_THAT(decoded, util::IsOk());
+    EXPECT_EQ(decoded->SerializeAsString(), tracefile.SerializeAsString());
+  }
+};
+
+TEST_F(TestColumnarTrace, AllOps) {
+  Tracefile tracefile;
+  tracefile.set_max_simultaneous_allocs(3);
+
+  TraceLine* malloc_line = tracefile.add_lines();
+  malloc_line->set_timestamp_ns(1000);
+  malloc_line->set_site_id(0x9e3779b97f4a7c15);
+  TraceLine::Malloc* malloc = malloc_line->mutable_malloc();
+  malloc->set_result_id(0);
+  malloc->set_input_size(24);
+
+  // Timestamps need not increase from line to line.
+  TraceLine* aligned_line = tracefile.add_lines();
+  aligned_line->set_thread_id(2);
+  aligned_line->set_timestamp_ns(900);
+  aligned_line->set_site_id(7);
+  aligned_line->set_lifetime_class(3);
+  TraceLine::Malloc* aligned = aligned_line->mutable_malloc();
+  aligned->set_result_id(1);
+  aligned->set_input_size(4096);
+  aligned->set_input_alignment(4096);
+
+  // Repeated sites are coded by index.
+  TraceLine* calloc_line = tracefile.add_lines();
+  calloc_line->set_site_id(0x9e3779b97f4a7c15);
+  TraceLine::Calloc* calloc = calloc_line->mutable_calloc();
+  calloc->set_result_id(2);
+  calloc->set_input_nmemb(10);
+  calloc->set_input_size(24);
+
+  TraceLine::Realloc* realloc = tracefile.add_lines()->mutable_realloc();
+  realloc->set_result_id(3);
+  realloc->set_input_id(0);
+  realloc->set_input_size(200);
+
+  TraceLine::Free* free = tracefile.add_lines()->mutable_free();
+  free->set_input_id(3);
+  free->set_input_size_hint(200);
+  free->set_input_alignment_hint(16);
+
+  for (uint64_t id : { 2, 1 }) {
+    tracefile.add_lines()->mutable_free()->set_input_id(id);
+  }
+  ExpectRoundTrips(tracefile);
+}
+
+TEST_F(TestColumnarTrace, ExtremeValues) {
+  // Exercises every varint length, ids far from the next fresh id in both
+  // directions, and sizes both inside and outside of the size dictionary.
+  Tracefile tracefile;
+  uint64_t id = 0;
+  for (uint32_t shift = 0; shift < 64; shift++) {
+    TraceLine::Malloc* malloc = tracefile.add_lines()->mutable_malloc();
+    malloc->set_result_id(id);
+    malloc->set_input_size(uint64_t{ 1 } << shift);
+    id += (uint64_t{ 1 } << shift) + 1;
+  }
+  for (uint32_t i = 0; i < 4; i++) {
+    TraceLine::Malloc* malloc = tracefile.add_lines()->mutable_malloc();
+    malloc->set_result_id(std::numeric_limits<uint64_t>::max() - i);
+    malloc->set_input_size(std::numeric_limits<uint64_t>::max());
+  }
+  tracefile.add_lines()->mutable_free()->set_input_id(0);
+  tracefile.add_lines()->mutable_free()->set_input_id(
+      std::numeric_limits<uint64_t>::max());
+  ExpectRoundTrips(tracefile);
+}
+
+TEST_F(TestColumnarTrace, RejectsTruncatedTrace) {
+  Tracefile tracefile;
+  for (uint64_t id = 0; id < 100; id++) {
+    TraceLine::Malloc* malloc = tracefile.add_lines()->mutable_malloc();
+    malloc->set_result_id(id * 1000);
+    malloc->set_input_size(id * 1000);
+  }
+
+  const std::string encoded = ColumnarTrace::Encode(tracefile);
+  EXPECT_FALSE(
+      ColumnarTrace::Decode(encoded.substr(0, encoded.size() - 1)).ok());
+}
+
+}  // namespace bench
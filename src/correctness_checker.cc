@@ -16,6 +16,7 @@
 #include "src/malloc_runner.h"
 #include "src/tracefile_executor.h"
 #include "src/tracefile_reader.h"
+#include "src/tracefile_stream_reader.h"
 
 namespace bench {
 
@@ -34,6 +35,15 @@ absl::Status CorrectnessChecker::Check(
   return checker.Run(options).status();
 }
 
+/* static */
+absl::Status CorrectnessChecker::Check(
+    TracefileStreamReader& reader, HeapFactory& heap_factory, bool verbose,
+    const TracefileExecutorOptions& options) {
+  TracefileExecutor<CorrectnessChecker> checker(reader, std::ref(heap_factory),
+                                                verbose);
+  return checker.Run(options).status();
+}
+
 absl::Status CorrectnessChecker::PostAlloc(void* ptr, size_t size,
                                            std::optional<size_t> alignment,
                                            bool is_calloc) {
@@ -12,6 +12,7 @@
 #include "src/malloc_runner.h"
 #include "src/tracefile_executor.h"
 #include "src/tracefile_reader.h"
+#include "src/tracefile_stream_reader.h"
 
 namespace bench {
 
@@ -27,6 +28,10 @@ class CorrectnessChecker : public MallocRunner<AllocatedBlock> {
   static absl::Status Check(
       TracefileReader& reader, HeapFactory& heap_factory, bool verbose = false,
       const TracefileExecutorOptions& options = TracefileExecutorOptions());
+  static absl::Status Check(
+      TracefileStreamReader& reader, HeapFactory& heap_factory,
+      bool verbose = false,
+      const TracefileExecutorOptions& options = TracefileExecutorOptions());
 
   absl::Status PostAlloc(void* ptr, size_t size,
                          std::optional<size_t> alignment,
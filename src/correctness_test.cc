@@ -2,6 +2,7 @@
 #include "util/absl_util.h"
 #include "util/gtest_util.h"
 
+#include "src/binary_trace.h"
 #include "src/correctness_checker.h"
 #include "src/mmap_heap_factory.h"
 #include "src/tracefile_reader.h"
@@ -15,6 +16,15 @@ class TestCorrectness : public ::testing::Test {
     MMapHeapFactory heap_factory;
     return bench::CorrectnessChecker::Check(reader, heap_factory);
   }
+
+  // Converts `tracefile` to a binary trace, which is replayed in place.
+  static absl::Status CheckBinary(const std::string& tracefile) {
+    DEFINE_OR_RETURN(TracefileReader, reader, TracefileReader::Open(tracefile));
+    const std::string binary =
+        ::testing::TempDir() + "/" + tracefile.substr(tracefile.find('/') + 1);
+    RETURN_IF_ERROR(BinaryTrace::Write(reader.Tracefile(), binary));
+    return Check(binary);
+  }
 };
 
 TEST_F(TestCorrectness, All) {
@@ -71,4 +81,11 @@ TEST_F(TestCorrectness, Zero) {
   ASSERT_THAT(Check("traces/test-zero.trace"), util::IsOk());
 }
 
+TEST_F(TestCorrectness, Binary) {
+  ASSERT_THAT(CheckBinary("traces/simple_calloc.trace"), util::IsOk());
+  ASSERT_THAT(CheckBinary("traces/simple_realloc.trace"), util::IsOk());
+  ASSERT_THAT(CheckBinary("traces/syn-mix-realloc.trace"), util::IsOk());
+  ASSERT_THAT(CheckBinary("traces/test-zero.trace"), util::IsOk());
+}
+
 }  // namespace bench
@@ -0,0 +1,58 @@
+#include "src/cpu_affinity.h"
+
+#include <cerrno>
+#include <cstring>
+#include <sched.h>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/str_join.h"
+
+namespace bench {
+
+absl::StatusOr<std::vector<int>> AllowedCpus() {
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  if (sched_getaffinity(/*pid=*/0, sizeof(cpu_set), &cpu_set) == -1) {
+    return absl::InternalError(
+        absl::StrFormat("Failed to get CPU affinity: %s", strerror(errno)));
+  }
+
+  std::vector<int> cpus;
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, &cpu_set)) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+absl::Status PinThreadToCpu(int cpu) {
+  return PinThreadToCpus({ cpu });
+}
+
+absl::Status PinThreadToCpus(const std::vector<int>& cpus) {
+  if (cpus.empty()) {
+    return absl::InvalidArgumentError("No CPUs to pin thread to");
+  }
+
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  for (int cpu : cpus) {
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+      return absl::InvalidArgumentError(
+          absl::StrFormat("CPU %d out of range", cpu));
+    }
+    CPU_SET(cpu, &cpu_set);
+  }
+  if (sched_setaffinity(/*pid=*/0, sizeof(cpu_set), &cpu_set) == -1) {
+    return absl::InternalError(
+        absl::StrFormat("Failed to pin thread to CPUs %s: %s",
+                        absl::StrJoin(cpus, ","), strerror(errno)));
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace bench
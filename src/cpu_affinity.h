@@ -0,0 +1,20 @@
+#pragma once
+
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+
+namespace bench {
+
+// Returns the CPUs the calling thread is allowed to run on, in increasing
+// order.
+absl::StatusOr<std::vector<int>> AllowedCpus();
+
+// Restricts the calling thread to run only on `cpu`.
+absl::Status PinThreadToCpu(int cpu);
+
+// Restricts the calling thread to run only on `cpus`, which must not be empty.
+absl::Status PinThreadToCpus(const std::vector<int>& cpus);
+
+}  // namespace bench
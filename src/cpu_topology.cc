@@ -0,0 +1,242 @@
+#include "src/cpu_topology.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_set.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
+#include "util/absl_util.h"
+
+#include "src/cpu_affinity.h"
+
+namespace bench {
+
+namespace {
+
+// Reads a single integer from a sysfs file, or returns `std::nullopt` if it
+// doesn't exist.
+std::optional<int> ReadSysfsInt(const std::string& path) {
+  std::ifstream file(path);
+  int value;
+  if (!(file >> value)) {
+    return std::nullopt;
+  }
+  return value;
+}
+
+}  // namespace
+
+absl::StatusOr<CpuPlacement> ParseCpuPlacement(absl::string_view name) {
+  if (name == "none") {
+    return CpuPlacement::kNone;
+  }
+  if (name == "compact") {
+    return CpuPlacement::kCompact;
+  }
+  if (name == "spread") {
+    return CpuPlacement::kSpread;
+  }
+  if (name == "no_smt") {
+    return CpuPlacement::kNoSmt;
+  }
+  if (name == "explicit") {
+    return CpuPlacement::kExplicit;
+  }
+  return absl::InvalidArgumentError(absl::StrFormat(
+      "Unknown CPU placement \"%s\", expected one of none, compact, spread, "
+      "no_smt or explicit",
+      name));
+}
+
+/* static */
+absl::StatusOr<CpuTopology> CpuTopology::Read(const std::string& sysfs_root) {
+  DEFINE_OR_RETURN(std::vector<int>, allowed_cpus, AllowedCpus());
+
+  std::vector<CpuInfo> cpus;
+  cpus.reserve(allowed_cpus.size());
+  for (int cpu : allowed_cpus) {
+    const std::string topology =
+        absl::StrFormat("%s/cpu%d/topology", sysfs_root, cpu);
+    std::optional<int> package_id =
+        ReadSysfsInt(absl::StrFormat("%s/physical_package_id", topology));
+    std::optional<int> core_id =
+        ReadSysfsInt(absl::StrFormat("%s/core_id", topology));
+    if (!package_id.has_value() || !core_id.has_value()) {
+      // Offset unknown cores past any real core ids so they can't collide.
+      package_id = 0;
+      core_id = (1 << 20) + cpu;
+    }
+    cpus.push_back({
+        .cpu = cpu,
+        .package_id = package_id.value(),
+        .core_id = core_id.value(),
+    });
+  }
+  return FromCpus(std::move(cpus));
+}
+
+/* static */
+CpuTopology CpuTopology::FromCpus(std::vector<CpuInfo> cpus) {
+  std::sort(cpus.begin(), cpus.end(),
+            [](const CpuInfo& a, const CpuInfo& b) { return a.cpu < b.cpu; });
+
+  std::map<std::pair<int, int>, int> threads_per_core;
+  for (CpuInfo& info : cpus) {
+    info.smt_index = threads_per_core[{ info.package_id, info.core_id }]++;
+  }
+  return CpuTopology(std::move(cpus));
+}
+
+absl::StatusOr<std::vector<int>> CpuTopology::WorkerCpus(
+    CpuPlacement placement, uint32_t n_workers,
+    const std::vector<int>& explicit_cpus) const {
+  switch (placement) {
+    case CpuPlacement::kNone: {
+      return std::vector<int>();
+    }
+    case CpuPlacement::kExplicit: {
+      if (explicit_cpus.empty()) {
+        return absl::InvalidArgumentError(
+            "Explicit CPU placement requires a list of CPUs");
+      }
+      absl::flat_hash_set<int> available;
+      for (const CpuInfo& info : cpus_) {
+        available.insert(info.cpu);
+      }
+      for (int cpu : explicit_cpus) {
+        if (!available.contains(cpu)) {
+          return absl::InvalidArgumentError(
+              absl::StrFormat("CPU %d is not available to this process", cpu));
+        }
+      }
+      return explicit_cpus;
+    }
+    case CpuPlacement::kCompact:
+    case CpuPlacement::kSpread:
+    case CpuPlacement::kNoSmt: {
+      break;
+    }
+  }
+
+  std::vector<CpuInfo> order = cpus_;
+  if (placement == CpuPlacement::kCompact) {
+    std::sort(order.begin(), order.end(),
+              [](const CpuInfo& a, const CpuInfo& b) {
+                return std::tie(a.package_id, a.core_id, a.smt_index) <
+                       std::tie(b.package_id, b.core_id, b.smt_index);
+              });
+  } else {
+    // Rank each core within its package, so the n-th core of every package is
+    // used before the (n+1)-th core of any.
+    std::map<int, std::map<int, int>> core_ranks;
+    for (const CpuInfo& info : cpus_) {
+      core_ranks[info.package_id][info.core_id] = 0;
+    }
+    for (auto& [package_id, cores] : core_ranks) {
+      int rank = 0;
+      for (auto& [core_id, core_rank] : cores) {
+        core_rank = rank++;
+      }
+    }
+
+    auto key = [&core_ranks](const CpuInfo& info) {
+      return std::make_tuple(info.smt_index,
+                             core_ranks[info.package_id][info.core_id],
+                             info.package_id);
+    };
+    std::sort(order.begin(), order.end(),
+              [&key](const CpuInfo& a, const CpuInfo& b) {
+                return key(a) < key(b);
+              });
+
+    if (placement == CpuPlacement::kNoSmt) {
+      order.erase(std::remove_if(order.begin(), order.end(),
+                                 [](const CpuInfo& info) {
+                                   return info.smt_index != 0;
+                                 }),
+                  order.end());
+      if (n_workers > order.size()) {
+        return absl::FailedPreconditionError(absl::StrFormat(
+            "Cannot place %u workers without sharing cores, only %zu cores "
+            "are available",
+            n_workers, order.size()));
+      }
+    }
+  }
+
+  std::vector<int> worker_cpus;
+  for (size_t i = 0; i < std::min<size_t>(n_workers, order.size()); i++) {
+    worker_cpus.push_back(order[i].cpu);
+  }
+  return worker_cpus;
+}
+
+std::vector<std::vector<int>> CpuTopology::HelperCpus(
+    const std::vector<int>& worker_cpus) const {
+  const absl::flat_hash_set<int> worker_set(worker_cpus.begin(),
+                                            worker_cpus.end());
+  absl::flat_hash_set<int> used = worker_set;
+  std::vector<std::vector<int>> helper_cpus(worker_cpus.size());
+
+  // Prefer a sibling, which shares the worker's caches but not its pipeline.
+  for (size_t i = 0; i < worker_cpus.size(); i++) {
+    auto worker = std::find_if(cpus_.begin(), cpus_.end(),
+                               [cpu = worker_cpus[i]](const CpuInfo& info) {
+                                 return info.cpu == cpu;
+                               });
+    if (worker == cpus_.end()) {
+      continue;
+    }
+    for (const CpuInfo& info : cpus_) {
+      if (info.package_id == worker->package_id &&
+          info.core_id == worker->core_id && !used.contains(info.cpu)) {
+        helper_cpus[i].push_back(info.cpu);
+        used.insert(info.cpu);
+        break;
+      }
+    }
+  }
+
+  for (std::vector<int>& cpus : helper_cpus) {
+    if (!cpus.empty()) {
+      continue;
+    }
+    for (const CpuInfo& info : cpus_) {
+      if (!used.contains(info.cpu)) {
+        cpus.push_back(info.cpu);
+        used.insert(info.cpu);
+        break;
+      }
+    }
+  }
+
+  std::vector<int> shared_cpus;
+  for (const CpuInfo& info : cpus_) {
+    if (!worker_set.contains(info.cpu)) {
+      shared_cpus.push_back(info.cpu);
+    }
+  }
+  if (shared_cpus.empty()) {
+    for (const CpuInfo& info : cpus_) {
+      shared_cpus.push_back(info.cpu);
+    }
+  }
+  for (std::vector<int>& cpus : helper_cpus) {
+    if (cpus.empty()) {
+      cpus = shared_cpus;
+    }
+  }
+  return helper_cpus;
+}
+
+}  // namespace bench
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+
+namespace bench {
+
+// How worker threads are assigned to CPUs.
+enum class CpuPlacement {
+  // Workers are not pinned, and may migrate between CPUs.
+  kNone,
+  // Workers fill all hardware threads of a core before moving on to the next
+  // core, and all cores of a package before moving on to the next package.
+  kCompact,
+  // Workers are spread one per physical core, alternating between packages,
+  // before any core runs a second worker on an SMT sibling.
+  kSpread,
+  // Like `kSpread`, but no two workers ever share a physical core. Fails if
+  // there are more workers than cores.
+  kNoSmt,
+  // Workers are pinned to an explicitly given list of CPUs, in order.
+  kExplicit,
+};
+
+absl::StatusOr<CpuPlacement> ParseCpuPlacement(absl::string_view name);
+
+// The location of a logical CPU in the machine's topology.
+struct CpuInfo {
+  int cpu;
+  int package_id;
+  int core_id;
+  // The index of this CPU among the hardware threads of its core.
+  int smt_index;
+};
+
+// The topology of the CPUs available to this process, as reported by
+// `/sys/devices/system/cpu`.
+class CpuTopology {
+ public:
+  // Reads the topology of the CPUs the calling thread may run on. CPUs whose
+  // topology isn't exposed under `sysfs_root` are treated as separate
+  // single-threaded cores of package 0.
+  static absl::StatusOr<CpuTopology> Read(
+      const std::string& sysfs_root = "/sys/devices/system/cpu");
+
+  // Builds a topology from already known CPUs, computing their `smt_index`.
+  static CpuTopology FromCpus(std::vector<CpuInfo> cpus);
+
+  // The available CPUs, ordered by CPU number.
+  const std::vector<CpuInfo>& Cpus() const {
+    return cpus_;
+  }
+
+  // Returns the CPUs to pin workers `0, 1, ..., n_workers - 1` to under
+  // `placement`, or an empty list for `CpuPlacement::kNone`. If the policy
+  // yields fewer CPUs than workers, workers wrap around the list.
+  // `explicit_cpus` is only used by `CpuPlacement::kExplicit`, and must all
+  // be available.
+  absl::StatusOr<std::vector<int>> WorkerCpus(
+      CpuPlacement placement, uint32_t n_workers,
+      const std::vector<int>& explicit_cpus) const;
+
+  // Returns the CPUs the helper thread of a worker pinned to each of
+  // `worker_cpus` may run on, keeping helpers off of the workers' CPUs. Each
+  // helper gets an SMT sibling of its worker's CPU if no worker uses it, or
+  // else any CPU no worker or other helper uses. Helpers left without a CPU of
+  // their own share every CPU no worker runs on, or all CPUs if workers run
+  // on all of them.
+  std::vector<std::vector<int>> HelperCpus(
+      const std::vector<int>& worker_cpus) const;
+
+ private:
+  explicit CpuTopology(std::vector<CpuInfo> cpus) : cpus_(std::move(cpus)) {}
+
+  std::vector<CpuInfo> cpus_;
+};
+
+}  // namespace bench
@@ -3,25 +3,40 @@
 #include <cstddef>
 #include <cstdlib>
 #include <filesystem>
+#include <fstream>
 #include <iomanip>
 #include <ios>
 #include <iostream>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 #include "absl/flags/flag.h"
 #include "absl/flags/parse.h"
 #include "absl/status/status.h"
 #include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_format.h"
 #include "absl/strings/strip.h"
 #include "util/absl_util.h"
 
+#include "src/best_fit_reference.h"
 #include "src/correctness_checker.h"
+#include "src/cpu_topology.h"
 #include "src/heap_factory.h"
+#include "src/latency_histogram.h"
 #include "src/mmap_heap_factory.h"
+#include "src/perf_counters.h"
 #include "src/perfetto.h"
 #include "src/perftest.h"
+#include "src/trace_index.h"
 #include "src/tracefile_executor.h"
 #include "src/tracefile_reader.h"
+#include "src/tracefile_stream_reader.h"
+#include "src/trial_stats.h"
+#include "src/util_timeline.h"
 #include "src/utiltest.h"
 
 ABSL_FLAG(std::string, trace, "",
@@ -40,16 +55,133 @@ ABSL_FLAG(size_t, perftest_iters, 1000000,
           "The minimum number of alloc/free operations to perform for each "
           "tracefile when measuring allocator throughput.");
 
+ABSL_FLAG(uint32_t, perftest_warmup, 0,
+          "The number of untimed runs of each tracefile before measuring "
+          "allocator throughput.");
+
+ABSL_FLAG(uint32_t, perftest_trials, 1,
+          "The number of independently timed runs of each tracefile. With more "
+          "than one, the median throughput is reported and used for scoring.");
+
+ABSL_FLAG(double, perftest_outlier_threshold, 3.5,
+          "Trials whose throughput is more than this many (MAD-estimated) "
+          "standard deviations from the median are discarded. 0 disables "
+          "outlier rejection.");
+
 ABSL_FLAG(uint32_t, threads, 1,
           "If not 1, the number of threads to run all tests with.");
 
+ABSL_FLAG(bool, stream, false,
+          "If true, tracefiles are streamed from disk a chunk at a time "
+          "instead of being loaded into memory, so arbitrarily long traces "
+          "can be replayed. Only single-threaded, unpinned replay is "
+          "supported.");
+
+ABSL_FLAG(std::string, placement, "none",
+          "How worker threads are pinned to CPUs: none, compact (fill SMT "
+          "siblings and cores in order), spread (one per physical core "
+          "first), no_smt (never share a physical core) or explicit (the "
+          "CPUs in --cpus). Scaling sweeps default to spread.");
+
+ABSL_FLAG(std::vector<std::string>, cpus, {},
+          "The comma-separated CPUs to pin worker threads to in order with "
+          "--placement=explicit.");
+
+ABSL_FLAG(bool, per_thread_replay, false,
+          "If true, each thread recorded in a tracefile is replayed on its own "
+          "worker thread, overriding --threads.");
+
+ABSL_FLAG(bool, pipelined_batches, false,
+          "If true, each worker thread has a helper thread preparing and "
+          "flushing its batches, so the measuring core only runs allocator "
+          "code.");
+
+ABSL_FLAG(bool, latency, false,
+          "If true, additionally times each allocator call individually and "
+          "reports latency percentiles per trace.");
+
+ABSL_FLAG(bool, paced_replay, false,
+          "If true, additionally replays each trace open loop, issuing each op "
+          "at its recorded time instead of as soon as the previous one "
+          "completes, and reports latency percentiles measured from when each "
+          "op was due. Traces must have timestamps, as recorded by "
+          "librecorder.so.");
+
+ABSL_FLAG(double, pace_scale, 1,
+          "With --paced_replay, the factor the recorded gaps between ops are "
+          "multiplied by, e.g. 0.5 replays traces at twice the recorded "
+          "rate.");
+
+ABSL_FLAG(uint64_t, util_sample_interval, 0,
+          "If nonzero, the utilization test samples live bytes, heap size and "
+          "resident memory every this many ops, and reports time-weighted "
+          "utilization and fragmentation by size range.");
+
+ABSL_FLAG(std::string, util_timeline, "",
+          "With --util_sample_interval, a CSV file to write each trace's "
+          "samples to.");
+
+ABSL_FLAG(bool, best_fit_reference, false,
+          "If true, additionally computes the utilization of a best-fit "
+          "reference placement of each trace (see `ComputeBestFitReference`), "
+          "and reports utilization relative to it. This is not a bound: an "
+          "allocator may beat it.");
+
+ABSL_FLAG(bool, lifetime_hints, false,
+          "If true, allocations are passed how long they will live as a hint, "
+          "from traces annotated with `trace_converter --annotate_lifetimes`.");
+
+ABSL_FLAG(bool, perf_counters, false,
+          "If true, additionally counts hardware perf events (cycles, cache "
+          "misses, ...) per allocator op for each trace, falling back to "
+          "software events where hardware events are unavailable.");
+
+ABSL_FLAG(std::vector<std::string>, scaling_sweep, {},
+          "If set, a comma-separated list of thread counts, e.g. 1,2,4,8. "
+          "Instead of the usual tests, each trace's throughput is measured at "
+          "every thread count, with workers pinned to CPUs (see "
+          "--placement), and reported with its speedup and parallel "
+          "efficiency relative to the first count.");
+
+ABSL_FLAG(std::string, scaling_out, "",
+          "If set, a file to write the results of --scaling_sweep to as CSV.");
+
+ABSL_FLAG(uint64_t, start_op, 0,
+          "If set, throughput is only timed from this op of --trace onward. "
+          "Earlier ops are replayed untimed, from the closest checkpoint in "
+          "--trace_index if given. Correctness, utilization and latency still "
+          "cover the whole trace.");
+
+ABSL_FLAG(uint64_t, window_ops, 0,
+          "If set, the number of ops from --start_op for which throughput is "
+          "timed, rather than the rest of the trace.");
+
+ABSL_FLAG(std::string, trace_index, "",
+          "If set, an index of --trace built by trace_indexer, used to reach "
+          "--start_op without replaying the trace from the beginning.");
+
 namespace bench {
 
 struct TraceResult {
   std::string trace;
   bool correct;
+  // The median of `mega_ops_stats`.
   double mega_ops;
+  TrialStats mega_ops_stats;
   double utilization;
+  // The peak sizes of the heaps, of the allocator's metadata heaps, and of the
+  // two together over the utilization test.
+  size_t peak_heap_size = 0;
+  size_t peak_metadata_size = 0;
+  size_t peak_footprint = 0;
+  std::optional<LatencyProfile> latency;
+  // The latencies of open-loop replay, from when each op was due.
+  std::optional<LatencyProfile> paced_latency;
+  std::optional<BestFitReference> best_fit_reference;
+  // Samples of the heap over the utilization test.
+  std::optional<UtilTimeline> util_timeline;
+  // The counts of each worker thread.
+  std::optional<std::vector<PerfCounterValues>> perf_counters;
 };
 
 bool ShouldIgnoreForScoring(const std::string& trace) {
@@ -66,17 +198,60 @@ bool IsHard(const std::string& trace) {
   return absl::StrContains(trace, "/gto.trace");
 }
 
-absl::StatusOr<TraceResult> RunTrace(const std::string& tracefile,
-                                     HeapFactory& heap_factory) {
+absl::StatusOr<TracefileExecutorOptions> ExecutorOptionsFromFlags() {
+  DEFINE_OR_RETURN(CpuPlacement, placement,
+                   ParseCpuPlacement(absl::GetFlag(FLAGS_placement)));
+  std::vector<int> cpus;
+  for (const std::string& value : absl::GetFlag(FLAGS_cpus)) {
+    int cpu;
+    if (!absl::SimpleAtoi(value, &cpu)) {
+      return absl::InvalidArgumentError(
+          absl::StrFormat("Invalid CPU \"%s\" in --cpus", value));
+    }
+    cpus.push_back(cpu);
+  }
+
+  return TracefileExecutorOptions{
+    .n_threads = absl::GetFlag(FLAGS_threads),
+    .per_thread_replay = absl::GetFlag(FLAGS_per_thread_replay),
+    .pipelined_batches = absl::GetFlag(FLAGS_pipelined_batches),
+    .placement = placement,
+    .cpus = std::move(cpus),
+    .lifetime_hints = absl::GetFlag(FLAGS_lifetime_hints),
+  };
+}
+
+bool WindowRequested() {
+  return absl::GetFlag(FLAGS_start_op) != 0 ||
+         absl::GetFlag(FLAGS_window_ops) != 0 ||
+         !absl::GetFlag(FLAGS_trace_index).empty();
+}
+
+// Runs `tracefile` from `reader`, which is either a `TracefileReader` or a
+// `TracefileStreamReader`.
+template <typename Reader>
+absl::StatusOr<TraceResult> RunTraceFrom(Reader& reader,
+                                         const std::string& tracefile,
+                                         HeapFactory& heap_factory) {
   TraceResult result{
     .trace = tracefile,
   };
 
-  DEFINE_OR_RETURN(TracefileReader, reader, TracefileReader::Open(tracefile));
+  DEFINE_OR_RETURN(TracefileExecutorOptions, options,
+                   ExecutorOptionsFromFlags());
 
-  TracefileExecutorOptions options = {
-    .n_threads = absl::GetFlag(FLAGS_threads),
-  };
+  // Throughput may be timed over only a window of the trace.
+  TracefileExecutorOptions perftest_options = options;
+  std::optional<TraceIndex> trace_index;
+  if constexpr (std::is_same_v<Reader, TracefileReader>) {
+    perftest_options.start_op = absl::GetFlag(FLAGS_start_op);
+    perftest_options.window_ops = absl::GetFlag(FLAGS_window_ops);
+    if (!absl::GetFlag(FLAGS_trace_index).empty()) {
+      ASSIGN_OR_RETURN(trace_index,
+                       TraceIndex::Open(absl::GetFlag(FLAGS_trace_index)));
+      perftest_options.trace_index = &trace_index.value();
+    }
+  }
 
   // Check for correctness.
   if (!absl::GetFlag(FLAGS_skip_correctness)) {
@@ -98,33 +273,99 @@ absl::StatusOr<TraceResult> RunTrace(const std::string& tracefile,
   }
 
   if (result.correct) {
-    auto perf_util_result =
-        [&reader, &heap_factory,
-         &options]() -> absl::StatusOr<std::pair<double, double>> {
-      DEFINE_OR_RETURN(
-          double, mega_ops,
-          Perftest::TimeTrace(reader, heap_factory,
-                              absl::GetFlag(FLAGS_perftest_iters), options));
-      DEFINE_OR_RETURN(
-          double, utilization,
-          Utiltest::MeasureUtilization(reader, heap_factory, options));
-
-      return std::make_pair(mega_ops, utilization);
+    absl::Status perf_util_status = [&tracefile, &reader, &heap_factory,
+                                     &options, &perftest_options,
+                                     &result]() -> absl::Status {
+      PerftestTrialOptions trial_options = {
+        .warmup = absl::GetFlag(FLAGS_perftest_warmup),
+        .trials = absl::GetFlag(FLAGS_perftest_trials),
+        .outlier_threshold = absl::GetFlag(FLAGS_perftest_outlier_threshold),
+      };
+      ASSIGN_OR_RETURN(result.mega_ops_stats,
+                       Perftest::TimeTrials(
+                           reader, heap_factory,
+                           absl::GetFlag(FLAGS_perftest_iters), trial_options,
+                           perftest_options));
+      result.mega_ops = result.mega_ops_stats.median;
+      UtilSampling sampling = {
+        .interval = absl::GetFlag(FLAGS_util_sample_interval),
+      };
+      if (sampling.interval != 0) {
+        sampling.timeline = &result.util_timeline.emplace();
+      }
+      ASSIGN_OR_RETURN(result.utilization,
+                       Utiltest::MeasureUtilization(reader, heap_factory,
+                                                    options, sampling));
+      result.peak_heap_size = heap_factory.PeakSize();
+      result.peak_metadata_size = heap_factory.PeakMetadataSize();
+      result.peak_footprint = heap_factory.PeakFootprint();
+      if constexpr (std::is_same_v<Reader, TracefileReader>) {
+        if (absl::GetFlag(FLAGS_latency)) {
+          ASSIGN_OR_RETURN(result.latency,
+                           Perftest::MeasureLatency(
+                               reader, heap_factory,
+                               absl::GetFlag(FLAGS_perftest_iters), options));
+        }
+        if (absl::GetFlag(FLAGS_paced_replay)) {
+          ASSIGN_OR_RETURN(result.paced_latency,
+                           Perftest::MeasurePacedLatency(
+                               reader, heap_factory,
+                               absl::GetFlag(FLAGS_pace_scale), options));
+        }
+        if (absl::GetFlag(FLAGS_best_fit_reference)) {
+          ASSIGN_OR_RETURN(result.best_fit_reference,
+                           ComputeBestFitReference(reader.Tracefile()));
+        }
+        if (absl::GetFlag(FLAGS_perf_counters)) {
+          auto counts =
+              Perftest::CountEvents(reader, heap_factory,
+                                    absl::GetFlag(FLAGS_perftest_iters),
+                                    perftest_options);
+          if (absl::IsUnavailable(counts.status())) {
+            std::cerr << "Warning: skipping perf counters for " << tracefile
+                      << ": " << counts.status() << std::endl;
+          } else {
+            ASSIGN_OR_RETURN(result.perf_counters, std::move(counts));
+          }
+        }
+      }
+
+      return absl::OkStatus();
     }();
-    if (!perf_util_result.ok()) {
-      std::cout << "Failed " << tracefile << ": " << perf_util_result.status()
+    if (!perf_util_status.ok()) {
+      std::cout << "Failed " << tracefile << ": " << perf_util_status
                 << std::endl;
       result.correct = false;
-    } else {
-      auto [mega_ops, utilization] = perf_util_result.value();
-      result.mega_ops = mega_ops;
-      result.utilization = utilization;
     }
   }
 
   return result;
 }
 
+absl::StatusOr<TraceResult> RunTrace(const std::string& tracefile,
+                                     HeapFactory& heap_factory) {
+  if (absl::GetFlag(FLAGS_stream)) {
+    if (absl::GetFlag(FLAGS_latency) || absl::GetFlag(FLAGS_paced_replay) ||
+        absl::GetFlag(FLAGS_perf_counters) ||
+        absl::GetFlag(FLAGS_best_fit_reference)) {
+      return absl::InvalidArgumentError(
+          "--latency, --paced_replay, --perf_counters and "
+          "--best_fit_reference are not supported with --stream");
+    }
+    if (WindowRequested()) {
+      return absl::InvalidArgumentError(
+          "--start_op, --window_ops and --trace_index are not supported with "
+          "--stream");
+    }
+    DEFINE_OR_RETURN(TracefileStreamReader, reader,
+                     TracefileStreamReader::Open(tracefile));
+    return RunTraceFrom(reader, tracefile, heap_factory);
+  }
+
+  DEFINE_OR_RETURN(TracefileReader, reader, TracefileReader::Open(tracefile));
+  return RunTraceFrom(reader, tracefile, heap_factory);
+}
+
 void PrintTestResults(const std::vector<TraceResult>& results) {
   size_t max_file_len = 0;
   for (const TraceResult& result : results) {
@@ -209,11 +450,383 @@ void PrintTestResults(const std::vector<TraceResult>& results) {
   }
 }
 
+void PrintTrialStats(const std::vector<TraceResult>& results) {
+  size_t max_file_len = 5;
+  for (const TraceResult& result : results) {
+    max_file_len = std::max(result.trace.size(), max_file_len);
+  }
+
+  const std::string separator(max_file_len + 72, '-');
+  std::cout << std::endl << "Throughput trials (mega ops / s):" << std::endl;
+  std::cout << separator << std::endl;
+  std::cout << "| trace" << std::setw(max_file_len - 5) << ""
+            << " |   median |      MAD |          95% CI          | trials |"
+               " rejected |"
+            << std::endl;
+  std::cout << separator << std::endl;
+  for (const TraceResult& result : results) {
+    if (!result.correct) {
+      continue;
+    }
+    const TrialStats& stats = result.mega_ops_stats;
+    std::cout << "| " << std::setw(max_file_len) << std::left << result.trace
+              << " | " << std::right << std::fixed << std::setprecision(1)
+              << std::setw(8) << stats.median << " | " << std::setw(8)
+              << stats.mad << " | [" << std::setw(10) << stats.ci_low << ", "
+              << std::setw(10) << stats.ci_high << "] | " << std::setw(6)
+              << stats.samples.size() << " | " << std::setw(8)
+              << stats.num_rejected << " |" << std::endl;
+  }
+  std::cout << separator << std::endl;
+}
+
+void PrintBestFitReferences(const std::vector<TraceResult>& results) {
+  size_t max_file_len = 5;
+  for (const TraceResult& result : results) {
+    max_file_len = std::max(result.trace.size(), max_file_len);
+  }
+
+  const std::string separator(max_file_len + 43, '-');
+  std::cout << std::endl << "Best-fit reference placements:" << std::endl;
+  std::cout << separator << std::endl;
+  std::cout << "| trace" << std::setw(max_file_len - 5) << ""
+            << " | utilization | best fit | of best fit |" << std::endl;
+  std::cout << separator << std::endl;
+  for (const TraceResult& result : results) {
+    if (!result.correct || !result.best_fit_reference.has_value()) {
+      continue;
+    }
+    const std::optional<double> reference =
+        result.best_fit_reference->Utilization();
+    std::cout << "| " << std::setw(max_file_len) << std::left << result.trace
+              << " | " << std::right << std::fixed << std::setprecision(1)
+              << std::setw(10) << (100 * result.utilization) << "% | ";
+    if (reference.has_value()) {
+      std::cout << std::setw(7) << (100 * reference.value()) << "% | "
+                << std::setw(10)
+                << (100 * result.utilization / reference.value()) << "% |";
+    } else {
+      std::cout << std::setw(8) << "n/a" << " | " << std::setw(11) << "n/a"
+                << " |";
+    }
+    std::cout << std::endl;
+  }
+  std::cout << separator << std::endl;
+}
+
+void PrintFootprints(const std::vector<TraceResult>& results) {
+  size_t max_file_len = 5;
+  for (const TraceResult& result : results) {
+    max_file_len = std::max(result.trace.size(), max_file_len);
+  }
+
+  const std::string separator(max_file_len + 52, '-');
+  std::cout << std::endl << "Peak footprint (bytes):" << std::endl;
+  std::cout << separator << std::endl;
+  std::cout << "| trace" << std::setw(max_file_len - 5) << ""
+            << " |         heap |     metadata |    footprint |" << std::endl;
+  std::cout << separator << std::endl;
+  for (const TraceResult& result : results) {
+    if (!result.correct) {
+      continue;
+    }
+    std::cout << "| " << std::setw(max_file_len) << std::left << result.trace
+              << " | " << std::right << std::setw(12) << result.peak_heap_size
+              << " | " << std::setw(12) << result.peak_metadata_size << " | "
+              << std::setw(12) << result.peak_footprint << " |" << std::endl;
+  }
+  std::cout << separator << std::endl;
+}
+
+void PrintUtilTimeline(const std::string& trace,
+                       const UtilTimeline& timeline) {
+  const std::string separator(38, '-');
+  std::cout << std::endl
+            << trace << " time-weighted utilization: " << std::fixed
+            << std::setprecision(1) << (100 * timeline.AverageUtilization())
+            << "% over " << timeline.Samples().size() << " samples"
+            << std::endl;
+  std::cout << separator << std::endl;
+  std::cout << "| fragmentation      | size     |  heap |" << std::endl;
+  std::cout << separator << std::endl;
+  for (size_t bucket = 0; bucket < LatencyProfile::kNumSizeBuckets;
+       bucket++) {
+    std::cout << "| internal           | " << std::setw(8) << std::left
+              << LatencyProfile::SizeBucketName(bucket) << " | " << std::right
+              << std::setw(4)
+              << (100 * timeline.AverageInternalFragmentation(bucket)) << "% |"
+              << std::endl;
+  }
+  std::cout << "| external           | all      | " << std::setw(4)
+            << (100 * timeline.AverageExternalFragmentation()) << "% |"
+            << std::endl;
+  std::cout << separator << std::endl;
+}
+
+void PrintLatencyRow(absl::string_view op, absl::string_view size,
+                     const LatencyHistogram& histogram) {
+  std::cout << "| " << std::setw(7) << std::left << op << " | " << std::setw(8)
+            << size << " | " << std::right << std::setw(10)
+            << histogram.Count() << " | " << std::setw(8)
+            << histogram.Quantile(0.5) << " | " << std::setw(8)
+            << histogram.Quantile(0.99) << " | " << std::setw(8)
+            << histogram.Quantile(0.999) << " | " << std::setw(8)
+            << histogram.Max() << " |" << std::endl;
+}
+
+void PrintLatencyProfile(const std::string& trace,
+                         const LatencyProfile& profile) {
+  const std::string separator(79, '-');
+  std::cout << std::endl << trace << " latency (ns):" << std::endl;
+  std::cout << separator << std::endl;
+  std::cout << "| op      | size     |      count |      p50 |      p99 |    "
+               "p99.9 |      max |"
+            << std::endl;
+  std::cout << separator << std::endl;
+  for (AllocOp op : LatencyProfile::kOps) {
+    LatencyHistogram op_histogram = profile.OpHistogram(op);
+    if (op_histogram.Count() == 0) {
+      continue;
+    }
+
+    PrintLatencyRow(LatencyProfile::OpName(op), "all", op_histogram);
+    for (size_t size_bucket = 0; size_bucket < LatencyProfile::kNumSizeBuckets;
+         size_bucket++) {
+      const LatencyHistogram& histogram = profile.Histogram(op, size_bucket);
+      if (histogram.Count() != 0) {
+        PrintLatencyRow("", LatencyProfile::SizeBucketName(size_bucket),
+                        histogram);
+      }
+    }
+  }
+  std::cout << separator << std::endl;
+}
+
+void PrintPerfCounters(const std::string& trace,
+                       const std::vector<PerfCounterValues>& thread_counts) {
+  PerfCounterValues total;
+  for (const PerfCounterValues& counts : thread_counts) {
+    total.Merge(counts);
+  }
+
+  const std::string separator(59, '-');
+  std::cout << std::endl
+            << trace << " perf counters (per op, " << thread_counts.size()
+            << " threads):" << std::endl;
+  if (!total[PerfEvent::kCycles].has_value()) {
+    std::cout << "(hardware events unavailable)" << std::endl;
+  }
+  std::cout << separator << std::endl;
+  std::cout << "| event            |   overall |  min thread |  max thread |"
+            << std::endl;
+  std::cout << separator << std::endl;
+  for (size_t i = 0; i < kNumPerfEvents; i++) {
+    const PerfEvent event = static_cast<PerfEvent>(i);
+    if (!total[event].has_value() || total.ops == 0) {
+      continue;
+    }
+
+    double min_per_op = INFINITY;
+    double max_per_op = 0;
+    for (const PerfCounterValues& counts : thread_counts) {
+      if (counts[event].has_value() && counts.ops != 0) {
+        const double per_op = counts[event].value() / counts.ops;
+        min_per_op = std::min(min_per_op, per_op);
+        max_per_op = std::max(max_per_op, per_op);
+      }
+    }
+
+    std::cout << "| " << std::setw(16) << std::left << PerfEventName(event)
+              << " | " << std::right << std::fixed << std::setprecision(3)
+              << std::setw(9) << total[event].value() / total.ops << " | "
+              << std::setw(11) << min_per_op << " | " << std::setw(11)
+              << max_per_op << " |" << std::endl;
+  }
+  std::cout << separator << std::endl;
+}
+
+struct ScalingPoint {
+  uint32_t n_threads;
+  TrialStats mega_ops;
+};
+
+struct ScalingResult {
+  std::string trace;
+  std::vector<ScalingPoint> points;
+};
+
+absl::StatusOr<std::vector<uint32_t>> ParseThreadCounts(
+    const std::vector<std::string>& values) {
+  std::vector<uint32_t> thread_counts;
+  for (const std::string& value : values) {
+    uint32_t n_threads;
+    if (!absl::SimpleAtoi(value, &n_threads) || n_threads == 0) {
+      return absl::InvalidArgumentError(
+          absl::StrFormat("Invalid thread count \"%s\"", value));
+    }
+    thread_counts.push_back(n_threads);
+  }
+  return thread_counts;
+}
+
+absl::StatusOr<ScalingResult> RunScalingSweep(
+    const std::string& tracefile, HeapFactory& heap_factory,
+    const std::vector<uint32_t>& thread_counts) {
+  ScalingResult result{
+    .trace = tracefile,
+  };
+
+  DEFINE_OR_RETURN(TracefileReader, reader, TracefileReader::Open(tracefile));
+  DEFINE_OR_RETURN(TracefileExecutorOptions, options,
+                   ExecutorOptionsFromFlags());
+  // Thread counts come from the sweep, and unpinned workers would make the
+  // results depend on the scheduler.
+  options.per_thread_replay = false;
+  if (options.placement == CpuPlacement::kNone) {
+    options.placement = CpuPlacement::kSpread;
+  }
+  PerftestTrialOptions trial_options = {
+    .warmup = absl::GetFlag(FLAGS_perftest_warmup),
+    .trials = absl::GetFlag(FLAGS_perftest_trials),
+    .outlier_threshold = absl::GetFlag(FLAGS_perftest_outlier_threshold),
+  };
+
+  if (!absl::GetFlag(FLAGS_skip_correctness)) {
+    options.n_threads =
+        *std::max_element(thread_counts.begin(), thread_counts.end());
+    RETURN_IF_ERROR(CorrectnessChecker::Check(reader, heap_factory,
+                                              /*verbose=*/false, options));
+  }
+
+  for (uint32_t n_threads : thread_counts) {
+    options.n_threads = n_threads;
+    DEFINE_OR_RETURN(
+        TrialStats, mega_ops,
+        Perftest::TimeTrials(reader, heap_factory,
+                             absl::GetFlag(FLAGS_perftest_iters),
+                             trial_options, options));
+    result.points.push_back({ .n_threads = n_threads, .mega_ops = mega_ops });
+  }
+  return result;
+}
+
+// The speedup and parallel efficiency of `point` relative to `baseline`.
+std::pair<double, double> Scaling(const ScalingPoint& point,
+                                  const ScalingPoint& baseline) {
+  const double speedup = point.mega_ops.median / baseline.mega_ops.median;
+  const double efficiency =
+      speedup * baseline.n_threads / static_cast<double>(point.n_threads);
+  return { speedup, efficiency };
+}
+
+void PrintScalingResult(const ScalingResult& result) {
+  const std::string separator(60, '-');
+  std::cout << std::endl << result.trace << " scaling:" << std::endl;
+  std::cout << separator << std::endl;
+  std::cout << "| threads | mega ops / s |      MAD | speedup | efficiency |"
+            << std::endl;
+  std::cout << separator << std::endl;
+  for (const ScalingPoint& point : result.points) {
+    const auto [speedup, efficiency] = Scaling(point, result.points.front());
+    std::cout << "| " << std::setw(7) << point.n_threads << " | " << std::fixed
+              << std::setprecision(1) << std::setw(12)
+              << point.mega_ops.median << " | " << std::setw(8)
+              << point.mega_ops.mad << " | " << std::setprecision(2)
+              << std::setw(7) << speedup << " | " << std::setprecision(1)
+              << std::setw(9) << (100 * efficiency) << "% |" << std::endl;
+  }
+  std::cout << separator << std::endl;
+}
+
+absl::Status WriteScalingCsv(const std::string& path,
+                             const std::vector<ScalingResult>& results) {
+  std::ofstream out(path);
+  if (!out) {
+    return absl::InternalError(
+        absl::StrFormat("Failed to open %s for writing", path));
+  }
+
+  out << "trace,threads,mega_ops,mad,ci_low,ci_high,speedup,efficiency"
+      << std::endl;
+  for (const ScalingResult& result : results) {
+    for (const ScalingPoint& point : result.points) {
+      const auto [speedup, efficiency] = Scaling(point, result.points.front());
+      out << absl::StrFormat("%s,%u,%f,%f,%f,%f,%f,%f", result.trace,
+                             point.n_threads, point.mega_ops.median,
+                             point.mega_ops.mad, point.mega_ops.ci_low,
+                             point.mega_ops.ci_high, speedup, efficiency)
+          << std::endl;
+    }
+  }
+  if (!out) {
+    return absl::InternalError(absl::StrFormat("Failed to write %s", path));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status WriteUtilTimelineCsv(const std::string& path,
+                                  const std::vector<TraceResult>& results) {
+  std::ofstream out(path);
+  if (!out) {
+    return absl::InternalError(
+        absl::StrFormat("Failed to open %s for writing", path));
+  }
+
+  out << "trace,op,heap_bytes,resident_bytes,live_bytes,usable_bytes";
+  for (size_t bucket = 0; bucket < LatencyProfile::kNumSizeBuckets;
+       bucket++) {
+    const std::string name = LatencyProfile::SizeBucketName(bucket);
+    out << ",live" << name << ",usable" << name;
+  }
+  out << std::endl;
+  for (const TraceResult& result : results) {
+    if (!result.util_timeline.has_value()) {
+      continue;
+    }
+    for (const UtilSample& sample : result.util_timeline->Samples()) {
+      out << absl::StrFormat("%s,%u,%u,%u,%u,%u", result.trace, sample.op,
+                             sample.heap_bytes, sample.resident_bytes,
+                             sample.TotalLiveBytes(),
+                             sample.TotalUsableBytes());
+      for (size_t bucket = 0; bucket < LatencyProfile::kNumSizeBuckets;
+           bucket++) {
+        out << "," << sample.live_bytes[bucket] << ","
+            << sample.usable_bytes[bucket];
+      }
+      out << std::endl;
+    }
+  }
+  if (!out) {
+    return absl::InternalError(absl::StrFormat("Failed to write %s", path));
+  }
+  return absl::OkStatus();
+}
+
+// Returns the path of the inflated copy of `tracefile` if it is compressed,
+// or `tracefile` otherwise.
+std::string InflatedPath(absl::string_view tracefile) {
+  if (absl::EndsWith(tracefile, ".trace.gz")) {
+    return std::string(absl::StripSuffix(tracefile, ".gz"));
+  }
+  if (absl::EndsWith(tracefile, ".trace.zst")) {
+    return std::string(absl::StripSuffix(tracefile, ".zst"));
+  }
+  return std::string(tracefile);
+}
+
+// Lists the tracefiles under `traces/`. Compressed `*.trace.gz` and
+// `*.trace.zst` files are read directly, unless they have already been
+// inflated alongside.
 std::vector<std::string> ListTracefiles() {
   std::vector<std::string> paths;
   for (const auto& dir_entry : std::filesystem::directory_iterator("traces")) {
     const std::string& tracefile = dir_entry.path();
-    if (!tracefile.ends_with(".trace")) {
+    if (const std::string inflated = InflatedPath(tracefile);
+        inflated != tracefile) {
+      if (std::filesystem::exists(inflated)) {
+        continue;
+      }
+    } else if (!tracefile.ends_with(".trace")) {
       continue;
     }
     paths.push_back(tracefile);
@@ -222,10 +835,9 @@ std::vector<std::string> ListTracefiles() {
   return paths;
 }
 
-int RunAllTraces() {
-  std::vector<bench::TraceResult> results;
-  MMapHeapFactory heap_factory;
-
+// Returns the tracefiles to run when no specific trace is given.
+std::vector<std::string> SelectTracefiles() {
+  std::vector<std::string> tracefiles;
   for (const auto& tracefile : ListTracefiles()) {
     if (absl::GetFlag(FLAGS_ignore_test) && ShouldIgnoreForScoring(tracefile)) {
       continue;
@@ -233,7 +845,48 @@ int RunAllTraces() {
     if (absl::GetFlag(FLAGS_ignore_hard) && IsHard(tracefile)) {
       continue;
     }
+    tracefiles.push_back(tracefile);
+  }
+  return tracefiles;
+}
+
+int RunScalingSweeps(const std::vector<std::string>& tracefiles) {
+  auto thread_counts = ParseThreadCounts(absl::GetFlag(FLAGS_scaling_sweep));
+  if (!thread_counts.ok()) {
+    std::cerr << "Invalid --scaling_sweep: " << thread_counts.status()
+              << std::endl;
+    return -1;
+  }
 
+  std::vector<ScalingResult> results;
+  MMapHeapFactory heap_factory;
+  for (const auto& tracefile : tracefiles) {
+    auto result = RunScalingSweep(tracefile, heap_factory, *thread_counts);
+    if (!result.ok()) {
+      std::cerr << "Failed to run scaling sweep of " << tracefile << ": "
+                << result.status() << std::endl;
+      return -1;
+    }
+    PrintScalingResult(*result);
+    results.push_back(std::move(result).value());
+  }
+
+  const std::string scaling_out = absl::GetFlag(FLAGS_scaling_out);
+  if (!scaling_out.empty()) {
+    absl::Status status = WriteScalingCsv(scaling_out, results);
+    if (!status.ok()) {
+      std::cerr << status << std::endl;
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int RunAllTraces() {
+  std::vector<bench::TraceResult> results;
+  MMapHeapFactory heap_factory;
+
+  for (const auto& tracefile : SelectTracefiles()) {
     auto result = RunTrace(tracefile, heap_factory);
     if (!result.ok()) {
       std::cerr << "Failed to run trace " << tracefile << ": "
@@ -244,7 +897,42 @@ int RunAllTraces() {
     results.push_back(result.value());
   }
   PrintTestResults(results);
+  if (absl::GetFlag(FLAGS_perftest_trials) > 1) {
+    PrintTrialStats(results);
+  }
+  if (absl::GetFlag(FLAGS_best_fit_reference)) {
+    PrintBestFitReferences(results);
+  }
+  if (std::any_of(results.begin(), results.end(),
+                  [](const TraceResult& result) {
+                    return result.peak_metadata_size != 0;
+                  })) {
+    PrintFootprints(results);
+  }
+  for (const TraceResult& result : results) {
+    if (result.latency.has_value()) {
+      PrintLatencyProfile(result.trace, result.latency.value());
+    }
+    if (result.paced_latency.has_value()) {
+      PrintLatencyProfile(result.trace + " paced",
+                          result.paced_latency.value());
+    }
+    if (result.perf_counters.has_value()) {
+      PrintPerfCounters(result.trace, result.perf_counters.value());
+    }
+    if (result.util_timeline.has_value()) {
+      PrintUtilTimeline(result.trace, result.util_timeline.value());
+    }
+  }
 
+  const std::string util_timeline = absl::GetFlag(FLAGS_util_timeline);
+  if (!util_timeline.empty()) {
+    absl::Status status = WriteUtilTimelineCsv(util_timeline, results);
+    if (!status.ok()) {
+      std::cerr << status << std::endl;
+      return -1;
+    }
+  }
   return 0;
 }
 
@@ -254,9 +942,25 @@ int main(int argc, char* argv[]) {
   absl::ParseCommandLine(argc, argv);
   bench::Perfetto perfetto;
 
-  // Strip .gz in case the user specifies the compressed trace.
-  const std::string tracefile(
-      absl::StripSuffix(absl::GetFlag(FLAGS_trace), ".gz"));
+  // Prefer the inflated trace if the user specifies a compressed trace which
+  // has already been inflated, since it is faster to load.
+  std::string tracefile = absl::GetFlag(FLAGS_trace);
+  if (std::string inflated = bench::InflatedPath(tracefile);
+      inflated != tracefile && std::filesystem::exists(inflated)) {
+    tracefile = std::move(inflated);
+  }
+  if (bench::WindowRequested() &&
+      (tracefile.empty() || !absl::GetFlag(FLAGS_scaling_sweep).empty())) {
+    std::cerr << "--start_op, --window_ops and --trace_index require --trace, "
+                 "and are not supported with --scaling_sweep"
+              << std::endl;
+    return -1;
+  }
+  if (!absl::GetFlag(FLAGS_scaling_sweep).empty()) {
+    return bench::RunScalingSweeps(
+        tracefile.empty() ? bench::SelectTracefiles()
+                          : std::vector<std::string>{ tracefile });
+  }
   if (tracefile.empty()) {
     return bench::RunAllTraces();
   }
@@ -274,8 +978,55 @@ int main(int argc, char* argv[]) {
   if (result->correct) {
     std::cout << "mega-ops / s: " << std::fixed << std::setprecision(1)
               << result->mega_ops << std::endl;
+    if (absl::GetFlag(FLAGS_perftest_trials) > 1) {
+      const bench::TrialStats& stats = result->mega_ops_stats;
+      std::cout << "  MAD: " << stats.mad << ", 95% CI: [" << stats.ci_low
+                << ", " << stats.ci_high << "], " << stats.samples.size()
+                << " trials (" << stats.num_rejected << " rejected)"
+                << std::endl;
+    }
     std::cout << "Utilization:  " << std::fixed << std::setprecision(1)
               << (result->utilization * 100) << "%" << std::endl;
+    std::cout << "Peak footprint: " << result->peak_footprint << " bytes ("
+              << result->peak_heap_size << " heap, "
+              << result->peak_metadata_size << " metadata)" << std::endl;
+    if (result->best_fit_reference.has_value()) {
+      const std::optional<double> reference =
+          result->best_fit_reference->Utilization();
+      if (reference.has_value()) {
+        std::cout << "Best-fit reference: " << (reference.value() * 100)
+                  << "% (" << result->best_fit_reference->heap_size
+                  << " byte heap), utilization is "
+                  << (result->utilization / reference.value() * 100)
+                  << "% of it" << std::endl;
+      } else {
+        std::cout << "Best-fit reference: n/a (nothing allocated)"
+                  << std::endl;
+      }
+    }
+    if (result->latency.has_value()) {
+      bench::PrintLatencyProfile(tracefile, result->latency.value());
+    }
+    if (result->paced_latency.has_value()) {
+      bench::PrintLatencyProfile(tracefile + " paced",
+                                 result->paced_latency.value());
+    }
+    if (result->perf_counters.has_value()) {
+      bench::PrintPerfCounters(tracefile, result->perf_counters.value());
+    }
+    if (result->util_timeline.has_value()) {
+      bench::PrintUtilTimeline(tracefile, result->util_timeline.value());
+    }
+  }
+
+  const std::string util_timeline = absl::GetFlag(FLAGS_util_timeline);
+  if (!util_timeline.empty()) {
+    absl::Status status = bench::WriteUtilTimelineCsv(
+        util_timeline, std::vector<bench::TraceResult>{ *std::move(result) });
+    if (!status.ok()) {
+      std::cerr << status << std::endl;
+      return -1;
+    }
   }
   return 0;
 }
@@ -0,0 +1,127 @@
+#include "src/gzip_input_stream.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
+#include "google/protobuf/io/zero_copy_stream.h"
+#include "zlib.h"
+
+namespace bench {
+
+namespace {
+
+// Window bits for `inflateInit2` which accept only a gzip header and trailer.
+constexpr int kGzipWindowBits = 15 + 16;
+
+}  // namespace
+
+GzipInputStream::~GzipInputStream() {
+  inflateEnd(&zstream_);
+}
+
+/* static */
+absl::StatusOr<std::unique_ptr<GzipInputStream>> GzipInputStream::Create(
+    google::protobuf::io::ZeroCopyInputStream* input, int buffer_size) {
+  std::unique_ptr<GzipInputStream> stream(
+      new GzipInputStream(input, buffer_size));
+  const int result = inflateInit2(&stream->zstream_, kGzipWindowBits);
+  if (result != Z_OK) {
+    return absl::ResourceExhaustedError(
+        absl::StrFormat("Failed to initialize zlib: %s", zError(result)));
+  }
+  return stream;
+}
+
+bool GzipInputStream::Next(const void** data, int* size) {
+  if (block_pos_ == block_.size()) {
+    if (!Fill()) {
+      return false;
+    }
+  }
+
+  *data = block_.data() + block_pos_;
+  *size = static_cast<int>(block_.size() - block_pos_);
+  block_pos_ = block_.size();
+  byte_count_ += *size;
+  return true;
+}
+
+void GzipInputStream::BackUp(int count) {
+  block_pos_ -= count;
+  byte_count_ -= count;
+}
+
+bool GzipInputStream::Skip(int count) {
+  while (count > 0) {
+    const void* data;
+    int size;
+    if (!Next(&data, &size)) {
+      return false;
+    }
+    if (size > count) {
+      BackUp(size - count);
+      return true;
+    }
+    count -= size;
+  }
+  return true;
+}
+
+int64_t GzipInputStream::ByteCount() const {
+  return byte_count_;
+}
+
+GzipInputStream::GzipInputStream(
+    google::protobuf::io::ZeroCopyInputStream* input, int buffer_size)
+    : input_(input), buffer_(buffer_size) {}
+
+bool GzipInputStream::Fill() {
+  if (!status_.ok()) {
+    return false;
+  }
+
+  zstream_.next_out = reinterpret_cast<Bytef*>(buffer_.data());
+  zstream_.avail_out = static_cast<uInt>(buffer_.size());
+  while (zstream_.avail_out == buffer_.size()) {
+    if (zstream_.avail_in == 0) {
+      const void* in;
+      int in_size;
+      if (!input_->Next(&in, &in_size)) {
+        if (in_member_) {
+          status_ = absl::DataLossError("Truncated gzip stream");
+        }
+        return false;
+      }
+      zstream_.next_in = reinterpret_cast<Bytef*>(const_cast<void*>(in));
+      zstream_.avail_in = static_cast<uInt>(in_size);
+      continue;
+    }
+
+    // Any data after the end of a member is the start of another.
+    if (!in_member_) {
+      inflateReset(&zstream_);
+      in_member_ = true;
+    }
+    const int result = inflate(&zstream_, Z_NO_FLUSH);
+    if (result == Z_STREAM_END) {
+      in_member_ = false;
+    } else if (result != Z_OK) {
+      status_ = absl::DataLossError(absl::StrFormat(
+          "zlib error: %s",
+          zstream_.msg != nullptr ? zstream_.msg : zError(result)));
+      return false;
+    }
+  }
+
+  block_ = absl::string_view(buffer_.data(),
+                             buffer_.size() - zstream_.avail_out);
+  block_pos_ = 0;
+  return true;
+}
+
+}  // namespace bench
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "google/protobuf/io/zero_copy_stream.h"
+#include "zlib.h"
+
+namespace bench {
+
+// A `ZeroCopyInputStream` over the inflated contents of the gzip-compressed
+// stream `input`, which may hold several concatenated gzip members and must
+// outlive the stream.
+//
+// Unlike protobuf's `GzipInputStream`, corrupt or truncated input ends the
+// stream with an error in `status()`, rather than looking like the end of the
+// data.
+class GzipInputStream : public google::protobuf::io::ZeroCopyInputStream {
+ public:
+  ~GzipInputStream() override;
+
+  // Inflates into blocks of up to `buffer_size` bytes.
+  static absl::StatusOr<std::unique_ptr<GzipInputStream>> Create(
+      google::protobuf::io::ZeroCopyInputStream* input, int buffer_size);
+
+  bool Next(const void** data, int* size) override;
+  void BackUp(int count) override;
+  bool Skip(int count) override;
+  int64_t ByteCount() const override;
+
+  // The error which ended the stream early, if any.
+  const absl::Status& status() const {
+    return status_;
+  }
+
+ private:
+  GzipInputStream(google::protobuf::io::ZeroCopyInputStream* input,
+                  int buffer_size);
+
+  // Inflates the next block of data into `buffer_`, returning false at the end
+  // of the input or on error.
+  bool Fill();
+
+  google::protobuf::io::ZeroCopyInputStream* const input_;
+  z_stream zstream_ = {};
+  // True if a gzip member has been started but not yet finished.
+  bool in_member_ = false;
+  std::vector<char> buffer_;
+
+  // The block last returned by `Next()`, and how much of it has been consumed.
+  absl::string_view block_;
+  size_t block_pos_ = 0;
+  int64_t byte_count_ = 0;
+  absl::Status status_;
+};
+
+}  // namespace bench
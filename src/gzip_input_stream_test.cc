@@ -0,0 +1,121 @@
+#include "src/gzip_input_stream.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
+#include "gtest/gtest.h"
+#include "util/gtest_util.h"
+#include "zlib.h"
+
+namespace bench {
+
+using google::protobuf::io::ArrayInputStream;
+
+class TestGzipInputStream : public ::testing::Test {
+ public:
+  static std::string Compress(const std::string& data) {
+    z_stream zstream = {};
+    EXPECT_EQ(deflateInit2(&zstream, /*level=*/6, Z_DEFLATED,
+                           /*windowBits=*/15 + 16, /*memLevel=*/8,
+                           Z_DEFAULT_STRATEGY),
+              Z_OK);
+    std::string compressed(deflateBound(&zstream, data.size()), '\0');
+    zstream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    zstream.avail_in = data.size();
+    zstream.next_out = reinterpret_cast<Bytef*>(compressed.data());
+    zstream.avail_out = compressed.size();
+    EXPECT_EQ(deflate(&zstream, Z_FINISH), Z_STREAM_END);
+    compressed.resize(zstream.total_out);
+    deflateEnd(&zstream);
+    return compressed;
+  }
+
+  // Inflates all of `compressed`, read in blocks of `block_size`, returning
+  // the data and the stream's final status.
+  static std::pair<std::string, absl::Status> Inflate(
+      const std::string& compressed, int block_size = 4096) {
+    ArrayInputStream input(compressed.data(), compressed.size(), block_size);
+    absl::StatusOr<std::unique_ptr<GzipInputStream>> stream =
+        GzipInputStream::Create(&input, /*buffer_size=*/1024);
+    EXPECT_THAT(stream, util::IsOk());
+
+    std::string result;
+    const void* data;
+    int size;
+    while ((*stream)->Next(&data, &size)) {
+      if (size > 1) {
+        (*stream)->BackUp(size / 2);
+        size -= size / 2;
+      }
+      result.append(static_cast<const char*>(data), size);
+    }
+    EXPECT_EQ((*stream)->ByteCount(), static_cast<int64_t>(result.size()));
+    return { result, (*stream)->status() };
+  }
+
+  static std::string MakeData(size_t size, uint32_t seed) {
+    std::string data(size, '\0');
+    for (size_t i = 0; i < size; i++) {
+      seed = seed * 1103515245 + 12345;
+      data[i] = static_cast<char>('a' + (seed >> 16) % 8);
+    }
+    return data;
+  }
+};
+
+TEST_F(TestGzipInputStream, SingleMember) {
+  const std::string data = MakeData(1 << 20, 1);
+  const std::string compressed = Compress(data);
+  for (int block_size : { 1, 4096 }) {
+    auto [result, status] = Inflate(compressed, block_size);
+    EXPECT_EQ(result, data);
+    EXPECT_THAT(status, util::IsOk());
+  }
+}
+
+TEST_F(TestGzipInputStream, ConcatenatedMembers) {
+  std::string data;
+  std::string compressed;
+  for (uint32_t member = 0; member < 3; member++) {
+    const std::string member_data = MakeData(10000 + member, member);
+    data += member_data;
+    compressed += Compress(member_data);
+  }
+  auto [result, status] = Inflate(compressed);
+  EXPECT_EQ(result, data);
+  EXPECT_THAT(status, util::IsOk());
+}
+
+TEST_F(TestGzipInputStream, Empty) {
+  auto [result, status] = Inflate("");
+  EXPECT_EQ(result, "");
+  EXPECT_THAT(status, util::IsOk());
+}
+
+TEST_F(TestGzipInputStream, Truncated) {
+  const std::string compressed = Compress(MakeData(1 << 16, 2));
+  for (size_t size : { size_t{ 2 }, compressed.size() / 2,
+                       compressed.size() - 1 }) {
+    auto [result, status] = Inflate(compressed.substr(0, size));
+    EXPECT_FALSE(status.ok()) << size;
+  }
+}
+
+TEST_F(TestGzipInputStream, Corrupt) {
+  const std::string data = MakeData(1 << 16, 3);
+  std::string compressed = Compress(data);
+  compressed[compressed.size() / 2] ^= 0x55;
+  compressed[compressed.size() / 2 + 1] ^= 0x55;
+
+  auto [result, status] = Inflate(compressed);
+  EXPECT_NE(result, data);
+  EXPECT_FALSE(status.ok());
+}
+
+}  // namespace bench
@@ -12,29 +12,53 @@
 
 namespace bench {
 
+HeapFactory::HeapFactory() {
+  size_counter_.parent = &footprint_counter_;
+  metadata_size_counter_.parent = &footprint_counter_;
+}
+
 absl::StatusOr<Heap*> HeapFactory::NewInstance(size_t size) {
-  DEFINE_OR_RETURN(std::unique_ptr<Heap>, heap, MakeHeap(size));
-  Heap* heap_ptr = heap.get();
+  return AddInstance(size, /*metadata=*/false);
+}
 
-  absl::WriterMutexLock lock(&mutex_);
-  heaps_.emplace(std::move(heap));
-  return heap_ptr;
+absl::StatusOr<Heap*> HeapFactory::NewMetadataInstance(size_t size) {
+  return AddInstance(size, /*metadata=*/true);
 }
 
 absl::Status HeapFactory::DeleteInstance(Heap* heap) {
   absl::WriterMutexLock lock(&mutex_);
-  auto it = heaps_.find(heap);
-  if (it == heaps_.end()) {
-    return absl::NotFoundError(absl::StrFormat("Heap not found: %p", heap));
+  if (auto it = heaps_.find(heap); it != heaps_.end()) {
+    size_counter_.Shrink(heap->Size());
+    heaps_.erase(it);
+    return absl::OkStatus();
   }
-
-  heaps_.erase(it);
-  return absl::OkStatus();
+  if (auto it = metadata_heaps_.find(heap); it != metadata_heaps_.end()) {
+    metadata_size_counter_.Shrink(heap->Size());
+    metadata_heaps_.erase(it);
+    return absl::OkStatus();
+  }
+  return absl::NotFoundError(absl::StrFormat("Heap not found: %p", heap));
 }
 
 void HeapFactory::Reset() {
   absl::WriterMutexLock lock(&mutex_);
   heaps_.clear();
+  metadata_heaps_.clear();
+  size_counter_.Clear();
+  metadata_size_counter_.Clear();
+  footprint_counter_.Clear();
+}
+
+absl::StatusOr<Heap*> HeapFactory::AddInstance(size_t size, bool metadata) {
+  DEFINE_OR_RETURN(std::unique_ptr<Heap>, heap, MakeHeap(size));
+  Heap* heap_ptr = heap.get();
+  HeapSizeCounter& counter = metadata ? metadata_size_counter_ : size_counter_;
+  counter.Grow(heap_ptr->Size());
+  heap_ptr->SetSizeCounter(&counter);
+
+  absl::WriterMutexLock lock(&mutex_);
+  (metadata ? metadata_heaps_ : heaps_).emplace(std::move(heap));
+  return heap_ptr;
 }
 
 }  // namespace bench
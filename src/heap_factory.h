@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <cstddef>
 #include <memory>
 #include <type_traits>
@@ -16,7 +17,7 @@ namespace bench {
 
 class HeapFactory {
  public:
-  HeapFactory() = default;
+  HeapFactory();
   HeapFactory(const HeapFactory&) = delete;
   virtual ~HeapFactory() = default;
 
@@ -24,7 +25,14 @@ class HeapFactory {
   // heap and a pointer to it.
   absl::StatusOr<Heap*> NewInstance(size_t size);
 
-  // Deletes a heap at the given index.
+  // Allocates a new heap of the requested size for an allocator's internal
+  // structures, which it may not return allocations from. Metadata heaps are
+  // not visited by `WithInstances`, but count toward the footprint, so
+  // allocators should keep any metadata which doesn't live in their heaps here
+  // rather than in static arrays or private mappings.
+  absl::StatusOr<Heap*> NewMetadataInstance(size_t size);
+
+  // Deletes a heap or metadata heap.
   absl::Status DeleteInstance(Heap* heap);
 
   template <typename ReturnVal, typename Fn>
@@ -32,15 +40,58 @@ class HeapFactory {
       ReturnVal, Fn, const absl::flat_hash_set<std::unique_ptr<Heap>>&>
   ReturnVal WithInstances(const Fn& fn);
 
+  // Like `WithInstances`, but visits the metadata heaps.
+  template <typename ReturnVal, typename Fn>
+  requires std::is_invocable_r_v<
+      ReturnVal, Fn, const absl::flat_hash_set<std::unique_ptr<Heap>>&>
+  ReturnVal WithMetadataInstances(const Fn& fn);
+
   // Clears the heap factory and deletes all allocated heaps.
   void Reset();
 
+  // Returns the total size of all heaps, without scanning them.
+  size_t TotalSize() const {
+    return size_counter_.total_size.load(std::memory_order_relaxed);
+  }
+
+  // Returns the largest `TotalSize()` has been since the last `Reset()`.
+  size_t PeakSize() const {
+    return size_counter_.peak_size.load(std::memory_order_relaxed);
+  }
+
+  // Returns the total size of all metadata heaps.
+  size_t MetadataSize() const {
+    return metadata_size_counter_.total_size.load(std::memory_order_relaxed);
+  }
+
+  // Returns the largest `MetadataSize()` has been since the last `Reset()`.
+  size_t PeakMetadataSize() const {
+    return metadata_size_counter_.peak_size.load(std::memory_order_relaxed);
+  }
+
+  // Returns the largest the heaps and metadata heaps together have been since
+  // the last `Reset()`. Since the two can peak at different times, this may be
+  // less than `PeakSize() + PeakMetadataSize()`.
+  size_t PeakFootprint() const {
+    return footprint_counter_.peak_size.load(std::memory_order_relaxed);
+  }
+
  protected:
   virtual absl::StatusOr<std::unique_ptr<Heap>> MakeHeap(size_t size) = 0;
 
  private:
+  absl::StatusOr<Heap*> AddInstance(size_t size, bool metadata)
+      BENCH_LOCKS_EXCLUDED(mutex_);
+
   absl::Mutex mutex_;
   absl::flat_hash_set<std::unique_ptr<Heap>> heaps_ BENCH_GUARDED_BY(mutex_);
+  absl::flat_hash_set<std::unique_ptr<Heap>> metadata_heaps_
+      BENCH_GUARDED_BY(mutex_);
+  // Updated by the heaps themselves, so read without holding `mutex_`. Both
+  // heap counters add to `footprint_counter_`.
+  HeapSizeCounter size_counter_;
+  HeapSizeCounter metadata_size_counter_;
+  HeapSizeCounter footprint_counter_;
 };
 
 template <typename ReturnVal, typename Fn>
@@ -51,4 +102,12 @@ ReturnVal HeapFactory::WithInstances(const Fn& fn) {
   return fn(heaps_);
 }
 
+template <typename ReturnVal, typename Fn>
+requires std::is_invocable_r_v<
+    ReturnVal, Fn, const absl::flat_hash_set<std::unique_ptr<Heap>>&>
+ReturnVal HeapFactory::WithMetadataInstances(const Fn& fn) {
+  absl::ReaderMutexLock lock(&mutex_);
+  return fn(metadata_heaps_);
+}
+
 }  // namespace bench
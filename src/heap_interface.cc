@@ -2,6 +2,7 @@
 
 #include <atomic>
 #include <cerrno>
+#include <cstdint>
 
 namespace bench {
 
@@ -23,7 +24,20 @@ void* Heap::sbrk(intptr_t increment) {
   } while (!heap_end_.compare_exchange_weak(
       old_heap_end, static_cast<uint8_t*>(old_heap_end) + increment,
       std::memory_order_relaxed, std::memory_order_relaxed));
+  if (size_counter_ != nullptr && increment != 0) {
+    size_counter_->Grow(increment);
+  }
   return old_heap_end;
 }
 
+void* Heap::Reset() {
+  void* old_heap_end =
+      heap_end_.exchange(heap_start_, std::memory_order_relaxed);
+  if (size_counter_ != nullptr) {
+    size_counter_->Shrink(static_cast<uint8_t*>(old_heap_end) -
+                          static_cast<uint8_t*>(heap_start_));
+  }
+  return heap_start_;
+}
+
 }  // namespace bench
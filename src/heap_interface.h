@@ -6,6 +6,39 @@
 
 namespace bench {
 
+// The total size of a group of heaps and the most it has been, kept up to date
+// by the heaps as they grow so the total never has to be recomputed by
+// scanning them. Changes are also applied to `parent`, if set, which totals
+// several groups.
+struct HeapSizeCounter {
+  std::atomic<size_t> total_size = 0;
+  std::atomic<size_t> peak_size = 0;
+  HeapSizeCounter* parent = nullptr;
+
+  void Grow(size_t increment) {
+    const size_t size =
+        total_size.fetch_add(increment, std::memory_order_relaxed) + increment;
+    size_t peak = peak_size.load(std::memory_order_relaxed);
+    while (peak < size && !peak_size.compare_exchange_weak(
+                              peak, size, std::memory_order_relaxed)) {}
+    if (parent != nullptr) {
+      parent->Grow(increment);
+    }
+  }
+
+  void Shrink(size_t decrement) {
+    total_size.fetch_sub(decrement, std::memory_order_relaxed);
+    if (parent != nullptr) {
+      parent->Shrink(decrement);
+    }
+  }
+
+  void Clear() {
+    total_size.store(0, std::memory_order_relaxed);
+    peak_size.store(0, std::memory_order_relaxed);
+  }
+};
+
 // Abstract interface for managing a single region of memory. Implementers are
 // responsible for allocating memory, and passing a pointer to the beginning of
 // the memory region to this class's constructor.
@@ -26,8 +59,10 @@ class Heap {
   Heap(Heap&& heap) noexcept
       : max_size_(heap.max_size_),
         heap_start_(heap.heap_start_),
+        size_counter_(heap.size_counter_),
         heap_end_(heap.heap_end_.load(std::memory_order_relaxed)) {
     heap.heap_start_ = nullptr;
+    heap.size_counter_ = nullptr;
     heap.heap_end_ = nullptr;
   }
 
@@ -43,9 +78,12 @@ class Heap {
   void* sbrk(intptr_t increment);
 
   // Resets the heap and returns a pointer to the beginning of the heap.
-  void* Reset() {
-    heap_end_.store(heap_start_, std::memory_order_relaxed);
-    return heap_start_;
+  void* Reset();
+
+  // Adds every change in the size of this heap to `counter`, which must
+  // outlive the heap. The heap's current size is not added.
+  void SetSizeCounter(HeapSizeCounter* counter) {
+    size_counter_ = counter;
   }
 
   // Returns the start of the heap.
@@ -71,6 +109,7 @@ class Heap {
  private:
   const size_t max_size_;
   void* heap_start_;
+  HeapSizeCounter* size_counter_ = nullptr;
   // Put the only mutable variable on its own cache line. Since this is the only
   // mutable variable, all atomics operations on it have relaxed memory
   // ordering.
@@ -0,0 +1,118 @@
+#include "src/latency_histogram.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+
+namespace bench {
+
+void LatencyHistogram::Record(uint64_t nanos) {
+  counts_[BucketIndex(nanos)]++;
+  count_++;
+  max_ = std::max(max_, nanos);
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other) {
+  for (size_t i = 0; i < kNumBuckets; i++) {
+    counts_[i] += other.counts_[i];
+  }
+  count_ += other.count_;
+  max_ = std::max(max_, other.max_);
+}
+
+uint64_t LatencyHistogram::Quantile(double quantile) const {
+  if (count_ == 0) {
+    return 0;
+  }
+
+  const uint64_t rank = std::max<uint64_t>(
+      static_cast<uint64_t>(std::ceil(quantile * count_)), 1);
+  uint64_t seen = 0;
+  for (size_t i = 0; i < kNumBuckets; i++) {
+    seen += counts_[i];
+    if (seen >= rank) {
+      return std::min(BucketUpperBound(i), max_);
+    }
+  }
+  return max_;
+}
+
+/* static */
+size_t LatencyHistogram::BucketIndex(uint64_t nanos) {
+  nanos = std::min(nanos, (uint64_t{ 1 } << kMaxExponent) - 1);
+  if (nanos < kSubBuckets) {
+    return nanos;
+  }
+
+  // The position of the highest set bit selects the power-of-two range, and
+  // the `kSubBucketBits` bits below it select the linear bucket within it.
+  const uint32_t shift = std::bit_width(nanos) - 1 - kSubBucketBits;
+  return (shift + 1) * kSubBuckets + ((nanos >> shift) - kSubBuckets);
+}
+
+/* static */
+uint64_t LatencyHistogram::BucketUpperBound(size_t idx) {
+  if (idx < kSubBuckets) {
+    return idx;
+  }
+
+  const uint32_t shift = idx / kSubBuckets - 1;
+  const uint64_t lower_bound = (kSubBuckets + idx % kSubBuckets) << shift;
+  return lower_bound + (uint64_t{ 1 } << shift) - 1;
+}
+
+/* static */
+size_t LatencyProfile::SizeBucket(size_t size) {
+  return std::lower_bound(kSizeBucketLimits.begin(), kSizeBucketLimits.end(),
+                          size) -
+         kSizeBucketLimits.begin();
+}
+
+/* static */
+std::string LatencyProfile::SizeBucketName(size_t size_bucket) {
+  if (size_bucket == kSizeBucketLimits.size()) {
+    return absl::StrCat(">", kSizeBucketLimits.back());
+  }
+  return absl::StrCat("<=", kSizeBucketLimits[size_bucket]);
+}
+
+/* static */
+absl::string_view LatencyProfile::OpName(AllocOp op) {
+  switch (op) {
+    case AllocOp::kMalloc:
+      return "malloc";
+    case AllocOp::kCalloc:
+      return "calloc";
+    case AllocOp::kRealloc:
+      return "realloc";
+    case AllocOp::kFree:
+      return "free";
+  }
+  __builtin_unreachable();
+}
+
+void LatencyProfile::Merge(const LatencyProfile& other) {
+  for (size_t op = 0; op < kNumOps; op++) {
+    for (size_t size_bucket = 0; size_bucket < kNumSizeBuckets;
+         size_bucket++) {
+      histograms_[op][size_bucket].Merge(other.histograms_[op][size_bucket]);
+    }
+  }
+}
+
+LatencyHistogram LatencyProfile::OpHistogram(AllocOp op) const {
+  LatencyHistogram histogram;
+  for (const LatencyHistogram& size_histogram :
+       histograms_[static_cast<size_t>(op)]) {
+    histogram.Merge(size_histogram);
+  }
+  return histogram;
+}
+
+}  // namespace bench
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "absl/strings/string_view.h"
+
+namespace bench {
+
+// A log-linear histogram of latencies in nanoseconds. Values are grouped into
+// power-of-two ranges, each of which is split into `kSubBuckets` linear
+// buckets, so reported quantiles are within 1/`kSubBuckets` of the true value.
+class LatencyHistogram {
+ public:
+  static constexpr uint32_t kSubBucketBits = 4;
+  static constexpr uint64_t kSubBuckets = 1 << kSubBucketBits;
+  // Values of 2^`kMaxExponent` ns (about 18 minutes) or more are clamped.
+  static constexpr uint32_t kMaxExponent = 40;
+  static constexpr size_t kNumBuckets =
+      (kMaxExponent - kSubBucketBits + 1) * kSubBuckets;
+
+  void Record(uint64_t nanos);
+
+  void Merge(const LatencyHistogram& other);
+
+  uint64_t Count() const {
+    return count_;
+  }
+
+  uint64_t Max() const {
+    return max_;
+  }
+
+  // Returns an upper bound on the latency at `quantile`, which must be in
+  // [0, 1]. Returns 0 if the histogram is empty.
+  uint64_t Quantile(double quantile) const;
+
+ private:
+  static size_t BucketIndex(uint64_t nanos);
+
+  static uint64_t BucketUpperBound(size_t idx);
+
+  std::array<uint64_t, kNumBuckets> counts_ = {};
+  uint64_t count_ = 0;
+  uint64_t max_ = 0;
+};
+
+enum class AllocOp {
+  kMalloc,
+  kCalloc,
+  kRealloc,
+  kFree,
+};
+
+// Latency histograms of allocator calls, broken down by operation and by the
+// size of the allocation involved.
+class LatencyProfile {
+ public:
+  static constexpr size_t kNumOps = 4;
+  // The inclusive upper bounds of all but the last size bucket, which holds
+  // everything larger.
+  static constexpr std::array<size_t, 4> kSizeBucketLimits = { 64, 512, 4096,
+                                                               32768 };
+  static constexpr size_t kNumSizeBuckets = kSizeBucketLimits.size() + 1;
+
+  static constexpr std::array<AllocOp, kNumOps> kOps = {
+    AllocOp::kMalloc,
+    AllocOp::kCalloc,
+    AllocOp::kRealloc,
+    AllocOp::kFree,
+  };
+
+  static size_t SizeBucket(size_t size);
+
+  static std::string SizeBucketName(size_t size_bucket);
+
+  static absl::string_view OpName(AllocOp op);
+
+  void Record(AllocOp op, size_t size, uint64_t nanos) {
+    histograms_[static_cast<size_t>(op)][SizeBucket(size)].Record(nanos);
+  }
+
+  void Merge(const LatencyProfile& other);
+
+  const LatencyHistogram& Histogram(AllocOp op, size_t size_bucket) const {
+    return histograms_[static_cast<size_t>(op)][size_bucket];
+  }
+
+  // Returns the histogram of `op` across all size buckets.
+  LatencyHistogram OpHistogram(AllocOp op) const;
+
+ private:
+  std::array<std::array<LatencyHistogram, kNumSizeBuckets>, kNumOps>
+      histograms_;
+};
+
+}  // namespace bench
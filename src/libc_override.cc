@@ -6,7 +6,11 @@
 #include <new>
 #include <unistd.h>
 
+#ifdef TRACE_RECORDER
+#include "src/trace_recorder.h"
+#else
 #include "src/allocator_interface.h"
+#endif
 
 #define ALLOC_ALIAS(fn) __attribute__((alias(#fn), visibility("default")))
 
@@ -28,8 +32,14 @@ inline int posix_memalign_helper(void** ptr, size_t align, size_t size) {
 }
 
 #ifdef __GLIBC__
-
 #define MALLOC_NOEXCEPT noexcept
+#else
+#define MALLOC_NOEXCEPT
+#endif
+
+// The trace recorder forwards to glibc's allocator through these entry points,
+// so must leave them in place.
+#if defined(__GLIBC__) && !defined(TRACE_RECORDER)
 
 extern "C" {
 
@@ -108,11 +118,7 @@ void* (*__MALLOC_HOOK_VOLATILE __memalign_hook)(size_t, size_t, const void*) =
 
 }  // extern "C"
 
-#else
-
-#define MALLOC_NOEXCEPT
-
-#endif  // __GLIBC__
+#endif  // defined(__GLIBC__) && !defined(TRACE_RECORDER)
 
 void* operator new(size_t size) noexcept(false) {
   void* res = bench::malloc(size);
@@ -154,7 +160,7 @@ void operator delete[](void* p, const std::nothrow_t&) noexcept {
 }
 
 void* operator new(size_t size, std::align_val_t alignment) noexcept(false) {
-  void* res = bench::malloc(static_cast<size_t>(alignment), size);
+  void* res = bench::malloc(size, static_cast<size_t>(alignment));
   if (res == nullptr) {
     throw std::bad_alloc();
   }
@@ -162,7 +168,7 @@ void* operator new(size_t size, std::align_val_t alignment) noexcept(false) {
 }
 void* operator new(size_t size, std::align_val_t alignment,
                    const std::nothrow_t&) noexcept {
-  return bench::malloc(static_cast<size_t>(alignment), size);
+  return bench::malloc(size, static_cast<size_t>(alignment));
 }
 void operator delete(void* p, std::align_val_t alignment) noexcept {
   bench::free(p, /*size=*/0, static_cast<size_t>(alignment));
@@ -176,7 +182,7 @@ void operator delete(void* p, size_t size,
   bench::free(p, size, static_cast<size_t>(alignment));
 }
 void* operator new[](size_t size, std::align_val_t alignment) noexcept(false) {
-  void* res = bench::malloc(static_cast<size_t>(alignment), size);
+  void* res = bench::malloc(size, static_cast<size_t>(alignment));
   if (res == nullptr) {
     throw std::bad_alloc();
   }
@@ -184,7 +190,7 @@ void* operator new[](size_t size, std::align_val_t alignment) noexcept(false) {
 }
 void* operator new[](size_t size, std::align_val_t alignment,
                      const std::nothrow_t&) noexcept {
-  return bench::malloc(static_cast<size_t>(alignment), size);
+  return bench::malloc(size, static_cast<size_t>(alignment));
 }
 void operator delete[](void* p, std::align_val_t alignment) noexcept {
   bench::free(p, /*size=*/0, static_cast<size_t>(alignment));
@@ -0,0 +1,74 @@
+#include "src/lifetime_annotator.h"
+
+#include <bit>
+#include <cstdint>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_format.h"
+#include "util/absl_util.h"
+
+#include "proto/tracefile.pb.h"
+
+namespace bench {
+
+uint32_t LifetimeClass(uint64_t lifetime) {
+  return static_cast<uint32_t>(std::bit_width(lifetime));
+}
+
+absl::Status AnnotateLifetimes(Tracefile& tracefile) {
+  // The line which made each live allocation, by id.
+  absl::flat_hash_map<uint64_t, int> live;
+  auto allocate = [&live, &tracefile](uint64_t id, int line) {
+    tracefile.mutable_lines(line)->clear_lifetime_class();
+    live[id] = line;
+  };
+  auto release = [&live, &tracefile](uint64_t id, int line) -> absl::Status {
+    auto it = live.find(id);
+    if (it == live.end()) {
+      return absl::FailedPreconditionError(
+          absl::StrFormat("Unknown ID being freed: %v", id));
+    }
+    tracefile.mutable_lines(it->second)
+        ->set_lifetime_class(LifetimeClass(line - it->second));
+    live.erase(it);
+    return absl::OkStatus();
+  };
+
+  for (int i = 0; i < tracefile.lines_size(); i++) {
+    const TraceLine& line = tracefile.lines(i);
+    switch (line.op_case()) {
+      case TraceLine::kMalloc: {
+        if (line.malloc().has_result_id()) {
+          allocate(line.malloc().result_id(), i);
+        }
+        break;
+      }
+      case TraceLine::kCalloc: {
+        if (line.calloc().has_result_id()) {
+          allocate(line.calloc().result_id(), i);
+        }
+        break;
+      }
+      case TraceLine::kRealloc: {
+        if (line.realloc().has_input_id()) {
+          RETURN_IF_ERROR(release(line.realloc().input_id(), i));
+        }
+        allocate(line.realloc().result_id(), i);
+        break;
+      }
+      case TraceLine::kFree: {
+        if (line.free().has_input_id()) {
+          RETURN_IF_ERROR(release(line.free().input_id(), i));
+        }
+        break;
+      }
+      case TraceLine::OP_NOT_SET: {
+        break;
+      }
+    }
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace bench
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+
+#include "absl/status/status.h"
+
+#include "proto/tracefile.pb.h"
+
+namespace bench {
+
+using proto::Tracefile;
+using proto::TraceLine;
+
+// Returns the lifetime class (see `TraceLine.lifetime_class`) of an
+// allocation freed `lifetime` lines after it was made.
+uint32_t LifetimeClass(uint64_t lifetime);
+
+// Sets `TraceLine.lifetime_class` on every line of `tracefile` making an
+// allocation which a later line frees or reallocs, and clears it on
+// allocations which are never freed. Fails if a line frees an id which isn't
+// live.
+absl::Status AnnotateLifetimes(Tracefile& tracefile);
+
+}  // namespace bench
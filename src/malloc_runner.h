@@ -7,6 +7,7 @@
 #include "absl/status/statusor.h"
 #include "util/absl_util.h"
 
+#include "src/alloc_hint.h"
 #include "src/allocator_interface.h"
 #include "src/heap_factory.h"
 #include "src/tracefile_executor.h"  // IWYU pragma: keep
@@ -46,11 +47,17 @@ class MallocRunner {
 
   virtual absl::Status PreRelease(void* ptr) = 0;
 
+  // Called before each op is passed to the allocator.
+  virtual void PreOp() {}
+
   absl::Status InitializeHeap();
   absl::Status CleanupHeap();
-  absl::StatusOr<void*> Malloc(size_t size, std::optional<size_t> alignment);
-  absl::StatusOr<void*> Calloc(size_t nmemb, size_t size);
-  absl::StatusOr<void*> Realloc(void* ptr, size_t size);
+  absl::StatusOr<void*> Malloc(size_t size, std::optional<size_t> alignment,
+                               const AllocHint& hint = AllocHint());
+  absl::StatusOr<void*> Calloc(size_t nmemb, size_t size,
+                               const AllocHint& hint = AllocHint());
+  absl::StatusOr<void*> Realloc(void* ptr, size_t size,
+                                const AllocHint& hint = AllocHint());
   absl::Status Free(void* ptr, std::optional<size_t> size_hint,
                     std::optional<size_t> alignment_hint);
 
@@ -100,11 +107,12 @@ absl::Status MallocRunner<ReallocData, Config>::CleanupHeap() {
 
 template <typename ReallocData, MallocRunnerConfig Config>
 absl::StatusOr<void*> MallocRunner<ReallocData, Config>::Malloc(
-    size_t size, std::optional<size_t> alignment) {
+    size_t size, std::optional<size_t> alignment, const AllocHint& hint) {
   if constexpr (Config.perftest) {
-    return bench::malloc(size, alignment.value_or(0));
+    return bench::malloc(size, alignment.value_or(0), hint);
   }
 
+  PreOp();
   if (options_.verbose) {
     if (alignment.has_value()) {
       std::cout << "aligned_alloc(" << size << ", " << alignment.value() << ")"
@@ -114,7 +122,7 @@ absl::StatusOr<void*> MallocRunner<ReallocData, Config>::Malloc(
     }
   }
 
-  void* ptr = bench::malloc(size, alignment.value_or(0));
+  void* ptr = bench::malloc(size, alignment.value_or(0), hint);
 
   if (options_.verbose) {
     std::cout << " = " << ptr << std::endl;
@@ -132,17 +140,18 @@ absl::StatusOr<void*> MallocRunner<ReallocData, Config>::Malloc(
 }
 
 template <typename ReallocData, MallocRunnerConfig Config>
-absl::StatusOr<void*> MallocRunner<ReallocData, Config>::Calloc(size_t nmemb,
-                                                                size_t size) {
+absl::StatusOr<void*> MallocRunner<ReallocData, Config>::Calloc(
+    size_t nmemb, size_t size, const AllocHint& hint) {
   if constexpr (Config.perftest) {
-    return bench::malloc(nmemb * size);
+    return bench::malloc(nmemb * size, /*alignment=*/0, hint);
   }
 
+  PreOp();
   if (options_.verbose) {
     std::cout << "calloc(" << nmemb << ", " << size << ")" << std::flush;
   }
 
-  void* ptr = bench::calloc(nmemb, size);
+  void* ptr = bench::calloc(nmemb, size, hint);
 
   if (options_.verbose) {
     std::cout << " = " << ptr << std::endl;
@@ -162,18 +171,19 @@ absl::StatusOr<void*> MallocRunner<ReallocData, Config>::Calloc(size_t nmemb,
 }
 
 template <typename ReallocData, MallocRunnerConfig Config>
-absl::StatusOr<void*> MallocRunner<ReallocData, Config>::Realloc(void* ptr,
-                                                                 size_t size) {
+absl::StatusOr<void*> MallocRunner<ReallocData, Config>::Realloc(
+    void* ptr, size_t size, const AllocHint& hint) {
   if constexpr (Config.perftest) {
-    return bench::realloc(ptr, size);
+    return bench::realloc(ptr, size, hint);
   }
 
+  PreOp();
   if (options_.verbose) {
     std::cout << "realloc(" << ptr << ", " << size << ")" << std::flush;
   }
 
   if (ptr == nullptr) {
-    void* new_ptr = bench::realloc(nullptr, size);
+    void* new_ptr = bench::realloc(nullptr, size, hint);
 
     if (options_.verbose) {
       std::cout << " = " << new_ptr << std::endl;
@@ -185,7 +195,7 @@ absl::StatusOr<void*> MallocRunner<ReallocData, Config>::Realloc(void* ptr,
   }
 
   DEFINE_OR_RETURN(ReallocData, realloc_data, PreRealloc(ptr, size));
-  void* new_ptr = bench::realloc(ptr, size);
+  void* new_ptr = bench::realloc(ptr, size, hint);
 
   if (options_.verbose) {
     std::cout << " = " << new_ptr << std::endl;
@@ -201,6 +211,7 @@ absl::Status MallocRunner<ReallocData, Config>::Free(
     void* ptr, std::optional<size_t> size_hint,
     std::optional<size_t> alignment_hint) {
   if constexpr (!Config.perftest) {
+    PreOp();
     if (options_.verbose) {
       std::cout << "free(" << ptr << ")" << std::endl;
     }
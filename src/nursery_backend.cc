@@ -0,0 +1,66 @@
+#include "src/nursery_backend.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "absl/synchronization/mutex.h"
+
+#include "src/alloc_hint.h"
+
+namespace bench {
+
+void* NurseryBackend::Alloc(size_t size, size_t alignment,
+                            const AllocHint& hint) {
+  if (hint.lifetime_class == 0 || hint.lifetime_class > max_lifetime_class_) {
+    return nullptr;
+  }
+
+  absl::MutexLock lock(&mutex_);
+  uint8_t* start = region_start_.load(std::memory_order_relaxed);
+  if (start == nullptr) {
+    if (failed_) {
+      return nullptr;
+    }
+    start = static_cast<uint8_t*>(
+        heap_->sbrk(static_cast<intptr_t>(region_size_)));
+    if (start == nullptr) {
+      failed_ = true;
+      return nullptr;
+    }
+    region_start_.store(start, std::memory_order_release);
+  }
+
+  // Zero-sized allocations still take a byte, so they are distinct and inside
+  // the region.
+  if (size == 0) {
+    size = 1;
+  }
+  if (alignment < kDefaultAlignment) {
+    alignment = kDefaultAlignment;
+  }
+  const uintptr_t base = reinterpret_cast<uintptr_t>(start);
+  const size_t offset =
+      ((base + next_ + alignment - 1) & ~(alignment - 1)) - base;
+  if (offset > region_size_ || size > region_size_ - offset) {
+    return nullptr;
+  }
+  next_ = offset + size;
+  live_++;
+  return start + offset;
+}
+
+void NurseryBackend::Free(void* /*ptr*/) {
+  absl::MutexLock lock(&mutex_);
+  if (--live_ == 0) {
+    next_ = 0;
+    resets_++;
+  }
+}
+
+uint64_t NurseryBackend::Resets() const {
+  absl::MutexLock lock(&mutex_);
+  return resets_;
+}
+
+}  // namespace bench
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+
+#include "src/alloc_hint.h"
+#include "src/heap_interface.h"
+
+namespace bench {
+
+// A bump region for allocations hinted to be short-lived (see
+// `AllocHint::lifetime_class`), for allocators to try before their general
+// path. Objects in the nursery are never freed individually: the region only
+// counts its live objects, and starts over from its beginning once they have
+// all died. Short-lived objects thus never fragment the rest of the heap, and
+// cost a pointer bump to allocate.
+//
+// The region is taken from the heap on first use, so the nursery never calls
+// the allocator and may be used to implement one. It is thread-safe.
+class NurseryBackend {
+ public:
+  // Allocations with a lifetime class of at most `max_lifetime_class` are
+  // placed in a region of `region_size` bytes of `heap`, which the nursery
+  // extends but does not otherwise own.
+  NurseryBackend(Heap* heap, size_t region_size, uint32_t max_lifetime_class)
+      : heap_(heap),
+        region_size_(region_size),
+        max_lifetime_class_(max_lifetime_class) {}
+
+  // Returns an allocation of `size` bytes aligned to `alignment` (a power of
+  // two, or 0 for the default) from the nursery, or nullptr if `hint` isn't
+  // short-lived or the nursery is full, in which case the caller should
+  // allocate it elsewhere.
+  void* Alloc(size_t size, size_t alignment, const AllocHint& hint);
+
+  // Whether `ptr` was allocated from the nursery.
+  bool Contains(const void* ptr) const {
+    const uint8_t* start = region_start_.load(std::memory_order_acquire);
+    const uint8_t* p = static_cast<const uint8_t*>(ptr);
+    return start != nullptr && p >= start && p < start + region_size_;
+  }
+
+  // Frees an allocation for which `Contains` is true.
+  void Free(void* ptr);
+
+  // The number of times the nursery emptied and started over.
+  uint64_t Resets() const;
+
+ private:
+  static constexpr size_t kDefaultAlignment = 16;
+
+  Heap* const heap_;
+  const size_t region_size_;
+  const uint32_t max_lifetime_class_;
+
+  mutable absl::Mutex mutex_;
+  // Set once on first use.
+  std::atomic<uint8_t*> region_start_ = nullptr;
+  // The offset of the next allocation in the region.
+  size_t next_ ABSL_GUARDED_BY(mutex_) = 0;
+  uint64_t live_ ABSL_GUARDED_BY(mutex_) = 0;
+  uint64_t resets_ ABSL_GUARDED_BY(mutex_) = 0;
+  // Set if the heap couldn't fit the region.
+  bool failed_ ABSL_GUARDED_BY(mutex_) = false;
+};
+
+}  // namespace bench
@@ -0,0 +1,69 @@
+#include "src/nursery_backend.h"
+
+#include <cstddef>
+#include <cstdint>
+
+#include "gtest/gtest.h"
+
+#include "src/alloc_hint.h"
+#include "src/heap_interface.h"
+#include "src/mmap_heap_factory.h"
+
+namespace bench {
+
+class TestNurseryBackend : public ::testing::Test {
+ protected:
+  static constexpr size_t kRegionSize = 4096;
+  static constexpr AllocHint kShortLived = { .lifetime_class = 4 };
+
+  MMapHeapFactory heap_factory_;
+  Heap* heap_ = heap_factory_.NewInstance(1 << 20).value();
+  NurseryBackend nursery_{ heap_, kRegionSize, /*max_lifetime_class=*/8 };
+};
+
+TEST_F(TestNurseryBackend, OnlyTakesShortLived) {
+  EXPECT_EQ(nursery_.Alloc(16, 0, AllocHint()), nullptr);
+  EXPECT_EQ(nursery_.Alloc(16, 0, AllocHint{ .lifetime_class = 9 }), nullptr);
+
+  void* ptr = nursery_.Alloc(16, 0, kShortLived);
+  ASSERT_NE(ptr, nullptr);
+  EXPECT_TRUE(nursery_.Contains(ptr));
+  EXPECT_FALSE(nursery_.Contains(static_cast<uint8_t*>(ptr) + kRegionSize));
+}
+
+TEST_F(TestNurseryBackend, Alignment) {
+  void* small = nursery_.Alloc(1, 0, kShortLived);
+  void* aligned = nursery_.Alloc(8, 256, kShortLived);
+  ASSERT_NE(small, nullptr);
+  ASSERT_NE(aligned, nullptr);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(aligned) % 256, 0);
+  EXPECT_GT(aligned, small);
+}
+
+TEST_F(TestNurseryBackend, ResetsOnceEmpty) {
+  void* a = nursery_.Alloc(kRegionSize / 2, 0, kShortLived);
+  void* b = nursery_.Alloc(kRegionSize / 2, 0, kShortLived);
+  ASSERT_NE(a, nullptr);
+  ASSERT_NE(b, nullptr);
+  EXPECT_EQ(nursery_.Alloc(16, 0, kShortLived), nullptr);
+
+  nursery_.Free(a);
+  EXPECT_EQ(nursery_.Resets(), 0);
+  nursery_.Free(b);
+  EXPECT_EQ(nursery_.Resets(), 1);
+  EXPECT_EQ(nursery_.Alloc(16, 0, kShortLived), a);
+}
+
+TEST_F(TestNurseryBackend, ZeroSizeWhenFull) {
+  void* full = nursery_.Alloc(kRegionSize, 0, kShortLived);
+  ASSERT_NE(full, nullptr);
+  EXPECT_EQ(nursery_.Alloc(0, 0, kShortLived), nullptr);
+
+  nursery_.Free(full);
+  EXPECT_EQ(nursery_.Resets(), 1);
+  void* empty = nursery_.Alloc(0, 0, kShortLived);
+  ASSERT_NE(empty, nullptr);
+  EXPECT_TRUE(nursery_.Contains(empty));
+}
+
+}  // namespace bench
@@ -0,0 +1,272 @@
+#include "src/perf_counters.h"
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
+#include "util/absl_util.h"
+
+namespace bench {
+
+namespace {
+
+constexpr std::array<PerfEvent, 6> kHardwareEvents = {
+  PerfEvent::kCycles,     PerfEvent::kInstructions, PerfEvent::kL1dMisses,
+  PerfEvent::kLlcMisses,  PerfEvent::kDtlbMisses,   PerfEvent::kBranchMisses,
+};
+
+constexpr std::array<PerfEvent, 2> kSoftwareEvents = {
+  PerfEvent::kPageFaults,
+  PerfEvent::kContextSwitches,
+};
+
+constexpr uint64_t CacheMissConfig(uint64_t cache) {
+  return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+         (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+
+std::pair<uint32_t, uint64_t> EventTypeAndConfig(PerfEvent event) {
+  switch (event) {
+    case PerfEvent::kCycles:
+      return { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES };
+    case PerfEvent::kInstructions:
+      return { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS };
+    case PerfEvent::kL1dMisses:
+      return { PERF_TYPE_HW_CACHE, CacheMissConfig(PERF_COUNT_HW_CACHE_L1D) };
+    case PerfEvent::kLlcMisses:
+      return { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES };
+    case PerfEvent::kDtlbMisses:
+      return { PERF_TYPE_HW_CACHE, CacheMissConfig(PERF_COUNT_HW_CACHE_DTLB) };
+    case PerfEvent::kBranchMisses:
+      return { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES };
+    case PerfEvent::kPageFaults:
+      return { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS };
+    case PerfEvent::kContextSwitches:
+      return { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES };
+  }
+  __builtin_unreachable();
+}
+
+// Opens `event` for the calling thread on any CPU, as a member of the group
+// led by `group_fd` (or as a new group leader if -1). Returns -1 on failure.
+int OpenEvent(PerfEvent event, int group_fd) {
+  const auto [type, config] = EventTypeAndConfig(event);
+
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                     PERF_FORMAT_TOTAL_TIME_RUNNING;
+  // Only the leader starts disabled, members follow the leader's state.
+  attr.disabled = group_fd == -1 ? 1 : 0;
+  attr.exclude_hv = 1;
+
+  // Count time spent in the kernel on behalf of the allocator (e.g. page
+  // faults) if permitted, otherwise settle for user-space only.
+  for (bool exclude_kernel : { false, true }) {
+    attr.exclude_kernel = exclude_kernel ? 1 : 0;
+    int fd = syscall(SYS_perf_event_open, &attr, /*pid=*/0, /*cpu=*/-1,
+                     group_fd, /*flags=*/0);
+    if (fd >= 0) {
+      return fd;
+    }
+    if (errno != EACCES && errno != EPERM) {
+      break;
+    }
+  }
+  return -1;
+}
+
+}  // namespace
+
+absl::string_view PerfEventName(PerfEvent event) {
+  switch (event) {
+    case PerfEvent::kCycles:
+      return "cycles";
+    case PerfEvent::kInstructions:
+      return "instructions";
+    case PerfEvent::kL1dMisses:
+      return "L1d misses";
+    case PerfEvent::kLlcMisses:
+      return "LLC misses";
+    case PerfEvent::kDtlbMisses:
+      return "dTLB misses";
+    case PerfEvent::kBranchMisses:
+      return "branch misses";
+    case PerfEvent::kPageFaults:
+      return "page faults";
+    case PerfEvent::kContextSwitches:
+      return "context switches";
+  }
+  __builtin_unreachable();
+}
+
+void PerfCounterValues::Merge(const PerfCounterValues& other) {
+  for (size_t i = 0; i < kNumPerfEvents; i++) {
+    if (other.counts[i].has_value()) {
+      counts[i] = counts[i].value_or(0) + other.counts[i].value();
+    }
+  }
+  ops += other.ops;
+}
+
+PerfCounterGroup::PerfCounterGroup(PerfCounterGroup&& other) noexcept
+    : hardware_(std::exchange(other.hardware_, {})),
+      software_(std::exchange(other.software_, {})) {}
+
+PerfCounterGroup::~PerfCounterGroup() {
+  for (const Group* group : { &hardware_, &software_ }) {
+    for (int fd : group->fds) {
+      close(fd);
+    }
+  }
+}
+
+/* static */
+absl::StatusOr<PerfCounterGroup> PerfCounterGroup::Open() {
+  PerfCounterGroup counters;
+  OpenGroup(counters.hardware_, kHardwareEvents);
+  OpenGroup(counters.software_, kSoftwareEvents);
+  if (counters.hardware_.leader_fd == -1 &&
+      counters.software_.leader_fd == -1) {
+    return absl::UnavailableError(
+        absl::StrFormat("Failed to open any perf events: %s (check "
+                        "/proc/sys/kernel/perf_event_paranoid)",
+                        strerror(errno)));
+  }
+  return counters;
+}
+
+void PerfCounterGroup::Enable() {
+  for (const Group* group : { &hardware_, &software_ }) {
+    if (group->leader_fd != -1) {
+      ioctl(group->leader_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+  }
+}
+
+void PerfCounterGroup::Disable() {
+  for (const Group* group : { &hardware_, &software_ }) {
+    if (group->leader_fd != -1) {
+      ioctl(group->leader_fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    }
+  }
+}
+
+absl::StatusOr<PerfCounterValues> PerfCounterGroup::Read() const {
+  PerfCounterValues values;
+  RETURN_IF_ERROR(ReadGroup(hardware_, values));
+  RETURN_IF_ERROR(ReadGroup(software_, values));
+  return values;
+}
+
+/* static */
+void PerfCounterGroup::OpenGroup(Group& group,
+                                 absl::Span<const PerfEvent> events) {
+  for (PerfEvent event : events) {
+    int fd = OpenEvent(event, group.leader_fd);
+    if (fd == -1) {
+      // Unsupported events are skipped, keeping whatever subset is available.
+      continue;
+    }
+    if (group.leader_fd == -1) {
+      group.leader_fd = fd;
+    }
+    group.events.push_back(event);
+    group.fds.push_back(fd);
+  }
+}
+
+/* static */
+absl::Status PerfCounterGroup::ReadGroup(const Group& group,
+                                         PerfCounterValues& values) {
+  if (group.leader_fd == -1) {
+    return absl::OkStatus();
+  }
+
+  // Layout of a `PERF_FORMAT_GROUP` read: the number of events, the time
+  // enabled and running, then the value of each event.
+  std::vector<uint64_t> buf(3 + group.events.size());
+  const ssize_t bytes =
+      read(group.leader_fd, buf.data(), buf.size() * sizeof(uint64_t));
+  if (bytes != static_cast<ssize_t>(buf.size() * sizeof(uint64_t)) ||
+      buf[0] != group.events.size()) {
+    return absl::InternalError(
+        absl::StrFormat("Failed to read perf event group: %s",
+                        bytes < 0 ? strerror(errno) : "short read"));
+  }
+
+  const uint64_t time_enabled = buf[1];
+  const uint64_t time_running = buf[2];
+  if (time_running == 0) {
+    // The group never got scheduled on a counter, so there is nothing to
+    // extrapolate from.
+    return absl::OkStatus();
+  }
+  // Scale up to account for time the group was multiplexed off the PMU.
+  const double scale = static_cast<double>(time_enabled) / time_running;
+  for (size_t i = 0; i < group.events.size(); i++) {
+    values.counts[static_cast<size_t>(group.events[i])] = buf[3 + i] * scale;
+  }
+  return absl::OkStatus();
+}
+
+void PerfCounterTotals::Add(const PerfCounterValues& thread_values) {
+  absl::MutexLock lock(&mutex_);
+  per_thread_.push_back(thread_values);
+}
+
+PerfCounterValues PerfCounterTotals::Total() const {
+  absl::MutexLock lock(&mutex_);
+  PerfCounterValues total;
+  for (const PerfCounterValues& values : per_thread_) {
+    total.Merge(values);
+  }
+  return total;
+}
+
+std::vector<PerfCounterValues> PerfCounterTotals::PerThread() const {
+  absl::MutexLock lock(&mutex_);
+  return per_thread_;
+}
+
+WorkerPerfCounters::WorkerPerfCounters(PerfCounterTotals* totals)
+    : totals_(totals) {
+  if (totals_ == nullptr) {
+    return;
+  }
+  absl::StatusOr<PerfCounterGroup> group = PerfCounterGroup::Open();
+  if (group.ok()) {
+    group_.emplace(std::move(group).value());
+  }
+}
+
+absl::Status WorkerPerfCounters::Finish() {
+  if (!group_.has_value()) {
+    return absl::OkStatus();
+  }
+  DEFINE_OR_RETURN(PerfCounterValues, values, group_->Read());
+  values.ops = ops_;
+  totals_->Add(values);
+  return absl::OkStatus();
+}
+
+}  // namespace bench
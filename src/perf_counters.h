@@ -0,0 +1,139 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
+
+#include "src/util.h"
+
+namespace bench {
+
+enum class PerfEvent {
+  kCycles,
+  kInstructions,
+  kL1dMisses,
+  kLlcMisses,
+  kDtlbMisses,
+  kBranchMisses,
+  kPageFaults,
+  kContextSwitches,
+};
+
+constexpr size_t kNumPerfEvents = 8;
+
+absl::string_view PerfEventName(PerfEvent event);
+
+// Counts of each perf event, scaled up to account for multiplexing. Events
+// which could not be opened have no value.
+struct PerfCounterValues {
+  std::array<std::optional<double>, kNumPerfEvents> counts;
+  // The number of allocator ops executed while counting.
+  uint64_t ops = 0;
+
+  const std::optional<double>& operator[](PerfEvent event) const {
+    return counts[static_cast<size_t>(event)];
+  }
+
+  void Merge(const PerfCounterValues& other);
+};
+
+// A set of perf event counters measuring the thread which opened them.
+//
+// Hardware events (cycles, instructions, cache, TLB and branch misses) are
+// opened as one group, skipping any the kernel or CPU doesn't support, e.g.
+// when running in a VM. Software events (page faults, context switches) are
+// always opened as a separate group, so some counters remain available even
+// when no hardware events are.
+class PerfCounterGroup {
+ public:
+  PerfCounterGroup(PerfCounterGroup&& other) noexcept;
+  PerfCounterGroup& operator=(PerfCounterGroup&&) = delete;
+  ~PerfCounterGroup();
+
+  // Opens counters for the calling thread, which start out disabled. Fails if
+  // no event at all could be opened, e.g. if perf events are forbidden by
+  // `/proc/sys/kernel/perf_event_paranoid`.
+  static absl::StatusOr<PerfCounterGroup> Open();
+
+  // Starts/stops counting. Counts accumulate across enabled periods.
+  void Enable();
+  void Disable();
+
+  absl::StatusOr<PerfCounterValues> Read() const;
+
+ private:
+  struct Group {
+    int leader_fd = -1;
+    // The event of each member of the group, in the order the kernel reports
+    // their values.
+    std::vector<PerfEvent> events;
+    std::vector<int> fds;
+  };
+
+  PerfCounterGroup() = default;
+
+  static void OpenGroup(Group& group, absl::Span<const PerfEvent> events);
+
+  static absl::Status ReadGroup(const Group& group, PerfCounterValues& values);
+
+  Group hardware_;
+  Group software_;
+};
+
+// Accumulates the counts measured by each worker thread of a tracefile run.
+class PerfCounterTotals {
+ public:
+  void Add(const PerfCounterValues& thread_values)
+      BENCH_LOCKS_EXCLUDED(mutex_);
+
+  // The sum of counts over all threads.
+  PerfCounterValues Total() const BENCH_LOCKS_EXCLUDED(mutex_);
+
+  // The counts of each thread, in the order they finished.
+  std::vector<PerfCounterValues> PerThread() const
+      BENCH_LOCKS_EXCLUDED(mutex_);
+
+ private:
+  mutable absl::Mutex mutex_;
+  std::vector<PerfCounterValues> per_thread_ BENCH_GUARDED_BY(mutex_);
+};
+
+// The counters of one worker thread of a tracefile run, which should be
+// enabled only around timed regions. Does nothing if `totals` is null, or if
+// no events could be opened for this thread.
+class WorkerPerfCounters {
+ public:
+  explicit WorkerPerfCounters(PerfCounterTotals* totals);
+
+  void Enable() {
+    if (group_.has_value()) {
+      group_->Enable();
+    }
+  }
+
+  // Stops counting, attributing the events since `Enable()` to `ops` ops.
+  void Disable(uint64_t ops) {
+    if (group_.has_value()) {
+      group_->Disable();
+      ops_ += ops;
+    }
+  }
+
+  // Adds this thread's counts to `totals`.
+  absl::Status Finish();
+
+ private:
+  PerfCounterTotals* const totals_;
+  std::optional<PerfCounterGroup> group_;
+  uint64_t ops_ = 0;
+};
+
+}  // namespace bench
@@ -1,34 +1,157 @@
 #include "src/perftest.h"
 
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
 #include <cstdlib>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
 
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
 #include "absl/time/time.h"
 
+#include "src/alloc_hint.h"
 #include "src/heap_factory.h"
+#include "src/latency_histogram.h"
+#include "src/perf_counters.h"
 #include "src/tracefile_executor.h"
 #include "src/tracefile_reader.h"
+#include "src/tracefile_stream_reader.h"
+#include "src/trial_stats.h"
+#include "src/tsc_clock.h"
 
 namespace bench {
 
+namespace {
+
+// Implements `Perftest::TimeTrace` for both in-memory and streamed traces.
+template <typename Reader>
+absl::StatusOr<double> TimeTraceFrom(Reader& reader, HeapFactory& heap_factory,
+                                     uint64_t min_desired_ops,
+                                     const TracefileExecutorOptions& options) {
+  TracefileExecutor<Perftest> perftest(reader, std::ref(heap_factory));
+
+  const uint64_t timed_ops = options.TimedOps(reader.size());
+  const uint64_t num_repetitions = (min_desired_ops - 1) / timed_ops + 1;
+
+  DEFINE_OR_RETURN(absl::Duration, time,
+                   perftest.RunRepeated(num_repetitions, options));
+
+  uint64_t total_ops = num_repetitions * timed_ops;
+  double seconds = absl::FDivDuration(time, absl::Seconds(1));
+  return total_ops / seconds / 1000000;
+}
+
+// Implements `Perftest::TimeTrials` for both in-memory and streamed traces.
+template <typename Reader>
+absl::StatusOr<TrialStats> TimeTrialsFrom(
+    Reader& reader, HeapFactory& heap_factory, uint64_t min_desired_ops,
+    const PerftestTrialOptions& trial_options,
+    const TracefileExecutorOptions& options) {
+  for (uint32_t i = 0; i < trial_options.warmup; i++) {
+    RETURN_IF_ERROR(
+        TimeTraceFrom(reader, heap_factory, min_desired_ops, options)
+            .status());
+  }
+
+  std::vector<double> mega_ops;
+  mega_ops.reserve(trial_options.trials);
+  for (uint32_t i = 0; i < trial_options.trials; i++) {
+    DEFINE_OR_RETURN(
+        double, trial_mega_ops,
+        TimeTraceFrom(reader, heap_factory, min_desired_ops, options));
+    mega_ops.push_back(trial_mega_ops);
+  }
+
+  return TrialStats::Compute(std::move(mega_ops),
+                             trial_options.outlier_threshold);
+}
+
+}  // namespace
+
 Perftest::Perftest(HeapFactory& heap_factory) : MallocRunner(heap_factory) {}
 
 /* static */
 absl::StatusOr<double> Perftest::TimeTrace(
     TracefileReader& reader, HeapFactory& heap_factory,
     uint64_t min_desired_ops, const TracefileExecutorOptions& options) {
-  TracefileExecutor<Perftest> perftest(reader, std::ref(heap_factory));
+  return TimeTraceFrom(reader, heap_factory, min_desired_ops, options);
+}
+
+/* static */
+absl::StatusOr<double> Perftest::TimeTrace(
+    TracefileStreamReader& reader, HeapFactory& heap_factory,
+    uint64_t min_desired_ops, const TracefileExecutorOptions& options) {
+  return TimeTraceFrom(reader, heap_factory, min_desired_ops, options);
+}
+
+/* static */
+absl::StatusOr<TrialStats> Perftest::TimeTrials(
+    TracefileReader& reader, HeapFactory& heap_factory,
+    uint64_t min_desired_ops, const PerftestTrialOptions& trial_options,
+    const TracefileExecutorOptions& options) {
+  return TimeTrialsFrom(reader, heap_factory, min_desired_ops, trial_options,
+                        options);
+}
+
+/* static */
+absl::StatusOr<TrialStats> Perftest::TimeTrials(
+    TracefileStreamReader& reader, HeapFactory& heap_factory,
+    uint64_t min_desired_ops, const PerftestTrialOptions& trial_options,
+    const TracefileExecutorOptions& options) {
+  return TimeTrialsFrom(reader, heap_factory, min_desired_ops, trial_options,
+                        options);
+}
+
+/* static */
+absl::StatusOr<LatencyProfile> Perftest::MeasureLatency(
+    TracefileReader& reader, HeapFactory& heap_factory,
+    uint64_t min_desired_ops, const TracefileExecutorOptions& options) {
+  TracefileExecutor<LatencyPerftest> perftest(reader, std::ref(heap_factory));
 
   const uint64_t num_repetitions = (min_desired_ops - 1) / reader.size() + 1;
+  RETURN_IF_ERROR(perftest.RunRepeated(num_repetitions, options).status());
 
-  DEFINE_OR_RETURN(absl::Duration, time,
-                   perftest.RunRepeated(num_repetitions, options));
+  return perftest.Inner().Profile();
+}
 
-  uint64_t total_ops = num_repetitions * reader.size();
-  double seconds = absl::FDivDuration(time, absl::Seconds(1));
-  return total_ops / seconds / 1000000;
+/* static */
+absl::StatusOr<LatencyProfile> Perftest::MeasurePacedLatency(
+    TracefileReader& reader, HeapFactory& heap_factory, double pace_scale,
+    const TracefileExecutorOptions& options) {
+  LatencyProfile profile;
+  TracefileExecutorOptions paced_options = options;
+  paced_options.paced_latency = &profile;
+  paced_options.pace_scale = pace_scale;
+
+  TracefileExecutor<Perftest> perftest(reader, std::ref(heap_factory));
+  RETURN_IF_ERROR(perftest.Run(paced_options).status());
+  return profile;
+}
+
+/* static */
+absl::StatusOr<std::vector<PerfCounterValues>> Perftest::CountEvents(
+    TracefileReader& reader, HeapFactory& heap_factory,
+    uint64_t min_desired_ops, const TracefileExecutorOptions& options) {
+  // Workers silently skip counting if they can't open any events, so check
+  // that counting is possible at all up front.
+  RETURN_IF_ERROR(PerfCounterGroup::Open().status());
+
+  PerfCounterTotals totals;
+  TracefileExecutorOptions counting_options = options;
+  counting_options.perf_counters = &totals;
+
+  TracefileExecutor<Perftest> perftest(reader, std::ref(heap_factory));
+  const uint64_t num_repetitions =
+      (min_desired_ops - 1) / options.TimedOps(reader.size()) + 1;
+  RETURN_IF_ERROR(
+      perftest.RunRepeated(num_repetitions, counting_options).status());
+
+  return totals.PerThread();
 }
 
 absl::Status Perftest::PostAlloc(void* ptr, size_t size,
@@ -60,4 +183,106 @@ absl::Status Perftest::PreRelease(void* ptr) {
   return absl::OkStatus();
 }
 
+namespace {
+
+std::atomic<uint64_t> next_latency_perftest_id = 0;
+
+}  // namespace
+
+LatencyPerftest::LatencyPerftest(HeapFactory& heap_factory)
+    : Perftest(heap_factory),
+      instance_id_(
+          next_latency_perftest_id.fetch_add(1, std::memory_order_relaxed)),
+      clock_(TscClock::Get()) {}
+
+absl::StatusOr<void*> LatencyPerftest::Malloc(size_t size,
+                                              std::optional<size_t> alignment,
+                                              const AllocHint& hint) {
+  const uint64_t start = TscClock::Start();
+  absl::StatusOr<void*> result = Perftest::Malloc(size, alignment, hint);
+  const uint64_t stop = TscClock::Stop();
+
+  Record(AllocOp::kMalloc, size, start, stop);
+  if (result.ok() && result.value() != nullptr) {
+    sizes_.insert({ result.value(), size });
+  }
+  return result;
+}
+
+absl::StatusOr<void*> LatencyPerftest::Calloc(size_t nmemb, size_t size,
+                                              const AllocHint& hint) {
+  const uint64_t start = TscClock::Start();
+  absl::StatusOr<void*> result = Perftest::Calloc(nmemb, size, hint);
+  const uint64_t stop = TscClock::Stop();
+
+  Record(AllocOp::kCalloc, nmemb * size, start, stop);
+  if (result.ok() && result.value() != nullptr) {
+    sizes_.insert({ result.value(), nmemb * size });
+  }
+  return result;
+}
+
+absl::StatusOr<void*> LatencyPerftest::Realloc(void* ptr, size_t size,
+                                               const AllocHint& hint) {
+  if (ptr != nullptr) {
+    sizes_.erase(ptr);
+  }
+
+  const uint64_t start = TscClock::Start();
+  absl::StatusOr<void*> result = Perftest::Realloc(ptr, size, hint);
+  const uint64_t stop = TscClock::Stop();
+
+  Record(AllocOp::kRealloc, size, start, stop);
+  if (result.ok() && result.value() != nullptr) {
+    sizes_.insert({ result.value(), size });
+  }
+  return result;
+}
+
+absl::Status LatencyPerftest::Free(void* ptr, std::optional<size_t> size_hint,
+                                   std::optional<size_t> alignment_hint) {
+  size_t size = 0;
+  if (ptr != nullptr) {
+    auto it = sizes_.find(ptr);
+    if (it != sizes_.end()) {
+      size = it->second;
+    }
+    sizes_.erase(ptr);
+  }
+
+  const uint64_t start = TscClock::Start();
+  absl::Status status = Perftest::Free(ptr, size_hint, alignment_hint);
+  const uint64_t stop = TscClock::Stop();
+
+  Record(AllocOp::kFree, size, start, stop);
+  return status;
+}
+
+LatencyProfile LatencyPerftest::Profile() {
+  LatencyProfile profile;
+  absl::MutexLock lock(&mutex_);
+  for (const auto& thread_profile : profiles_) {
+    profile.Merge(*thread_profile);
+  }
+  return profile;
+}
+
+LatencyProfile& LatencyPerftest::ThreadProfile() {
+  thread_local uint64_t cached_instance_id = UINT64_MAX;
+  thread_local LatencyProfile* cached_profile = nullptr;
+  if (cached_instance_id != instance_id_) {
+    absl::MutexLock lock(&mutex_);
+    cached_profile =
+        profiles_.emplace_back(std::make_unique<LatencyProfile>()).get();
+    cached_instance_id = instance_id_;
+  }
+  return *cached_profile;
+}
+
+void LatencyPerftest::Record(AllocOp op, size_t size, uint64_t start,
+                             uint64_t stop) {
+  ThreadProfile().Record(
+      op, size, static_cast<uint64_t>(clock_.ElapsedNanos(start, stop)));
+}
+
 }  // namespace bench
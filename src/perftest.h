@@ -2,16 +2,38 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
 
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "folly/concurrency/ConcurrentHashMap.h"
 
+#include "src/alloc_hint.h"
 #include "src/heap_factory.h"
+#include "src/latency_histogram.h"
 #include "src/malloc_runner.h"
+#include "src/perf_counters.h"
 #include "src/tracefile_reader.h"
+#include "src/tracefile_stream_reader.h"
+#include "src/trial_stats.h"
+#include "src/tsc_clock.h"
+#include "src/util.h"
 
 namespace bench {
 
+struct PerftestTrialOptions {
+  // The number of untimed runs of the trace before any timed ones, to warm up
+  // caches, the page tables and the CPU frequency.
+  uint32_t warmup = 0;
+  // The number of independently timed runs of the trace.
+  uint32_t trials = 1;
+  // See `TrialStats::Compute`.
+  double outlier_threshold = 3.5;
+};
+
 class Perftest
     : public MallocRunner<bool, MallocRunnerConfig{ .perftest = true }> {
  public:
@@ -22,6 +44,45 @@ class Perftest
       TracefileReader& reader, HeapFactory& heap_factory,
       uint64_t min_desired_ops,
       const TracefileExecutorOptions& options = TracefileExecutorOptions());
+  static absl::StatusOr<double> TimeTrace(
+      TracefileStreamReader& reader, HeapFactory& heap_factory,
+      uint64_t min_desired_ops,
+      const TracefileExecutorOptions& options = TracefileExecutorOptions());
+
+  // Runs `TimeTrace` `trial_options.warmup` times, discarding the results, and
+  // then `trial_options.trials` times, returning statistics of the MOps/s of
+  // each trial.
+  static absl::StatusOr<TrialStats> TimeTrials(
+      TracefileReader& reader, HeapFactory& heap_factory,
+      uint64_t min_desired_ops, const PerftestTrialOptions& trial_options,
+      const TracefileExecutorOptions& options = TracefileExecutorOptions());
+  static absl::StatusOr<TrialStats> TimeTrials(
+      TracefileStreamReader& reader, HeapFactory& heap_factory,
+      uint64_t min_desired_ops, const PerftestTrialOptions& trial_options,
+      const TracefileExecutorOptions& options = TracefileExecutorOptions());
+
+  // Replays the trace like `TimeTrace`, timing each allocator call
+  // individually with `TscClock`.
+  static absl::StatusOr<LatencyProfile> MeasureLatency(
+      TracefileReader& reader, HeapFactory& heap_factory,
+      uint64_t min_desired_ops,
+      const TracefileExecutorOptions& options = TracefileExecutorOptions());
+
+  // Replays the trace once open loop, issuing each op at its recorded time
+  // with the gaps between ops multiplied by `pace_scale`, and returns the
+  // latency of each op from when it was due. The trace must have timestamps,
+  // see `TracefileExecutorOptions::paced_latency`.
+  static absl::StatusOr<LatencyProfile> MeasurePacedLatency(
+      TracefileReader& reader, HeapFactory& heap_factory, double pace_scale,
+      const TracefileExecutorOptions& options = TracefileExecutorOptions());
+
+  // Replays the trace like `TimeTrace`, counting perf events over the timed
+  // regions of each worker thread. Fails with `absl::StatusCode::kUnavailable`
+  // if no perf events can be opened.
+  static absl::StatusOr<std::vector<PerfCounterValues>> CountEvents(
+      TracefileReader& reader, HeapFactory& heap_factory,
+      uint64_t min_desired_ops,
+      const TracefileExecutorOptions& options = TracefileExecutorOptions());
 
   absl::Status PostAlloc(void* ptr, size_t size,
                          std::optional<size_t> alignment,
@@ -35,4 +96,44 @@ class Perftest
   absl::Status PreRelease(void* ptr) override;
 };
 
+// A perftest which records the latency of every allocator call into a
+// `LatencyProfile`. These methods hide `MallocRunner`'s, which works since
+// `TracefileExecutor` calls them on the concrete allocator type.
+//
+// Each thread records into its own profile, and allocation sizes are tracked
+// outside of the timed region so frees can be attributed to a size bucket.
+class LatencyPerftest : public Perftest {
+ public:
+  explicit LatencyPerftest(HeapFactory& heap_factory);
+
+  absl::StatusOr<void*> Malloc(size_t size, std::optional<size_t> alignment,
+                               const AllocHint& hint = AllocHint());
+  absl::StatusOr<void*> Calloc(size_t nmemb, size_t size,
+                               const AllocHint& hint = AllocHint());
+  absl::StatusOr<void*> Realloc(void* ptr, size_t size,
+                                const AllocHint& hint = AllocHint());
+  absl::Status Free(void* ptr, std::optional<size_t> size_hint,
+                    std::optional<size_t> alignment_hint);
+
+  // Returns the merged profile of all threads.
+  LatencyProfile Profile() BENCH_LOCKS_EXCLUDED(mutex_);
+
+ private:
+  // Returns the calling thread's profile, creating it on first use.
+  LatencyProfile& ThreadProfile() BENCH_LOCKS_EXCLUDED(mutex_);
+
+  void Record(AllocOp op, size_t size, uint64_t start, uint64_t stop);
+
+  // Distinguishes instances for the thread-local profile cache, since a new
+  // instance may be constructed at the address of a destroyed one.
+  const uint64_t instance_id_;
+  const TscClock& clock_;
+
+  folly::ConcurrentHashMap<void*, size_t> sizes_;
+
+  absl::Mutex mutex_;
+  std::vector<std::unique_ptr<LatencyProfile>> profiles_
+      BENCH_GUARDED_BY(mutex_);
+};
+
 }  // namespace bench
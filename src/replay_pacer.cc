@@ -0,0 +1,131 @@
+#include "src/replay_pacer.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_format.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+
+#include "proto/tracefile.pb.h"
+#include "src/latency_histogram.h"
+#include "src/tsc_clock.h"
+
+namespace bench {
+
+namespace {
+
+// Long waits sleep until this long before an op is due and spin for the rest,
+// since sleeps may overshoot by tens of microseconds.
+constexpr absl::Duration kSpinTime = absl::Microseconds(100);
+
+}  // namespace
+
+/* static */
+absl::StatusOr<ReplayPacer> ReplayPacer::Build(const Tracefile& tracefile,
+                                               double scale) {
+  if (!(scale > 0)) {
+    return absl::InvalidArgumentError(
+        absl::StrFormat("Pace scale must be positive, got %f", scale));
+  }
+
+  uint64_t origin_ns = std::numeric_limits<uint64_t>::max();
+  std::vector<uint64_t> id_sizes;
+  auto set_size = [&id_sizes](uint64_t id, uint64_t size) {
+    if (id >= id_sizes.size()) {
+      id_sizes.resize(id + 1);
+    }
+    id_sizes[id] = size;
+  };
+  for (const TraceLine& line : tracefile.lines()) {
+    if (line.has_timestamp_ns()) {
+      origin_ns = std::min(origin_ns, line.timestamp_ns());
+    }
+    switch (line.op_case()) {
+      case TraceLine::kMalloc:
+        set_size(line.malloc().result_id(), line.malloc().input_size());
+        break;
+      case TraceLine::kCalloc:
+        set_size(line.calloc().result_id(),
+                 line.calloc().input_nmemb() * line.calloc().input_size());
+        break;
+      case TraceLine::kRealloc:
+        set_size(line.realloc().result_id(), line.realloc().input_size());
+        break;
+      case TraceLine::kFree:
+      case TraceLine::OP_NOT_SET:
+        break;
+    }
+  }
+  if (origin_ns == std::numeric_limits<uint64_t>::max()) {
+    return absl::FailedPreconditionError(
+        "Paced replay requires a trace with timestamps");
+  }
+
+  return ReplayPacer(origin_ns, TscClock::Get().TicksPerNano() * scale,
+                     std::move(id_sizes));
+}
+
+ReplayPacer::ReplayPacer(uint64_t origin_ns, double ticks_per_ns,
+                         std::vector<uint64_t>&& id_sizes)
+    : clock_(&TscClock::Get()),
+      origin_ns_(origin_ns),
+      ticks_per_ns_(ticks_per_ns),
+      id_sizes_(std::move(id_sizes)) {}
+
+uint64_t ReplayPacer::WaitUntilDue(const TraceLine& line,
+                                   uint64_t start) const {
+  uint64_t now = TscClock::Start();
+  if (!line.has_timestamp_ns()) {
+    return now;
+  }
+
+  const uint64_t due =
+      start + static_cast<uint64_t>((line.timestamp_ns() - origin_ns_) *
+                                    ticks_per_ns_);
+  if (now >= due) {
+    return due;
+  }
+  const absl::Duration wait = absl::Nanoseconds(clock_->ToNanos(due - now));
+  if (wait > 2 * kSpinTime) {
+    absl::SleepFor(wait - kSpinTime);
+  }
+  while (TscClock::Start() < due) {
+  }
+  return due;
+}
+
+void ReplayPacer::Record(const TraceLine& line, uint64_t due, uint64_t done,
+                         LatencyProfile& profile) const {
+  const uint64_t nanos =
+      done > due ? static_cast<uint64_t>(clock_->ToNanos(done - due)) : 0;
+  switch (line.op_case()) {
+    case TraceLine::kMalloc:
+      profile.Record(AllocOp::kMalloc, line.malloc().input_size(), nanos);
+      break;
+    case TraceLine::kCalloc:
+      profile.Record(AllocOp::kCalloc,
+                     line.calloc().input_nmemb() * line.calloc().input_size(),
+                     nanos);
+      break;
+    case TraceLine::kRealloc:
+      profile.Record(AllocOp::kRealloc, line.realloc().input_size(), nanos);
+      break;
+    case TraceLine::kFree:
+      profile.Record(AllocOp::kFree,
+                     line.free().has_input_id()
+                         ? id_sizes_[line.free().input_id()]
+                         : 0,
+                     nanos);
+      break;
+    case TraceLine::OP_NOT_SET:
+      break;
+  }
+}
+
+}  // namespace bench
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "absl/status/statusor.h"
+
+#include "proto/tracefile.pb.h"
+#include "src/latency_histogram.h"
+#include "src/tsc_clock.h"
+
+namespace bench {
+
+using proto::Tracefile;
+using proto::TraceLine;
+
+// Schedules the ops of a timestamped trace (see `TraceLine.timestamp_ns`) for
+// open-loop replay, where each op is issued at its recorded time regardless of
+// how long earlier ops took. Latencies are measured from when an op was due
+// rather than when it was issued, so an op delayed behind a slow one is
+// charged for the delay, as a request arriving at that time would have been.
+//
+// Times are in `TscClock` ticks.
+class ReplayPacer {
+ public:
+  // Builds a pacer for `tracefile`, which must have had its ids rewritten to be
+  // unique and contiguous from 0, and must have timestamps. The gaps between
+  // recorded times are multiplied by `scale`, so 0.5 replays the trace twice
+  // as fast.
+  static absl::StatusOr<ReplayPacer> Build(const Tracefile& tracefile,
+                                           double scale);
+
+  // The number of unique ids allocated by the trace.
+  uint64_t NumIds() const {
+    return id_sizes_.size();
+  }
+
+  // Waits until `line` is due in a replay which started at tick `start`, and
+  // returns the tick it was due at. Lines without a timestamp are due as soon
+  // as they are reached. Long waits sleep, leaving the CPU to any background
+  // work of the allocator.
+  uint64_t WaitUntilDue(const TraceLine& line, uint64_t start) const;
+
+  // Records the latency of `line`, which was due at tick `due` and completed
+  // at tick `done`.
+  void Record(const TraceLine& line, uint64_t due, uint64_t done,
+              LatencyProfile& profile) const;
+
+ private:
+  ReplayPacer(uint64_t origin_ns, double ticks_per_ns,
+              std::vector<uint64_t>&& id_sizes);
+
+  const TscClock* clock_;
+  // The earliest timestamp in the trace, which is due at the start of a
+  // replay.
+  uint64_t origin_ns_;
+  // `TscClock` ticks per recorded nanosecond, including the scale.
+  double ticks_per_ns_;
+  // The size of each id's allocation, to attribute frees to a size bucket.
+  std::vector<uint64_t> id_sizes_;
+};
+
+}  // namespace bench
@@ -0,0 +1,177 @@
+#include "src/site_span_backend.h"
+
+#include <cstddef>
+#include <cstdint>
+
+#include "absl/synchronization/mutex.h"
+
+#include "src/alloc_hint.h"
+
+namespace bench {
+
+void* SiteSpanBackend::AllocSpan(size_t pages, const AllocHint& hint) {
+  absl::MutexLock lock(&mutex_);
+  if (chunks_ == nullptr && !Initialize()) {
+    return nullptr;
+  }
+  if (pages == 0) {
+    pages = 1;
+  }
+
+  if (pages > kChunkPages) {
+    const uint32_t n = (pages + kChunkPages - 1) / kChunkPages;
+    const uint32_t chunk = TakeChunks(n);
+    if (chunk == kNoChunk) {
+      return nullptr;
+    }
+    chunks_[chunk].live_spans = 1;
+    chunks_[chunk].run_chunks = n;
+    return ChunkStart(chunk);
+  }
+
+  uint32_t& current = current_[hint.site_id % kNumSiteClasses];
+  if (current == kNoChunk ||
+      chunks_[current].used_pages + pages > kChunkPages) {
+    const uint32_t chunk = TakeChunks(1);
+    if (chunk == kNoChunk) {
+      return nullptr;
+    }
+    if (current != kNoChunk) {
+      chunks_[current].current = false;
+      if (chunks_[current].live_spans == 0) {
+        ReleaseChunks(current, 1);
+      }
+    }
+    current = chunk;
+    chunks_[current].current = true;
+  }
+
+  Chunk& chunk = chunks_[current];
+  void* span = static_cast<uint8_t*>(ChunkStart(current)) +
+               static_cast<size_t>(chunk.used_pages) * kPageSize;
+  chunk.used_pages += pages;
+  chunk.live_spans++;
+  return span;
+}
+
+void SiteSpanBackend::FreeSpan(void* span) {
+  absl::MutexLock lock(&mutex_);
+  const uint32_t index =
+      (static_cast<uint8_t*>(span) - chunks_start_) / kChunkSize;
+  Chunk& chunk = chunks_[index];
+  if (chunk.run_chunks != 0) {
+    ReleaseChunks(index, chunk.run_chunks);
+    return;
+  }
+
+  if (--chunk.live_spans == 0) {
+    if (chunk.current) {
+      // Keep the chunk for its site class, starting from its first page.
+      chunk.used_pages = 0;
+    } else {
+      ReleaseChunks(index, 1);
+    }
+  }
+}
+
+bool SiteSpanBackend::Initialize() {
+  const size_t max_chunks = heap_->MaxSize() / kChunkSize;
+  const size_t metadata_size =
+      (max_chunks * sizeof(Chunk) + kPageSize - 1) / kPageSize * kPageSize;
+  void* metadata = heap_->sbrk(static_cast<intptr_t>(metadata_size));
+  if (metadata == nullptr) {
+    return false;
+  }
+
+  chunks_ = static_cast<Chunk*>(metadata);
+  chunks_start_ = static_cast<uint8_t*>(metadata) + metadata_size;
+  for (uint32_t& current : current_) {
+    current = kNoChunk;
+  }
+  return true;
+}
+
+uint32_t SiteSpanBackend::TakeChunks(uint32_t n) {
+  uint32_t chunk = free_runs_;
+  while (chunk != kNoChunk && chunks_[chunk].run_chunks < n) {
+    chunk = chunks_[chunk].next_free;
+  }
+
+  if (chunk != kNoChunk) {
+    const uint32_t run_chunks = chunks_[chunk].run_chunks;
+    RemoveFreeRun(chunk);
+    if (run_chunks > n) {
+      AddFreeRun(chunk + n, run_chunks - n);
+    }
+  } else {
+    if (heap_->sbrk(static_cast<intptr_t>(n * kChunkSize)) == nullptr) {
+      return kNoChunk;
+    }
+    chunk = num_chunks_;
+    num_chunks_ += n;
+  }
+
+  for (uint32_t i = chunk; i < chunk + n; i++) {
+    chunks_[i] = Chunk{
+      .live_spans = 0,
+      .used_pages = 0,
+      .run_chunks = 0,
+      .next_free = kNoChunk,
+      .prev_free = kNoChunk,
+      .run_start = kNoChunk,
+      .current = false,
+      .free = false,
+    };
+  }
+  return chunk;
+}
+
+void SiteSpanBackend::ReleaseChunks(uint32_t first, uint32_t n) {
+  for (uint32_t i = first; i < first + n; i++) {
+    chunks_[i].free = true;
+  }
+  if (first > 0 && chunks_[first - 1].free) {
+    const uint32_t left = chunks_[first - 1].run_start;
+    RemoveFreeRun(left);
+    n += first - left;
+    first = left;
+  }
+  if (first + n < num_chunks_ && chunks_[first + n].free) {
+    const uint32_t right = first + n;
+    n += chunks_[right].run_chunks;
+    RemoveFreeRun(right);
+  }
+  AddFreeRun(first, n);
+}
+
+void SiteSpanBackend::AddFreeRun(uint32_t first, uint32_t n) {
+  chunks_[first] = Chunk{
+    .live_spans = 0,
+    .used_pages = 0,
+    .run_chunks = n,
+    .next_free = free_runs_,
+    .prev_free = kNoChunk,
+    .run_start = first,
+    .current = false,
+    .free = true,
+  };
+  chunks_[first + n - 1].run_start = first;
+  if (free_runs_ != kNoChunk) {
+    chunks_[free_runs_].prev_free = first;
+  }
+  free_runs_ = first;
+}
+
+void SiteSpanBackend::RemoveFreeRun(uint32_t first) {
+  const Chunk& run = chunks_[first];
+  if (run.prev_free != kNoChunk) {
+    chunks_[run.prev_free].next_free = run.next_free;
+  } else {
+    free_runs_ = run.next_free;
+  }
+  if (run.next_free != kNoChunk) {
+    chunks_[run.next_free].prev_free = run.prev_free;
+  }
+}
+
+}  // namespace bench
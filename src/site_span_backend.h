@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+
+#include "src/alloc_hint.h"
+#include "src/heap_interface.h"
+
+namespace bench {
+
+// A page-level backend for allocators which segregates spans by allocation
+// site (see `AllocHint::site_id`). The heap is carved into chunks, and each
+// site class allocates its spans from a chunk of its own, so allocations from
+// one site share pages and, as they tend to die together, chunks empty out as
+// a whole and are reused by any site.
+//
+// Spans larger than a chunk get a run of contiguous chunks to themselves.
+// Empty chunks are coalesced with their free neighbors, so the chunks of freed
+// spans of any size can be reused by later ones.
+//
+// The backend's metadata is kept at the start of its heap, so it never calls
+// the allocator and may be used to implement one. It is thread-safe.
+class SiteSpanBackend {
+ public:
+  static constexpr size_t kPageSize = 4096;
+  static constexpr size_t kChunkPages = 64;
+  static constexpr size_t kChunkSize = kChunkPages * kPageSize;
+  // Sites are hashed into this many classes, each with its own current chunk.
+  static constexpr size_t kNumSiteClasses = 64;
+
+  // `heap` must be empty, and is used exclusively by this backend.
+  explicit SiteSpanBackend(Heap* heap) : heap_(heap) {}
+
+  // Returns a page-aligned span of `pages` pages, placed according to `hint`,
+  // or nullptr if the heap is exhausted.
+  void* AllocSpan(size_t pages, const AllocHint& hint);
+
+  // Frees a span returned by `AllocSpan`.
+  void FreeSpan(void* span);
+
+ private:
+  static constexpr uint32_t kNoChunk = UINT32_MAX;
+
+  struct Chunk {
+    // The number of spans allocated from this chunk and not yet freed.
+    uint32_t live_spans;
+    // The number of pages handed out, which are never reused until the chunk
+    // empties.
+    uint32_t used_pages;
+    // If this chunk starts a span larger than a chunk or a free run, its
+    // length in chunks.
+    uint32_t run_chunks;
+    // If this chunk starts a free run, the next and previous runs on the free
+    // list.
+    uint32_t next_free;
+    uint32_t prev_free;
+    // If this chunk ends a free run, the run's first chunk.
+    uint32_t run_start;
+    // Whether the chunk is some site class's current chunk.
+    bool current;
+    // Whether the chunk is part of a free run.
+    bool free;
+  };
+
+  // Maps the chunk metadata on first use. Returns false if the heap is too
+  // small.
+  bool Initialize() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Returns the index of the first of `n` free chunks, which are contiguous,
+  // or `kNoChunk` if the heap is exhausted. Chunks are taken from the first
+  // free run long enough to hold them, and only taken from the heap if there
+  // is none.
+  uint32_t TakeChunks(uint32_t n) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Frees the `n` chunks starting at `first`, merging them with the free runs
+  // around them.
+  void ReleaseChunks(uint32_t first, uint32_t n)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Adds the `n` free chunks starting at `first` to the free list as a run.
+  void AddFreeRun(uint32_t first, uint32_t n)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Removes the free run starting at `first` from the free list.
+  void RemoveFreeRun(uint32_t first) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  void* ChunkStart(uint32_t chunk) const ABSL_SHARED_LOCKS_REQUIRED(mutex_) {
+    return chunks_start_ + static_cast<size_t>(chunk) * kChunkSize;
+  }
+
+  Heap* const heap_;
+
+  absl::Mutex mutex_;
+  // Metadata for every chunk the heap can hold, indexed by chunk number.
+  Chunk* chunks_ ABSL_GUARDED_BY(mutex_) = nullptr;
+  // The start of chunk 0, just past the metadata.
+  uint8_t* chunks_start_ ABSL_GUARDED_BY(mutex_) = nullptr;
+  // The number of chunks taken from the heap so far.
+  uint32_t num_chunks_ ABSL_GUARDED_BY(mutex_) = 0;
+  // The first of the runs of chunks which have been taken from the heap but
+  // hold no spans. Adjacent free chunks always belong to the same run.
+  uint32_t free_runs_ ABSL_GUARDED_BY(mutex_) = kNoChunk;
+  uint32_t current_[kNumSiteClasses] ABSL_GUARDED_BY(mutex_);
+};
+
+}  // namespace bench
@@ -0,0 +1,105 @@
+#include "src/site_span_backend.h"
+
+#include <cstddef>
+#include <cstdint>
+
+#include "gtest/gtest.h"
+
+#include "src/alloc_hint.h"
+#include "src/heap_interface.h"
+#include "src/mmap_heap_factory.h"
+
+namespace bench {
+
+class TestSiteSpanBackend : public ::testing::Test {
+ protected:
+  static constexpr size_t kChunkSize = SiteSpanBackend::kChunkSize;
+  static constexpr size_t kPageSize = SiteSpanBackend::kPageSize;
+
+  MMapHeapFactory heap_factory_;
+  Heap* heap_ = heap_factory_.NewInstance(64 * kChunkSize).value();
+  SiteSpanBackend backend_{ heap_ };
+};
+
+TEST_F(TestSiteSpanBackend, SegregatesSites) {
+  const AllocHint site_a = { .site_id = 1 };
+  const AllocHint site_b = { .site_id = 2 };
+  void* a1 = backend_.AllocSpan(1, site_a);
+  void* b1 = backend_.AllocSpan(2, site_b);
+  void* a2 = backend_.AllocSpan(3, site_a);
+  ASSERT_NE(a1, nullptr);
+  ASSERT_NE(b1, nullptr);
+  ASSERT_NE(a2, nullptr);
+
+  // Site a's spans share its chunk, while site b takes the next one.
+  EXPECT_EQ(static_cast<uint8_t*>(a2) - static_cast<uint8_t*>(a1), kPageSize);
+  EXPECT_EQ(static_cast<uint8_t*>(b1) - static_cast<uint8_t*>(a1), kChunkSize);
+}
+
+TEST_F(TestSiteSpanBackend, ReusesEmptyChunks) {
+  const AllocHint site_a = { .site_id = 1 };
+  const AllocHint site_b = { .site_id = 2 };
+  // Fill a chunk for site a, then move it on to a new chunk.
+  void* full = backend_.AllocSpan(SiteSpanBackend::kChunkPages, site_a);
+  void* next = backend_.AllocSpan(1, site_a);
+  ASSERT_NE(full, nullptr);
+  ASSERT_NE(next, nullptr);
+
+  // Once empty, the first chunk may be taken by any site.
+  backend_.FreeSpan(full);
+  EXPECT_EQ(backend_.AllocSpan(1, site_b), full);
+}
+
+TEST_F(TestSiteSpanBackend, LargeSpans) {
+  void* large =
+      backend_.AllocSpan(3 * SiteSpanBackend::kChunkPages, AllocHint());
+  ASSERT_NE(large, nullptr);
+  const size_t heap_size = heap_->Size();
+  backend_.FreeSpan(large);
+
+  // The chunks of the large span are reused rather than taken from the heap.
+  for (int i = 0; i < 3; i++) {
+    void* span = backend_.AllocSpan(SiteSpanBackend::kChunkPages,
+                                     AllocHint{ .site_id = 5 });
+    ASSERT_NE(span, nullptr);
+  }
+  EXPECT_EQ(heap_->Size(), heap_size);
+}
+
+TEST_F(TestSiteSpanBackend, ReusesFreedRuns) {
+  const size_t pages = 2 * SiteSpanBackend::kChunkPages + 1;
+  void* span = backend_.AllocSpan(pages, AllocHint());
+  ASSERT_NE(span, nullptr);
+  backend_.FreeSpan(span);
+  const size_t heap_size = heap_->Size();
+
+  for (int i = 0; i < 100; i++) {
+    span = backend_.AllocSpan(pages, AllocHint());
+    ASSERT_NE(span, nullptr);
+    backend_.FreeSpan(span);
+  }
+  EXPECT_EQ(heap_->Size(), heap_size);
+}
+
+TEST_F(TestSiteSpanBackend, CoalescesFreeChunks) {
+  void* a = backend_.AllocSpan(2 * SiteSpanBackend::kChunkPages, AllocHint());
+  void* b = backend_.AllocSpan(2 * SiteSpanBackend::kChunkPages, AllocHint());
+  ASSERT_NE(a, nullptr);
+  ASSERT_NE(b, nullptr);
+  const size_t heap_size = heap_->Size();
+  backend_.FreeSpan(b);
+  backend_.FreeSpan(a);
+
+  // The chunks of both spans merge into a run long enough for a larger span.
+  EXPECT_EQ(backend_.AllocSpan(4 * SiteSpanBackend::kChunkPages, AllocHint()),
+            a);
+  EXPECT_EQ(heap_->Size(), heap_size);
+}
+
+TEST_F(TestSiteSpanBackend, Exhaustion) {
+  EXPECT_EQ(backend_.AllocSpan(64 * SiteSpanBackend::kChunkPages, AllocHint()),
+            nullptr);
+  EXPECT_NE(backend_.AllocSpan(1, AllocHint()), nullptr);
+}
+
+}  // namespace bench
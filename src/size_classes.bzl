@@ -0,0 +1,37 @@
+"""Macros for size class tables generated from traces."""
+
+def size_class_library(
+        name,
+        traces,
+        num_classes = 48,
+        max_size = 32768,
+        alignment = 16,
+        cpp_namespace = "bench",
+        visibility = None):
+    """A cc_library with a header `<name>.h` of size classes fit to `traces`.
+
+    The header defines `kSizeClasses`, `kMaxSizeClass` and `SizeClassIndex()`
+    in `cpp_namespace`, chosen by //src:sizeclass_gen to minimize internal
+    fragmentation at peak live bytes of `traces`.
+    """
+    native.genrule(
+        name = name + "_gen",
+        srcs = traces,
+        outs = [name + ".h"],
+        cmd_bash = " ".join([
+            "$(location //src:sizeclass_gen)",
+            "--traces=$$(echo $(SRCS) | tr ' ' ',')",
+            "--output=$@",
+            "--num_classes=%d" % num_classes,
+            "--max_size=%d" % max_size,
+            "--alignment=%d" % alignment,
+            "--cpp_namespace=%s" % cpp_namespace,
+            "> /dev/null",
+        ]),
+        tools = ["//src:sizeclass_gen"],
+    )
+    native.cc_library(
+        name = name,
+        hdrs = [name + ".h"],
+        visibility = visibility,
+    )
@@ -0,0 +1,390 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/btree_map.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/str_join.h"
+#include "util/absl_util.h"
+
+#include "proto/tracefile.pb.h"
+#include "src/trace_index.h"
+#include "src/tracefile_reader.h"
+
+ABSL_FLAG(std::vector<std::string>, traces, {},
+          "Comma-separated file paths of the traces to profile, in any format "
+          "readable by the driver.");
+
+ABSL_FLAG(std::string, output, "",
+          "File path of the C++ header to write the size classes to.");
+
+ABSL_FLAG(uint32_t, num_classes, 48,
+          "The maximum number of size classes to generate.");
+
+ABSL_FLAG(uint64_t, max_size, 32768,
+          "The largest size class. Requests larger than this are left to the "
+          "allocator's large allocation path and do not affect the classes.");
+
+ABSL_FLAG(uint64_t, alignment, 16,
+          "Every size class is a multiple of this, which must be a power of "
+          "two.");
+
+ABSL_FLAG(std::string, cpp_namespace, "bench",
+          "The namespace to declare the size classes in.");
+
+namespace bench {
+
+namespace {
+
+// Requested sizes rounded up to the alignment, each with the number of objects
+// requested at that size live when the most bytes are live in the trace.
+// Weighting by the objects live at the peak makes the internal fragmentation
+// minimized that of the heap at its largest, rather than that of the
+// allocation stream.
+struct SizeProfile {
+  // Rounded size -> sum over the sizes rounding to it of objects live at peak.
+  absl::btree_map<uint64_t, double> weight;
+  // Rounded size -> sum over the sizes rounding to it of bytes live at peak.
+  absl::btree_map<uint64_t, double> weighted_bytes;
+};
+
+uint64_t RoundUp(uint64_t size, uint64_t alignment) {
+  return (std::max<uint64_t>(size, 1) + alignment - 1) & ~(alignment - 1);
+}
+
+// Updates `live` to reflect `line`, keeping `live_bytes` the total size of the
+// allocations in `live`.
+absl::Status ApplyLine(const TraceLine& line, LiveSet& live,
+                       uint64_t& live_bytes) {
+  std::optional<uint64_t> input_id;
+  std::optional<uint64_t> result_id;
+  switch (line.op_case()) {
+    case TraceLine::kMalloc:
+      if (line.malloc().has_result_id()) {
+        result_id = line.malloc().result_id();
+      }
+      break;
+    case TraceLine::kCalloc:
+      if (line.calloc().has_result_id()) {
+        result_id = line.calloc().result_id();
+      }
+      break;
+    case TraceLine::kRealloc:
+      if (line.realloc().has_input_id()) {
+        input_id = line.realloc().input_id();
+      }
+      result_id = line.realloc().result_id();
+      break;
+    case TraceLine::kFree:
+      if (line.free().has_input_id()) {
+        input_id = line.free().input_id();
+      }
+      break;
+    case TraceLine::OP_NOT_SET:
+      break;
+  }
+
+  if (input_id.has_value()) {
+    auto it = live.find(input_id.value());
+    if (it != live.end()) {
+      live_bytes -= it->second.size;
+    }
+  }
+  RETURN_IF_ERROR(TraceIndex::Apply(line, live));
+  if (result_id.has_value()) {
+    auto it = live.find(result_id.value());
+    if (it == live.end()) {
+      return absl::InvalidArgumentError(
+          absl::StrFormat("Allocation with id %v missing from the live set",
+                          result_id.value()));
+    }
+    live_bytes += it->second.size;
+  }
+  return absl::OkStatus();
+}
+
+absl::Status ProfileTracefile(const std::string& path, uint64_t max_size,
+                              uint64_t alignment, SizeProfile& profile) {
+  DEFINE_OR_RETURN(TracefileReader, reader, TracefileReader::Open(path));
+
+  // Find how many ops it takes to first reach the most bytes live, then replay
+  // that many to recover the live set at the peak.
+  LiveSet live;
+  uint64_t live_bytes = 0;
+  uint64_t peak_live_bytes = 0;
+  size_t ops = 0;
+  size_t peak_ops = 0;
+  for (const TraceLine& line : reader) {
+    RETURN_IF_ERROR(ApplyLine(line, live, live_bytes));
+    ops++;
+    if (live_bytes > peak_live_bytes) {
+      peak_live_bytes = live_bytes;
+      peak_ops = ops;
+    }
+  }
+
+  live.clear();
+  live_bytes = 0;
+  for (auto it = reader.begin(); peak_ops > 0; ++it, peak_ops--) {
+    RETURN_IF_ERROR(ApplyLine(*it, live, live_bytes));
+  }
+
+  absl::flat_hash_map<uint64_t, uint64_t> peak_count;
+  for (const auto& [id, allocation] : live) {
+    peak_count[allocation.size]++;
+  }
+  for (const auto [size, peak] : peak_count) {
+    if (size > max_size) {
+      continue;
+    }
+    const uint64_t rounded = RoundUp(size, alignment);
+    profile.weight[rounded] += static_cast<double>(peak);
+    profile.weighted_bytes[rounded] +=
+        static_cast<double>(peak) * static_cast<double>(size);
+  }
+  return absl::OkStatus();
+}
+
+// Chooses at most `num_classes` size classes from the rounded sizes of
+// `profile` minimizing the total bytes wasted at peak, where each size is
+// served by the smallest class at least as large.
+//
+// Row `k` of the solution holds, for each `i`, the least waste serving the `i`
+// smallest sizes with `k` classes, the largest of which is the `i`-th size.
+// The cost of serving a run of sizes with one class satisfies the quadrangle
+// inequality, so the optimal split point is monotone in `i` and each row is
+// solved by divide and conquer in O(n log n).
+class SizeClassSolver {
+ public:
+  explicit SizeClassSolver(const SizeProfile& profile) {
+    sizes_.push_back(0);
+    prefix_weight_.push_back(0);
+    prefix_bytes_.push_back(0);
+    for (const auto [size, weight] : profile.weight) {
+      sizes_.push_back(size);
+      prefix_weight_.push_back(prefix_weight_.back() + weight);
+      prefix_bytes_.push_back(prefix_bytes_.back() +
+                              profile.weighted_bytes.at(size));
+    }
+  }
+
+  std::vector<uint64_t> Solve(uint32_t num_classes) {
+    const size_t n = sizes_.size() - 1;
+    const size_t k_max = std::min<size_t>(num_classes, n);
+
+    std::vector<double> prev(n + 1);
+    for (size_t i = 1; i <= n; i++) {
+      prev[i] = Cost(0, i);
+    }
+    splits_.assign(k_max + 1, std::vector<uint32_t>(n + 1, 0));
+    for (size_t k = 2; k <= k_max; k++) {
+      std::vector<double> cur(n + 1, std::numeric_limits<double>::infinity());
+      SolveRow(k, k, n, k - 1, n - 1, prev, cur);
+      prev = std::move(cur);
+    }
+
+    std::vector<uint64_t> classes;
+    for (size_t k = k_max, i = n; k > 0; i = splits_[k--][i]) {
+      classes.push_back(sizes_[i]);
+    }
+    std::reverse(classes.begin(), classes.end());
+    return classes;
+  }
+
+  // The bytes wasted at peak by the classes chosen out of the profiled sizes,
+  // and the bytes requested at peak.
+  std::pair<double, double> Waste(const std::vector<uint64_t>& classes) const {
+    double waste = 0;
+    size_t j = 0;
+    for (uint64_t size : classes) {
+      size_t i = std::lower_bound(sizes_.begin(), sizes_.end(), size) -
+                 sizes_.begin();
+      waste += Cost(j, i);
+      j = i;
+    }
+    return { waste, prefix_bytes_.back() };
+  }
+
+ private:
+  // The waste serving sizes `(j, i]` with a class of the `i`-th size.
+  double Cost(size_t j, size_t i) const {
+    return static_cast<double>(sizes_[i]) *
+               (prefix_weight_[i] - prefix_weight_[j]) -
+           (prefix_bytes_[i] - prefix_bytes_[j]);
+  }
+
+  void SolveRow(size_t k, size_t lo, size_t hi, size_t split_lo,
+                size_t split_hi, const std::vector<double>& prev,
+                std::vector<double>& cur) {
+    if (lo > hi) {
+      return;
+    }
+    const size_t mid = lo + (hi - lo) / 2;
+    size_t best_split = split_lo;
+    for (size_t j = split_lo; j <= std::min(split_hi, mid - 1); j++) {
+      const double cost = prev[j] + Cost(j, mid);
+      if (cost < cur[mid]) {
+        cur[mid] = cost;
+        best_split = j;
+      }
+    }
+    splits_[k][mid] = best_split;
+    if (mid > lo) {
+      SolveRow(k, lo, mid - 1, split_lo, best_split, prev, cur);
+    }
+    SolveRow(k, mid + 1, hi, best_split, split_hi, prev, cur);
+  }
+
+  // Index 0 is a sentinel for the empty prefix of sizes.
+  std::vector<uint64_t> sizes_;
+  std::vector<double> prefix_weight_;
+  std::vector<double> prefix_bytes_;
+  std::vector<std::vector<uint32_t>> splits_;
+};
+
+std::string SizeClassHeader(const std::vector<std::string>& traces,
+                            const std::vector<uint64_t>& classes,
+                            double waste_fraction, const std::string& ns) {
+  std::string header = absl::StrFormat(
+      "#pragma once\n"
+      "\n"
+      "// Generated by sizeclass_gen from %s.\n"
+      "// Internal fragmentation at peak live bytes of the profiled traces: "
+      "%.2f%%.\n"
+      "\n"
+      "#include <array>\n"
+      "#include <cstddef>\n"
+      "\n"
+      "namespace %s {\n"
+      "\n",
+      absl::StrJoin(traces, ", "), waste_fraction * 100, ns);
+
+  std::vector<std::string> lines;
+  std::string line;
+  for (uint64_t size : classes) {
+    std::string entry = absl::StrFormat("%u,", size);
+    if (!line.empty() && line.size() + entry.size() + 1 > 76) {
+      lines.push_back(line);
+      line.clear();
+    }
+    absl::StrAppend(&line, line.empty() ? "" : " ", entry);
+  }
+  if (!line.empty()) {
+    lines.push_back(line);
+  }
+
+  absl::StrAppendFormat(
+      &header,
+      "inline constexpr std::array<size_t, %u> kSizeClasses = {\n"
+      "  %s\n"
+      "};\n"
+      "\n"
+      "inline constexpr size_t kMaxSizeClass = kSizeClasses.back();\n"
+      "\n"
+      "// Returns the index of the smallest size class holding `size`, which "
+      "must\n"
+      "// be at most `kMaxSizeClass`.\n"
+      "constexpr size_t SizeClassIndex(size_t size) {\n"
+      "  size_t lo = 0;\n"
+      "  size_t hi = kSizeClasses.size() - 1;\n"
+      "  while (lo < hi) {\n"
+      "    const size_t mid = lo + (hi - lo) / 2;\n"
+      "    if (kSizeClasses[mid] < size) {\n"
+      "      lo = mid + 1;\n"
+      "    } else {\n"
+      "      hi = mid;\n"
+      "    }\n"
+      "  }\n"
+      "  return lo;\n"
+      "}\n"
+      "\n"
+      "}  // namespace %s\n",
+      classes.size(), absl::StrJoin(lines, "\n  "), ns);
+  return header;
+}
+
+absl::Status GenerateSizeClasses(const std::vector<std::string>& traces,
+                                 const std::string& output_path,
+                                 uint32_t num_classes, uint64_t max_size,
+                                 uint64_t alignment, const std::string& ns) {
+  if (num_classes == 0) {
+    return absl::InvalidArgumentError("--num_classes must be nonzero");
+  }
+  if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+    return absl::InvalidArgumentError("--alignment must be a power of two");
+  }
+  if (max_size % alignment != 0) {
+    return absl::InvalidArgumentError(
+        "--max_size must be a multiple of --alignment");
+  }
+
+  SizeProfile profile;
+  for (const std::string& trace : traces) {
+    RETURN_IF_ERROR(ProfileTracefile(trace, max_size, alignment, profile));
+  }
+  // The largest class is always `max_size`, so every size up to it has a
+  // class even if it was never profiled.
+  profile.weight.try_emplace(max_size, 0);
+  profile.weighted_bytes.try_emplace(max_size, 0);
+
+  SizeClassSolver solver(profile);
+  const std::vector<uint64_t> classes = solver.Solve(num_classes);
+  const auto [waste, bytes] = solver.Waste(classes);
+  const double waste_fraction = bytes == 0 ? 0 : waste / (waste + bytes);
+
+  std::ofstream file(output_path, std::ios::trunc);
+  if (!file.is_open()) {
+    return absl::InternalError(
+        absl::StrFormat("Failed to open %s for writing", output_path));
+  }
+  file << SizeClassHeader(traces, classes, waste_fraction, ns);
+  if (!file.good()) {
+    return absl::InternalError(
+        absl::StrFormat("Failed to write %s", output_path));
+  }
+
+  std::cout << absl::StrFormat(
+                   "Wrote %u size classes to %s, %.2f%% internal "
+                   "fragmentation at peak",
+                   classes.size(), output_path, waste_fraction * 100)
+            << std::endl;
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+}  // namespace bench
+
+int main(int argc, char* argv[]) {
+  absl::ParseCommandLine(argc, argv);
+
+  const std::vector<std::string>& traces = absl::GetFlag(FLAGS_traces);
+  const std::string& output_path = absl::GetFlag(FLAGS_output);
+  if (traces.empty() || output_path.empty()) {
+    std::cerr << "Flags --traces and --output are required" << std::endl;
+    return -1;
+  }
+
+  absl::Status s = bench::GenerateSizeClasses(
+      traces, output_path, absl::GetFlag(FLAGS_num_classes),
+      absl::GetFlag(FLAGS_max_size), absl::GetFlag(FLAGS_alignment),
+      absl::GetFlag(FLAGS_cpp_namespace));
+  if (!s.ok()) {
+    std::cerr << "Fatal error: " << s << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <optional>
+#include <utility>
+
+namespace bench {
+
+// A fixed-capacity, lock-free ring buffer for passing values from exactly one
+// producer thread to exactly one consumer thread.
+template <typename T, size_t kCapacity>
+class SpscRing {
+  static_assert(std::has_single_bit(kCapacity),
+                "SpscRing capacity must be a power of two");
+
+ public:
+  // Pushes `value` to the back of the ring. Returns false if the ring is full,
+  // in which case `value` is not moved from. Must only be called by the
+  // producer.
+  bool TryPush(T&& value) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) == kCapacity) {
+      return false;
+    }
+    slots_[tail % kCapacity] = std::move(value);
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Pops the value at the front of the ring, or returns `std::nullopt` if the
+  // ring is empty. Must only be called by the consumer.
+  std::optional<T> TryPop() {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) {
+      return std::nullopt;
+    }
+    std::optional<T> value = std::move(slots_[head % kCapacity]);
+    head_.store(head + 1, std::memory_order_release);
+    return value;
+  }
+
+ private:
+  // The producer and consumer indices are on separate cache lines so the two
+  // threads don't contend on every operation.
+  alignas(64) std::atomic<size_t> head_ = 0;
+  alignas(64) std::atomic<size_t> tail_ = 0;
+  alignas(64) std::array<T, kCapacity> slots_;
+};
+
+}  // namespace bench
@@ -0,0 +1,120 @@
+#include "src/thread_streams.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_format.h"
+
+#include "proto/tracefile.pb.h"
+
+namespace bench {
+
+namespace {
+
+std::optional<uint64_t> InputId(const TraceLine& line) {
+  switch (line.op_case()) {
+    case TraceLine::kRealloc: {
+      return line.realloc().has_input_id()
+                 ? std::optional(line.realloc().input_id())
+                 : std::nullopt;
+    }
+    case TraceLine::kFree: {
+      return line.free().has_input_id() ? std::optional(line.free().input_id())
+                                        : std::nullopt;
+    }
+    case TraceLine::kMalloc:
+    case TraceLine::kCalloc:
+    case TraceLine::OP_NOT_SET: {
+      return std::nullopt;
+    }
+  }
+  return std::nullopt;
+}
+
+std::optional<uint64_t> ResultId(const TraceLine& line) {
+  switch (line.op_case()) {
+    case TraceLine::kMalloc: {
+      return line.malloc().has_result_id()
+                 ? std::optional(line.malloc().result_id())
+                 : std::nullopt;
+    }
+    case TraceLine::kCalloc: {
+      return line.calloc().has_result_id()
+                 ? std::optional(line.calloc().result_id())
+                 : std::nullopt;
+    }
+    case TraceLine::kRealloc: {
+      return line.realloc().result_id();
+    }
+    case TraceLine::kFree:
+    case TraceLine::OP_NOT_SET: {
+      return std::nullopt;
+    }
+  }
+  return std::nullopt;
+}
+
+}  // namespace
+
+/* static */
+absl::StatusOr<ThreadStreams> ThreadStreams::Build(const Tracefile& tracefile) {
+  uint64_t num_ids = 0;
+  for (const TraceLine& line : tracefile.lines()) {
+    std::optional<uint64_t> result_id = ResultId(line);
+    if (result_id.has_value()) {
+      num_ids = std::max(num_ids, result_id.value() + 1);
+    }
+  }
+
+  // Maps recorded thread ids to dense stream indices.
+  absl::flat_hash_map<uint32_t, uint32_t> stream_idx;
+  std::vector<std::vector<Op>> streams;
+  // For each id, the stream which allocated it and the number of ops that
+  // stream had completed once the allocation was made.
+  std::vector<std::pair<uint32_t, uint64_t>> producers(num_ids);
+
+  for (const TraceLine& line : tracefile.lines()) {
+    auto [it, inserted] = stream_idx.emplace(line.thread_id(), streams.size());
+    if (inserted) {
+      streams.emplace_back();
+    }
+    const uint32_t thread = it->second;
+    std::vector<Op>& stream = streams[thread];
+
+    Op op = { .line = &line, .dep_thread = 0, .dep_ops = 0 };
+    std::optional<uint64_t> input_id = InputId(line);
+    if (input_id.has_value()) {
+      if (input_id.value() >= num_ids) {
+        return absl::FailedPreconditionError(
+            absl::StrFormat("Unknown ID being released: %v", input_id.value()));
+      }
+      auto [producer_thread, producer_ops] = producers[input_id.value()];
+      if (producer_thread != thread) {
+        op.dep_thread = producer_thread;
+        op.dep_ops = producer_ops;
+      }
+    }
+
+    stream.push_back(op);
+
+    std::optional<uint64_t> result_id = ResultId(line);
+    if (result_id.has_value()) {
+      producers[result_id.value()] = { thread, stream.size() };
+    }
+  }
+
+  return ThreadStreams(std::move(streams), num_ids);
+}
+
+ThreadStreams::ThreadStreams(std::vector<std::vector<Op>>&& streams,
+                             uint64_t num_ids)
+    : streams_(std::move(streams)), num_ids_(num_ids) {}
+
+}  // namespace bench
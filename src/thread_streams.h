@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "absl/status/statusor.h"
+
+#include "proto/tracefile.pb.h"
+
+namespace bench {
+
+using proto::Tracefile;
+using proto::TraceLine;
+
+// Splits a tracefile into the per-thread streams recorded in the `thread_id`
+// field of its trace lines. Lines without a thread id belong to thread 0.
+//
+// Ops in a stream may consume allocations made by another thread (e.g. a
+// cross-thread free). Each such op records the number of ops the producing
+// thread must have completed in the current iteration before it may run,
+// which preserves the ordering of the original trace.
+class ThreadStreams {
+ public:
+  struct Op {
+    const TraceLine* line;
+    // The thread this op waits on, only meaningful if `dep_ops` is nonzero.
+    uint32_t dep_thread;
+    // The number of ops `dep_thread` must have completed before this op may
+    // execute, or 0 if this op has no cross-thread dependency.
+    uint64_t dep_ops;
+  };
+
+  // Builds the thread streams of `tracefile`, which must have had its ids
+  // rewritten to be unique and contiguous from 0.
+  static absl::StatusOr<ThreadStreams> Build(const Tracefile& tracefile);
+
+  size_t NumThreads() const {
+    return streams_.size();
+  }
+
+  const std::vector<Op>& Stream(size_t thread) const {
+    return streams_[thread];
+  }
+
+  // The number of unique ids allocated by the trace, i.e. one more than the
+  // largest result id.
+  uint64_t NumIds() const {
+    return num_ids_;
+  }
+
+ private:
+  ThreadStreams(std::vector<std::vector<Op>>&& streams, uint64_t num_ids);
+
+  std::vector<std::vector<Op>> streams_;
+  uint64_t num_ids_;
+};
+
+}  // namespace bench
@@ -0,0 +1,66 @@
+#include <iostream>
+#include <string>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/status/status.h"
+#include "util/absl_util.h"
+
+#include "src/lifetime_annotator.h"
+#include "src/tracefile_reader.h"
+#include "src/tracefile_writer.h"
+
+ABSL_FLAG(std::string, input, "",
+          "File path of the trace to convert, in any format readable by the "
+          "driver.");
+
+ABSL_FLAG(std::string, output, "", "File path to write the converted trace.");
+
+ABSL_FLAG(std::string, format, "binary",
+          "Format of the output trace, one of \"binary\" (memory-mappable "
+          "fixed-size records), \"columnar\" (compact varint columns) or "
+          "\"proto\" (serialized `Tracefile`).");
+
+ABSL_FLAG(bool, annotate_lifetimes, false,
+          "If true, annotates each allocation in the output with how long it "
+          "lives (see `TraceLine.lifetime_class`), for replay with "
+          "`driver --lifetime_hints`.");
+
+namespace bench {
+
+absl::Status ConvertTracefile(const std::string& input_path,
+                              const std::string& output_path,
+                              const std::string& format,
+                              bool annotate_lifetimes) {
+  DEFINE_OR_RETURN(TracefileReader, reader, TracefileReader::Open(input_path));
+  if (!annotate_lifetimes) {
+    return WriteTracefile(reader.Tracefile(), output_path, format);
+  }
+
+  Tracefile tracefile = reader.Tracefile();
+  RETURN_IF_ERROR(AnnotateLifetimes(tracefile));
+  return WriteTracefile(tracefile, output_path, format);
+}
+
+}  // namespace bench
+
+int main(int argc, char* argv[]) {
+  absl::ParseCommandLine(argc, argv);
+
+  const std::string& input_path = absl::GetFlag(FLAGS_input);
+  const std::string& output_path = absl::GetFlag(FLAGS_output);
+  if (input_path.empty() || output_path.empty()) {
+    std::cerr << "Flags --input and --output are required" << std::endl;
+    return -1;
+  }
+
+  absl::Status s = bench::ConvertTracefile(
+      input_path, output_path, absl::GetFlag(FLAGS_format),
+      absl::GetFlag(FLAGS_annotate_lifetimes));
+  if (!s.ok()) {
+    std::cerr << "Fatal error: " << s << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
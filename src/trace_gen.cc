@@ -0,0 +1,523 @@
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <numbers>
+#include <queue>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_format.h"
+#include "util/absl_util.h"
+
+#include "proto/tracefile.pb.h"
+#include "src/trace_index.h"
+#include "src/tracefile_reader.h"
+#include "src/tracefile_writer.h"
+
+ABSL_FLAG(std::string, output, "", "File path to write the generated trace.");
+
+ABSL_FLAG(std::string, format, "proto",
+          "Format of the generated trace, one of \"binary\", \"columnar\" or "
+          "\"proto\", see trace_converter.");
+
+ABSL_FLAG(uint64_t, seed, 1,
+          "Seed of the generator. The same flags and seed always generate the "
+          "same trace with the same toolchain.");
+
+ABSL_FLAG(uint64_t, allocations, 1000000,
+          "The number of mallocs and reallocs to generate. Every allocation is "
+          "freed, so the trace has about twice this many ops.");
+
+ABSL_FLAG(std::string, size_dist, "lognormal",
+          "Distribution of requested sizes, one of \"uniform\" (between "
+          "--min_size and --max_size), \"lognormal\" (see --size_median and "
+          "--size_sigma) or \"empirical\" (the sizes requested in --profile).");
+
+ABSL_FLAG(uint64_t, min_size, 1, "The smallest size requested.");
+
+ABSL_FLAG(uint64_t, max_size, 65536, "The largest size requested.");
+
+ABSL_FLAG(double, size_median, 64, "The median of lognormal sizes.");
+
+ABSL_FLAG(double, size_sigma, 1,
+          "The standard deviation of the log of lognormal sizes.");
+
+ABSL_FLAG(std::string, lifetime_dist, "exponential",
+          "Distribution of allocation lifetimes, measured in allocations made "
+          "before the allocation is freed. One of \"exponential\" (with mean "
+          "--lifetime), \"uniform\" (up to twice --lifetime), \"lognormal\" "
+          "(with median --lifetime, see --lifetime_sigma) or \"empirical\" "
+          "(the lifetimes in --profile).");
+
+ABSL_FLAG(double, lifetime, 1000,
+          "The mean or median lifetime, which is about the number of "
+          "allocations live at once.");
+
+ABSL_FLAG(double, lifetime_sigma, 2,
+          "The standard deviation of the log of lognormal lifetimes.");
+
+ABSL_FLAG(std::string, profile, "",
+          "A trace to draw empirical sizes and lifetimes from.");
+
+ABSL_FLAG(double, realloc_prob, 0,
+          "The probability that an allocation reallocs a random live "
+          "allocation rather than mallocing a new one.");
+
+ABSL_FLAG(double, aligned_fraction, 0,
+          "The fraction of mallocs which request an alignment from "
+          "--alignments.");
+
+ABSL_FLAG(std::vector<std::string>, alignments,
+          std::vector<std::string>({ "64", "4096" }),
+          "The alignments requested by aligned mallocs, chosen uniformly.");
+
+ABSL_FLAG(uint64_t, ramp_allocations, 0,
+          "If nonzero, the working set grows linearly to its steady state size "
+          "over this many allocations, by shortening the lifetimes of earlier "
+          "allocations.");
+
+ABSL_FLAG(uint32_t, phases, 1,
+          "The number of equal-length phases of the trace. Each phase after "
+          "the first scales sizes by a new factor (see --phase_size_spread) "
+          "and frees part of the working set (see --phase_turnover).");
+
+ABSL_FLAG(double, phase_size_spread, 1,
+          "Sizes in each phase are scaled by a log-uniform factor between "
+          "1 / spread and spread.");
+
+ABSL_FLAG(double, phase_turnover, 0,
+          "The fraction of live allocations freed at each phase change.");
+
+ABSL_FLAG(uint32_t, producers, 1,
+          "The number of threads making allocations, chosen uniformly.");
+
+ABSL_FLAG(uint32_t, consumers, 0,
+          "The number of threads freeing allocations, chosen uniformly. If 0, "
+          "allocations are freed by the thread which made them.");
+
+namespace bench {
+
+namespace {
+
+using proto::Tracefile;
+using proto::TraceLine;
+
+struct GeneratorOptions {
+  uint64_t seed;
+  uint64_t allocations;
+  uint64_t min_size;
+  uint64_t max_size;
+  double realloc_prob;
+  double aligned_fraction;
+  std::vector<uint64_t> alignments;
+  uint64_t ramp_allocations;
+  uint32_t phases;
+  double phase_size_spread;
+  double phase_turnover;
+  uint32_t producers;
+  uint32_t consumers;
+};
+
+// A deterministic source of random values. The engine's output is fully
+// specified by the standard, but the standard distributions are not, so the
+// distributions are derived here to not depend on the standard library. They
+// use `std::log`, `std::exp` and `std::cos`, whose results may differ in the
+// last bit between math libraries, so the same seed is only guaranteed to
+// generate the same trace with the same toolchain.
+class Random {
+ public:
+  explicit Random(uint64_t seed) : engine_(seed) {}
+
+  // Returns a value uniformly distributed in [0, 1).
+  double Uniform() {
+    return static_cast<double>(engine_() >> 11) * 0x1p-53;
+  }
+
+  // Returns a value uniformly distributed in [0, n).
+  uint64_t UniformInt(uint64_t n) {
+    return static_cast<uint64_t>(
+        (static_cast<unsigned __int128>(engine_()) * n) >> 64);
+  }
+
+  double Exponential(double mean) {
+    return -mean * std::log1p(-Uniform());
+  }
+
+  double LogNormal(double median, double sigma) {
+    // Box-Muller transform of two uniform values to a standard normal value.
+    const double u = 1 - Uniform();
+    const double v = Uniform();
+    const double normal =
+        std::sqrt(-2 * std::log(u)) * std::cos(2 * std::numbers::pi * v);
+    return median * std::exp(sigma * normal);
+  }
+
+ private:
+  std::mt19937_64 engine_;
+};
+
+using Distribution = std::function<double(Random&)>;
+
+// The sizes requested and lifetimes of the allocations in a trace, with
+// lifetimes measured in allocations like the generated ones. Allocations
+// never freed have no lifetime.
+struct TraceProfile {
+  std::vector<uint64_t> sizes;
+  std::vector<uint64_t> lifetimes;
+};
+
+absl::StatusOr<TraceProfile> ProfileTracefile(const std::string& path) {
+  DEFINE_OR_RETURN(TracefileReader, reader, TracefileReader::Open(path));
+
+  TraceProfile profile;
+  LiveSet live;
+  absl::flat_hash_map<uint64_t, uint64_t> birth;
+  const auto release = [&](uint64_t id) {
+    auto it = birth.find(id);
+    if (it != birth.end()) {
+      profile.lifetimes.push_back(profile.sizes.size() - it->second);
+      birth.erase(it);
+    }
+  };
+  const auto allocate = [&](uint64_t id) {
+    birth[id] = profile.sizes.size();
+    profile.sizes.push_back(live.at(id).size);
+  };
+
+  for (const TraceLine& line : reader) {
+    if (line.has_free() && line.free().has_input_id()) {
+      release(line.free().input_id());
+    } else if (line.has_realloc() && line.realloc().has_input_id()) {
+      release(line.realloc().input_id());
+    }
+    RETURN_IF_ERROR(TraceIndex::Apply(line, live));
+
+    if (line.has_malloc() && line.malloc().has_result_id()) {
+      allocate(line.malloc().result_id());
+    } else if (line.has_calloc() && line.calloc().has_result_id()) {
+      allocate(line.calloc().result_id());
+    } else if (line.has_realloc()) {
+      allocate(line.realloc().result_id());
+    }
+  }
+  return profile;
+}
+
+absl::StatusOr<Distribution> MakeDistribution(
+    const std::string& name, const std::string& kind, double uniform_min,
+    double uniform_max, double median, double sigma,
+    const std::vector<uint64_t>* empirical) {
+  if (kind == "uniform") {
+    return [uniform_min, uniform_max](Random& random) {
+      return uniform_min + (uniform_max - uniform_min) * random.Uniform();
+    };
+  }
+  if (kind == "exponential") {
+    return [median](Random& random) { return random.Exponential(median); };
+  }
+  if (kind == "lognormal") {
+    return [median, sigma](Random& random) {
+      return random.LogNormal(median, sigma);
+    };
+  }
+  if (kind == "empirical") {
+    if (empirical == nullptr || empirical->empty()) {
+      return absl::InvalidArgumentError(absl::StrFormat(
+          "Empirical %s distribution requires a --profile trace with %ss",
+          name, name));
+    }
+    return [empirical](Random& random) {
+      return static_cast<double>(
+          (*empirical)[random.UniformInt(empirical->size())]);
+    };
+  }
+  return absl::InvalidArgumentError(
+      absl::StrFormat("Unsupported %s distribution \"%s\"", name, kind));
+}
+
+class TraceGenerator {
+ public:
+  TraceGenerator(const GeneratorOptions& options, Distribution size_dist,
+                 Distribution lifetime_dist)
+      : options_(options),
+        size_dist_(std::move(size_dist)),
+        lifetime_dist_(std::move(lifetime_dist)),
+        random_(options.seed) {}
+
+  Tracefile Generate() && {
+    for (uint64_t t = 0; t < options_.allocations; t++) {
+      if (t != 0 && t % PhaseLength() == 0) {
+        ChangePhase();
+      }
+      FreeDead(t);
+      if (!live_.empty() && random_.Uniform() < options_.realloc_prob) {
+        Realloc(t);
+      } else {
+        Malloc(t);
+      }
+    }
+    FreeDead(std::numeric_limits<uint64_t>::max());
+
+    tracefile_.set_max_simultaneous_allocs(max_live_);
+    return std::move(tracefile_);
+  }
+
+ private:
+  struct LiveObject {
+    uint64_t id;
+    uint32_t thread;
+  };
+
+  uint64_t PhaseLength() const {
+    return std::max<uint64_t>(options_.allocations / options_.phases, 1);
+  }
+
+  uint64_t SampleSize() {
+    const double size = std::round(size_dist_(random_) * size_scale_);
+    return static_cast<uint64_t>(
+        std::clamp(size, static_cast<double>(options_.min_size),
+                   static_cast<double>(options_.max_size)));
+  }
+
+  // Returns the time at which an allocation made at time `t` dies.
+  uint64_t SampleDeath(uint64_t t) {
+    double lifetime = lifetime_dist_(random_);
+    if (t < options_.ramp_allocations) {
+      lifetime *= static_cast<double>(t + 1) / options_.ramp_allocations;
+    }
+    return t + 1 +
+           static_cast<uint64_t>(std::min(
+               lifetime, static_cast<double>(options_.allocations) * 2));
+  }
+
+  uint32_t FreeingThread(const LiveObject& object) {
+    if (options_.consumers == 0) {
+      return object.thread;
+    }
+    return options_.producers +
+           static_cast<uint32_t>(random_.UniformInt(options_.consumers));
+  }
+
+  TraceLine& AddLine(uint32_t thread) {
+    TraceLine& line = *tracefile_.add_lines();
+    if (options_.producers + options_.consumers > 1) {
+      // Thread ids are numbered in order of first appearance.
+      auto [it, _] = thread_ids_.emplace(thread, thread_ids_.size());
+      line.set_thread_id(it->second);
+    }
+    return line;
+  }
+
+  void AddLive(LiveObject object, uint64_t death) {
+    live_index_[object.id] = live_.size();
+    live_.push_back(object);
+    deaths_.push({ death, object.id });
+    max_live_ = std::max<uint64_t>(max_live_, live_.size());
+  }
+
+  LiveObject RemoveLive(uint64_t id) {
+    auto it = live_index_.find(id);
+    const size_t idx = it->second;
+    live_index_.erase(it);
+
+    const LiveObject object = live_[idx];
+    live_[idx] = live_.back();
+    live_.pop_back();
+    if (idx != live_.size()) {
+      live_index_[live_[idx].id] = idx;
+    }
+    return object;
+  }
+
+  void Free(uint64_t id) {
+    const LiveObject object = RemoveLive(id);
+    AddLine(FreeingThread(object)).mutable_free()->set_input_id(id);
+  }
+
+  void FreeDead(uint64_t t) {
+    while (!deaths_.empty() && deaths_.top().first <= t) {
+      const uint64_t id = deaths_.top().second;
+      deaths_.pop();
+      // Reallocated and phase-freed allocations leave stale deaths behind.
+      if (live_index_.contains(id)) {
+        Free(id);
+      }
+    }
+  }
+
+  void Malloc(uint64_t t) {
+    const LiveObject object = {
+      .id = next_id_++,
+      .thread = static_cast<uint32_t>(random_.UniformInt(options_.producers)),
+    };
+    TraceLine::Malloc& malloc = *AddLine(object.thread).mutable_malloc();
+    malloc.set_result_id(object.id);
+    malloc.set_input_size(SampleSize());
+    if (options_.aligned_fraction != 0 &&
+        random_.Uniform() < options_.aligned_fraction) {
+      malloc.set_input_alignment(options_.alignments[random_.UniformInt(
+          options_.alignments.size())]);
+    }
+    AddLive(object, SampleDeath(t));
+  }
+
+  void Realloc(uint64_t t) {
+    const LiveObject old_object =
+        RemoveLive(live_[random_.UniformInt(live_.size())].id);
+    const LiveObject object = { .id = next_id_++,
+                                .thread = old_object.thread };
+    TraceLine::Realloc& realloc = *AddLine(object.thread).mutable_realloc();
+    realloc.set_input_id(old_object.id);
+    realloc.set_result_id(object.id);
+    realloc.set_input_size(SampleSize());
+    AddLive(object, SampleDeath(t));
+  }
+
+  void ChangePhase() {
+    const double log_spread = std::log(options_.phase_size_spread);
+    size_scale_ = std::exp(log_spread * (2 * random_.Uniform() - 1));
+
+    if (options_.phase_turnover != 0) {
+      std::vector<uint64_t> freed;
+      for (const LiveObject& object : live_) {
+        if (random_.Uniform() < options_.phase_turnover) {
+          freed.push_back(object.id);
+        }
+      }
+      for (uint64_t id : freed) {
+        Free(id);
+      }
+    }
+  }
+
+  const GeneratorOptions options_;
+  const Distribution size_dist_;
+  const Distribution lifetime_dist_;
+  Random random_;
+
+  Tracefile tracefile_;
+  uint64_t next_id_ = 0;
+  uint64_t max_live_ = 0;
+  double size_scale_ = 1;
+
+  // The live allocations, in no particular order so a random one can be
+  // chosen, and the index of each in `live_` by id.
+  std::vector<LiveObject> live_;
+  absl::flat_hash_map<uint64_t, size_t> live_index_;
+  // Min-heap of (time of death, id) of live allocations.
+  std::priority_queue<std::pair<uint64_t, uint64_t>,
+                      std::vector<std::pair<uint64_t, uint64_t>>,
+                      std::greater<>>
+      deaths_;
+  absl::flat_hash_map<uint32_t, uint32_t> thread_ids_;
+};
+
+absl::StatusOr<GeneratorOptions> GeneratorOptionsFromFlags() {
+  GeneratorOptions options = {
+    .seed = absl::GetFlag(FLAGS_seed),
+    .allocations = absl::GetFlag(FLAGS_allocations),
+    .min_size = absl::GetFlag(FLAGS_min_size),
+    .max_size = absl::GetFlag(FLAGS_max_size),
+    .realloc_prob = absl::GetFlag(FLAGS_realloc_prob),
+    .aligned_fraction = absl::GetFlag(FLAGS_aligned_fraction),
+    .ramp_allocations = absl::GetFlag(FLAGS_ramp_allocations),
+    .phases = absl::GetFlag(FLAGS_phases),
+    .phase_size_spread = absl::GetFlag(FLAGS_phase_size_spread),
+    .phase_turnover = absl::GetFlag(FLAGS_phase_turnover),
+    .producers = absl::GetFlag(FLAGS_producers),
+    .consumers = absl::GetFlag(FLAGS_consumers),
+  };
+
+  for (const std::string& alignment_str : absl::GetFlag(FLAGS_alignments)) {
+    uint64_t alignment;
+    if (!absl::SimpleAtoi(alignment_str, &alignment) || alignment == 0 ||
+        (alignment & (alignment - 1)) != 0) {
+      return absl::InvalidArgumentError(absl::StrFormat(
+          "Alignment \"%s\" is not a power of two", alignment_str));
+    }
+    options.alignments.push_back(alignment);
+  }
+
+  if (options.min_size > options.max_size) {
+    return absl::InvalidArgumentError(
+        "--min_size must be at most --max_size");
+  }
+  if (options.aligned_fraction != 0 && options.alignments.empty()) {
+    return absl::InvalidArgumentError(
+        "--aligned_fraction requires --alignments");
+  }
+  if (options.phases == 0 || options.producers == 0) {
+    return absl::InvalidArgumentError(
+        "--phases and --producers must be nonzero");
+  }
+  if (options.phase_size_spread < 1) {
+    return absl::InvalidArgumentError("--phase_size_spread must be at least 1");
+  }
+  return options;
+}
+
+absl::Status GenerateTracefile(const std::string& output_path,
+                               const std::string& format) {
+  DEFINE_OR_RETURN(GeneratorOptions, options, GeneratorOptionsFromFlags());
+
+  TraceProfile profile;
+  const std::string& profile_path = absl::GetFlag(FLAGS_profile);
+  if (!profile_path.empty()) {
+    ASSIGN_OR_RETURN(profile, ProfileTracefile(profile_path));
+  }
+
+  DEFINE_OR_RETURN(
+      Distribution, size_dist,
+      MakeDistribution("size", absl::GetFlag(FLAGS_size_dist),
+                       static_cast<double>(options.min_size),
+                       static_cast<double>(options.max_size),
+                       absl::GetFlag(FLAGS_size_median),
+                       absl::GetFlag(FLAGS_size_sigma), &profile.sizes));
+  const double lifetime = absl::GetFlag(FLAGS_lifetime);
+  DEFINE_OR_RETURN(
+      Distribution, lifetime_dist,
+      MakeDistribution("lifetime", absl::GetFlag(FLAGS_lifetime_dist), 0,
+                       2 * lifetime, lifetime,
+                       absl::GetFlag(FLAGS_lifetime_sigma),
+                       &profile.lifetimes));
+
+  Tracefile tracefile =
+      TraceGenerator(options, std::move(size_dist), std::move(lifetime_dist))
+          .Generate();
+  return WriteTracefile(tracefile, output_path, format);
+}
+
+}  // namespace
+
+}  // namespace bench
+
+int main(int argc, char* argv[]) {
+  absl::ParseCommandLine(argc, argv);
+
+  const std::string& output_path = absl::GetFlag(FLAGS_output);
+  if (output_path.empty()) {
+    std::cerr << "Flag --output is required" << std::endl;
+    return -1;
+  }
+
+  absl::Status s =
+      bench::GenerateTracefile(output_path, absl::GetFlag(FLAGS_format));
+  if (!s.ok()) {
+    std::cerr << "Fatal error: " << s << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
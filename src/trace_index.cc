@@ -0,0 +1,193 @@
+#include "src/trace_index.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_format.h"
+#include "util/absl_util.h"
+
+#include "proto/tracefile.pb.h"
+
+namespace bench {
+
+namespace {
+
+absl::Status Allocate(uint64_t id, LiveAllocation allocation, LiveSet& live) {
+  if (!live.insert({ id, allocation }).second) {
+    return absl::FailedPreconditionError(
+        absl::StrFormat("Duplicate result ID %v", id));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status Release(uint64_t id, LiveSet& live) {
+  if (live.erase(id) == 0) {
+    return absl::FailedPreconditionError(
+        absl::StrFormat("Unknown ID being freed: %v", id));
+  }
+  return absl::OkStatus();
+}
+
+void AddCheckpoint(uint64_t op_index, const LiveSet& live,
+                   proto::TraceIndex& index) {
+  std::vector<std::pair<uint64_t, LiveAllocation>> sorted(live.begin(),
+                                                          live.end());
+  std::sort(sorted.begin(), sorted.end(),
+            [](const auto& a, const auto& b) { return a.first < b.first; });
+
+  TraceIndex::Checkpoint& checkpoint = *index.add_checkpoints();
+  checkpoint.set_op_index(op_index);
+  checkpoint.mutable_live()->Reserve(sorted.size());
+  for (const auto& [id, allocation] : sorted) {
+    proto::TraceIndex::LiveAllocation& live_allocation =
+        *checkpoint.add_live();
+    live_allocation.set_id(id);
+    live_allocation.set_size(allocation.size);
+    if (allocation.alignment.has_value()) {
+      live_allocation.set_alignment(allocation.alignment.value());
+    }
+  }
+}
+
+}  // namespace
+
+/* static */
+absl::StatusOr<TraceIndex> TraceIndex::Build(const Tracefile& tracefile,
+                                             uint64_t interval) {
+  if (interval == 0) {
+    return absl::InvalidArgumentError("Trace index interval must be nonzero");
+  }
+
+  proto::TraceIndex index;
+  index.set_num_ops(tracefile.lines_size());
+  index.set_interval(interval);
+
+  LiveSet live;
+  for (int i = 0; i < tracefile.lines_size(); i++) {
+    if (i % interval == 0) {
+      AddCheckpoint(i, live, index);
+    }
+    RETURN_IF_ERROR(Apply(tracefile.lines(i), live));
+  }
+
+  if (!live.empty()) {
+    return absl::FailedPreconditionError(
+        "Not all allocations freed in tracefile");
+  }
+  return TraceIndex(std::move(index));
+}
+
+/* static */
+absl::StatusOr<TraceIndex> TraceIndex::Open(const std::string& filename) {
+  std::ifstream file(filename, std::ios::binary);
+  if (!file.is_open()) {
+    return absl::InternalError(
+        absl::StrFormat("Failed to open file %s", filename));
+  }
+
+  proto::TraceIndex index;
+  if (!index.ParseFromIstream(&file)) {
+    return absl::InternalError(
+        absl::StrFormat("Failed to parse %s as a trace index", filename));
+  }
+  if (index.checkpoints_size() == 0 ||
+      index.checkpoints(0).op_index() != 0) {
+    return absl::InvalidArgumentError(
+        absl::StrFormat("Trace index %s has no checkpoint at op 0", filename));
+  }
+  return TraceIndex(std::move(index));
+}
+
+absl::Status TraceIndex::Write(const std::string& filename) const {
+  std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+  if (!file.is_open() || !index_.SerializeToOstream(&file)) {
+    return absl::InternalError(absl::StrFormat("Failed to write %s", filename));
+  }
+  return absl::OkStatus();
+}
+
+const TraceIndex::Checkpoint& TraceIndex::CheckpointBefore(uint64_t op) const {
+  auto it = std::upper_bound(
+      index_.checkpoints().begin(), index_.checkpoints().end(), op,
+      [](uint64_t op, const Checkpoint& checkpoint) {
+        return op < checkpoint.op_index();
+      });
+  // There is always a checkpoint at op 0.
+  return *std::prev(it);
+}
+
+/* static */
+LiveSet TraceIndex::CheckpointLiveSet(const Checkpoint& checkpoint) {
+  LiveSet live;
+  live.reserve(checkpoint.live_size());
+  for (const auto& allocation : checkpoint.live()) {
+    live.insert({ allocation.id(),
+                  LiveAllocation{
+                      .size = allocation.size(),
+                      .alignment = allocation.has_alignment()
+                                       ? std::optional(allocation.alignment())
+                                       : std::nullopt,
+                  } });
+  }
+  return live;
+}
+
+/* static */
+absl::Status TraceIndex::Apply(const TraceLine& line, LiveSet& live) {
+  switch (line.op_case()) {
+    case TraceLine::kMalloc: {
+      const TraceLine::Malloc& malloc = line.malloc();
+      if (!malloc.has_result_id()) {
+        return absl::OkStatus();
+      }
+      return Allocate(malloc.result_id(),
+                      LiveAllocation{
+                          .size = malloc.input_size(),
+                          .alignment = malloc.has_input_alignment()
+                                           ? std::optional(
+                                                 malloc.input_alignment())
+                                           : std::nullopt,
+                      },
+                      live);
+    }
+    case TraceLine::kCalloc: {
+      const TraceLine::Calloc& calloc = line.calloc();
+      if (!calloc.has_result_id()) {
+        return absl::OkStatus();
+      }
+      return Allocate(
+          calloc.result_id(),
+          LiveAllocation{ .size = calloc.input_nmemb() * calloc.input_size() },
+          live);
+    }
+    case TraceLine::kRealloc: {
+      const TraceLine::Realloc& realloc = line.realloc();
+      if (realloc.has_input_id()) {
+        RETURN_IF_ERROR(Release(realloc.input_id(), live));
+      }
+      return Allocate(realloc.result_id(),
+                      LiveAllocation{ .size = realloc.input_size() }, live);
+    }
+    case TraceLine::kFree: {
+      const TraceLine::Free& free = line.free();
+      if (!free.has_input_id()) {
+        return absl::OkStatus();
+      }
+      return Release(free.input_id(), live);
+    }
+    case TraceLine::OP_NOT_SET: {
+      return absl::FailedPreconditionError("Op not set in tracefile");
+    }
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace bench
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+
+#include "proto/tracefile.pb.h"
+
+namespace bench {
+
+using proto::Tracefile;
+using proto::TraceLine;
+
+struct LiveAllocation {
+  uint64_t size;
+  std::optional<uint64_t> alignment;
+};
+
+// The allocations live at some point in a trace, by id.
+using LiveSet = absl::flat_hash_map<uint64_t, LiveAllocation>;
+
+// Checkpoints of the live set of a trace every `interval` ops, so a window of
+// the trace can be replayed by recreating the live set of the checkpoint
+// preceding it rather than replaying the trace from the beginning.
+class TraceIndex {
+ public:
+  using Checkpoint = proto::TraceIndex::Checkpoint;
+
+  // Builds an index of `tracefile`, which must free every allocation exactly
+  // once, with a checkpoint every `interval` ops starting at op 0.
+  static absl::StatusOr<TraceIndex> Build(const Tracefile& tracefile,
+                                          uint64_t interval);
+
+  static absl::StatusOr<TraceIndex> Open(const std::string& filename);
+
+  absl::Status Write(const std::string& filename) const;
+
+  // The number of ops in the indexed trace.
+  uint64_t NumOps() const {
+    return index_.num_ops();
+  }
+
+  // Returns the last checkpoint at or before `op`.
+  const Checkpoint& CheckpointBefore(uint64_t op) const;
+
+  static LiveSet CheckpointLiveSet(const Checkpoint& checkpoint);
+
+  // Updates `live` to reflect the allocations made and released by `line`.
+  static absl::Status Apply(const TraceLine& line, LiveSet& live);
+
+ private:
+  explicit TraceIndex(proto::TraceIndex&& index) : index_(std::move(index)) {}
+
+  proto::TraceIndex index_;
+};
+
+}  // namespace bench
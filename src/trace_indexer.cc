@@ -0,0 +1,54 @@
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/status/status.h"
+#include "util/absl_util.h"
+
+#include "src/trace_index.h"
+#include "src/tracefile_reader.h"
+
+ABSL_FLAG(std::string, input, "", "File path of the trace to index.");
+
+ABSL_FLAG(std::string, output, "",
+          "File path to write the index to, conventionally the trace's path "
+          "with \".index\" appended.");
+
+ABSL_FLAG(uint64_t, interval, 1000000,
+          "The number of ops between checkpoints. Smaller intervals make "
+          "reaching a window faster at the cost of a larger index.");
+
+namespace bench {
+
+absl::Status IndexTracefile(const std::string& input_path,
+                            const std::string& output_path,
+                            uint64_t interval) {
+  DEFINE_OR_RETURN(TracefileReader, reader, TracefileReader::Open(input_path));
+  DEFINE_OR_RETURN(TraceIndex, index,
+                   TraceIndex::Build(reader.Tracefile(), interval));
+  return index.Write(output_path);
+}
+
+}  // namespace bench
+
+int main(int argc, char* argv[]) {
+  absl::ParseCommandLine(argc, argv);
+
+  const std::string& input_path = absl::GetFlag(FLAGS_input);
+  const std::string& output_path = absl::GetFlag(FLAGS_output);
+  if (input_path.empty() || output_path.empty()) {
+    std::cerr << "Flags --input and --output are required" << std::endl;
+    return -1;
+  }
+
+  absl::Status s = bench::IndexTracefile(input_path, output_path,
+                                         absl::GetFlag(FLAGS_interval));
+  if (!s.ok()) {
+    std::cerr << "Fatal error: " << s << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,210 @@
+#include "src/trace_input_stream.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include "absl/flags/flag.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
+#include "google/protobuf/io/zero_copy_stream.h"
+#include "google/protobuf/io/zero_copy_stream_impl.h"
+#include "util/absl_util.h"
+
+#include "src/gzip_input_stream.h"
+#include "src/zstd_input_stream.h"
+
+ABSL_FLAG(std::string, zstd_dictionary, "",
+          "If set, zstd-compressed traces are decompressed with the "
+          "dictionary in this file, e.g. made by `zstd --train`.");
+
+ABSL_FLAG(uint32_t, decompression_threads, 0,
+          "The number of threads decompressing the independent frames of a "
+          "zstd-compressed trace (e.g. made by pzstd) in parallel, or 0 for "
+          "one per available CPU.");
+
+namespace bench {
+
+namespace {
+
+using google::protobuf::io::FileInputStream;
+
+constexpr uint8_t kGzipMagic[2] = { 0x1f, 0x8b };
+
+// The size of reads from the underlying file, and of the buffer decompressed
+// data is inflated into. Larger than protobuf's defaults to amortize the
+// per-buffer overhead of inflating.
+constexpr int kBufferSize = 1 << 16;
+
+}  // namespace
+
+TraceInputStream::TraceInputStream(TraceInputStream&& other)
+    : filename_(std::move(other.filename_)),
+      fd_(std::exchange(other.fd_, -1)),
+      compression_(other.compression_),
+      file_stream_(std::move(other.file_stream_)),
+      gzip_stream_(std::move(other.gzip_stream_)),
+      mapping_(std::exchange(other.mapping_, nullptr)),
+      mapping_size_(std::exchange(other.mapping_size_, 0)),
+      zstd_dictionary_(std::move(other.zstd_dictionary_)),
+      zstd_stream_(std::move(other.zstd_stream_)) {}
+
+TraceInputStream::~TraceInputStream() {
+  zstd_stream_.reset();
+  gzip_stream_.reset();
+  file_stream_.reset();
+  if (mapping_ != nullptr) {
+    munmap(mapping_, mapping_size_);
+  }
+  if (fd_ != -1) {
+    close(fd_);
+  }
+}
+
+/* static */
+absl::StatusOr<TraceInputStream> TraceInputStream::Open(
+    const std::string& filename) {
+  DEFINE_OR_RETURN(Compression, compression, DetectCompression(filename));
+
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1) {
+    return absl::InternalError(absl::StrFormat("Failed to open file %s: %s",
+                                               filename, strerror(errno)));
+  }
+  TraceInputStream input(filename, fd, compression);
+
+  if (compression == Compression::kZstd) {
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+      return absl::InternalError(
+          absl::StrFormat("Failed to stat %s: %s", filename, strerror(errno)));
+    }
+    if (st.st_size != 0) {
+      void* mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapping == MAP_FAILED) {
+        return absl::InternalError(absl::StrFormat(
+            "Failed to mmap %s: %s", filename, strerror(errno)));
+      }
+      input.mapping_ = mapping;
+      input.mapping_size_ = st.st_size;
+    }
+
+    const std::string dictionary = absl::GetFlag(FLAGS_zstd_dictionary);
+    if (!dictionary.empty()) {
+      ASSIGN_OR_RETURN(input.zstd_dictionary_,
+                       ZstdDictionary::Load(dictionary));
+    }
+  }
+
+  RETURN_IF_ERROR(input.ResetStreams());
+  return input;
+}
+
+/* static */
+absl::StatusOr<TraceInputStream::Compression>
+TraceInputStream::DetectCompression(const std::string& filename) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1) {
+    return absl::InternalError(absl::StrFormat("Failed to open file %s: %s",
+                                               filename, strerror(errno)));
+  }
+  char magic[4];
+  const ssize_t n = read(fd, magic, sizeof(magic));
+  close(fd);
+  if (n == -1) {
+    return absl::InternalError(
+        absl::StrFormat("Failed to read %s: %s", filename, strerror(errno)));
+  }
+
+  if (n >= static_cast<ssize_t>(sizeof(kGzipMagic)) &&
+      memcmp(magic, kGzipMagic, sizeof(kGzipMagic)) == 0) {
+    return Compression::kGzip;
+  }
+  if (IsZstdMagic(absl::string_view(magic, n))) {
+    return Compression::kZstd;
+  }
+  return Compression::kNone;
+}
+
+google::protobuf::io::ZeroCopyInputStream* TraceInputStream::stream() const {
+  switch (compression_) {
+    case Compression::kNone: {
+      return file_stream_.get();
+    }
+    case Compression::kGzip: {
+      return gzip_stream_.get();
+    }
+    case Compression::kZstd: {
+      return zstd_stream_.get();
+    }
+  }
+  return nullptr;
+}
+
+absl::Status TraceInputStream::status() const {
+  if (gzip_stream_ != nullptr) {
+    return gzip_stream_->status();
+  }
+  if (zstd_stream_ != nullptr) {
+    return zstd_stream_->status();
+  }
+  return absl::OkStatus();
+}
+
+absl::Status TraceInputStream::Rewind() {
+  zstd_stream_.reset();
+  gzip_stream_.reset();
+  file_stream_.reset();
+  if (lseek(fd_, 0, SEEK_SET) == -1) {
+    return absl::InternalError(absl::StrFormat("Failed to rewind %s: %s",
+                                               filename_, strerror(errno)));
+  }
+  return ResetStreams();
+}
+
+TraceInputStream::TraceInputStream(std::string filename, int fd,
+                                   Compression compression)
+    : filename_(std::move(filename)), fd_(fd), compression_(compression) {}
+
+absl::Status TraceInputStream::ResetStreams() {
+  switch (compression_) {
+    case Compression::kNone: {
+      file_stream_ = std::make_unique<FileInputStream>(fd_, kBufferSize);
+      break;
+    }
+    case Compression::kGzip: {
+      file_stream_ = std::make_unique<FileInputStream>(fd_, kBufferSize);
+      ASSIGN_OR_RETURN(gzip_stream_, GzipInputStream::Create(
+                                         file_stream_.get(), kBufferSize));
+      break;
+    }
+    case Compression::kZstd: {
+      uint32_t threads = absl::GetFlag(FLAGS_decompression_threads);
+      if (threads == 0) {
+        threads = std::max(std::thread::hardware_concurrency(), 1u);
+      }
+      ASSIGN_OR_RETURN(
+          zstd_stream_,
+          ZstdInputStream::Create(
+              absl::string_view(static_cast<const char*>(mapping_),
+                                mapping_size_),
+              zstd_dictionary_, threads));
+      break;
+    }
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace bench
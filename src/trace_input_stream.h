@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "google/protobuf/io/zero_copy_stream.h"
+#include "google/protobuf/io/zero_copy_stream_impl.h"
+
+#include "src/gzip_input_stream.h"
+#include "src/zstd_input_stream.h"
+
+namespace bench {
+
+// A `ZeroCopyInputStream` over the contents of a tracefile, which is
+// transparently decompressed if it is gzip-compressed (e.g. `*.trace.gz`) or
+// zstd-compressed (e.g. `*.trace.zst`). Compression is detected from the file
+// contents, not its name.
+//
+// zstd-compressed tracefiles are decompressed with the dictionary given by
+// `--zstd_dictionary`, if any, and independent frames are decompressed on
+// `--decompression_threads` threads.
+class TraceInputStream {
+ public:
+  enum class Compression {
+    kNone,
+    kGzip,
+    kZstd,
+  };
+
+  TraceInputStream(TraceInputStream&& other);
+  ~TraceInputStream();
+
+  static absl::StatusOr<TraceInputStream> Open(const std::string& filename);
+
+  // Returns how `filename` is compressed, by its magic bytes.
+  static absl::StatusOr<Compression> DetectCompression(
+      const std::string& filename);
+
+  bool compressed() const {
+    return compression_ != Compression::kNone;
+  }
+
+  // The (decompressed) contents of the file. Invalidated by `Rewind()`.
+  google::protobuf::io::ZeroCopyInputStream* stream() const;
+
+  // The error which ended `stream()` early, if any. Uncompressed files report
+  // no errors here, their streams just end.
+  absl::Status status() const;
+
+  // Restarts reading from the beginning of the file.
+  absl::Status Rewind();
+
+ private:
+  TraceInputStream(std::string filename, int fd, Compression compression);
+
+  absl::Status ResetStreams();
+
+  std::string filename_;
+  int fd_;
+  Compression compression_;
+  std::unique_ptr<google::protobuf::io::FileInputStream> file_stream_;
+  std::unique_ptr<GzipInputStream> gzip_stream_;
+
+  // zstd-compressed files are mapped, so that their frames can be found and
+  // decompressed in parallel.
+  void* mapping_ = nullptr;
+  size_t mapping_size_ = 0;
+  std::shared_ptr<const ZstdDictionary> zstd_dictionary_;
+  std::unique_ptr<ZstdInputStream> zstd_stream_;
+};
+
+}  // namespace bench
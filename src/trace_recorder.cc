@@ -0,0 +1,427 @@
+#include "src/trace_recorder.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <new>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "src/trace_recording.h"
+
+#ifndef __GLIBC__
+#error "The trace recorder forwards to glibc's allocator"
+#endif
+
+// NOLINTBEGIN(bugprone-reserved-identifier, readability-identifier-naming)
+
+// glibc's allocator, which libc_override.cc leaves in place when building the
+// recorder.
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t nmemb, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* ptr);
+}
+
+// NOLINTEND(bugprone-reserved-identifier, readability-identifier-naming)
+
+namespace bench {
+
+namespace {
+
+// The number of ops a thread records before handing its buffer off to be
+// written.
+constexpr size_t kBufferOps = 1 << 14;
+
+// How often the flusher thread writes full buffers to the recording.
+constexpr useconds_t kFlushIntervalUs = 10000;
+
+// The number of caller frames hashed into site ids unless `BENCH_SITE_DEPTH`
+// says otherwise, and the most that may be.
+constexpr int kDefaultSiteDepth = 4;
+constexpr int kMaxSiteDepth = 32;
+
+// The recorder's own frames on top of the stack of an allocating call. They
+// are the same for every call through the same entry point, so hashing them
+// doesn't merge distinct sites.
+constexpr int kRecorderFrames = 3;
+
+// A batch of ops recorded by one thread. Buffers and thread logs are mapped
+// directly rather than allocated, so recording never reenters the allocator.
+struct Buffer {
+  // The next buffer in `g_full_buffers`.
+  Buffer* next = nullptr;
+  // The number of ops recorded, stored with release ordering so a partially
+  // filled buffer can be flushed when the process exits.
+  std::atomic<uint64_t> size = 0;
+  RecordedOp ops[kBufferOps];
+};
+
+// The recording state of a thread, created on its first recorded op. Logs are
+// never freed, so the ops of threads still running at exit can be flushed.
+struct ThreadLog {
+  // The next log in `g_thread_logs`.
+  ThreadLog* next;
+  uint32_t thread_id;
+  // The buffer being filled, or null if recording stopped for lack of memory.
+  std::atomic<Buffer*> buffer;
+};
+
+// Full buffers waiting to be written by the flusher thread, most recently
+// filled first.
+std::atomic<Buffer*> g_full_buffers = nullptr;
+// The logs of every thread which has recorded an op.
+std::atomic<ThreadLog*> g_thread_logs = nullptr;
+std::atomic<uint32_t> g_next_thread_id = 0;
+// Cleared when the process exits, after which ops are no longer recorded.
+std::atomic<bool> g_recording = true;
+std::atomic<bool> g_stop_flusher = false;
+
+// The recording, and the number of ops written to it. Only written by the
+// flusher thread, and by the process exiting after the flusher has stopped.
+int g_fd = -1;
+uint64_t g_num_records = 0;
+
+pthread_t g_flusher;
+bool g_flusher_started = false;
+
+// Initial-exec TLS is allocated with the thread, while the default model may
+// call the allocator on first access.
+thread_local ThreadLog* t_log __attribute__((tls_model("initial-exec"))) =
+    nullptr;
+// Set on the flusher thread, whose allocations aren't the program's, and
+// while unwinding the stack, which may allocate.
+thread_local bool t_untraced __attribute__((tls_model("initial-exec"))) =
+    false;
+
+// The number of caller frames hashed into site ids, or 0 to not record sites.
+int g_site_depth = kDefaultSiteDepth;
+
+uint64_t NowNs() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000 +
+         static_cast<uint64_t>(ts.tv_nsec);
+}
+
+// Returns a nonzero hash of the return addresses of the calling allocator
+// call, or 0 if sites aren't recorded. Not inlined, so the number of the
+// recorder's frames on the stack is fixed.
+__attribute__((noinline)) uint64_t SiteId() {
+  if (g_site_depth == 0) {
+    return 0;
+  }
+  void* frames[kMaxSiteDepth + kRecorderFrames];
+  t_untraced = true;
+  const int depth = backtrace(frames, g_site_depth + kRecorderFrames);
+  t_untraced = false;
+
+  uint64_t hash = 0xcbf29ce484222325;
+  for (int i = 0; i < depth; i++) {
+    hash ^= reinterpret_cast<uintptr_t>(frames[i]);
+    hash *= 0xff51afd7ed558ccd;
+    hash ^= hash >> 32;
+  }
+  return hash == 0 ? 1 : hash;
+}
+
+void* MapPages(size_t size) {
+  void* pages = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  return pages == MAP_FAILED ? nullptr : pages;
+}
+
+Buffer* NewBuffer() {
+  void* pages = MapPages(sizeof(Buffer));
+  return pages == nullptr ? nullptr : new (pages) Buffer;
+}
+
+template <typename T>
+void Push(std::atomic<T*>& list, T* node) {
+  node->next = list.load(std::memory_order_relaxed);
+  while (!list.compare_exchange_weak(node->next, node,
+                                     std::memory_order_release,
+                                     std::memory_order_relaxed)) {
+  }
+}
+
+ThreadLog* CurrentLog() {
+  if (t_log != nullptr) {
+    return t_log;
+  }
+
+  void* pages = MapPages(sizeof(ThreadLog));
+  if (pages == nullptr) {
+    return nullptr;
+  }
+  Buffer* buffer = NewBuffer();
+  if (buffer == nullptr) {
+    munmap(pages, sizeof(ThreadLog));
+    return nullptr;
+  }
+  t_log = new (pages) ThreadLog{
+    .next = nullptr,
+    .thread_id = g_next_thread_id.fetch_add(1, std::memory_order_relaxed),
+    .buffer = buffer,
+  };
+  Push(g_thread_logs, t_log);
+  return t_log;
+}
+
+bool Recording() {
+  return !t_untraced && g_recording.load(std::memory_order_relaxed);
+}
+
+void Record(RecordedOpType op, const void* ptr, uint64_t size, uint64_t arg,
+            uint64_t start_ns, uint64_t end_ns, uint64_t site_id = 0) {
+  ThreadLog* log = CurrentLog();
+  if (log == nullptr) {
+    return;
+  }
+  Buffer* buffer = log->buffer.load(std::memory_order_relaxed);
+  const uint64_t buffer_size = buffer->size.load(std::memory_order_relaxed);
+  buffer->ops[buffer_size] = RecordedOp{
+    .op = op,
+    .reserved = {},
+    .thread_id = log->thread_id,
+    .ptr = reinterpret_cast<uintptr_t>(ptr),
+    .size = size,
+    .arg = arg,
+    .start_ns = start_ns,
+    .end_ns = end_ns,
+    .site_id = site_id,
+  };
+  buffer->size.store(buffer_size + 1, std::memory_order_release);
+
+  if (buffer_size + 1 == kBufferOps) {
+    Buffer* next_buffer = NewBuffer();
+    if (next_buffer == nullptr) {
+      // Stop rather than leave a gap in the middle of the recording.
+      g_recording.store(false, std::memory_order_relaxed);
+    }
+    log->buffer.store(next_buffer, std::memory_order_release);
+    Push(g_full_buffers, buffer);
+  }
+}
+
+void WriteOps(const RecordedOp* ops, uint64_t num_ops) {
+  const char* data = reinterpret_cast<const char*>(ops);
+  size_t remaining = num_ops * sizeof(RecordedOp);
+  while (remaining > 0) {
+    ssize_t written = write(g_fd, data, remaining);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return;
+    }
+    data += written;
+    remaining -= written;
+  }
+  g_num_records += num_ops;
+}
+
+void FlushFullBuffers() {
+  // Reverse the list so each thread's buffers are written in the order they
+  // were filled.
+  Buffer* buffers = nullptr;
+  for (Buffer* buffer =
+           g_full_buffers.exchange(nullptr, std::memory_order_acquire);
+       buffer != nullptr;) {
+    Buffer* next = buffer->next;
+    buffer->next = buffers;
+    buffers = buffer;
+    buffer = next;
+  }
+
+  while (buffers != nullptr) {
+    Buffer* next = buffers->next;
+    WriteOps(buffers->ops, kBufferOps);
+    munmap(buffers, sizeof(Buffer));
+    buffers = next;
+  }
+}
+
+void* FlusherMain(void* /*arg*/) {
+  t_untraced = true;
+  while (!g_stop_flusher.load(std::memory_order_acquire)) {
+    FlushFullBuffers();
+    usleep(kFlushIntervalUs);
+  }
+  FlushFullBuffers();
+  return nullptr;
+}
+
+// Returns false with `errno` set if the header couldn't be written.
+bool WriteHeader() {
+  RecordingHeader header = {};
+  memcpy(header.magic, kRecordingMagic, sizeof(header.magic));
+  header.version = kRecordingVersion;
+  header.record_size = sizeof(RecordedOp);
+  header.num_records = g_num_records;
+  ssize_t written = pwrite(g_fd, &header, sizeof(header), 0);
+  if (written >= 0 && written != sizeof(header)) {
+    errno = EIO;
+  }
+  return written == sizeof(header);
+}
+
+// Opens the recording, expanding "%p" in `BENCH_RECORDING` to the process id
+// so processes sharing the environment don't overwrite each other's.
+int OpenRecording() {
+  const char* pattern = getenv("BENCH_RECORDING");
+  if (pattern == nullptr) {
+    pattern = "malloc-%p.rec";
+  }
+
+  char path[4096];
+  size_t len = 0;
+  for (const char* c = pattern; *c != '\0' && len < sizeof(path) - 1; c++) {
+    if (c[0] == '%' && c[1] == 'p') {
+      int n = snprintf(path + len, sizeof(path) - len, "%d", getpid());
+      len = std::min(len + n, sizeof(path) - 1);
+      c++;
+    } else {
+      path[len++] = *c;
+    }
+  }
+  path[len] = '\0';
+
+  return open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+}
+
+void StopRecordingInChild() {
+  // The flusher thread doesn't survive fork, and the child would interleave
+  // its ops with the parent's in the same file.
+  g_recording.store(false, std::memory_order_relaxed);
+  g_fd = -1;
+}
+
+__attribute__((constructor)) void StartRecording() {
+  const char* site_depth = getenv("BENCH_SITE_DEPTH");
+  if (site_depth != nullptr) {
+    g_site_depth = std::clamp(atoi(site_depth), 0, kMaxSiteDepth);
+  }
+  // The first unwind loads the unwinder, which allocates. Ops made before
+  // this runs get their sites from unwinding with the default depth.
+  SiteId();
+
+  // Ops made before this runs are buffered, and written once the flusher
+  // starts.
+  g_fd = OpenRecording();
+  if (g_fd < 0) {
+    g_recording.store(false, std::memory_order_relaxed);
+    fprintf(stderr, "Failed to open trace recording: %s\n", strerror(errno));
+    return;
+  }
+  // Ops are appended after the header, which is rewritten at exit.
+  if (!WriteHeader()) {
+    g_recording.store(false, std::memory_order_relaxed);
+    fprintf(stderr, "Failed to write trace recording header: %s\n",
+            strerror(errno));
+    close(g_fd);
+    g_fd = -1;
+    return;
+  }
+  lseek(g_fd, sizeof(RecordingHeader), SEEK_SET);
+  pthread_atfork(nullptr, nullptr, &StopRecordingInChild);
+  g_flusher_started =
+      pthread_create(&g_flusher, nullptr, &FlusherMain, nullptr) == 0;
+}
+
+__attribute__((destructor)) void StopRecording() {
+  if (g_fd < 0) {
+    return;
+  }
+  g_recording.store(false, std::memory_order_relaxed);
+  if (g_flusher_started) {
+    g_stop_flusher.store(true, std::memory_order_release);
+    pthread_join(g_flusher, nullptr);
+  }
+  FlushFullBuffers();
+
+  for (ThreadLog* log = g_thread_logs.load(std::memory_order_acquire);
+       log != nullptr; log = log->next) {
+    Buffer* buffer = log->buffer.load(std::memory_order_acquire);
+    if (buffer != nullptr) {
+      WriteOps(buffer->ops, buffer->size.load(std::memory_order_acquire));
+    }
+  }
+
+  // Now that the number of records is known.
+  if (!WriteHeader()) {
+    fprintf(stderr, "Failed to write trace recording header: %s\n",
+            strerror(errno));
+  }
+  close(g_fd);
+  g_fd = -1;
+}
+
+}  // namespace
+
+void* malloc(size_t size, size_t alignment) {
+  void* result = alignment == 0 ? __libc_malloc(size)
+                                : __libc_memalign(alignment, size);
+  if (result != nullptr && Recording()) {
+    const uint64_t now = NowNs();
+    Record(RecordedOpType::kMalloc, result, size, alignment, now, now,
+           SiteId());
+  }
+  return result;
+}
+
+void* calloc(size_t nmemb, size_t size) {
+  void* result = __libc_calloc(nmemb, size);
+  if (result != nullptr && Recording()) {
+    const uint64_t now = NowNs();
+    Record(RecordedOpType::kCalloc, result, size, nmemb, now, now, SiteId());
+  }
+  return result;
+}
+
+void* realloc(void* ptr, size_t size) {
+  if (!Recording()) {
+    return __libc_realloc(ptr, size);
+  }
+
+  const uint64_t start_ns = NowNs();
+  void* result = __libc_realloc(ptr, size);
+  if (result != nullptr) {
+    const uint64_t end_ns = NowNs();
+    Record(RecordedOpType::kRealloc, result, size,
+           reinterpret_cast<uintptr_t>(ptr), start_ns, end_ns, SiteId());
+  } else if (ptr != nullptr && size == 0) {
+    // glibc frees `ptr` when reallocing it to size 0.
+    Record(RecordedOpType::kFree, ptr, 0, 0, start_ns, start_ns);
+  }
+  return result;
+}
+
+void free(void* ptr, size_t size, size_t alignment) {
+  if (ptr != nullptr && Recording()) {
+    const uint64_t now = NowNs();
+    Record(RecordedOpType::kFree, ptr, size, alignment, now, now);
+  }
+  __libc_free(ptr);
+}
+
+size_t get_size(void* ptr) {
+  // malloc_usable_size is overridden by libc_override.cc.
+  static auto* const usable_size = reinterpret_cast<size_t (*)(void*)>(
+      dlsym(RTLD_NEXT, "malloc_usable_size"));
+  return usable_size(ptr);
+}
+
+}  // namespace bench
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+
+namespace bench {
+
+// The allocator of the trace recorder, librecorder.so, which is built from
+// libc_override.cc in place of allocator_interface.h. Every call is forwarded
+// to the system allocator and recorded to the file named by the environment
+// variable `BENCH_RECORDING`, or "malloc-<pid>.rec" if unset. See
+// trace_recording.h for the format.
+//
+// Allocations are tagged with a site id hashed from the innermost
+// `BENCH_SITE_DEPTH` (default 4) frames of the caller's stack. Unwinding is
+// slow, so `BENCH_SITE_DEPTH=0` may be set to skip it.
+
+void* malloc(size_t size, size_t alignment = 0);
+
+void* calloc(size_t nmemb, size_t size);
+
+void* realloc(void* ptr, size_t size);
+
+void free(void* ptr, size_t size = 0, size_t alignment = 0);
+
+size_t get_size(void* ptr);
+
+}  // namespace bench
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+
+namespace bench {
+
+// The format of recordings made by the trace recorder (librecorder.so): a
+// `RecordingHeader` followed by `RecordedOp`s. Each thread's ops appear in the
+// order it made them, but threads' ops are interleaved in batches, so
+// recordings must be ordered by time and have their pointers replaced by ids
+// to become a trace, which `tracefile_parser --recording` does.
+//
+// The layout mirrors the binary trace format (see binary_trace.h), but this
+// header is kept free of dependencies for the recorder, which is preloaded
+// into arbitrary programs.
+
+constexpr char kRecordingMagic[8] = { 'B', 'E', 'N', 'C',
+                                      'H', 'R', 'E', 'C' };
+constexpr uint32_t kRecordingVersion = 2;
+
+struct RecordingHeader {
+  char magic[8];
+  uint32_t version;
+  // `sizeof(RecordedOp)`, to catch layout mismatches.
+  uint32_t record_size;
+  // The number of ops, written when the recorded process exits.
+  uint64_t num_records;
+  uint64_t reserved[5];
+};
+static_assert(sizeof(RecordingHeader) == 64);
+
+enum class RecordedOpType : uint8_t {
+  kMalloc = 1,
+  kCalloc = 2,
+  kRealloc = 3,
+  kFree = 4,
+};
+
+// One allocator call, with pointers as passed to and returned by the
+// allocator. Absent arguments are 0:
+//
+// | op      | ptr    | size         | arg               |
+// |---------|--------|--------------|-------------------|
+// | malloc  | result | size         | alignment         |
+// | calloc  | result | element size | number of members |
+// | realloc | result | size         | input pointer     |
+// | free    | input  | size hint    | alignment hint    |
+//
+// The allocator may release the input pointer of a call as soon as the call
+// starts, and another thread may obtain a pointer as soon as it is released,
+// so ops are ordered by when they release their input pointer (`start_ns`)
+// and when they obtain their result (`end_ns`) separately. Frees are timed
+// before the call and allocations after it, so only a realloc has two
+// different times.
+//
+// Allocating ops carry the id of their call site, a hash of the return
+// addresses on the stack, which is 0 for frees or if stacks aren't recorded.
+struct RecordedOp {
+  RecordedOpType op;
+  uint8_t reserved[3];
+  // Assigned densely from 0 in the order threads first call the allocator.
+  uint32_t thread_id;
+  uint64_t ptr;
+  uint64_t size;
+  uint64_t arg;
+  // CLOCK_MONOTONIC times, in nanoseconds.
+  uint64_t start_ns;
+  uint64_t end_ns;
+  uint64_t site_id;
+};
+static_assert(sizeof(RecordedOp) == 56);
+
+}  // namespace bench
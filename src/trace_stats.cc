@@ -0,0 +1,508 @@
+#include "src/trace_stats.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/container/btree_map.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/str_join.h"
+#include "util/absl_util.h"
+
+#include "proto/tracefile.pb.h"
+
+namespace bench {
+
+namespace {
+
+using proto::Tracefile;
+using proto::TraceLine;
+
+// Counts of values in power-of-two buckets: bucket 0 holds 0, and bucket `b`
+// holds `[2^(b-1), 2^b)`.
+class Log2Histogram {
+ public:
+  void Add(uint64_t value) {
+    buckets_[std::bit_width(value)]++;
+  }
+
+  void Merge(const Log2Histogram& other) {
+    for (size_t i = 0; i < buckets_.size(); i++) {
+      buckets_[i] += other.buckets_[i];
+    }
+  }
+
+  // Formats the nonempty buckets as a JSON array.
+  std::string ToJson(const std::string& unit) const {
+    std::vector<std::string> entries;
+    for (size_t b = 0; b < buckets_.size(); b++) {
+      if (buckets_[b] == 0) {
+        continue;
+      }
+      const uint64_t min = b == 0 ? 0 : uint64_t{ 1 } << (b - 1);
+      const uint64_t max = b == 0 ? 0 : min + (min - 1);
+      entries.push_back(absl::StrFormat(
+          R"({"min_%s": %u, "max_%s": %u, "count": %u})", unit, min, unit, max,
+          buckets_[b]));
+    }
+    return absl::StrCat("[", absl::StrJoin(entries, ", "), "]");
+  }
+
+ private:
+  std::array<uint64_t, 65> buckets_ = {};
+};
+
+template <typename Map>
+void MergeCounts(Map& counts, const Map& other) {
+  for (const auto& [key, count] : other) {
+    counts[key] += count;
+  }
+}
+
+template <typename Map>
+std::string CountsToJson(const Map& counts, const std::string& key_name) {
+  std::vector<std::string> entries;
+  for (const auto& [key, count] : counts) {
+    entries.push_back(
+        absl::StrFormat(R"({"%s": %u, "count": %u})", key_name, key, count));
+  }
+  return absl::StrCat("[", absl::StrJoin(entries, ", "), "]");
+}
+
+struct AllocInfo {
+  // The op which made the allocation.
+  uint64_t op;
+  uint64_t size;
+  // The number of reallocs leading to this allocation. If `chain_base` is
+  // set, this is relative to the chain length of `chain_base`, an allocation
+  // from an earlier chunk which was realloc-ed, plus one.
+  uint64_t chain;
+  std::optional<uint64_t> chain_base;
+};
+
+// A release of an allocation made in an earlier chunk, which can only be
+// resolved once earlier chunks have been merged.
+struct ExternalRelease {
+  uint64_t id;
+  uint64_t op;
+  bool realloc;
+  // The peak of the chunk's `live_bytes` and `live_objects` since the previous
+  // external release, before this one.
+  int64_t peak_live_bytes;
+  int64_t peak_live_objects;
+};
+
+// The statistics of one contiguous chunk of the trace, computed independently
+// of the other chunks.
+struct TraceStats {
+  uint64_t mallocs = 0;
+  uint64_t callocs = 0;
+  uint64_t reallocs = 0;
+  uint64_t frees = 0;
+  // Frees of non-null pointers, and how many of those have a size hint.
+  uint64_t nonnull_frees = 0;
+  uint64_t sized_frees = 0;
+  uint64_t unaligned_mallocs = 0;
+  absl::btree_map<uint64_t, uint64_t> alignments;
+
+  Log2Histogram sizes;
+  absl::flat_hash_map<uint64_t, uint64_t> size_counts;
+  Log2Histogram lifetimes;
+  // Counts of realloc chains by the number of reallocs in them, counted when
+  // the last allocation of the chain is freed.
+  absl::btree_map<uint64_t, uint64_t> chain_lengths;
+
+  // Changes in the live bytes and objects over each timeline interval.
+  std::vector<int64_t> live_bytes_delta;
+  std::vector<int64_t> live_objects_delta;
+
+  // The live bytes and objects at the end of the chunk, and their peak. Within
+  // a chunk, these only count allocations and releases made in the chunk, and
+  // the peak is only since the last external release, whose size is unknown
+  // until the merge.
+  int64_t live_bytes = 0;
+  int64_t live_objects = 0;
+  int64_t peak_live_bytes = 0;
+  int64_t peak_live_objects = 0;
+
+  // Allocations still live at the end of the chunk.
+  absl::flat_hash_map<uint64_t, AllocInfo> open;
+  std::vector<ExternalRelease> external_releases;
+  // Chains ended in this chunk whose base is from an earlier chunk, as
+  // `(chain_base, relative chain length)`.
+  std::vector<std::pair<uint64_t, uint64_t>> pending_chain_ends;
+};
+
+class ChunkScanner {
+ public:
+  ChunkScanner(uint64_t interval, size_t num_intervals, TraceStats& stats)
+      : interval_(interval), stats_(stats) {
+    stats_.live_bytes_delta.resize(num_intervals);
+    stats_.live_objects_delta.resize(num_intervals);
+  }
+
+  absl::Status Scan(const Tracefile& tracefile, uint64_t begin, uint64_t end) {
+    for (uint64_t op = begin; op < end; op++) {
+      RETURN_IF_ERROR(ScanLine(tracefile.lines(op), op));
+    }
+    return absl::OkStatus();
+  }
+
+ private:
+  absl::Status ScanLine(const TraceLine& line, uint64_t op) {
+    switch (line.op_case()) {
+      case TraceLine::kMalloc: {
+        const TraceLine::Malloc& malloc = line.malloc();
+        stats_.mallocs++;
+        if (malloc.has_input_alignment()) {
+          stats_.alignments[malloc.input_alignment()]++;
+        } else {
+          stats_.unaligned_mallocs++;
+        }
+        if (!malloc.has_result_id()) {
+          return absl::OkStatus();
+        }
+        return Allocate(malloc.result_id(),
+                        { .op = op, .size = malloc.input_size(), .chain = 0 });
+      }
+      case TraceLine::kCalloc: {
+        const TraceLine::Calloc& calloc = line.calloc();
+        stats_.callocs++;
+        if (!calloc.has_result_id()) {
+          return absl::OkStatus();
+        }
+        return Allocate(
+            calloc.result_id(),
+            { .op = op,
+              .size = calloc.input_nmemb() * calloc.input_size(),
+              .chain = 0 });
+      }
+      case TraceLine::kRealloc: {
+        const TraceLine::Realloc& realloc = line.realloc();
+        stats_.reallocs++;
+        AllocInfo info = { .op = op, .size = realloc.input_size(), .chain = 0 };
+        if (realloc.has_input_id()) {
+          std::optional<AllocInfo> input =
+              Release(realloc.input_id(), op, /*realloc=*/true);
+          if (input.has_value()) {
+            info.chain = input->chain + 1;
+            info.chain_base = input->chain_base;
+          } else {
+            info.chain_base = realloc.input_id();
+          }
+        }
+        return Allocate(realloc.result_id(), info);
+      }
+      case TraceLine::kFree: {
+        const TraceLine::Free& free = line.free();
+        stats_.frees++;
+        if (!free.has_input_id()) {
+          return absl::OkStatus();
+        }
+        stats_.nonnull_frees++;
+        if (free.has_input_size_hint()) {
+          stats_.sized_frees++;
+        }
+
+        std::optional<AllocInfo> input =
+            Release(free.input_id(), op, /*realloc=*/false);
+        if (input.has_value()) {
+          if (input->chain_base.has_value()) {
+            stats_.pending_chain_ends.emplace_back(input->chain_base.value(),
+                                                   input->chain);
+          } else {
+            stats_.chain_lengths[input->chain]++;
+          }
+        }
+        return absl::OkStatus();
+      }
+      case TraceLine::OP_NOT_SET: {
+        return absl::FailedPreconditionError("Op not set in tracefile");
+      }
+    }
+    return absl::OkStatus();
+  }
+
+  absl::Status Allocate(uint64_t id, const AllocInfo& info) {
+    if (!stats_.open.insert({ id, info }).second) {
+      return absl::FailedPreconditionError(
+          absl::StrFormat("Duplicate result ID %v", id));
+    }
+    stats_.sizes.Add(info.size);
+    stats_.size_counts[info.size]++;
+    stats_.live_bytes_delta[info.op / interval_] += info.size;
+    stats_.live_objects_delta[info.op / interval_]++;
+    stats_.live_bytes += info.size;
+    stats_.live_objects++;
+    stats_.peak_live_bytes =
+        std::max(stats_.peak_live_bytes, stats_.live_bytes);
+    stats_.peak_live_objects =
+        std::max(stats_.peak_live_objects, stats_.live_objects);
+    return absl::OkStatus();
+  }
+
+  // Returns the released allocation if it was made in this chunk.
+  std::optional<AllocInfo> Release(uint64_t id, uint64_t op, bool realloc) {
+    auto it = stats_.open.find(id);
+    if (it == stats_.open.end()) {
+      stats_.external_releases.push_back(
+          { .id = id,
+            .op = op,
+            .realloc = realloc,
+            .peak_live_bytes = stats_.peak_live_bytes,
+            .peak_live_objects = stats_.peak_live_objects });
+      stats_.peak_live_bytes = stats_.live_bytes;
+      stats_.peak_live_objects = stats_.live_objects;
+      return std::nullopt;
+    }
+
+    AllocInfo info = it->second;
+    stats_.open.erase(it);
+    stats_.lifetimes.Add(op - info.op);
+    stats_.live_bytes_delta[op / interval_] -= info.size;
+    stats_.live_objects_delta[op / interval_]--;
+    stats_.live_bytes -= info.size;
+    stats_.live_objects--;
+    return info;
+  }
+
+  const uint64_t interval_;
+  TraceStats& stats_;
+};
+
+// Folds the statistics of the next chunk into `total`, resolving releases and
+// realloc chains which span chunks against `total.open`.
+absl::Status MergeChunk(TraceStats& chunk, uint64_t interval,
+                        TraceStats& total) {
+  // The chain lengths of allocations from earlier chunks realloc-ed in this
+  // chunk.
+  absl::flat_hash_map<uint64_t, uint64_t> base_chains;
+  // The live bytes and objects of earlier chunks released so far in this
+  // chunk.
+  int64_t released_bytes = 0;
+  int64_t released_objects = 0;
+  for (const ExternalRelease& release : chunk.external_releases) {
+    total.peak_live_bytes =
+        std::max(total.peak_live_bytes,
+                 total.live_bytes + release.peak_live_bytes - released_bytes);
+    total.peak_live_objects = std::max(
+        total.peak_live_objects,
+        total.live_objects + release.peak_live_objects - released_objects);
+
+    auto it = total.open.find(release.id);
+    if (it == total.open.end()) {
+      return absl::FailedPreconditionError(
+          absl::StrFormat("Unknown ID being freed: %v", release.id));
+    }
+    const AllocInfo info = it->second;
+    total.open.erase(it);
+
+    total.lifetimes.Add(release.op - info.op);
+    total.live_bytes_delta[release.op / interval] -= info.size;
+    total.live_objects_delta[release.op / interval]--;
+    released_bytes += info.size;
+    released_objects++;
+    if (release.realloc) {
+      base_chains[release.id] = info.chain;
+    } else {
+      total.chain_lengths[info.chain]++;
+    }
+  }
+
+  total.peak_live_bytes =
+      std::max(total.peak_live_bytes,
+               total.live_bytes + chunk.peak_live_bytes - released_bytes);
+  total.peak_live_objects =
+      std::max(total.peak_live_objects,
+               total.live_objects + chunk.peak_live_objects - released_objects);
+  total.live_bytes += chunk.live_bytes - released_bytes;
+  total.live_objects += chunk.live_objects - released_objects;
+
+  for (const auto& [base, chain] : chunk.pending_chain_ends) {
+    total.chain_lengths[base_chains[base] + 1 + chain]++;
+  }
+  for (auto& [id, info] : chunk.open) {
+    if (info.chain_base.has_value()) {
+      info.chain += base_chains[info.chain_base.value()] + 1;
+      info.chain_base = std::nullopt;
+    }
+    if (!total.open.insert({ id, info }).second) {
+      return absl::FailedPreconditionError(
+          absl::StrFormat("Duplicate result ID %v", id));
+    }
+  }
+
+  total.mallocs += chunk.mallocs;
+  total.callocs += chunk.callocs;
+  total.reallocs += chunk.reallocs;
+  total.frees += chunk.frees;
+  total.nonnull_frees += chunk.nonnull_frees;
+  total.sized_frees += chunk.sized_frees;
+  total.unaligned_mallocs += chunk.unaligned_mallocs;
+  MergeCounts(total.alignments, chunk.alignments);
+  total.sizes.Merge(chunk.sizes);
+  MergeCounts(total.size_counts, chunk.size_counts);
+  total.lifetimes.Merge(chunk.lifetimes);
+  MergeCounts(total.chain_lengths, chunk.chain_lengths);
+  for (size_t i = 0; i < total.live_bytes_delta.size(); i++) {
+    total.live_bytes_delta[i] += chunk.live_bytes_delta[i];
+    total.live_objects_delta[i] += chunk.live_objects_delta[i];
+  }
+  return absl::OkStatus();
+}
+
+// Quotes `str` as a JSON string.
+std::string JsonString(const std::string& str) {
+  std::string quoted = "\"";
+  for (const char c : str) {
+    switch (c) {
+      case '"':
+        quoted += "\\\"";
+        break;
+      case '\\':
+        quoted += "\\\\";
+        break;
+      case '\n':
+        quoted += "\\n";
+        break;
+      case '\t':
+        quoted += "\\t";
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          absl::StrAppendFormat(&quoted, "\\u%04x",
+                                static_cast<unsigned char>(c));
+        } else {
+          quoted += c;
+        }
+    }
+  }
+  quoted += '"';
+  return quoted;
+}
+
+std::string StatsToJson(const std::string& trace, uint64_t num_ops,
+                        uint64_t interval, uint64_t max_top_sizes,
+                        const TraceStats& stats) {
+  std::vector<std::pair<uint64_t, uint64_t>> top_sizes(
+      stats.size_counts.begin(), stats.size_counts.end());
+  std::sort(top_sizes.begin(), top_sizes.end(),
+            [](const auto& a, const auto& b) {
+              return a.second != b.second ? a.second > b.second
+                                          : a.first < b.first;
+            });
+  top_sizes.resize(
+      std::min<size_t>(top_sizes.size(), max_top_sizes));
+
+  std::vector<int64_t> live_bytes;
+  std::vector<int64_t> live_objects;
+  int64_t bytes = 0;
+  int64_t objects = 0;
+  for (size_t i = 0; i < stats.live_bytes_delta.size(); i++) {
+    bytes += stats.live_bytes_delta[i];
+    objects += stats.live_objects_delta[i];
+    live_bytes.push_back(bytes);
+    live_objects.push_back(objects);
+  }
+
+  std::string json = "{\n";
+  absl::StrAppend(&json, "  \"trace\": ", JsonString(trace), ",\n");
+  absl::StrAppendFormat(&json,
+                        "  \"ops\": {\"total\": %u, \"malloc\": %u, "
+                        "\"calloc\": %u, \"realloc\": %u, \"free\": %u},\n",
+                        num_ops, stats.mallocs, stats.callocs, stats.reallocs,
+                        stats.frees);
+  absl::StrAppend(&json, "  \"size_histogram\": ", stats.sizes.ToJson("size"),
+                  ",\n");
+  absl::StrAppend(&json, "  \"top_sizes\": ", CountsToJson(top_sizes, "size"),
+                  ",\n");
+  absl::StrAppend(&json, "  \"lifetime_histogram\": ",
+                  stats.lifetimes.ToJson("ops"), ",\n");
+  absl::StrAppendFormat(&json, "  \"unfreed\": %u,\n", stats.open.size());
+  absl::StrAppendFormat(
+      &json,
+      "  \"live_timeline\": {\"interval_ops\": %u, \"bytes\": [%s], "
+      "\"objects\": [%s]},\n",
+      interval, absl::StrJoin(live_bytes, ", "),
+      absl::StrJoin(live_objects, ", "));
+  absl::StrAppendFormat(&json,
+                        "  \"peak_live_bytes\": %d,\n"
+                        "  \"peak_live_objects\": %d,\n",
+                        stats.peak_live_bytes, stats.peak_live_objects);
+  absl::StrAppend(&json, "  \"realloc_chain_lengths\": ",
+                  CountsToJson(stats.chain_lengths, "reallocs"), ",\n");
+  absl::StrAppendFormat(&json, "  \"unaligned_mallocs\": %u,\n",
+                        stats.unaligned_mallocs);
+  absl::StrAppend(&json, "  \"alignments\": ",
+                  CountsToJson(stats.alignments, "alignment"), ",\n");
+  absl::StrAppendFormat(
+      &json,
+      "  \"frees\": {\"nonnull\": %u, \"with_size_hint\": %u, "
+      "\"sized_fraction\": %.4f}\n",
+      stats.nonnull_frees, stats.sized_frees,
+      stats.nonnull_frees == 0
+          ? 0.
+          : static_cast<double>(stats.sized_frees) / stats.nonnull_frees);
+  json += "}\n";
+  return json;
+}
+
+}  // namespace
+
+absl::StatusOr<std::string> TraceStatsJson(const proto::Tracefile& tracefile,
+                                           const std::string& trace,
+                                           uint32_t threads,
+                                           uint64_t timeline_points,
+                                           uint64_t top_sizes) {
+  const uint64_t num_ops = tracefile.lines_size();
+
+  const uint64_t interval = std::max<uint64_t>(
+      (num_ops + timeline_points - 1) / std::max<uint64_t>(timeline_points, 1),
+      1);
+  const size_t num_intervals = (num_ops + interval - 1) / interval;
+
+  const uint32_t n_threads =
+      std::max<uint64_t>(std::min<uint64_t>(threads, num_ops), 1);
+
+  // Each thread scans a contiguous chunk independently. Only allocations
+  // crossing chunk boundaries are left to be matched up in the merge.
+  std::vector<TraceStats> chunks(n_threads);
+  std::vector<absl::Status> statuses(n_threads);
+  std::vector<std::thread> scan_threads;
+  for (uint32_t i = 0; i < n_threads; i++) {
+    scan_threads.emplace_back([&, i]() {
+      ChunkScanner scanner(interval, num_intervals, chunks[i]);
+      statuses[i] = scanner.Scan(tracefile, num_ops * i / n_threads,
+                                 num_ops * (i + 1) / n_threads);
+    });
+  }
+  for (std::thread& thread : scan_threads) {
+    thread.join();
+  }
+  for (const absl::Status& status : statuses) {
+    RETURN_IF_ERROR(status);
+  }
+
+  TraceStats total;
+  total.live_bytes_delta.resize(num_intervals);
+  total.live_objects_delta.resize(num_intervals);
+  for (TraceStats& chunk : chunks) {
+    RETURN_IF_ERROR(MergeChunk(chunk, interval, total));
+    chunk = TraceStats();
+  }
+
+  return StatsToJson(trace, num_ops, interval, top_sizes, total);
+}
+
+}  // namespace bench
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "absl/status/statusor.h"
+
+#include "proto/tracefile.pb.h"
+
+namespace bench {
+
+// Summarizes `tracefile` as a JSON object: op counts, size and lifetime
+// histograms, the `top_sizes` most requested sizes, live bytes and objects at
+// `timeline_points` points through the trace and at their peak, realloc chain
+// lengths, alignments, and sized frees. `trace` is recorded as the name of the
+// trace.
+//
+// The trace is scanned in `threads` contiguous chunks in parallel, and the
+// chunks are merged in order, so the result is the same for any `threads`.
+absl::StatusOr<std::string> TraceStatsJson(const proto::Tracefile& tracefile,
+                                           const std::string& trace,
+                                           uint32_t threads,
+                                           uint64_t timeline_points,
+                                           uint64_t top_sizes);
+
+}  // namespace bench
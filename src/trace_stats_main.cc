@@ -0,0 +1,85 @@
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <ostream>
+#include <string>
+#include <thread>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/status/status.h"
+#include "util/absl_util.h"
+
+#include "src/trace_stats.h"
+#include "src/tracefile_reader.h"
+
+ABSL_FLAG(std::string, trace, "",
+          "File path of the trace to analyze, in any format readable by the "
+          "driver.");
+
+ABSL_FLAG(std::string, output, "",
+          "If set, a file to write the statistics to as JSON, rather than "
+          "stdout.");
+
+ABSL_FLAG(uint32_t, threads, 0,
+          "The number of threads scanning the trace in parallel, or 0 for one "
+          "per available CPU.");
+
+ABSL_FLAG(uint64_t, timeline_points, 1000,
+          "The number of samples of live bytes and objects over the course of "
+          "the trace.");
+
+ABSL_FLAG(uint64_t, top_sizes, 64,
+          "The number of most frequently requested sizes to report exactly.");
+
+namespace bench {
+
+absl::Status AnalyzeTracefile(const std::string& path, std::ostream& out) {
+  DEFINE_OR_RETURN(TracefileReader, reader, TracefileReader::Open(path));
+
+  uint32_t threads = absl::GetFlag(FLAGS_threads);
+  if (threads == 0) {
+    threads = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+
+  DEFINE_OR_RETURN(
+      std::string, json,
+      TraceStatsJson(reader.Tracefile(), path, threads,
+                     absl::GetFlag(FLAGS_timeline_points),
+                     absl::GetFlag(FLAGS_top_sizes)));
+  out << json;
+  return absl::OkStatus();
+}
+
+}  // namespace bench
+
+int main(int argc, char* argv[]) {
+  absl::ParseCommandLine(argc, argv);
+
+  const std::string& tracefile = absl::GetFlag(FLAGS_trace);
+  if (tracefile.empty()) {
+    std::cerr << "Flag --trace is required" << std::endl;
+    return -1;
+  }
+
+  absl::Status s;
+  const std::string& output = absl::GetFlag(FLAGS_output);
+  if (output.empty()) {
+    s = bench::AnalyzeTracefile(tracefile, std::cout);
+  } else {
+    std::ofstream out(output);
+    if (!out.is_open()) {
+      std::cerr << "Failed to open " << output << std::endl;
+      return -1;
+    }
+    s = bench::AnalyzeTracefile(tracefile, out);
+  }
+
+  if (!s.ok()) {
+    std::cerr << "Fatal error: " << s << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
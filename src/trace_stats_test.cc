@@ -0,0 +1,102 @@
+#include "src/trace_stats.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "absl/status/statusor.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "util/gtest_util.h"
+
+#include "proto/tracefile.pb.h"
+
+namespace bench {
+
+using proto::Tracefile;
+using proto::TraceLine;
+using ::testing::HasSubstr;
+
+class TestTraceStats : public ::testing::Test {
+ protected:
+  static void AddMalloc(Tracefile& tracefile, uint64_t id, size_t size) {
+    TraceLine* line = tracefile.add_lines();
+    line->mutable_malloc()->set_result_id(id);
+    line->mutable_malloc()->set_input_size(size);
+  }
+
+  static void AddRealloc(Tracefile& tracefile, uint64_t input_id,
+                         uint64_t result_id, size_t size) {
+    TraceLine* line = tracefile.add_lines();
+    line->mutable_realloc()->set_input_id(input_id);
+    line->mutable_realloc()->set_result_id(result_id);
+    line->mutable_realloc()->set_input_size(size);
+  }
+
+  static void AddFree(Tracefile& tracefile, uint64_t id) {
+    TraceLine* line = tracefile.add_lines();
+    line->mutable_free()->set_input_id(id);
+  }
+
+  static absl::StatusOr<std::string> Stats(const Tracefile& tracefile,
+                                           uint32_t threads) {
+    return TraceStatsJson(tracefile, "trace", threads,
+                          /*timeline_points=*/4, /*top_sizes=*/2);
+  }
+};
+
+TEST_F(TestTraceStats, ChunksMergeToSameStats) {
+  // A realloc chain and allocations which cross every split of the trace into
+  // chunks.
+  Tracefile tracefile;
+  AddMalloc(tracefile, /*id=*/1, /*size=*/100);
+  AddMalloc(tracefile, /*id=*/2, /*size=*/50);
+  AddRealloc(tracefile, /*input_id=*/1, /*result_id=*/3, /*size=*/200);
+  AddFree(tracefile, /*id=*/2);
+  AddMalloc(tracefile, /*id=*/4, /*size=*/400);
+  AddRealloc(tracefile, /*input_id=*/3, /*result_id=*/5, /*size=*/300);
+  AddFree(tracefile, /*id=*/4);
+  AddFree(tracefile, /*id=*/5);
+
+  absl::StatusOr<std::string> serial = Stats(tracefile, /*threads=*/1);
+  ASSERT_THAT(serial, util::IsOk());
+  EXPECT_THAT(serial.value(), HasSubstr("\"peak_live_bytes\": 700,"));
+  EXPECT_THAT(serial.value(), HasSubstr("\"peak_live_objects\": 2,"));
+  EXPECT_THAT(serial.value(), HasSubstr("\"unfreed\": 0,"));
+  EXPECT_THAT(serial.value(),
+              HasSubstr("\"realloc_chain_lengths\": [{\"reallocs\": 0, "
+                        "\"count\": 2}, {\"reallocs\": 2, \"count\": 1}],"));
+  EXPECT_THAT(serial.value(),
+              HasSubstr("\"bytes\": [150, 200, 700, 0], "
+                        "\"objects\": [2, 1, 2, 0]"));
+
+  for (uint32_t threads = 2; threads <= 9; threads++) {
+    absl::StatusOr<std::string> parallel = Stats(tracefile, threads);
+    ASSERT_THAT(parallel, util::IsOk());
+    EXPECT_EQ(parallel.value(), serial.value()) << threads << " threads";
+  }
+}
+
+TEST_F(TestTraceStats, RejectsUnknownFree) {
+  Tracefile tracefile;
+  AddMalloc(tracefile, /*id=*/1, /*size=*/16);
+  AddFree(tracefile, /*id=*/2);
+  for (uint32_t threads : { 1, 2 }) {
+    EXPECT_FALSE(Stats(tracefile, threads).ok());
+  }
+}
+
+TEST_F(TestTraceStats, EscapesTraceName) {
+  Tracefile tracefile;
+  AddMalloc(tracefile, /*id=*/1, /*size=*/16);
+  AddFree(tracefile, /*id=*/1);
+
+  absl::StatusOr<std::string> json =
+      TraceStatsJson(tracefile, "dir\\\"quoted\"\n.trace", /*threads=*/1,
+                     /*timeline_points=*/1, /*top_sizes=*/1);
+  ASSERT_THAT(json, util::IsOk());
+  EXPECT_THAT(json.value(),
+              HasSubstr("\"trace\": \"dir\\\\\\\"quoted\\\"\\n.trace\","));
+}
+
+}  // namespace bench
@@ -1,24 +1,40 @@
 #pragma once
 
+#include <algorithm>
 #include <atomic>
 #include <barrier>
 #include <cstddef>
 #include <cstdint>
+#include <memory>
 #include <optional>
 #include <thread>
+#include <vector>
 
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/synchronization/mutex.h"
 #include "absl/time/clock.h"
 #include "absl/time/time.h"
+#include "absl/types/span.h"
 #include "util/absl_util.h"
 
 #include "proto/tracefile.pb.h"
+#include "src/alloc_hint.h"
+#include "src/binary_trace.h"
 #include "src/concurrent_id_map.h"
+#include "src/cpu_affinity.h"
+#include "src/cpu_topology.h"
+#include "src/latency_histogram.h"
 #include "src/local_id_map.h"
+#include "src/perf_counters.h"
 #include "src/perfetto.h"  // IWYU pragma: keep
+#include "src/replay_pacer.h"
+#include "src/spsc_ring.h"
+#include "src/thread_streams.h"
+#include "src/trace_index.h"
 #include "src/tracefile_reader.h"
+#include "src/tracefile_stream_reader.h"
+#include "src/tsc_clock.h"
 
 namespace bench {
 
@@ -39,19 +55,27 @@ struct IdMap {
   }
 };
 
+// The number of ops a thread has completed across all iterations of its stream
+// during per-thread replay. Kept on its own cache line, since it is polled by
+// every thread which depends on it.
+struct alignas(64) ThreadProgress {
+  std::atomic<uint64_t> ops_done = 0;
+};
+
 template <typename T>
 concept TracefileAllocator = requires(T allocator, size_t size, void* ptr,
-                                      std::optional<size_t> alignment) {
+                                      std::optional<size_t> alignment,
+                                      const AllocHint& hint) {
   { allocator.InitializeHeap() } -> std::convertible_to<absl::Status>;
   { allocator.CleanupHeap() } -> std::convertible_to<absl::Status>;
   {
-    allocator.Malloc(size, alignment)
+    allocator.Malloc(size, alignment, hint)
   } -> std::convertible_to<absl::StatusOr<void*>>;
   {
-    allocator.Calloc(size, size)
+    allocator.Calloc(size, size, hint)
   } -> std::convertible_to<absl::StatusOr<void*>>;
   {
-    allocator.Realloc(ptr, size)
+    allocator.Realloc(ptr, size, hint)
   } -> std::convertible_to<absl::StatusOr<void*>>;
   {
     allocator.Free(ptr, alignment, alignment)
@@ -60,6 +84,58 @@ concept TracefileAllocator = requires(T allocator, size_t size, void* ptr,
 
 struct TracefileExecutorOptions {
   uint32_t n_threads = 1;
+  // If true, each thread recorded in the tracefile (see `TraceLine.thread_id`)
+  // replays its own stream of ops on a dedicated worker thread, in recorded
+  // order, and `n_threads` is ignored. Ops consuming an allocation made by
+  // another thread wait for that allocation, so cross-thread frees happen as
+  // they did in the traced program.
+  bool per_thread_replay = false;
+  // If true, each worker thread is paired with a helper thread which prepares
+  // upcoming batches and flushes completed ones, so the worker's core only
+  // runs allocator code and its caches reflect steady-state allocator
+  // behavior. Helpers of pinned workers are kept off of the workers' CPUs,
+  // see `CpuTopology::HelperCpus`.
+  bool pipelined_batches = false;
+  // If set, each worker thread counts perf events over the regions it times,
+  // and adds its counts here.
+  PerfCounterTotals* perf_counters = nullptr;
+  // How worker threads are pinned to CPUs, see `CpuTopology::WorkerCpus`.
+  CpuPlacement placement = CpuPlacement::kNone;
+  // The CPUs to pin workers to with `CpuPlacement::kExplicit`.
+  std::vector<int> cpus;
+  // If either is nonzero, only ops `[start_op, start_op + window_ops)` of the
+  // trace are timed, or through the end of the trace if `window_ops` is 0.
+  // The ops before the window are replayed untimed each repetition, starting
+  // from the closest checkpoint in `trace_index` if given, and allocations
+  // still live after the window are freed untimed. Only supported for a
+  // single, unpinned worker replaying an in-memory trace.
+  uint64_t start_op = 0;
+  uint64_t window_ops = 0;
+  const TraceIndex* trace_index = nullptr;
+  // If set, ops are replayed open loop: each is issued at its recorded time
+  // (see `TraceLine.timestamp_ns`), with the gaps between ops multiplied by
+  // `pace_scale`, instead of as soon as the previous op completes. The latency
+  // of each op from when it was due is added here, see `ReplayPacer`. Only
+  // supported for a single, unpinned worker or per-thread replay of an
+  // in-memory trace, and the returned time includes time spent waiting.
+  LatencyProfile* paced_latency = nullptr;
+  double pace_scale = 1;
+  // If true, each allocation's `TraceLine.lifetime_class` is passed to the
+  // allocator in its `AllocHint`, as an oracle lifetime predictor would.
+  bool lifetime_hints = false;
+
+  bool Windowed() const {
+    return start_op != 0 || window_ops != 0;
+  }
+
+  // The number of ops timed per repetition of a trace of `trace_ops` ops.
+  uint64_t TimedOps(uint64_t trace_ops) const {
+    if (!Windowed() || start_op >= trace_ops) {
+      return trace_ops;
+    }
+    return window_ops == 0 ? trace_ops - start_op
+                           : std::min(window_ops, trace_ops - start_op);
+  }
 };
 
 template <TracefileAllocator Allocator>
@@ -68,6 +144,13 @@ class TracefileExecutor {
   template <typename... Args>
   explicit TracefileExecutor(TracefileReader& reader, Args... args);
 
+  // Replays the tracefile from `reader` one chunk at a time, without ever
+  // holding all of it in memory. Only supports a single, unpinned worker
+  // thread. The trace's ids are used to index the id map directly, so they
+  // should be dense, as produced by the tracefile parser.
+  template <typename... Args>
+  explicit TracefileExecutor(TracefileStreamReader& reader, Args... args);
+
   // hi i am a coder woww i am going to hack into your compouter now with mty
   // computer skills hohohohoho
   absl::StatusOr<absl::Duration> Run(
@@ -86,45 +169,182 @@ class TracefileExecutor {
 
  private:
   uint64_t UniqueId(uint64_t id, uint64_t iteration) {
-    return ConcurrentIdMap::UniqueId(id, iteration, reader_.Tracefile());
+    return ConcurrentIdMap::UniqueId(id, iteration, reader_->Tracefile());
   }
 
-  absl::Status DoMalloc(const TraceLine::Malloc& malloc, IdMap& id_map);
+  absl::Status DoMalloc(const TraceLine::Malloc& malloc, const AllocHint& hint,
+                        IdMap& id_map);
 
-  absl::Status DoCalloc(const TraceLine::Calloc& calloc, IdMap& id_map);
+  absl::Status DoCalloc(const TraceLine::Calloc& calloc, const AllocHint& hint,
+                        IdMap& id_map);
 
-  absl::Status DoRealloc(const TraceLine::Realloc& realloc, IdMap& id_map);
+  absl::Status DoRealloc(const TraceLine::Realloc& realloc,
+                         const AllocHint& hint, IdMap& id_map);
 
   absl::Status DoFree(const TraceLine::Free& free, IdMap& id_map);
 
+  // The maximum number of batches a pipelined worker keeps prepared or in
+  // flight at once.
+  static constexpr size_t kPipelineDepth = 4;
+
+  // The number of lines decoded at a time during streaming replay.
+  static constexpr size_t kStreamChunkLines = 1 << 14;
+  // Streamed and windowed traces index the id map with raw ids, so reject ids
+  // which would make it unreasonably large.
+  static constexpr uint64_t kMaxStreamId = uint64_t{ 1 } << 32;
+
+  using BatchRing =
+      SpscRing<std::unique_ptr<LocalIdMap::BatchContext>, kPipelineDepth>;
+
   absl::StatusOr<absl::Duration> ProcessTracefile(
       uint64_t num_repetitions, const TracefileExecutorOptions& options);
 
+  // Returns the CPU each of `n_workers` workers should be pinned to under
+  // `options.placement`, or an empty list if workers aren't pinned.
+  static absl::StatusOr<std::vector<int>> PlaceWorkers(
+      uint32_t n_workers, const TracefileExecutorOptions& options);
+
+  // Pins the calling thread to worker `worker`'s CPU from `worker_cpus`, if
+  // any.
+  static absl::Status PinWorker(uint32_t worker,
+                                const std::vector<int>& worker_cpus);
+
+  // Returns the CPUs the helper of each worker pinned to `worker_cpus` may run
+  // on with `options.pipelined_batches`, see `CpuTopology::HelperCpus`, or an
+  // empty list if workers aren't pinned or have no helpers.
+  static absl::StatusOr<std::vector<std::vector<int>>> PlaceHelpers(
+      const std::vector<int>& worker_cpus,
+      const TracefileExecutorOptions& options);
+
+  // Runs the worker main loop selected by `options`. With
+  // `options.pipelined_batches`, the worker's helper thread is pinned to
+  // `helper_cpus` if not empty.
+  absl::StatusOr<absl::Duration> RunWorker(
+      std::barrier<>& barrier, std::atomic<uint64_t>& idx,
+      std::atomic<bool>& done, const Tracefile& tracefile,
+      ConcurrentIdMap& global_id_map, uint64_t num_repetitions,
+      const TracefileExecutorOptions& options,
+      const std::vector<int>& helper_cpus);
+
   // Worker thread main loop, returns the total amount of time spend in
   // allocation code (filtering out *most* of the expensive testing
   // infrastructure logic).
-  absl::StatusOr<absl::Duration> ProcessorWorker(std::barrier<>& barrier,
-                                                 std::atomic<uint64_t>& idx,
-                                                 std::atomic<bool>& done,
-                                                 const Tracefile& tracefile,
-                                                 ConcurrentIdMap& global_id_map,
-                                                 uint64_t num_repetitions);
+  absl::StatusOr<absl::Duration> ProcessorWorker(
+      std::barrier<>& barrier, std::atomic<uint64_t>& idx,
+      std::atomic<bool>& done, const Tracefile& tracefile,
+      ConcurrentIdMap& global_id_map, uint64_t num_repetitions,
+      PerfCounterTotals* perf_counters);
+
+  // Replays the trace from `stream_reader_` on the calling thread.
+  absl::StatusOr<absl::Duration> ProcessTraceStream(
+      uint64_t num_repetitions, const TracefileExecutorOptions& options);
+
+  // Replays the records of a binary trace in place on the calling thread,
+  // with `ids` already grown to fit their ids.
+  absl::StatusOr<absl::Duration> ProcessRecords(
+      absl::Span<const BinaryTraceRecord> records, std::vector<void*>& ids,
+      uint64_t num_repetitions, const TracefileExecutorOptions& options);
+
+  // Grows `ids` to fit the ids allocated by `lines`, failing if they are too
+  // large to index directly.
+  template <typename Line>
+  static absl::Status FitIds(absl::Span<const Line> lines,
+                             std::vector<void*>& ids);
+
+  // Replays `chunk` of a streamed or in-place trace `repetitions` times in a
+  // row, adding the time spent in the allocator to `time`. `ids` must fit the
+  // chunk's ids, see `FitIds`. Repeating only makes sense for chunks holding
+  // the whole trace.
+  template <typename Line>
+  absl::Status ReplayChunk(absl::Span<const Line> chunk, uint64_t repetitions,
+                           std::vector<void*>& ids,
+                           WorkerPerfCounters& counters, absl::Duration& time);
+
+  // Replays the window of the trace selected by `options.start_op` and
+  // `options.window_ops` on the calling thread.
+  absl::StatusOr<absl::Duration> ProcessWindow(
+      uint64_t num_repetitions, const TracefileExecutorOptions& options);
+
+  // Replays `tracefile` open loop on the calling thread, see
+  // `TracefileExecutorOptions::paced_latency`.
+  absl::StatusOr<absl::Duration> ProcessPaced(
+      const Tracefile& tracefile, uint64_t num_repetitions,
+      const TracefileExecutorOptions& options);
+
+  // Returns the id allocated by `line`, or 0 if it doesn't allocate.
+  static uint64_t ResultId(const TraceLine& line);
+  static uint64_t ResultId(const BinaryTraceRecord& record);
+
+  // Returns false if `line` has no op.
+  static bool HasOp(const TraceLine& line) {
+    return line.op_case() != TraceLine::OP_NOT_SET;
+  }
+  // `TracefileReader` rejects binary traces with invalid ops.
+  static bool HasOp(const BinaryTraceRecord&) {
+    return true;
+  }
+
+  // Replays each recorded thread's stream of ops on its own worker thread.
+  absl::StatusOr<absl::Duration> ProcessThreadStreams(
+      const Tracefile& tracefile, uint64_t num_repetitions,
+      const TracefileExecutorOptions& options);
+
+  // Worker thread main loop for per-thread replay, returns the total amount of
+  // time spent replaying `thread`'s stream, including time spent waiting on
+  // allocations made by other threads. If `pacer` is set, ops are paced and
+  // their latencies recorded in `paced_latency`.
+  absl::StatusOr<absl::Duration> StreamWorker(
+      std::barrier<>& barrier, std::atomic<bool>& done,
+      const ThreadStreams& streams, uint32_t thread,
+      std::vector<ThreadProgress>& progress, IdMap id_map,
+      uint64_t num_repetitions, PerfCounterTotals* perf_counters,
+      const ReplayPacer* pacer, LatencyProfile* paced_latency);
+
+  // Like `ProcessorWorker`, but batches are prepared and flushed by a helper
+  // thread, leaving only allocator calls to the measuring thread. The helper
+  // is pinned to `helper_cpus` if not empty, since it would otherwise inherit
+  // the affinity of a pinned worker and compete with it for its CPU.
+  absl::StatusOr<absl::Duration> PipelinedProcessorWorker(
+      std::barrier<>& barrier, std::atomic<uint64_t>& idx,
+      std::atomic<bool>& done, const Tracefile& tracefile,
+      ConcurrentIdMap& global_id_map, uint64_t num_repetitions,
+      PerfCounterTotals* perf_counters, const std::vector<int>& helper_cpus);
+
+  // The helper thread main loop for `PipelinedProcessorWorker`. Keeps up to
+  // `kPipelineDepth` batches prepared or in flight, and pushes `nullptr` to
+  // `prepared` once there is no more work for this worker.
+  static absl::Status PipelineHelper(LocalIdMap& local_id_map,
+                                     BatchRing& prepared, BatchRing& finished,
+                                     std::atomic<bool>& done,
+                                     const std::atomic<bool>& stop);
 
   static absl::Status RewriteIdsToUnique(Tracefile& tracefile);
 
   BENCH_ALWAYS_INLINE absl::Status ProcessLine(const TraceLine& line,
                                                IdMap& id_map);
+  BENCH_ALWAYS_INLINE absl::Status ProcessLine(const BinaryTraceRecord& record,
+                                               IdMap& id_map);
 
   Allocator allocator_;
+  // `TracefileExecutorOptions::lifetime_hints` of the current run.
+  bool lifetime_hints_ = false;
 
-  TracefileReader& reader_;
+  // Exactly one of `reader_` and `stream_reader_` is set.
+  TracefileReader* const reader_ = nullptr;
+  TracefileStreamReader* const stream_reader_ = nullptr;
 };
 
 template <TracefileAllocator Allocator>
 template <typename... Args>
 TracefileExecutor<Allocator>::TracefileExecutor(TracefileReader& reader,
                                                 Args... args)
-    : allocator_(std::forward<Args>(args)...), reader_(reader) {}
+    : allocator_(std::forward<Args>(args)...), reader_(&reader) {}
+
+template <TracefileAllocator Allocator>
+template <typename... Args>
+TracefileExecutor<Allocator>::TracefileExecutor(TracefileStreamReader& reader,
+                                                Args... args)
+    : allocator_(std::forward<Args>(args)...), stream_reader_(&reader) {}
 
 template <TracefileAllocator Allocator>
 absl::StatusOr<absl::Duration> TracefileExecutor<Allocator>::Run(
@@ -136,9 +356,12 @@ template <TracefileAllocator Allocator>
 absl::StatusOr<absl::Duration> TracefileExecutor<Allocator>::RunRepeated(
     uint64_t num_repetitions, const TracefileExecutorOptions& options) {
   RETURN_IF_ERROR(allocator_.InitializeHeap());
+  lifetime_hints_ = options.lifetime_hints;
 
   absl::StatusOr<absl::Duration> result =
-      ProcessTracefile(num_repetitions, options);
+      stream_reader_ != nullptr
+          ? ProcessTraceStream(num_repetitions, options)
+          : ProcessTracefile(num_repetitions, options);
 
   RETURN_IF_ERROR(allocator_.CleanupHeap());
   return result;
@@ -146,12 +369,12 @@ absl::StatusOr<absl::Duration> TracefileExecutor<Allocator>::RunRepeated(
 
 template <TracefileAllocator Allocator>
 absl::Status TracefileExecutor<Allocator>::DoMalloc(
-    const TraceLine::Malloc& malloc, IdMap& id_map) {
+    const TraceLine::Malloc& malloc, const AllocHint& hint, IdMap& id_map) {
   std::optional<size_t> alignment =
       malloc.has_input_alignment() ? std::optional(malloc.input_alignment())
                                    : std::nullopt;
   DEFINE_OR_RETURN(void*, ptr,
-                   allocator_.Malloc(malloc.input_size(), alignment));
+                   allocator_.Malloc(malloc.input_size(), alignment, hint));
 
   if (malloc.input_size() != 0 && malloc.has_result_id()) {
     id_map.SetId(malloc.result_id(), ptr);
@@ -162,9 +385,10 @@ absl::Status TracefileExecutor<Allocator>::DoMalloc(
 
 template <TracefileAllocator Allocator>
 absl::Status TracefileExecutor<Allocator>::DoCalloc(
-    const TraceLine::Calloc& calloc, IdMap& id_map) {
+    const TraceLine::Calloc& calloc, const AllocHint& hint, IdMap& id_map) {
   DEFINE_OR_RETURN(
-      void*, ptr, allocator_.Calloc(calloc.input_nmemb(), calloc.input_size()));
+      void*, ptr,
+      allocator_.Calloc(calloc.input_nmemb(), calloc.input_size(), hint));
 
   if (calloc.input_nmemb() != 0 && calloc.input_size() != 0 &&
       calloc.has_result_id()) {
@@ -176,7 +400,7 @@ absl::Status TracefileExecutor<Allocator>::DoCalloc(
 
 template <TracefileAllocator Allocator>
 absl::Status TracefileExecutor<Allocator>::DoRealloc(
-    const TraceLine::Realloc& realloc, IdMap& id_map) {
+    const TraceLine::Realloc& realloc, const AllocHint& hint, IdMap& id_map) {
   void* input_ptr;
   if (realloc.has_input_id()) {
     input_ptr = id_map.GetId(realloc.input_id());
@@ -184,7 +408,7 @@ absl::Status TracefileExecutor<Allocator>::DoRealloc(
     input_ptr = nullptr;
   }
   DEFINE_OR_RETURN(void*, result_ptr,
-                   allocator_.Realloc(input_ptr, realloc.input_size()));
+                   allocator_.Realloc(input_ptr, realloc.input_size(), hint));
   id_map.SetId(realloc.result_id(), result_ptr);
 
   return absl::OkStatus();
@@ -213,9 +437,39 @@ absl::Status TracefileExecutor<Allocator>::DoFree(const TraceLine::Free& free,
 template <TracefileAllocator Allocator>
 absl::StatusOr<absl::Duration> TracefileExecutor<Allocator>::ProcessTracefile(
     uint64_t num_repetitions, const TracefileExecutorOptions& options) {
-  Tracefile tracefile(reader_.Tracefile());
+  if (options.Windowed()) {
+    if (options.paced_latency != nullptr) {
+      return absl::InvalidArgumentError(
+          "Paced replay does not support replaying a window of the trace");
+    }
+    return ProcessWindow(num_repetitions, options);
+  }
+
+  // Binary traces replayed in order by a single worker are read straight from
+  // their mapping, rather than expanded to protos. Traces with sparse ids
+  // take the proto path below, which renumbers them.
+  if (const BinaryTrace* binary_trace = reader_->Binary();
+      binary_trace != nullptr && options.n_threads == 1 &&
+      !options.per_thread_replay && !options.pipelined_batches &&
+      options.placement == CpuPlacement::kNone &&
+      options.paced_latency == nullptr) {
+    std::vector<void*> ids;
+    if (FitIds(binary_trace->Records(), ids).ok()) {
+      return ProcessRecords(binary_trace->Records(), ids, num_repetitions,
+                            options);
+    }
+  }
+
+  Tracefile tracefile(reader_->Tracefile());
   RETURN_IF_ERROR(RewriteIdsToUnique(tracefile));
 
+  if (options.per_thread_replay) {
+    return ProcessThreadStreams(tracefile, num_repetitions, options);
+  }
+  if (options.paced_latency != nullptr) {
+    return ProcessPaced(tracefile, num_repetitions, options);
+  }
+
   absl::Duration max_allocation_time;
   absl::Status status = absl::OkStatus();
   absl::Mutex status_lock;
@@ -224,10 +478,16 @@ absl::StatusOr<absl::Duration> TracefileExecutor<Allocator>::ProcessTracefile(
   std::atomic<bool> done = false;
   std::atomic<uint64_t> idx = 0;
   ConcurrentIdMap global_id_map;
-
-  if (options.n_threads == 1) {
-    return ProcessorWorker(barrier, idx, done, tracefile, global_id_map,
-                           num_repetitions);
+  DEFINE_OR_RETURN(std::vector<int>, worker_cpus,
+                   PlaceWorkers(options.n_threads, options));
+  DEFINE_OR_RETURN(std::vector<std::vector<int>>, helper_cpus,
+                   PlaceHelpers(worker_cpus, options));
+
+  // Pinned workers always get their own thread, so the caller's affinity is
+  // left alone.
+  if (options.n_threads == 1 && worker_cpus.empty()) {
+    return RunWorker(barrier, idx, done, tracefile, global_id_map,
+                     num_repetitions, options, /*helper_cpus=*/{});
   }
 
   std::vector<std::thread> threads;
@@ -235,9 +495,21 @@ absl::StatusOr<absl::Duration> TracefileExecutor<Allocator>::ProcessTracefile(
   for (uint32_t i = 0; i < options.n_threads; i++) {
     threads.emplace_back([this, &max_allocation_time, &status, &status_lock,
                           &barrier, &done, &idx, &tracefile, &global_id_map,
-                          num_repetitions]() {
-      auto result = ProcessorWorker(barrier, idx, done, tracefile,
-                                    global_id_map, num_repetitions);
+                          num_repetitions, &options, &worker_cpus,
+                          &helper_cpus, i]() {
+      static const std::vector<int> kUnpinned;
+      const std::vector<int>& worker_helper_cpus =
+          helper_cpus.empty() ? kUnpinned
+                              : helper_cpus[i % helper_cpus.size()];
+      absl::StatusOr<absl::Duration> result;
+      if (absl::Status pin_status = PinWorker(i, worker_cpus);
+          pin_status.ok()) {
+        result = RunWorker(barrier, idx, done, tracefile, global_id_map,
+                           num_repetitions, options, worker_helper_cpus);
+      } else {
+        barrier.arrive_and_drop();
+        result = pin_status;
+      }
 
       if (result.ok()) {
         absl::MutexLock lock(&status_lock);
@@ -264,12 +536,62 @@ absl::StatusOr<absl::Duration> TracefileExecutor<Allocator>::ProcessTracefile(
   return max_allocation_time;
 }
 
+/* static */
+template <TracefileAllocator Allocator>
+absl::StatusOr<std::vector<int>> TracefileExecutor<Allocator>::PlaceWorkers(
+    uint32_t n_workers, const TracefileExecutorOptions& options) {
+  if (options.placement == CpuPlacement::kNone) {
+    return std::vector<int>();
+  }
+  DEFINE_OR_RETURN(CpuTopology, topology, CpuTopology::Read());
+  return topology.WorkerCpus(options.placement, n_workers, options.cpus);
+}
+
+/* static */
+template <TracefileAllocator Allocator>
+absl::Status TracefileExecutor<Allocator>::PinWorker(
+    uint32_t worker, const std::vector<int>& worker_cpus) {
+  if (worker_cpus.empty()) {
+    return absl::OkStatus();
+  }
+  return PinThreadToCpu(worker_cpus[worker % worker_cpus.size()]);
+}
+
+/* static */
+template <TracefileAllocator Allocator>
+absl::StatusOr<std::vector<std::vector<int>>>
+TracefileExecutor<Allocator>::PlaceHelpers(
+    const std::vector<int>& worker_cpus,
+    const TracefileExecutorOptions& options) {
+  if (worker_cpus.empty() || !options.pipelined_batches) {
+    return std::vector<std::vector<int>>();
+  }
+  DEFINE_OR_RETURN(CpuTopology, topology, CpuTopology::Read());
+  return topology.HelperCpus(worker_cpus);
+}
+
+template <TracefileAllocator Allocator>
+absl::StatusOr<absl::Duration> TracefileExecutor<Allocator>::RunWorker(
+    std::barrier<>& barrier, std::atomic<uint64_t>& idx, std::atomic<bool>& done,
+    const Tracefile& tracefile, ConcurrentIdMap& global_id_map,
+    uint64_t num_repetitions, const TracefileExecutorOptions& options,
+    const std::vector<int>& helper_cpus) {
+  if (options.pipelined_batches) {
+    return PipelinedProcessorWorker(barrier, idx, done, tracefile,
+                                    global_id_map, num_repetitions,
+                                    options.perf_counters, helper_cpus);
+  }
+  return ProcessorWorker(barrier, idx, done, tracefile, global_id_map,
+                         num_repetitions, options.perf_counters);
+}
+
 template <TracefileAllocator Allocator>
 absl::StatusOr<absl::Duration> TracefileExecutor<Allocator>::ProcessorWorker(
     std::barrier<>& barrier, std::atomic<uint64_t>& idx, std::atomic<bool>& done,
     const Tracefile& tracefile, ConcurrentIdMap& global_id_map,
-    uint64_t num_repetitions) {
+    uint64_t num_repetitions, PerfCounterTotals* perf_counters) {
   absl::Duration time;
+  WorkerPerfCounters counters(perf_counters);
 
   LocalIdMap local_id_map(idx, tracefile, global_id_map, num_repetitions);
   while (!done.load(std::memory_order_relaxed)) {
@@ -291,11 +613,13 @@ absl::StatusOr<absl::Duration> TracefileExecutor<Allocator>::ProcessorWorker(
       TRACE_EVENT("test_infrastructure", "TracefileExecutor::MeasureAllocator");
 
       IdMap id_map{ .id_map = context.IdMap().data() };
+      counters.Enable();
       absl::Time start = absl::Now();
       for (const auto& line : context.Ops()) {
         RETURN_IF_ERROR(ProcessLine(line, id_map));
       }
       absl::Time end = absl::Now();
+      counters.Disable(context.NumOps());
       time += end - start;
     }
 
@@ -304,6 +628,544 @@ absl::StatusOr<absl::Duration> TracefileExecutor<Allocator>::ProcessorWorker(
   }
 
   barrier.arrive_and_drop();
+  RETURN_IF_ERROR(counters.Finish());
+  return time;
+}
+
+template <TracefileAllocator Allocator>
+absl::StatusOr<absl::Duration>
+TracefileExecutor<Allocator>::PipelinedProcessorWorker(
+    std::barrier<>& barrier, std::atomic<uint64_t>& idx, std::atomic<bool>& done,
+    const Tracefile& tracefile, ConcurrentIdMap& global_id_map,
+    uint64_t num_repetitions, PerfCounterTotals* perf_counters,
+    const std::vector<int>& helper_cpus) {
+  LocalIdMap local_id_map(idx, tracefile, global_id_map, num_repetitions);
+  BatchRing prepared;
+  BatchRing finished;
+  std::atomic<bool> stop = false;
+
+  absl::Status helper_status;
+  std::thread helper([&local_id_map, &prepared, &finished, &done, &stop,
+                      &helper_status, &helper_cpus]() {
+    if (!helper_cpus.empty()) {
+      helper_status = PinThreadToCpus(helper_cpus);
+      if (!helper_status.ok()) {
+        done.store(true, std::memory_order_relaxed);
+        return;
+      }
+    }
+    helper_status =
+        PipelineHelper(local_id_map, prepared, finished, done, stop);
+  });
+
+  WorkerPerfCounters counters(perf_counters);
+  auto result = [this, &barrier, &done, &prepared, &finished,
+                 &counters]() -> absl::StatusOr<absl::Duration> {
+    absl::Duration time;
+    while (!done.load(std::memory_order_relaxed)) {
+      std::optional<std::unique_ptr<LocalIdMap::BatchContext>> context;
+      while (!(context = prepared.TryPop()).has_value()) {
+        if (done.load(std::memory_order_relaxed)) {
+          return time;
+        }
+        std::this_thread::yield();
+      }
+      if (context.value() == nullptr) {
+        break;
+      }
+
+      // See `ProcessorWorker` for why the barrier is waited on twice.
+      barrier.arrive_and_wait();
+      barrier.arrive_and_wait();
+
+      {
+        TRACE_EVENT("test_infrastructure",
+                    "TracefileExecutor::MeasureAllocator");
+
+        IdMap id_map{ .id_map = context.value()->IdMap().data() };
+        counters.Enable();
+        absl::Time start = absl::Now();
+        for (const auto& line : context.value()->Ops()) {
+          RETURN_IF_ERROR(ProcessLine(line, id_map));
+        }
+        absl::Time end = absl::Now();
+        counters.Disable(context.value()->NumOps());
+        time += end - start;
+      }
+
+      // The helper never has more than `kPipelineDepth` batches in flight, so
+      // there is always room to return this one.
+      finished.TryPush(std::move(context.value()));
+      barrier.arrive_and_wait();
+    }
+    return time;
+  }();
+
+  if (!result.ok()) {
+    done.store(true, std::memory_order_relaxed);
+  }
+  stop.store(true, std::memory_order_relaxed);
+  helper.join();
+  barrier.arrive_and_drop();
+
+  RETURN_IF_ERROR(helper_status);
+  if (result.ok()) {
+    RETURN_IF_ERROR(counters.Finish());
+  }
+  return result;
+}
+
+/* static */
+template <TracefileAllocator Allocator>
+absl::Status TracefileExecutor<Allocator>::PipelineHelper(
+    LocalIdMap& local_id_map, BatchRing& prepared, BatchRing& finished,
+    std::atomic<bool>& done, const std::atomic<bool>& stop) {
+  size_t in_flight = 0;
+  while (!stop.load(std::memory_order_relaxed)) {
+    std::optional<std::unique_ptr<LocalIdMap::BatchContext>> finished_context;
+    while ((finished_context = finished.TryPop()).has_value()) {
+      absl::Status status = local_id_map.FlushOps(*finished_context.value());
+      if (!status.ok()) {
+        done.store(true, std::memory_order_relaxed);
+        return status;
+      }
+      in_flight--;
+    }
+
+    if (in_flight == kPipelineDepth) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    auto context = local_id_map.PrepareBatch();
+    if (!context.ok()) {
+      done.store(true, std::memory_order_relaxed);
+      return context.status();
+    }
+    if (context->NumOps() == 0) {
+      // Ops may still be waiting on allocations from batches in flight, which
+      // are queued for whichever worker takes them next once flushed. Only
+      // signal the end of work once nothing remains in flight.
+      if (in_flight == 0) {
+        prepared.TryPush(nullptr);
+        return absl::OkStatus();
+      }
+      std::this_thread::yield();
+      continue;
+    }
+
+    prepared.TryPush(std::make_unique<LocalIdMap::BatchContext>(
+        std::move(context).value()));
+    in_flight++;
+  }
+
+  return absl::OkStatus();
+}
+
+template <TracefileAllocator Allocator>
+absl::StatusOr<absl::Duration> TracefileExecutor<Allocator>::ProcessTraceStream(
+    uint64_t num_repetitions, const TracefileExecutorOptions& options) {
+  if (options.n_threads != 1 || options.per_thread_replay ||
+      options.pipelined_batches || options.placement != CpuPlacement::kNone) {
+    return absl::InvalidArgumentError(
+        "Streaming replay only supports a single, unpinned worker thread");
+  }
+  if (options.Windowed()) {
+    return absl::InvalidArgumentError(
+        "Streaming replay does not support replaying a window of the trace");
+  }
+  if (options.paced_latency != nullptr) {
+    return absl::InvalidArgumentError(
+        "Streaming replay does not support paced replay");
+  }
+
+  absl::Duration time;
+  WorkerPerfCounters counters(options.perf_counters);
+  // Only `kStreamChunkLines` lines are held at once, and the id map only
+  // grows to the largest id seen, which for dense ids is bounded by the
+  // maximum number of live allocations.
+  std::vector<TraceLine> chunk;
+  std::vector<void*> ids;
+
+  // Traces which fit in a single chunk are only decoded once. Every id is
+  // freed by the end of the trace, so repetitions of short traces can share a
+  // timed region, keeping the clock overhead negligible.
+  if (stream_reader_->size() <= kStreamChunkLines) {
+    RETURN_IF_ERROR(stream_reader_->Rewind());
+    RETURN_IF_ERROR(stream_reader_->NextChunk(kStreamChunkLines, chunk));
+    RETURN_IF_ERROR(FitIds(absl::MakeConstSpan(chunk), ids));
+    const uint64_t repetitions_per_region =
+        kStreamChunkLines / std::max<size_t>(chunk.size(), 1);
+    for (uint64_t iteration = 0; iteration < num_repetitions;
+         iteration += repetitions_per_region) {
+      RETURN_IF_ERROR(ReplayChunk(
+          absl::MakeConstSpan(chunk),
+          std::min(repetitions_per_region, num_repetitions - iteration), ids,
+          counters, time));
+    }
+  } else {
+    for (uint64_t iteration = 0; iteration < num_repetitions; iteration++) {
+      RETURN_IF_ERROR(stream_reader_->Rewind());
+      while (true) {
+        RETURN_IF_ERROR(stream_reader_->NextChunk(kStreamChunkLines, chunk));
+        if (chunk.empty()) {
+          break;
+        }
+        RETURN_IF_ERROR(FitIds(absl::MakeConstSpan(chunk), ids));
+        RETURN_IF_ERROR(ReplayChunk(absl::MakeConstSpan(chunk),
+                                    /*repetitions=*/1, ids, counters, time));
+      }
+    }
+  }
+
+  RETURN_IF_ERROR(counters.Finish());
+  return time;
+}
+
+template <TracefileAllocator Allocator>
+absl::StatusOr<absl::Duration> TracefileExecutor<Allocator>::ProcessRecords(
+    absl::Span<const BinaryTraceRecord> records, std::vector<void*>& ids,
+    uint64_t num_repetitions, const TracefileExecutorOptions& options) {
+  absl::Duration time;
+  WorkerPerfCounters counters(options.perf_counters);
+  // Like streamed traces which fit in a single chunk, repetitions of short
+  // traces share a timed region.
+  const uint64_t repetitions_per_region = std::max<uint64_t>(
+      kStreamChunkLines / std::max<size_t>(records.size(), 1), 1);
+  for (uint64_t iteration = 0; iteration < num_repetitions;
+       iteration += repetitions_per_region) {
+    RETURN_IF_ERROR(ReplayChunk(
+        records, std::min(repetitions_per_region, num_repetitions - iteration),
+        ids, counters, time));
+  }
+
+  RETURN_IF_ERROR(counters.Finish());
+  return time;
+}
+
+/* static */
+template <TracefileAllocator Allocator>
+template <typename Line>
+absl::Status TracefileExecutor<Allocator>::FitIds(absl::Span<const Line> lines,
+                                                  std::vector<void*>& ids) {
+  uint64_t max_id = 0;
+  for (const Line& line : lines) {
+    if (!HasOp(line)) {
+      return absl::FailedPreconditionError("Op not set in tracefile");
+    }
+    max_id = std::max(max_id, ResultId(line));
+  }
+  if (max_id >= kMaxStreamId) {
+    return absl::FailedPreconditionError(absl::StrFormat(
+        "ID %v is too large to index directly, ids must be dense", max_id));
+  }
+  if (max_id >= ids.size()) {
+    ids.resize(max_id + 1);
+  }
+  return absl::OkStatus();
+}
+
+template <TracefileAllocator Allocator>
+template <typename Line>
+absl::Status TracefileExecutor<Allocator>::ReplayChunk(
+    absl::Span<const Line> chunk, uint64_t repetitions,
+    std::vector<void*>& ids, WorkerPerfCounters& counters,
+    absl::Duration& time) {
+  TRACE_EVENT("test_infrastructure", "TracefileExecutor::MeasureAllocator");
+  IdMap id_map{ .id_map = ids.data() };
+  counters.Enable();
+  absl::Time start = absl::Now();
+  for (uint64_t i = 0; i < repetitions; i++) {
+    for (const Line& line : chunk) {
+      RETURN_IF_ERROR(ProcessLine(line, id_map));
+    }
+  }
+  absl::Time end = absl::Now();
+  counters.Disable(repetitions * chunk.size());
+  time += end - start;
+  return absl::OkStatus();
+}
+
+template <TracefileAllocator Allocator>
+absl::StatusOr<absl::Duration> TracefileExecutor<Allocator>::ProcessWindow(
+    uint64_t num_repetitions, const TracefileExecutorOptions& options) {
+  if (options.n_threads != 1 || options.per_thread_replay ||
+      options.pipelined_batches || options.placement != CpuPlacement::kNone) {
+    return absl::InvalidArgumentError(
+        "Window replay only supports a single, unpinned worker thread");
+  }
+
+  const auto& lines = reader_->Tracefile().lines();
+  const uint64_t num_ops = lines.size();
+  if (options.start_op >= num_ops) {
+    return absl::InvalidArgumentError(absl::StrFormat(
+        "Window start %v is past the end of the %v-op trace", options.start_op,
+        num_ops));
+  }
+  const uint64_t end_op = options.start_op + options.TimedOps(num_ops);
+
+  // Without an index, the window is reached by replaying from the start.
+  const TraceIndex::Checkpoint* checkpoint = nullptr;
+  uint64_t restore_op = 0;
+  LiveSet live;
+  if (options.trace_index != nullptr) {
+    if (options.trace_index->NumOps() != num_ops) {
+      return absl::FailedPreconditionError(absl::StrFormat(
+          "Trace index is for a %v-op trace, but the trace has %v ops",
+          options.trace_index->NumOps(), num_ops));
+    }
+    checkpoint = &options.trace_index->CheckpointBefore(options.start_op);
+    restore_op = checkpoint->op_index();
+    live = TraceIndex::CheckpointLiveSet(*checkpoint);
+  }
+
+  // Find the allocations left live by the end of the window, which are freed
+  // after each repetition, and the largest id used along the way.
+  uint64_t max_id = 0;
+  for (const auto& [id, allocation] : live) {
+    max_id = std::max(max_id, id);
+  }
+  for (uint64_t i = restore_op; i < end_op; i++) {
+    RETURN_IF_ERROR(TraceIndex::Apply(lines[i], live));
+    max_id = std::max(max_id, ResultId(lines[i]));
+  }
+  if (max_id >= kMaxStreamId) {
+    return absl::FailedPreconditionError(absl::StrFormat(
+        "ID %v is too large for window replay, ids must be dense", max_id));
+  }
+
+  absl::Duration time;
+  WorkerPerfCounters counters(options.perf_counters);
+  std::vector<void*> ids(max_id + 1);
+  IdMap id_map{ .id_map = ids.data() };
+  for (uint64_t iteration = 0; iteration < num_repetitions; iteration++) {
+    if (checkpoint != nullptr) {
+      for (const auto& allocation : checkpoint->live()) {
+        std::optional<size_t> alignment =
+            allocation.has_alignment() ? std::optional(allocation.alignment())
+                                       : std::nullopt;
+        DEFINE_OR_RETURN(void*, ptr,
+                         allocator_.Malloc(allocation.size(), alignment));
+        id_map.SetId(allocation.id(), ptr);
+      }
+    }
+    for (uint64_t i = restore_op; i < options.start_op; i++) {
+      RETURN_IF_ERROR(ProcessLine(lines[i], id_map));
+    }
+
+    {
+      TRACE_EVENT("test_infrastructure", "TracefileExecutor::MeasureAllocator");
+      counters.Enable();
+      absl::Time start = absl::Now();
+      for (uint64_t i = options.start_op; i < end_op; i++) {
+        RETURN_IF_ERROR(ProcessLine(lines[i], id_map));
+      }
+      absl::Time end = absl::Now();
+      counters.Disable(end_op - options.start_op);
+      time += end - start;
+    }
+
+    for (const auto& [id, allocation] : live) {
+      RETURN_IF_ERROR(allocator_.Free(id_map.GetId(id), allocation.size,
+                                      allocation.alignment));
+    }
+  }
+
+  RETURN_IF_ERROR(counters.Finish());
+  return time;
+}
+
+template <TracefileAllocator Allocator>
+absl::StatusOr<absl::Duration> TracefileExecutor<Allocator>::ProcessPaced(
+    const Tracefile& tracefile, uint64_t num_repetitions,
+    const TracefileExecutorOptions& options) {
+  if (options.n_threads != 1 || options.pipelined_batches ||
+      options.placement != CpuPlacement::kNone) {
+    return absl::InvalidArgumentError(
+        "Paced replay only supports a single, unpinned worker thread, or "
+        "per-thread replay");
+  }
+  DEFINE_OR_RETURN(ReplayPacer, pacer,
+                   ReplayPacer::Build(tracefile, options.pace_scale));
+
+  absl::Duration time;
+  WorkerPerfCounters counters(options.perf_counters);
+  std::vector<void*> ids(pacer.NumIds());
+  IdMap id_map{ .id_map = ids.data() };
+  for (uint64_t iteration = 0; iteration < num_repetitions; iteration++) {
+    TRACE_EVENT("test_infrastructure", "TracefileExecutor::MeasureAllocator");
+    counters.Enable();
+    absl::Time start_time = absl::Now();
+    const uint64_t start = TscClock::Start();
+    for (const TraceLine& line : tracefile.lines()) {
+      const uint64_t due = pacer.WaitUntilDue(line, start);
+      RETURN_IF_ERROR(ProcessLine(line, id_map));
+      pacer.Record(line, due, TscClock::Stop(), *options.paced_latency);
+    }
+    absl::Time end_time = absl::Now();
+    counters.Disable(tracefile.lines_size());
+    time += end_time - start_time;
+  }
+
+  RETURN_IF_ERROR(counters.Finish());
+  return time;
+}
+
+/* static */
+template <TracefileAllocator Allocator>
+uint64_t TracefileExecutor<Allocator>::ResultId(const TraceLine& line) {
+  switch (line.op_case()) {
+    case TraceLine::kMalloc:
+      return line.malloc().result_id();
+    case TraceLine::kCalloc:
+      return line.calloc().result_id();
+    case TraceLine::kRealloc:
+      return line.realloc().result_id();
+    case TraceLine::kFree:
+    case TraceLine::OP_NOT_SET:
+      return 0;
+  }
+  return 0;
+}
+
+/* static */
+template <TracefileAllocator Allocator>
+uint64_t TracefileExecutor<Allocator>::ResultId(
+    const BinaryTraceRecord& record) {
+  return record.op == BinaryTraceOp::kFree ? 0 : record.id;
+}
+
+template <TracefileAllocator Allocator>
+absl::StatusOr<absl::Duration>
+TracefileExecutor<Allocator>::ProcessThreadStreams(
+    const Tracefile& tracefile, uint64_t num_repetitions,
+    const TracefileExecutorOptions& options) {
+  DEFINE_OR_RETURN(ThreadStreams, streams, ThreadStreams::Build(tracefile));
+  std::optional<ReplayPacer> pacer;
+  if (options.paced_latency != nullptr) {
+    ASSIGN_OR_RETURN(pacer, ReplayPacer::Build(tracefile, options.pace_scale));
+  }
+
+  // Every id is allocated exactly once per iteration of the trace, and
+  // iterations are separated by a barrier, so all threads can share one id map.
+  std::vector<void*> ids(streams.NumIds());
+  IdMap id_map{ .id_map = ids.data() };
+  std::vector<ThreadProgress> progress(streams.NumThreads());
+  DEFINE_OR_RETURN(std::vector<int>, worker_cpus,
+                   PlaceWorkers(streams.NumThreads(), options));
+
+  absl::Duration max_allocation_time;
+  absl::Status status = absl::OkStatus();
+  absl::Mutex status_lock;
+
+  std::barrier barrier(streams.NumThreads());
+  std::atomic<bool> done = false;
+
+  std::vector<std::thread> threads;
+  threads.reserve(streams.NumThreads());
+  for (uint32_t i = 0; i < streams.NumThreads(); i++) {
+    threads.emplace_back([this, &max_allocation_time, &status, &status_lock,
+                          &barrier, &done, &streams, &progress, id_map,
+                          num_repetitions, &options, &worker_cpus, &pacer,
+                          i]() {
+      LatencyProfile paced_latency;
+      absl::StatusOr<absl::Duration> result;
+      if (absl::Status pin_status = PinWorker(i, worker_cpus);
+          pin_status.ok()) {
+        result = StreamWorker(barrier, done, streams, i, progress, id_map,
+                              num_repetitions, options.perf_counters,
+                              pacer.has_value() ? &pacer.value() : nullptr,
+                              &paced_latency);
+      } else {
+        done.store(true, std::memory_order_relaxed);
+        barrier.arrive_and_drop();
+        result = pin_status;
+      }
+
+      absl::MutexLock lock(&status_lock);
+      if (pacer.has_value()) {
+        options.paced_latency->Merge(paced_latency);
+      }
+      if (result.ok()) {
+        max_allocation_time = std::max(result.value(), max_allocation_time);
+      } else if (status.ok()) {
+        status = result.status();
+      }
+    });
+  }
+
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  if (!status.ok()) {
+    return status;
+  }
+
+  return max_allocation_time;
+}
+
+template <TracefileAllocator Allocator>
+absl::StatusOr<absl::Duration> TracefileExecutor<Allocator>::StreamWorker(
+    std::barrier<>& barrier, std::atomic<bool>& done,
+    const ThreadStreams& streams, uint32_t thread,
+    std::vector<ThreadProgress>& progress, IdMap id_map,
+    uint64_t num_repetitions, PerfCounterTotals* perf_counters,
+    const ReplayPacer* pacer, LatencyProfile* paced_latency) {
+  const std::vector<ThreadStreams::Op>& stream = streams.Stream(thread);
+  std::atomic<uint64_t>& ops_done = progress[thread].ops_done;
+  absl::Duration time;
+  WorkerPerfCounters counters(perf_counters);
+
+  for (uint64_t iteration = 0; iteration < num_repetitions; iteration++) {
+    barrier.arrive_and_wait();
+    if (done.load(std::memory_order_relaxed)) {
+      break;
+    }
+
+    TRACE_EVENT("test_infrastructure", "TracefileExecutor::MeasureAllocator");
+    counters.Enable();
+    absl::Time start = absl::Now();
+    // Each thread's ops are due relative to when it leaves the barrier.
+    const uint64_t pace_start = pacer != nullptr ? TscClock::Start() : 0;
+    for (size_t i = 0; i < stream.size(); i++) {
+      const ThreadStreams::Op& op = stream[i];
+      const uint64_t due =
+          pacer != nullptr ? pacer->WaitUntilDue(*op.line, pace_start) : 0;
+      if (op.dep_ops != 0) {
+        const uint64_t required_ops =
+            iteration * streams.Stream(op.dep_thread).size() + op.dep_ops;
+        const std::atomic<uint64_t>& dep_ops_done =
+            progress[op.dep_thread].ops_done;
+        while (dep_ops_done.load(std::memory_order_acquire) < required_ops) {
+          if (done.load(std::memory_order_relaxed)) {
+            // Another thread failed, and will report its error.
+            barrier.arrive_and_drop();
+            return time;
+          }
+          std::this_thread::yield();
+        }
+      }
+
+      absl::Status status = ProcessLine(*op.line, id_map);
+      if (!status.ok()) {
+        done.store(true, std::memory_order_relaxed);
+        barrier.arrive_and_drop();
+        return status;
+      }
+      if (pacer != nullptr) {
+        pacer->Record(*op.line, due, TscClock::Stop(), *paced_latency);
+      }
+      ops_done.store(iteration * stream.size() + i + 1,
+                     std::memory_order_release);
+    }
+    absl::Time end = absl::Now();
+    counters.Disable(stream.size());
+    time += end - start;
+  }
+
+  barrier.arrive_and_drop();
+  RETURN_IF_ERROR(counters.Finish());
   return time;
 }
 
@@ -403,15 +1265,19 @@ absl::Status TracefileExecutor<Allocator>::RewriteIdsToUnique(
 template <TracefileAllocator Allocator>
 absl::Status TracefileExecutor<Allocator>::ProcessLine(const TraceLine& line,
                                                        IdMap& id_map) {
+  const AllocHint hint = {
+    .site_id = line.site_id(),
+    .lifetime_class = lifetime_hints_ ? line.lifetime_class() : 0,
+  };
   switch (line.op_case()) {
     case TraceLine::kMalloc: {
-      return DoMalloc(line.malloc(), id_map);
+      return DoMalloc(line.malloc(), hint, id_map);
     }
     case TraceLine::kCalloc: {
-      return DoCalloc(line.calloc(), id_map);
+      return DoCalloc(line.calloc(), hint, id_map);
     }
     case TraceLine::kRealloc: {
-      return DoRealloc(line.realloc(), id_map);
+      return DoRealloc(line.realloc(), hint, id_map);
     }
     case TraceLine::kFree: {
       return DoFree(line.free(), id_map);
@@ -422,4 +1288,60 @@ absl::Status TracefileExecutor<Allocator>::ProcessLine(const TraceLine& line,
   }
 }
 
+// Mirrors the proto path above, see `BinaryTraceRecord` for how each op's
+// fields are stored. Fields which aren't set are 0, like unset proto fields.
+template <TracefileAllocator Allocator>
+absl::Status TracefileExecutor<Allocator>::ProcessLine(
+    const BinaryTraceRecord& record, IdMap& id_map) {
+  const AllocHint hint = {
+    .site_id = record.site_id,
+    .lifetime_class = lifetime_hints_ ? record.lifetime_class : 0u,
+  };
+  switch (record.op) {
+    case BinaryTraceOp::kMalloc: {
+      std::optional<size_t> alignment =
+          record.Has(BinaryTraceRecord::kHasArg) ? std::optional(record.arg)
+                                                 : std::nullopt;
+      DEFINE_OR_RETURN(void*, ptr,
+                       allocator_.Malloc(record.size, alignment, hint));
+      if (record.size != 0 && record.Has(BinaryTraceRecord::kHasId)) {
+        id_map.SetId(record.id, ptr);
+      }
+      return absl::OkStatus();
+    }
+    case BinaryTraceOp::kCalloc: {
+      DEFINE_OR_RETURN(void*, ptr,
+                       allocator_.Calloc(record.arg, record.size, hint));
+      if (record.arg != 0 && record.size != 0 &&
+          record.Has(BinaryTraceRecord::kHasId)) {
+        id_map.SetId(record.id, ptr);
+      }
+      return absl::OkStatus();
+    }
+    case BinaryTraceOp::kRealloc: {
+      void* input_ptr = record.Has(BinaryTraceRecord::kHasArg)
+                            ? id_map.GetId(record.arg)
+                            : nullptr;
+      DEFINE_OR_RETURN(void*, result_ptr,
+                       allocator_.Realloc(input_ptr, record.size, hint));
+      id_map.SetId(record.id, result_ptr);
+      return absl::OkStatus();
+    }
+    case BinaryTraceOp::kFree: {
+      if (!record.Has(BinaryTraceRecord::kHasId)) {
+        return allocator_.Free(nullptr, std::nullopt, std::nullopt);
+      }
+      std::optional<size_t> size_hint =
+          record.Has(BinaryTraceRecord::kHasSize) ? std::optional(record.size)
+                                                  : std::nullopt;
+      std::optional<size_t> alignment_hint =
+          record.Has(BinaryTraceRecord::kHasArg) ? std::optional(record.arg)
+                                                 : std::nullopt;
+      return allocator_.Free(id_map.GetId(record.id), size_hint,
+                             alignment_hint);
+    }
+  }
+  __builtin_unreachable();
+}
+
 }  // namespace bench
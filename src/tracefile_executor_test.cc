@@ -0,0 +1,143 @@
+#include "src/tracefile_executor.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <optional>
+#include <string>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_format.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "gtest/gtest.h"
+#include "util/absl_util.h"
+#include "util/gtest_util.h"
+
+#include "proto/tracefile.pb.h"
+#include "src/alloc_hint.h"
+#include "src/tracefile_reader.h"
+
+namespace bench {
+
+// An allocator which fails any op on memory it hasn't handed out, and which
+// stalls allocations of `kSlowSize` bytes, so ops which don't wait for them
+// are caught.
+class CheckingAllocator {
+ public:
+  static constexpr size_t kSlowSize = 100;
+
+  absl::Status InitializeHeap() {
+    return absl::OkStatus();
+  }
+
+  absl::Status CleanupHeap() {
+    absl::MutexLock lock(&mutex_);
+    if (!live_.empty()) {
+      return absl::FailedPreconditionError(
+          absl::StrFormat("%v allocations leaked", live_.size()));
+    }
+    return absl::OkStatus();
+  }
+
+  absl::StatusOr<void*> Malloc(size_t size, std::optional<size_t> alignment,
+                               const AllocHint& hint = AllocHint()) {
+    (void) alignment;
+    (void) hint;
+    if (size == kSlowSize) {
+      absl::SleepFor(absl::Milliseconds(10));
+    }
+    void* ptr = std::malloc(size);
+    absl::MutexLock lock(&mutex_);
+    live_.insert(ptr);
+    return ptr;
+  }
+
+  absl::StatusOr<void*> Calloc(size_t nmemb, size_t size,
+                               const AllocHint& hint = AllocHint()) {
+    return Malloc(nmemb * size, std::nullopt, hint);
+  }
+
+  absl::StatusOr<void*> Realloc(void* ptr, size_t size,
+                                const AllocHint& hint = AllocHint()) {
+    if (ptr != nullptr) {
+      RETURN_IF_ERROR(Free(ptr, std::nullopt, std::nullopt));
+    }
+    return Malloc(size, std::nullopt, hint);
+  }
+
+  absl::Status Free(void* ptr, std::optional<size_t> size_hint,
+                    std::optional<size_t> alignment_hint) {
+    (void) size_hint;
+    (void) alignment_hint;
+    if (ptr == nullptr) {
+      return absl::OkStatus();
+    }
+    absl::MutexLock lock(&mutex_);
+    if (!live_.erase(ptr)) {
+      return absl::FailedPreconditionError(
+          absl::StrFormat("Freed %p, which is not allocated", ptr));
+    }
+    std::free(ptr);
+    return absl::OkStatus();
+  }
+
+ private:
+  absl::Mutex mutex_;
+  absl::flat_hash_set<void*> live_ ABSL_GUARDED_BY(mutex_);
+};
+
+class TestTracefileExecutor : public ::testing::Test {
+ public:
+  // Writes `tracefile` to a temporary file and replays it
+  // `num_repetitions` times.
+  static absl::Status Replay(const Tracefile& tracefile,
+                             const std::string& name, uint64_t num_repetitions,
+                             const TracefileExecutorOptions& options) {
+    const std::string path = ::testing::TempDir() + "/" + name;
+    {
+      std::ofstream file(path, std::ios::binary | std::ios::trunc);
+      if (!tracefile.SerializeToOstream(&file)) {
+        return absl::InternalError(absl::StrFormat("Failed to write %s", path));
+      }
+    }
+    DEFINE_OR_RETURN(TracefileReader, reader, TracefileReader::Open(path));
+    TracefileExecutor<CheckingAllocator> executor(reader);
+    return executor.RunRepeated(num_repetitions, options).status();
+  }
+
+  static void AddMalloc(Tracefile& tracefile, uint32_t thread_id, uint64_t id,
+                        size_t size) {
+    TraceLine* line = tracefile.add_lines();
+    line->set_thread_id(thread_id);
+    line->mutable_malloc()->set_result_id(id);
+    line->mutable_malloc()->set_input_size(size);
+  }
+
+  static void AddFree(Tracefile& tracefile, uint32_t thread_id, uint64_t id) {
+    TraceLine* line = tracefile.add_lines();
+    line->set_thread_id(thread_id);
+    line->mutable_free()->set_input_id(id);
+  }
+};
+
+TEST_F(TestTracefileExecutor, CrossThreadFreeWaitsForAllocation) {
+  // Each thread frees what the other allocated, and thread 0's allocation is
+  // slow, so thread 1 would free it too early if it didn't wait.
+  Tracefile tracefile;
+  AddMalloc(tracefile, /*thread_id=*/0, /*id=*/0, CheckingAllocator::kSlowSize);
+  AddFree(tracefile, /*thread_id=*/1, /*id=*/0);
+  AddMalloc(tracefile, /*thread_id=*/1, /*id=*/1, /*size=*/200);
+  AddFree(tracefile, /*thread_id=*/0, /*id=*/1);
+
+  EXPECT_THAT(Replay(tracefile, "cross_thread.trace", /*num_repetitions=*/5,
+                     { .per_thread_replay = true }),
+              util::IsOk());
+}
+
+}  // namespace bench
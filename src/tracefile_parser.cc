@@ -1,335 +1,670 @@
+#include "src/tracefile_parser.h"
+
+#include <algorithm>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <limits>
-#include <ostream>
+#include <optional>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
 #include <unistd.h>
+#include <utility>
+#include <vector>
 
-#include "absl/container/btree_set.h"
-#include "absl/flags/flag.h"
-#include "absl/flags/parse.h"
+#include "absl/container/flat_hash_map.h"
 #include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/ascii.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
-#include "google/protobuf/io/zero_copy_stream_impl.h"
-#include "google/protobuf/text_format.h"
-#include "re2/re2.h"
 #include "util/absl_util.h"
 
 #include "proto/tracefile.pb.h"
-
-ABSL_FLAG(std::string, trace, "", "File path of the trace to clean.");
-
-ABSL_FLAG(bool, binary, false, "Output binary proto");
-
-ABSL_FLAG(uint64_t, max_ops, std::numeric_limits<uint64_t>::max(),
-          "Limits the total number of ops in a trace. A tracefile will stop "
-          "being parsed after enough ops have been parsed, accounting for "
-          "needing to free all allocated memory.");
+#include "src/trace_recording.h"
 
 namespace bench {
 
-using proto::Tracefile;
-using proto::TraceLine;
-
 namespace {
 
-using re2::LazyRE2;
-using re2::RE2;
-
 /**
- * Matches a single line of valigrind --trace-malloc=yes output.
+ * Parses valgrind --trace-malloc=yes output.
  *
- * Lines have one of the following formats:
+ * Calls appear anywhere in a line in one of the following formats:
  *
  * --{pid}-- free({ptr})
  * --{pid}-- malloc({size}) = {ptr}
- * --{pid}-- calloc({size},{nmemb}) = {ptr}
+ * --{pid}-- memalign(al {alignment}, size {size}) = {ptr}
+ * --{pid}-- _ZnwmSt11align_val_t(size {size}, al {alignment}) = {ptr}
+ * --{pid}-- calloc({nmemb},{size}) = {ptr}
  * --{pid}-- realloc({ptr},{size}) = {ptr}
  * --{pid}-- realloc(0x0,{size})malloc({size}) = {ptr}
  *
- * Where pid, size, and nmemb are decimal numbers, and ptr is a hex value.
+ * Where pid, size, alignment and nmemb are decimal numbers, and ptr is a hex
+ * value prefixed by "0x".
  *
- * "free" has aliases "_ZdlPv", "_ZdaPv", "_ZdlPvm", "_ZdaPvm", and
- * "malloc" has aliases "_Znwm", "_Znam".
+ * "free" has aliases "_ZdlPv", "_ZdaPv", "_ZdlPvm", "_ZdaPvm",
+ * "_ZdlPvSt11align_val_t", and "malloc" has aliases "_Znwm", "_Znam",
+ * "_ZnwmRKSt9nothrow_t".
  */
-constexpr LazyRE2 kFreeRegex = {
-  R"(--(\d+)-- (?:free|_ZdlPv|_ZdaPv|_ZdlPvm|_ZdaPvm|_ZdlPvSt11align_val_t)\(0x([0-9A-Fa-f]+)\))"
-};
-constexpr LazyRE2 kMallocRegex = {
-  R"(--(\d+)-- (?:malloc|_Znwm|_Znam|_ZnwmRKSt9nothrow_t)\((\d+)\) = 0x([0-9A-Fa-f]+))"
-};
-constexpr LazyRE2 kMemalignAllocRegex = {
-  R"(--(\d+)-- (?:memalign)\(al (\d+), size (\d+)\) = 0x([0-9A-Fa-f]+))"
-};
-constexpr LazyRE2 kAlignedAllocRegex = {
-  R"(--(\d+)-- (?:_ZnwmSt11align_val_t)\(size (\d+), al (\d+)\) = 0x([0-9A-Fa-f]+))"
-};
-constexpr LazyRE2 kCallocRegex = {
-  R"(--(\d+)-- calloc\((\d+),(\d+)\) = 0x([0-9A-Fa-f]+))"
+struct ParsedCall {
+  enum class Type : uint8_t {
+    kMalloc,
+    kAlignedMalloc,
+    kCalloc,
+    kRealloc,
+    kFree,
+  };
+
+  Type type;
+  uint32_t pid;
+  // The pointer freed or reallocated, which may be null.
+  uint64_t input_ptr;
+  uint64_t result_ptr;
+  uint64_t size;
+  // The alignment of aligned mallocs, or nmemb of callocs.
+  uint64_t arg;
 };
-constexpr LazyRE2 kReallocRegex = {
-  R"(--(\d+)-- realloc\(0x([0-9A-Fa-f]+),(\d+)\)(?:malloc\(\d+\))? = 0x([0-9A-Fa-f]+))"
-};
-
-}  // namespace
 
-class DirtyTracefileReader {
+// Consumes the call at the front of a line.
+class CallTokenizer {
  public:
-  using const_iterator =
-      google::protobuf::internal::RepeatedPtrIterator<const TraceLine>;
-
-  static absl::StatusOr<DirtyTracefileReader> Open(
-      const std::string& filename) {
-    std::ifstream file(filename);
-
-    if (!file.is_open()) {
-      return absl::InternalError(
-          absl::StrCat("Failed to open file ", filename));
+  explicit CallTokenizer(std::string_view text) : text_(text) {}
+
+  std::optional<ParsedCall> Parse() {
+    ParsedCall call = {};
+    uint64_t pid;
+    if (!Consume("--") || !ConsumeDecimal(pid) || !Consume("-- ") ||
+        pid > std::numeric_limits<uint32_t>::max()) {
+      return std::nullopt;
     }
+    call.pid = static_cast<uint32_t>(pid);
 
-    class Tracefile tracefile;
-    std::optional<int32_t> required_pid;
-    absl::flat_hash_map<void*, uint64_t> id_map;
-    absl::btree_set<uint64_t> available_ids;
-    uint64_t next_id = 0;
-    uint64_t max_simultaneous_allocs = 0;
-
-    const auto get_next_id = [&available_ids, &next_id,
-                              &id_map](void* ptr) -> absl::StatusOr<uint64_t> {
-      uint64_t id;
-      if (available_ids.empty()) {
-        id = next_id++;
-      } else {
-        auto it = available_ids.begin();
-        id = *it;
-        available_ids.erase(it);
+    const std::string_view name = ConsumeName();
+    if (!Consume("(")) {
+      return std::nullopt;
+    }
+    if (name == "free" || name == "_ZdlPv" || name == "_ZdaPv" ||
+        name == "_ZdlPvm" || name == "_ZdaPvm" ||
+        name == "_ZdlPvSt11align_val_t") {
+      call.type = ParsedCall::Type::kFree;
+      if (!ConsumePtr(call.input_ptr) || !Consume(")")) {
+        return std::nullopt;
       }
+      return call;
+    }
 
-      auto [_it, inserted] = id_map.emplace(ptr, id);
-      if (!inserted) {
-        return absl::FailedPreconditionError(
-            absl::StrFormat("Allocated duplicate pointer %p", ptr));
-      }
-      return id;
-    };
-    const auto find_and_erase_id =
-        [&available_ids, &id_map](void* ptr) -> absl::StatusOr<uint64_t> {
-      auto it = id_map.find(ptr);
-      if (it == id_map.end()) {
-        return absl::FailedPreconditionError(
-            absl::StrFormat("Tracefile frees unallocated ptr %p", ptr));
-      }
-      uint64_t id = it->second;
-      id_map.erase(it);
-
-      auto [_it, inserted] = available_ids.insert(id);
-      assert(inserted);
-      return id;
-    };
-
-    for (uint64_t iter = 0; iter + id_map.size() < absl::GetFlag(FLAGS_max_ops);
-         iter++) {
-      std::string line_str;
-      if (std::getline(file, line_str).eof()) {
-        break;
+    bool ok;
+    if (name == "malloc" || name == "_Znwm" || name == "_Znam" ||
+        name == "_ZnwmRKSt9nothrow_t") {
+      call.type = ParsedCall::Type::kMalloc;
+      ok = ConsumeDecimal(call.size) && Consume(")");
+    } else if (name == "memalign") {
+      call.type = ParsedCall::Type::kAlignedMalloc;
+      ok = Consume("al ") && ConsumeDecimal(call.arg) && Consume(", size ") &&
+           ConsumeDecimal(call.size) && Consume(")");
+    } else if (name == "_ZnwmSt11align_val_t") {
+      call.type = ParsedCall::Type::kAlignedMalloc;
+      ok = Consume("size ") && ConsumeDecimal(call.size) && Consume(", al ") &&
+           ConsumeDecimal(call.arg) && Consume(")");
+    } else if (name == "calloc") {
+      call.type = ParsedCall::Type::kCalloc;
+      ok = ConsumeDecimal(call.arg) && Consume(",") &&
+           ConsumeDecimal(call.size) && Consume(")");
+    } else if (name == "realloc") {
+      call.type = ParsedCall::Type::kRealloc;
+      ok = ConsumePtr(call.input_ptr) && Consume(",") &&
+           ConsumeDecimal(call.size) && Consume(")");
+      // Reallocs of null are followed by the malloc they turn into.
+      uint64_t malloc_size;
+      if (ok && Consume("malloc(")) {
+        ok = ConsumeDecimal(malloc_size) && Consume(")");
       }
+    } else {
+      return std::nullopt;
+    }
 
-      TraceLine line;
-      int32_t pid;
-      absl::string_view matches[4];
-      if (RE2::PartialMatch(line_str, *kFreeRegex, &matches[0], &matches[1])) {
-        ASSIGN_OR_RETURN(pid, ParsePid(matches[0]));
+    if (!ok || !Consume(" = ") || !ConsumePtr(call.result_ptr)) {
+      return std::nullopt;
+    }
+    return call;
+  }
 
-        void* input_ptr;
-        ASSIGN_OR_RETURN(input_ptr, ParsePtr(matches[1]));
+ private:
+  bool Consume(std::string_view prefix) {
+    if (!text_.starts_with(prefix)) {
+      return false;
+    }
+    text_.remove_prefix(prefix.size());
+    return true;
+  }
 
-        proto::TraceLine_Free* free = line.mutable_free();
-        if (input_ptr != nullptr) {
-          DEFINE_OR_RETURN(uint64_t, id, find_and_erase_id(input_ptr));
-          free->set_input_id(id);
-        }
-      } else if (RE2::PartialMatch(line_str, *kMallocRegex, &matches[0],
-                                   &matches[1], &matches[2])) {
-        ASSIGN_OR_RETURN(pid, ParsePid(matches[0]));
-
-        size_t input_size;
-        ASSIGN_OR_RETURN(input_size, ParseSize(matches[1]));
-        void* result_ptr;
-        ASSIGN_OR_RETURN(result_ptr, ParsePtr(matches[2]));
-
-        DEFINE_OR_RETURN(uint64_t, id, get_next_id(result_ptr));
-        proto::TraceLine_Malloc* malloc = line.mutable_malloc();
-        malloc->set_input_size(input_size);
-        malloc->set_result_id(id);
-      } else if (RE2::PartialMatch(line_str, *kMemalignAllocRegex, &matches[0],
-                                   &matches[1], &matches[2], &matches[3])) {
-        ASSIGN_OR_RETURN(pid, ParsePid(matches[0]));
-
-        size_t input_alignment;
-        ASSIGN_OR_RETURN(input_alignment, ParseSize(matches[1]));
-        size_t input_size;
-        ASSIGN_OR_RETURN(input_size, ParseSize(matches[2]));
-        void* result_ptr;
-        ASSIGN_OR_RETURN(result_ptr, ParsePtr(matches[3]));
-
-        DEFINE_OR_RETURN(uint64_t, id, get_next_id(result_ptr));
-        proto::TraceLine_Malloc* malloc = line.mutable_malloc();
-        malloc->set_input_size(input_size);
-        malloc->set_input_alignment(input_alignment);
-        malloc->set_result_id(id);
-      } else if (RE2::PartialMatch(line_str, *kAlignedAllocRegex, &matches[0],
-                                   &matches[1], &matches[2], &matches[3])) {
-        ASSIGN_OR_RETURN(pid, ParsePid(matches[0]));
-
-        size_t input_size;
-        ASSIGN_OR_RETURN(input_size, ParseSize(matches[1]));
-        size_t input_alignment;
-        ASSIGN_OR_RETURN(input_alignment, ParseSize(matches[2]));
-        void* result_ptr;
-        ASSIGN_OR_RETURN(result_ptr, ParsePtr(matches[3]));
-
-        DEFINE_OR_RETURN(uint64_t, id, get_next_id(result_ptr));
-        proto::TraceLine_Malloc* malloc = line.mutable_malloc();
-        malloc->set_input_size(input_size);
-        malloc->set_input_alignment(input_alignment);
-        malloc->set_result_id(id);
-      } else if (RE2::PartialMatch(line_str, *kCallocRegex, &matches[0],
-                                   &matches[1], &matches[2], &matches[3])) {
-        ASSIGN_OR_RETURN(pid, ParsePid(matches[0]));
-
-        size_t nmemb;
-        ASSIGN_OR_RETURN(nmemb, ParseSize(matches[1]));
-        size_t input_size;
-        ASSIGN_OR_RETURN(input_size, ParseSize(matches[2]));
-        void* result_ptr;
-        ASSIGN_OR_RETURN(result_ptr, ParsePtr(matches[3]));
-
-        DEFINE_OR_RETURN(uint64_t, id, get_next_id(result_ptr));
-        proto::TraceLine_Calloc* calloc = line.mutable_calloc();
-        calloc->set_input_nmemb(nmemb);
-        calloc->set_input_size(input_size);
-        calloc->set_result_id(id);
-      } else if (RE2::PartialMatch(line_str, *kReallocRegex, &matches[0],
-                                   &matches[1], &matches[2], &matches[3])) {
-        ASSIGN_OR_RETURN(pid, ParsePid(matches[0]));
-
-        void* input_ptr;
-        ASSIGN_OR_RETURN(input_ptr, ParsePtr(matches[1]));
-        size_t input_size;
-        ASSIGN_OR_RETURN(input_size, ParseSize(matches[2]));
-        void* result_ptr;
-        ASSIGN_OR_RETURN(result_ptr, ParsePtr(matches[3]));
-
-        proto::TraceLine_Realloc* realloc = line.mutable_realloc();
-        if (input_ptr != nullptr) {
-          DEFINE_OR_RETURN(uint64_t, id, find_and_erase_id(input_ptr));
-          realloc->set_input_id(id);
-        }
-        DEFINE_OR_RETURN(uint64_t, id, get_next_id(result_ptr));
-        realloc->set_input_size(input_size);
-        realloc->set_result_id(id);
-      } else {
-        std::cerr << "Skipping line " << line_str << std::endl;
-        continue;
+  std::string_view ConsumeName() {
+    size_t len = 0;
+    while (len < text_.size() &&
+           (absl::ascii_isalnum(text_[len]) || text_[len] == '_')) {
+      len++;
+    }
+    std::string_view name = text_.substr(0, len);
+    text_.remove_prefix(len);
+    return name;
+  }
+
+  // Fails if there are no digits or the value overflows.
+  bool ConsumeDecimal(uint64_t& value) {
+    size_t len = 0;
+    value = 0;
+    while (len < text_.size() && absl::ascii_isdigit(text_[len])) {
+      const uint64_t digit = text_[len] - '0';
+      if (value > (std::numeric_limits<uint64_t>::max() - digit) / 10) {
+        return false;
       }
+      value = value * 10 + digit;
+      len++;
+    }
+    text_.remove_prefix(len);
+    return len != 0;
+  }
 
-      if (!required_pid.has_value()) {
-        // Assume the main process makes the first allocation.
-        required_pid = pid;
-      } else if (required_pid.value() != pid) {
-        continue;
+  bool ConsumePtr(uint64_t& value) {
+    if (!Consume("0x")) {
+      return false;
+    }
+    size_t len = 0;
+    value = 0;
+    while (len < text_.size() && absl::ascii_isxdigit(text_[len])) {
+      if (len == 16) {
+        return false;
       }
-      *tracefile.mutable_lines()->Add() = std::move(line);
+      const char c = absl::ascii_tolower(text_[len]);
+      value = (value << 4) | (c <= '9' ? c - '0' : c - 'a' + 10);
+      len++;
+    }
+    text_.remove_prefix(len);
+    return len != 0;
+  }
 
-      max_simultaneous_allocs =
-          std::max<uint64_t>(max_simultaneous_allocs, id_map.size());
+  std::string_view text_;
+};
+
+// Returns the call in `line`, if any, which may be preceded by other output.
+std::optional<ParsedCall> ParseLine(std::string_view line) {
+  for (size_t pos = line.find("--"); pos != std::string_view::npos;
+       pos = line.find("--", pos + 1)) {
+    std::optional<ParsedCall> call = CallTokenizer(line.substr(pos)).Parse();
+    if (call.has_value()) {
+      return call;
     }
+  }
+  return std::nullopt;
+}
 
-    file.close();
+// The calls in a contiguous range of lines, and the lines without one.
+struct ParsedChunk {
+  std::vector<ParsedCall> calls;
+  std::vector<std::string_view> skipped_lines;
+};
 
-    // Free all unfreed memory.
-    for (auto [ptr, id] : id_map) {
-      TraceLine* line = tracefile.mutable_lines()->Add();
-      proto::TraceLine_Free* free = line->mutable_free();
-      free->set_input_id(id);
+ParsedChunk ParseChunk(std::string_view chunk) {
+  ParsedChunk parsed;
+  while (!chunk.empty()) {
+    const size_t end = chunk.find('\n');
+    const std::string_view line = chunk.substr(0, end);
+    chunk.remove_prefix(end == std::string_view::npos ? chunk.size()
+                                                      : end + 1);
+
+    std::optional<ParsedCall> call = ParseLine(line);
+    if (call.has_value()) {
+      parsed.calls.push_back(call.value());
+    } else {
+      parsed.skipped_lines.push_back(line);
     }
+  }
+  return parsed;
+}
 
-    tracefile.set_max_simultaneous_allocs(max_simultaneous_allocs);
-    return DirtyTracefileReader(std::move(tracefile));
+// Splits `text` into at most `n` chunks of about equal size, ending at line
+// boundaries.
+std::vector<std::string_view> SplitLines(std::string_view text, size_t n) {
+  std::vector<std::string_view> chunks;
+  while (!text.empty()) {
+    size_t end = text.size() / n--;
+    end = text.find('\n', end == 0 ? 0 : end - 1);
+    end = end == std::string_view::npos ? text.size() : end + 1;
+    chunks.push_back(text.substr(0, end));
+    text.remove_prefix(end);
   }
+  return chunks;
+}
 
-  const Tracefile& Tracefile() const {
-    return tracefile_;
+// A read-only mapping of a file.
+class MappedFile {
+ public:
+  MappedFile(MappedFile&& other) noexcept
+      : data_(std::exchange(other.data_, nullptr)),
+        size_(std::exchange(other.size_, 0)) {}
+  MappedFile& operator=(MappedFile&&) = delete;
+  ~MappedFile() {
+    if (data_ != nullptr) {
+      munmap(data_, size_);
+    }
+  }
+
+  static absl::StatusOr<MappedFile> Open(const std::string& filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1) {
+      return absl::InternalError(
+          absl::StrCat("Failed to open file ", filename));
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+      close(fd);
+      return absl::InternalError(absl::StrCat("Failed to stat ", filename));
+    }
+    if (st.st_size == 0) {
+      close(fd);
+      return MappedFile(nullptr, 0);
+    }
+
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+      return absl::InternalError(absl::StrCat("Failed to mmap ", filename));
+    }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    return MappedFile(data, st.st_size);
+  }
+
+  std::string_view contents() const {
+    return std::string_view(static_cast<const char*>(data_), size_);
   }
 
  private:
-  explicit DirtyTracefileReader(class Tracefile&& tracefile)
-      : tracefile_(std::move(tracefile)) {}
+  MappedFile(void* data, size_t size) : data_(data), size_(size) {}
 
-  static absl::StatusOr<int32_t> ParsePid(absl::string_view spid) {
-    int32_t pid;
-    if (!absl::SimpleAtoi(spid, &pid)) {
-      return absl::InternalError(
-          absl::StrCat("failed to parse ", spid, " as int32"));
+  void* data_;
+  size_t size_;
+};
+
+// Assigns ids to the pointers live in a trace, reusing the smallest freed id
+// so ids stay dense. Pointers are scoped to the address space of `pid`, so
+// the same pointer may be live in several processes at once.
+class IdAssigner {
+ public:
+  absl::StatusOr<uint64_t> Allocate(void* ptr, uint32_t pid = 0) {
+    uint64_t id;
+    if (available_ids_.empty()) {
+      id = next_id_++;
+    } else {
+      id = available_ids_.top();
+      available_ids_.pop();
     }
-    return pid;
+
+    auto [_it, inserted] = id_map_.emplace(std::make_pair(pid, ptr), id);
+    if (!inserted) {
+      return absl::FailedPreconditionError(absl::StrFormat(
+          "Allocated duplicate pointer %p in pid %v", ptr, pid));
+    }
+    return id;
   }
-  static absl::StatusOr<void*> ParsePtr(absl::string_view sptr) {
-    uintptr_t ptr_val;
-    if (!absl::SimpleHexAtoi(sptr, &ptr_val)) {
-      return absl::InternalError(
-          absl::StrCat("failed to parse 0x", sptr, " as void*"));
+
+  // Releases `ptr` and returns its id. The id is immediately available for
+  // reuse unless `recycle` is false, in which case it must later be passed to
+  // `Recycle()`.
+  absl::StatusOr<uint64_t> Release(void* ptr, uint32_t pid = 0,
+                                   bool recycle = true) {
+    auto it = id_map_.find(std::make_pair(pid, ptr));
+    if (it == id_map_.end()) {
+      return absl::FailedPreconditionError(absl::StrFormat(
+          "Tracefile frees unallocated ptr %p in pid %v", ptr, pid));
     }
-    // NOLINTNEXTLINE(performance-no-int-to-ptr)
-    return reinterpret_cast<void*>(ptr_val);
+    uint64_t id = it->second;
+    id_map_.erase(it);
+
+    if (recycle) {
+      Recycle(id);
+    }
+    return id;
   }
 
-  static absl::StatusOr<size_t> ParseSize(absl::string_view ssize) {
-    size_t size;
-    if (!absl::SimpleAtoi(ssize, &size)) {
-      return absl::InternalError(
-          absl::StrCat("failed to parse ", ssize, " as size_t"));
+  void Recycle(uint64_t id) {
+    available_ids_.push(id);
+  }
+
+  bool IsLive(void* ptr, uint32_t pid = 0) const {
+    return id_map_.contains(std::make_pair(pid, ptr));
+  }
+
+  size_t NumLive() const {
+    return id_map_.size();
+  }
+
+  // Appends frees of all unfreed memory to `tracefile`, in order of id.
+  void FreeAll(Tracefile& tracefile) const {
+    std::vector<uint64_t> ids;
+    ids.reserve(id_map_.size());
+    for (const auto& [key, id] : id_map_) {
+      ids.push_back(id);
+    }
+    std::sort(ids.begin(), ids.end());
+    for (uint64_t id : ids) {
+      TraceLine* line = tracefile.mutable_lines()->Add();
+      proto::TraceLine_Free* free = line->mutable_free();
+      free->set_input_id(id);
     }
-    return size;
   }
 
-  const class Tracefile tracefile_;
+ private:
+  absl::flat_hash_map<std::pair<uint32_t, void*>, uint64_t> id_map_;
+  // A min-heap of the ids of freed pointers.
+  std::priority_queue<uint64_t, std::vector<uint64_t>, std::greater<>>
+      available_ids_;
+  uint64_t next_id_ = 0;
 };
 
-absl::Status CleanTracefile(absl::string_view input_path, std::ostream& out,
-                            bool text_serialize = false) {
-  DEFINE_OR_RETURN(DirtyTracefileReader, reader,
-                   DirtyTracefileReader::Open(std::string(input_path)));
-  if (text_serialize) {
-    google::protobuf::io::OstreamOutputStream os(&out);
-    google::protobuf::TextFormat::Print(reader.Tracefile(), &os);
-  } else {
-    reader.Tracefile().SerializeToOstream(&out);
+// Reads every op recorded in `filename`.
+absl::StatusOr<std::vector<RecordedOp>> ReadRecordedOps(
+    const std::string& filename) {
+  std::ifstream file(filename, std::ios::binary);
+  if (!file.is_open()) {
+    return absl::InternalError(
+        absl::StrCat("Failed to open file ", filename));
+  }
+
+  RecordingHeader header;
+  if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+      memcmp(header.magic, kRecordingMagic, sizeof(header.magic)) != 0) {
+    return absl::InvalidArgumentError(
+        absl::StrCat(filename, " is not a trace recording"));
+  }
+  if (header.version != kRecordingVersion ||
+      header.record_size != sizeof(RecordedOp)) {
+    return absl::InvalidArgumentError(absl::StrFormat(
+        "Unsupported recording version %v with record size %v",
+        header.version, header.record_size));
   }
 
+  // The header is only updated when the recorded process exits, so read
+  // every whole record present in case it didn't exit cleanly.
+  std::vector<RecordedOp> ops;
+  RecordedOp op;
+  while (file.read(reinterpret_cast<char*>(&op), sizeof(op))) {
+    ops.push_back(op);
+  }
+  return ops;
+}
+
+// Appends `call` to `tracefile`, tagging it with the thread id of its pid.
+absl::Status AddCall(const ParsedCall& call, IdAssigner& ids,
+                     absl::flat_hash_map<uint32_t, uint32_t>& thread_ids,
+                     Tracefile& tracefile) {
+  // NOLINTBEGIN(performance-no-int-to-ptr)
+  void* input_ptr = reinterpret_cast<void*>(call.input_ptr);
+  void* result_ptr = reinterpret_cast<void*>(call.result_ptr);
+  // NOLINTEND(performance-no-int-to-ptr)
+
+  TraceLine& line = *tracefile.mutable_lines()->Add();
+  // Thread ids are assigned in order of first appearance.
+  auto [it, _inserted] = thread_ids.emplace(call.pid, thread_ids.size());
+  line.set_thread_id(it->second);
+
+  switch (call.type) {
+    case ParsedCall::Type::kFree: {
+      proto::TraceLine_Free* free = line.mutable_free();
+      if (input_ptr != nullptr) {
+        DEFINE_OR_RETURN(uint64_t, id, ids.Release(input_ptr, call.pid));
+        free->set_input_id(id);
+      }
+      break;
+    }
+    case ParsedCall::Type::kMalloc:
+    case ParsedCall::Type::kAlignedMalloc: {
+      DEFINE_OR_RETURN(uint64_t, id, ids.Allocate(result_ptr, call.pid));
+      proto::TraceLine_Malloc* malloc = line.mutable_malloc();
+      malloc->set_input_size(call.size);
+      if (call.type == ParsedCall::Type::kAlignedMalloc) {
+        malloc->set_input_alignment(call.arg);
+      }
+      malloc->set_result_id(id);
+      break;
+    }
+    case ParsedCall::Type::kCalloc: {
+      DEFINE_OR_RETURN(uint64_t, id, ids.Allocate(result_ptr, call.pid));
+      proto::TraceLine_Calloc* calloc = line.mutable_calloc();
+      calloc->set_input_nmemb(call.arg);
+      calloc->set_input_size(call.size);
+      calloc->set_result_id(id);
+      break;
+    }
+    case ParsedCall::Type::kRealloc: {
+      proto::TraceLine_Realloc* realloc = line.mutable_realloc();
+      if (input_ptr != nullptr) {
+        DEFINE_OR_RETURN(uint64_t, id, ids.Release(input_ptr, call.pid));
+        realloc->set_input_id(id);
+      }
+      DEFINE_OR_RETURN(uint64_t, id, ids.Allocate(result_ptr, call.pid));
+      realloc->set_input_size(call.size);
+      realloc->set_result_id(id);
+      break;
+    }
+  }
   return absl::OkStatus();
 }
 
-}  // namespace bench
+}  // namespace
+
+absl::StatusOr<Tracefile> ParseValgrindLog(std::string_view log,
+                                           uint32_t threads,
+                                           uint64_t max_ops) {
+  const std::vector<std::string_view> chunks = SplitLines(log, threads);
+  std::vector<ParsedChunk> parsed(chunks.size());
+  {
+    std::vector<std::thread> workers;
+    workers.reserve(chunks.size());
+    for (size_t i = 0; i < chunks.size(); i++) {
+      workers.emplace_back(
+          [&chunks, &parsed, i] { parsed[i] = ParseChunk(chunks[i]); });
+    }
+    for (std::thread& worker : workers) {
+      worker.join();
+    }
+  }
+
+  Tracefile tracefile;
+  absl::flat_hash_map<uint32_t, uint32_t> thread_ids;
+  IdAssigner ids;
+  uint64_t max_simultaneous_allocs = 0;
+  uint64_t num_ops = 0;
+
+  for (const ParsedChunk& chunk : parsed) {
+    for (std::string_view line : chunk.skipped_lines) {
+      std::cerr << "Skipping line " << line << std::endl;
+    }
+    for (const ParsedCall& call : chunk.calls) {
+      if (num_ops + ids.NumLive() >= max_ops) {
+        break;
+      }
+      RETURN_IF_ERROR(AddCall(call, ids, thread_ids, tracefile));
+      max_simultaneous_allocs =
+          std::max<uint64_t>(max_simultaneous_allocs, ids.NumLive());
+      num_ops++;
+    }
+    if (num_ops + ids.NumLive() >= max_ops) {
+      break;
+    }
+  }
+
+  ids.FreeAll(tracefile);
 
-int main(int argc, char* argv[]) {
-  absl::ParseCommandLine(argc, argv);
+  tracefile.set_max_simultaneous_allocs(max_simultaneous_allocs);
+  return tracefile;
+}
+
+absl::StatusOr<Tracefile> ReadValgrindLog(const std::string& filename,
+                                          uint32_t threads, uint64_t max_ops) {
+  DEFINE_OR_RETURN(MappedFile, file, MappedFile::Open(filename));
+  return ParseValgrindLog(file.contents(), threads, max_ops);
+}
 
-  const std::string& input_tracefile_path = absl::GetFlag(FLAGS_trace);
-  if (input_tracefile_path.empty()) {
-    std::cerr << "Flag --input is required" << std::endl;
+absl::StatusOr<Tracefile> ReadRecording(const std::string& filename,
+                                        uint64_t max_ops) {
+  DEFINE_OR_RETURN(std::vector<RecordedOp>, ops, ReadRecordedOps(filename));
+
+  // A realloc releases its input pointer when it starts, and obtains its
+  // result when it ends.
+  struct Event {
+    uint64_t time_ns;
+    uint64_t op_idx;
+    bool release;
+  };
+  std::vector<Event> events;
+  events.reserve(ops.size());
+  for (uint64_t i = 0; i < ops.size(); i++) {
+    const RecordedOp& op = ops[i];
+    if (op.op == RecordedOpType::kFree ||
+        (op.op == RecordedOpType::kRealloc && op.arg != 0)) {
+      events.push_back(
+          Event{ .time_ns = op.start_ns, .op_idx = i, .release = true });
+    }
+    if (op.op != RecordedOpType::kFree) {
+      events.push_back(
+          Event{ .time_ns = op.end_ns, .op_idx = i, .release = false });
+    }
   }
+  // Stable, so each thread's ops stay in the order it made them.
+  std::stable_sort(
+      events.begin(), events.end(),
+      [](const Event& a, const Event& b) { return a.time_ns < b.time_ns; });
+
+  Tracefile tracefile;
+  absl::flat_hash_map<uint32_t, uint32_t> thread_ids;
+  IdAssigner ids;
+  // The ids released by reallocs which have started but not ended.
+  absl::flat_hash_map<uint64_t, uint64_t> realloc_input_ids;
+  uint64_t max_simultaneous_allocs = 0;
+  uint64_t unknown_frees = 0;
+
+  // Lines are timestamped relative to the first event.
+  const uint64_t start_ns = events.empty() ? 0 : events.front().time_ns;
+  const auto add_line = [&thread_ids, &tracefile, start_ns](
+                            const RecordedOp& op, const Event& event) {
+    TraceLine& line = *tracefile.mutable_lines()->Add();
+    // Thread ids are assigned in order of first appearance.
+    auto [it, _inserted] =
+        thread_ids.emplace(op.thread_id, thread_ids.size());
+    line.set_thread_id(it->second);
+    line.set_timestamp_ns(event.time_ns - start_ns);
+    if (op.site_id != 0) {
+      line.set_site_id(op.site_id);
+    }
+    return &line;
+  };
+
+  for (uint64_t iter = 0;
+       iter < events.size() && iter + ids.NumLive() < max_ops; iter++) {
+    const Event& event = events[iter];
+    const RecordedOp& op = ops[event.op_idx];
+
+    if (event.release) {
+      // NOLINTNEXTLINE(performance-no-int-to-ptr)
+      void* input_ptr = reinterpret_cast<void*>(
+          op.op == RecordedOpType::kFree ? op.ptr : op.arg);
+      // Pointers obtained before the recorder was loaded, e.g. by the
+      // dynamic loader, were never recorded.
+      if (!ids.IsLive(input_ptr)) {
+        unknown_frees++;
+        continue;
+      }
+      if (op.op == RecordedOpType::kRealloc) {
+        DEFINE_OR_RETURN(uint64_t, id,
+                         ids.Release(input_ptr, /*pid=*/0,
+                                     /*recycle=*/false));
+        realloc_input_ids[event.op_idx] = id;
+        continue;
+      }
 
-  absl::Status s =
-      bench::CleanTracefile(input_tracefile_path, std::cout,
-                            /*text_serialize=*/!absl::GetFlag(FLAGS_binary));
+      DEFINE_OR_RETURN(uint64_t, id, ids.Release(input_ptr));
+      proto::TraceLine_Free* free = add_line(op, event)->mutable_free();
+      free->set_input_id(id);
+      if (op.size != 0) {
+        free->set_input_size_hint(op.size);
+      }
+      if (op.arg != 0) {
+        free->set_input_alignment_hint(op.arg);
+      }
+      continue;
+    }
 
-  if (!s.ok()) {
-    std::cerr << "Fatal error: " << s << std::endl;
+    // NOLINTNEXTLINE(performance-no-int-to-ptr)
+    void* result_ptr = reinterpret_cast<void*>(op.ptr);
+    switch (op.op) {
+      case RecordedOpType::kMalloc: {
+        DEFINE_OR_RETURN(uint64_t, id, ids.Allocate(result_ptr));
+        proto::TraceLine_Malloc* malloc =
+            add_line(op, event)->mutable_malloc();
+        malloc->set_input_size(op.size);
+        if (op.arg != 0) {
+          malloc->set_input_alignment(op.arg);
+        }
+        malloc->set_result_id(id);
+        break;
+      }
+      case RecordedOpType::kCalloc: {
+        DEFINE_OR_RETURN(uint64_t, id, ids.Allocate(result_ptr));
+        proto::TraceLine_Calloc* calloc =
+            add_line(op, event)->mutable_calloc();
+        calloc->set_input_nmemb(op.arg);
+        calloc->set_input_size(op.size);
+        calloc->set_result_id(id);
+        break;
+      }
+      case RecordedOpType::kRealloc: {
+        // As in valgrind traces, the result may reuse the input's id.
+        std::optional<uint64_t> input_id;
+        auto it = realloc_input_ids.find(event.op_idx);
+        if (it != realloc_input_ids.end()) {
+          input_id = it->second;
+          ids.Recycle(it->second);
+          realloc_input_ids.erase(it);
+        }
+        DEFINE_OR_RETURN(uint64_t, id, ids.Allocate(result_ptr));
+        proto::TraceLine_Realloc* realloc =
+            add_line(op, event)->mutable_realloc();
+        if (input_id.has_value()) {
+          realloc->set_input_id(input_id.value());
+        }
+        realloc->set_input_size(op.size);
+        realloc->set_result_id(id);
+        break;
+      }
+      default: {
+        return absl::InvalidArgumentError(absl::StrFormat(
+            "Unknown recorded op %v", static_cast<uint32_t>(op.op)));
+      }
+    }
+
+    max_simultaneous_allocs =
+        std::max<uint64_t>(max_simultaneous_allocs, ids.NumLive());
   }
 
-  return 0;
+  if (unknown_frees != 0) {
+    std::cerr << "Skipped " << unknown_frees
+              << " frees of pointers not allocated in the recording"
+              << std::endl;
+  }
+  ids.FreeAll(tracefile);
+
+  tracefile.set_max_simultaneous_allocs(max_simultaneous_allocs);
+  return tracefile;
 }
+
+}  // namespace bench
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+
+#include "absl/status/statusor.h"
+
+#include "proto/tracefile.pb.h"
+
+namespace bench {
+
+using proto::Tracefile;
+using proto::TraceLine;
+
+// Converts valgrind --trace-malloc=yes output to a tracefile. `log` is parsed
+// in `threads` chunks in parallel, then ids are assigned to the pointers in
+// each call in order. Every pid is kept as its own thread, with its pointers
+// tracked separately, since pids may be separate processes which reuse the
+// same addresses.
+//
+// Stops once the ops parsed plus the frees needed for all unfreed memory reach
+// `max_ops`.
+absl::StatusOr<Tracefile> ParseValgrindLog(
+    std::string_view log, uint32_t threads,
+    uint64_t max_ops = std::numeric_limits<uint64_t>::max());
+
+// Parses the valgrind output in the file `filename` with `ParseValgrindLog()`.
+absl::StatusOr<Tracefile> ReadValgrindLog(
+    const std::string& filename, uint32_t threads,
+    uint64_t max_ops = std::numeric_limits<uint64_t>::max());
+
+// Converts a recording made by librecorder.so (see trace_recording.h) to a
+// tracefile, ordering ops by when they obtained and released pointers.
+absl::StatusOr<Tracefile> ReadRecording(
+    const std::string& filename,
+    uint64_t max_ops = std::numeric_limits<uint64_t>::max());
+
+}  // namespace bench
@@ -0,0 +1,90 @@
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <ostream>
+#include <string>
+#include <thread>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "google/protobuf/io/zero_copy_stream_impl.h"
+#include "google/protobuf/text_format.h"
+#include "util/absl_util.h"
+
+#include "proto/tracefile.pb.h"
+#include "src/tracefile_parser.h"
+
+ABSL_FLAG(std::string, trace, "", "File path of the trace to clean.");
+
+ABSL_FLAG(bool, binary, false, "Output binary proto");
+
+ABSL_FLAG(uint64_t, max_ops, std::numeric_limits<uint64_t>::max(),
+          "Limits the total number of ops in a trace. A tracefile will stop "
+          "being parsed after enough ops have been parsed, accounting for "
+          "needing to free all allocated memory.");
+
+ABSL_FLAG(uint32_t, threads, 0,
+          "The number of threads parsing valgrind output in parallel, or 0 "
+          "for one per available CPU. Every pid in the output is kept as its "
+          "own thread.");
+
+ABSL_FLAG(bool, recording, false,
+          "If set, --trace is a recording made by librecorder.so rather than "
+          "the output of valgrind --trace-malloc=yes. Every thread is kept.");
+
+namespace bench {
+
+void SerializeTracefile(const Tracefile& tracefile, std::ostream& out,
+                        bool text_serialize) {
+  if (text_serialize) {
+    google::protobuf::io::OstreamOutputStream os(&out);
+    google::protobuf::TextFormat::Print(tracefile, &os);
+  } else {
+    tracefile.SerializeToOstream(&out);
+  }
+}
+
+absl::Status CleanTracefile(absl::string_view input_path, std::ostream& out,
+                            bool text_serialize = false) {
+  const uint64_t max_ops = absl::GetFlag(FLAGS_max_ops);
+  if (absl::GetFlag(FLAGS_recording)) {
+    DEFINE_OR_RETURN(Tracefile, tracefile,
+                     ReadRecording(std::string(input_path), max_ops));
+    SerializeTracefile(tracefile, out, text_serialize);
+    return absl::OkStatus();
+  }
+
+  uint32_t threads = absl::GetFlag(FLAGS_threads);
+  if (threads == 0) {
+    threads = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+  DEFINE_OR_RETURN(
+      Tracefile, tracefile,
+      ReadValgrindLog(std::string(input_path), threads, max_ops));
+  SerializeTracefile(tracefile, out, text_serialize);
+  return absl::OkStatus();
+}
+
+}  // namespace bench
+
+int main(int argc, char* argv[]) {
+  absl::ParseCommandLine(argc, argv);
+
+  const std::string& input_tracefile_path = absl::GetFlag(FLAGS_trace);
+  if (input_tracefile_path.empty()) {
+    std::cerr << "Flag --input is required" << std::endl;
+  }
+
+  absl::Status s =
+      bench::CleanTracefile(input_tracefile_path, std::cout,
+                            /*text_serialize=*/!absl::GetFlag(FLAGS_binary));
+
+  if (!s.ok()) {
+    std::cerr << "Fatal error: " << s << std::endl;
+  }
+
+  return 0;
+}
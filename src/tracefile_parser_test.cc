@@ -0,0 +1,64 @@
+#include "src/tracefile_parser.h"
+
+#include <cstdint>
+
+#include "absl/status/statusor.h"
+#include "gtest/gtest.h"
+#include "util/gtest_util.h"
+
+#include "proto/tracefile.pb.h"
+
+namespace bench {
+
+class TestTracefileParser : public ::testing::Test {
+ protected:
+  // Two processes, e.g. a parent and its fork, which allocate the same address
+  // and free it in the opposite order.
+  static constexpr char kTwoPidLog[] =
+      "==100== Memcheck, a memory error detector\n"
+      "--100-- malloc(16) = 0x4a4b040\n"
+      "--200-- malloc(32) = 0x4a4b040\n"
+      "--200-- free(0x4a4b040)\n"
+      "--100-- free(0x4a4b040)\n";
+};
+
+TEST_F(TestTracefileParser, KeepsEveryPid) {
+  for (uint32_t threads : { 1, 2, 4 }) {
+    absl::StatusOr<Tracefile> tracefile =
+        ParseValgrindLog(kTwoPidLog, threads);
+    ASSERT_THAT(tracefile, util::IsOk());
+    ASSERT_EQ(tracefile->lines_size(), 4);
+
+    const TraceLine& malloc_100 = tracefile->lines(0);
+    const TraceLine& malloc_200 = tracefile->lines(1);
+    const TraceLine& free_200 = tracefile->lines(2);
+    const TraceLine& free_100 = tracefile->lines(3);
+    ASSERT_TRUE(malloc_100.has_malloc());
+    ASSERT_TRUE(malloc_200.has_malloc());
+    ASSERT_TRUE(free_200.has_free());
+    ASSERT_TRUE(free_100.has_free());
+
+    EXPECT_EQ(malloc_100.thread_id(), 0);
+    EXPECT_EQ(malloc_200.thread_id(), 1);
+    EXPECT_EQ(free_200.thread_id(), 1);
+    EXPECT_EQ(free_100.thread_id(), 0);
+
+    // The same address in each pid is a different allocation.
+    EXPECT_NE(malloc_100.malloc().result_id(),
+              malloc_200.malloc().result_id());
+    EXPECT_EQ(malloc_100.malloc().input_size(), 16);
+    EXPECT_EQ(malloc_200.malloc().input_size(), 32);
+    EXPECT_EQ(free_200.free().input_id(), malloc_200.malloc().result_id());
+    EXPECT_EQ(free_100.free().input_id(), malloc_100.malloc().result_id());
+    EXPECT_EQ(tracefile->max_simultaneous_allocs(), 2);
+  }
+}
+
+TEST_F(TestTracefileParser, RejectsFreeFromOtherPid) {
+  EXPECT_FALSE(ParseValgrindLog("--100-- malloc(16) = 0x4a4b040\n"
+                                "--200-- free(0x4a4b040)\n",
+                                /*threads=*/1)
+                   .ok());
+}
+
+}  // namespace bench
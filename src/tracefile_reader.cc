@@ -1,46 +1,97 @@
 #include "src/tracefile_reader.h"
 
 #include <cstddef>
-#include <fstream>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <utility>
 
+#include "absl/base/call_once.h"
+#include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "util/absl_util.h"
+
+#include "src/binary_trace.h"
+#include "src/columnar_trace.h"
+#include "src/trace_input_stream.h"
 
 namespace bench {
 
 /* static */
 absl::StatusOr<TracefileReader> TracefileReader::Open(
     const std::string& filename) {
-  std::ifstream file(filename);
+  DEFINE_OR_RETURN(bool, is_binary, BinaryTrace::IsBinaryTrace(filename));
+  if (is_binary) {
+    DEFINE_OR_RETURN(BinaryTrace, binary_trace, BinaryTrace::Open(filename));
+    // Check every op up front, so converting the trace on demand can't fail.
+    for (const BinaryTraceRecord& record : binary_trace.Records()) {
+      if (record.op < BinaryTraceOp::kMalloc ||
+          record.op > BinaryTraceOp::kFree) {
+        return absl::InvalidArgumentError(
+            absl::StrFormat("Invalid binary trace op %u in %s",
+                            static_cast<uint8_t>(record.op), filename));
+      }
+    }
+    return TracefileReader(std::move(binary_trace));
+  }
 
-  if (!file.is_open()) {
-    return absl::InternalError(absl::StrCat("Failed to open file ", filename));
+  DEFINE_OR_RETURN(bool, is_columnar,
+                   ColumnarTrace::IsColumnarTrace(filename));
+  if (is_columnar) {
+    DEFINE_OR_RETURN(class Tracefile, tracefile,
+                     ColumnarTrace::Read(filename));
+    return TracefileReader(std::move(tracefile));
   }
 
+  DEFINE_OR_RETURN(TraceInputStream, input, TraceInputStream::Open(filename));
+
   class Tracefile tracefile;
-  if (!tracefile.ParseFromIstream(&file)) {
+  const bool parsed = tracefile.ParseFromZeroCopyStream(input.stream());
+  // A decompression error may end the stream on a line boundary, which still
+  // parses.
+  RETURN_IF_ERROR(input.status());
+  if (!parsed) {
     return absl::InternalError(
         absl::StrCat("Failed to parse ", filename, " as proto"));
   }
-  file.close();
 
   return TracefileReader(std::move(tracefile));
 }
 
 size_t TracefileReader::size() const {
-  return tracefile_.lines_size();
+  if (binary_trace_.has_value()) {
+    return binary_trace_->Records().size();
+  }
+  return tracefile_->tracefile.lines_size();
 }
 
 TracefileReader::const_iterator TracefileReader::begin() const {
-  return tracefile_.lines().cbegin();
+  return Tracefile().lines().cbegin();
 }
 
 TracefileReader::const_iterator TracefileReader::end() const {
-  return tracefile_.lines().cend();
+  return Tracefile().lines().cend();
+}
+
+const Tracefile& TracefileReader::Tracefile() const {
+  if (binary_trace_.has_value()) {
+    absl::call_once(tracefile_->converted, [this]() {
+      // Every op was checked by `Open`.
+      tracefile_->tracefile = binary_trace_->ToTracefile().value();
+    });
+  }
+  return tracefile_->tracefile;
 }
 
 TracefileReader::TracefileReader(class Tracefile&& tracefile)
-    : tracefile_(std::move(tracefile)) {}
+    : tracefile_(std::make_unique<LazyTracefile>()) {
+  tracefile_->tracefile = std::move(tracefile);
+}
+
+TracefileReader::TracefileReader(BinaryTrace&& binary_trace)
+    : binary_trace_(std::move(binary_trace)),
+      tracefile_(std::make_unique<LazyTracefile>()) {}
 
 }  // namespace bench
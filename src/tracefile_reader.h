@@ -1,11 +1,15 @@
 #pragma once
 
 #include <cstddef>
+#include <memory>
+#include <optional>
 #include <string>
 
+#include "absl/base/call_once.h"
 #include "absl/status/statusor.h"
 
 #include "proto/tracefile.pb.h"
+#include "src/binary_trace.h"
 
 namespace bench {
 
@@ -17,6 +21,10 @@ class TracefileReader {
   using const_iterator = google::protobuf::internal::RepeatedPtrIterator<
       const TraceLine>::iterator;
 
+  // Reads `filename`, which may be a serialized `Tracefile` proto, optionally
+  // gzip- or zstd-compressed, a binary trace (see `BinaryTrace`), or a
+  // columnar trace (see `ColumnarTrace`). Binary traces are only mapped, and
+  // are not converted to a proto until `Tracefile()` is first called.
   static absl::StatusOr<TracefileReader> Open(const std::string& filename);
 
   size_t size() const;
@@ -24,14 +32,27 @@ class TracefileReader {
   const_iterator begin() const;
   const_iterator end() const;
 
-  const Tracefile& Tracefile() const {
-    return tracefile_;
+  // The mapped trace if the file was a binary trace, which can be replayed in
+  // place, or nullptr.
+  const BinaryTrace* Binary() const {
+    return binary_trace_.has_value() ? &binary_trace_.value() : nullptr;
   }
 
+  const Tracefile& Tracefile() const;
+
  private:
+  // The proto representation of the trace, built on first use for binary
+  // traces.
+  struct LazyTracefile {
+    absl::once_flag converted;
+    class Tracefile tracefile;
+  };
+
   explicit TracefileReader(class Tracefile&& tracefile);
+  explicit TracefileReader(BinaryTrace&& binary_trace);
 
-  const class Tracefile tracefile_;
+  std::optional<BinaryTrace> binary_trace_;
+  std::unique_ptr<LazyTracefile> tracefile_;
 };
 
 }  // namespace bench
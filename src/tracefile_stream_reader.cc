@@ -0,0 +1,146 @@
+#include "src/tracefile_stream_reader.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/wire_format_lite.h"
+#include "util/absl_util.h"
+
+#include "proto/tracefile.pb.h"
+#include "src/trace_input_stream.h"
+
+namespace bench {
+
+namespace {
+
+using google::protobuf::internal::WireFormatLite;
+using google::protobuf::io::CodedInputStream;
+
+// `Tracefile.lines`.
+constexpr uint32_t kLinesFieldNumber = 1;
+
+// The number of lines skipped per `CodedInputStream` when counting lines. Each
+// `CodedInputStream` can read at most 2 GiB, so long traces must be read
+// through several.
+constexpr size_t kCountChunkLines = 1 << 16;
+
+}  // namespace
+
+TracefileStreamReader::~TracefileStreamReader() = default;
+
+TracefileStreamReader::TracefileStreamReader(TracefileStreamReader&& other)
+    : filename_(std::move(other.filename_)),
+      input_(std::move(other.input_)),
+      size_(other.size_) {}
+
+/* static */
+absl::StatusOr<TracefileStreamReader> TracefileStreamReader::Open(
+    const std::string& filename) {
+  DEFINE_OR_RETURN(TraceInputStream, input_stream,
+                   TraceInputStream::Open(filename));
+
+  TracefileStreamReader reader(filename, std::move(input_stream));
+  while (true) {
+    CodedInputStream input(reader.input_.stream());
+    size_t lines = 0;
+    while (lines < kCountChunkLines) {
+      DEFINE_OR_RETURN(bool, has_line, reader.NextLine(input, nullptr));
+      if (!has_line) {
+        break;
+      }
+      lines++;
+    }
+    reader.size_ += lines;
+    if (lines < kCountChunkLines) {
+      break;
+    }
+  }
+  RETURN_IF_ERROR(reader.input_.status());
+
+  RETURN_IF_ERROR(reader.Rewind());
+  return reader;
+}
+
+absl::Status TracefileStreamReader::NextChunk(size_t max_lines,
+                                              std::vector<TraceLine>& chunk) {
+  // Lines are decoded into the existing messages where possible, to reuse
+  // their memory across chunks.
+  chunk.resize(max_lines);
+  CodedInputStream input(input_.stream());
+  size_t lines = 0;
+  while (lines < max_lines) {
+    DEFINE_OR_RETURN(bool, has_line, NextLine(input, &chunk[lines]));
+    if (!has_line) {
+      break;
+    }
+    lines++;
+  }
+  chunk.resize(lines);
+  return input_.status();
+}
+
+absl::Status TracefileStreamReader::Rewind() {
+  return input_.Rewind();
+}
+
+TracefileStreamReader::TracefileStreamReader(std::string filename,
+                                             TraceInputStream input)
+    : filename_(std::move(filename)), input_(std::move(input)) {}
+
+absl::Status TracefileStreamReader::ReadError(
+    absl::string_view problem) const {
+  RETURN_IF_ERROR(input_.status());
+  return absl::InternalError(absl::StrFormat("%s in %s", problem, filename_));
+}
+
+absl::StatusOr<bool> TracefileStreamReader::NextLine(CodedInputStream& input,
+                                                     TraceLine* line) {
+  while (true) {
+    const uint32_t tag = input.ReadTag();
+    if (tag == 0) {
+      if (!input.ConsumedEntireMessage()) {
+        return ReadError("Malformed tag");
+      }
+      return false;
+    }
+
+    if (WireFormatLite::GetTagFieldNumber(tag) != kLinesFieldNumber ||
+        WireFormatLite::GetTagWireType(tag) !=
+            WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+      if (!WireFormatLite::SkipField(&input, tag)) {
+        return ReadError("Malformed field");
+      }
+      continue;
+    }
+
+    uint32_t length;
+    if (!input.ReadVarint32(&length)) {
+      return ReadError("Truncated line length");
+    }
+    if (line == nullptr) {
+      if (!input.Skip(length)) {
+        return ReadError("Truncated line");
+      }
+      return true;
+    }
+
+    const CodedInputStream::Limit limit = input.PushLimit(length);
+    line->Clear();
+    if (!line->MergeFromCodedStream(&input) ||
+        !input.ConsumedEntireMessage()) {
+      return ReadError("Failed to parse line");
+    }
+    input.PopLimit(limit);
+    return true;
+  }
+}
+
+}  // namespace bench
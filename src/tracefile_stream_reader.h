@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "google/protobuf/io/coded_stream.h"
+
+#include "proto/tracefile.pb.h"
+#include "src/trace_input_stream.h"
+
+namespace bench {
+
+using proto::TraceLine;
+
+// Reads the lines of a tracefile incrementally, decoding the `Tracefile` wire
+// format one `TraceLine` at a time instead of parsing the whole message into
+// memory. Since `Tracefile.lines` is a repeated length-delimited field, every
+// existing tracefile can be streamed this way. Compressed tracefiles are
+// decompressed as they are read.
+class TracefileStreamReader {
+ public:
+  TracefileStreamReader(TracefileStreamReader&& other);
+  ~TracefileStreamReader();
+
+  // Opens `filename` and makes a first pass over it, skipping over each line
+  // without decoding it, to count the lines and validate the framing.
+  static absl::StatusOr<TracefileStreamReader> Open(
+      const std::string& filename);
+
+  // The number of lines in the tracefile.
+  size_t size() const {
+    return size_;
+  }
+
+  // Decodes up to `max_lines` lines following the last ones returned into
+  // `chunk`, replacing its contents. `chunk` is left empty once all lines have
+  // been read.
+  absl::Status NextChunk(size_t max_lines, std::vector<TraceLine>& chunk);
+
+  // Restarts reading from the first line.
+  absl::Status Rewind();
+
+ private:
+  TracefileStreamReader(std::string filename, TraceInputStream input);
+
+  // Reads the next line into `line`, returning false at the end of the file.
+  absl::StatusOr<bool> NextLine(google::protobuf::io::CodedInputStream& input,
+                                TraceLine* line);
+
+  // The error for malformed input, which is the decompression error behind it
+  // if there is one.
+  absl::Status ReadError(absl::string_view problem) const;
+
+  std::string filename_;
+  TraceInputStream input_;
+  size_t size_ = 0;
+};
+
+}  // namespace bench
@@ -0,0 +1,35 @@
+#include "src/tracefile_writer.h"
+
+#include <fstream>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+
+#include "proto/tracefile.pb.h"
+#include "src/binary_trace.h"
+#include "src/columnar_trace.h"
+
+namespace bench {
+
+absl::Status WriteTracefile(const Tracefile& tracefile,
+                            const std::string& filename,
+                            const std::string& format) {
+  if (format == "binary") {
+    return BinaryTrace::Write(tracefile, filename);
+  }
+  if (format == "columnar") {
+    return ColumnarTrace::Write(tracefile, filename);
+  }
+  if (format == "proto") {
+    std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+    if (!out.is_open() || !tracefile.SerializeToOstream(&out)) {
+      return absl::InternalError(absl::StrCat("Failed to write ", filename));
+    }
+    return absl::OkStatus();
+  }
+  return absl::InvalidArgumentError(
+      absl::StrCat("Unknown trace format \"", format, "\""));
+}
+
+}  // namespace bench
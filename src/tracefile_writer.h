@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+
+#include "absl/status/status.h"
+
+#include "proto/tracefile.pb.h"
+
+namespace bench {
+
+using proto::Tracefile;
+
+// Writes `tracefile` to `filename` in `format`, one of "binary" (see
+// `BinaryTrace`), "columnar" (see `ColumnarTrace`) or "proto" (a serialized
+// `Tracefile`).
+absl::Status WriteTracefile(const Tracefile& tracefile,
+                            const std::string& filename,
+                            const std::string& format);
+
+}  // namespace bench
@@ -0,0 +1,91 @@
+#include "src/trial_stats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+
+namespace bench {
+
+namespace {
+
+// Scales the MAD to estimate the standard deviation of a normal distribution.
+constexpr double kMadToStddev = 1.4826;
+
+// The z-value of a two-sided 95% confidence interval.
+constexpr double kZ95 = 1.96;
+
+// Returns the median of `sorted`, which must be non-empty and sorted.
+double SortedMedian(const std::vector<double>& sorted) {
+  const size_t n = sorted.size();
+  return n % 2 == 1 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+}
+
+double Mad(const std::vector<double>& samples, double median) {
+  std::vector<double> deviations;
+  deviations.reserve(samples.size());
+  for (double sample : samples) {
+    deviations.push_back(std::abs(sample - median));
+  }
+  std::sort(deviations.begin(), deviations.end());
+  return SortedMedian(deviations);
+}
+
+}  // namespace
+
+/* static */
+absl::StatusOr<TrialStats> TrialStats::Compute(std::vector<double> samples,
+                                               double outlier_threshold) {
+  if (samples.empty()) {
+    return absl::InvalidArgumentError("No samples to compute statistics of");
+  }
+  std::sort(samples.begin(), samples.end());
+
+  size_t num_rejected = 0;
+  const double median = SortedMedian(samples);
+  const double mad = Mad(samples, median);
+  if (outlier_threshold > 0 && mad > 0) {
+    const double max_deviation = outlier_threshold * kMadToStddev * mad;
+    std::vector<double> kept;
+    kept.reserve(samples.size());
+    for (double sample : samples) {
+      if (std::abs(sample - median) <= max_deviation) {
+        kept.push_back(sample);
+      }
+    }
+    num_rejected = samples.size() - kept.size();
+    samples = std::move(kept);
+  }
+
+  TrialStats stats{
+    .num_rejected = num_rejected,
+    .median = SortedMedian(samples),
+  };
+  stats.mad = Mad(samples, stats.median);
+
+  // The ranks of the order statistics bounding the median with 95%
+  // confidence, from the normal approximation to the binomial distribution of
+  // the number of samples below the true median.
+  const size_t n = samples.size();
+  if (n < 6) {
+    stats.ci_low = samples.front();
+    stats.ci_high = samples.back();
+  } else {
+    const double half_width = kZ95 * std::sqrt(n) / 2;
+    const size_t low = static_cast<size_t>(
+        std::max(std::floor(n / 2.0 - half_width), 1.0));
+    const size_t high = static_cast<size_t>(
+        std::min(std::ceil(n / 2.0 + 1 + half_width), static_cast<double>(n)));
+    stats.ci_low = samples[low - 1];
+    stats.ci_high = samples[high - 1];
+  }
+
+  stats.samples = std::move(samples);
+  return stats;
+}
+
+}  // namespace bench
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "absl/status/statusor.h"
+
+namespace bench {
+
+// Robust summary statistics of repeated measurements of the same quantity,
+// e.g. the throughput of independent perftest trials.
+struct TrialStats {
+  // The samples remaining after outlier rejection.
+  std::vector<double> samples;
+  size_t num_rejected;
+
+  double median;
+  // The median absolute deviation from the median.
+  double mad;
+  // A distribution-free 95% confidence interval of the median, taken from the
+  // order statistics of `samples`. With fewer than 6 samples this is simply
+  // the range of the samples.
+  double ci_low;
+  double ci_high;
+
+  // Computes the statistics of `samples`, first discarding samples whose
+  // modified z-score (their distance from the median in units of
+  // 1.4826 * MAD, which estimates the standard deviation of normally
+  // distributed samples) exceeds `outlier_threshold`. A threshold of 0
+  // disables outlier rejection.
+  static absl::StatusOr<TrialStats> Compute(std::vector<double> samples,
+                                            double outlier_threshold);
+};
+
+}  // namespace bench
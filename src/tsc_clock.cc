@@ -0,0 +1,51 @@
+#include "src/tsc_clock.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+
+namespace bench {
+
+namespace {
+
+// How long to spin when measuring the tick rate against the wall clock.
+constexpr absl::Duration kCalibrationTime = absl::Milliseconds(20);
+
+constexpr uint32_t kOverheadSamples = 10000;
+
+}  // namespace
+
+/* static */
+const TscClock& TscClock::Get() {
+  static const TscClock clock = Calibrate();
+  return clock;
+}
+
+/* static */
+TscClock TscClock::Calibrate() {
+  const absl::Time wall_start = absl::Now();
+  const uint64_t tick_start = Start();
+  absl::Time wall_end;
+  do {
+    wall_end = absl::Now();
+  } while (wall_end - wall_start < kCalibrationTime);
+  const uint64_t tick_end = Stop();
+
+  const double ticks_per_ns =
+      static_cast<double>(tick_end - tick_start) /
+      absl::ToDoubleNanoseconds(wall_end - wall_start);
+
+  uint64_t overhead_ticks = std::numeric_limits<uint64_t>::max();
+  for (uint32_t i = 0; i < kOverheadSamples; i++) {
+    const uint64_t start = Start();
+    const uint64_t stop = Stop();
+    overhead_ticks = std::min(overhead_ticks, stop - start);
+  }
+
+  return TscClock(ticks_per_ns, overhead_ticks);
+}
+
+}  // namespace bench
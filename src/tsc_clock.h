@@ -0,0 +1,88 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+#include "src/util.h"
+
+namespace bench {
+
+// A cycle-resolution clock for timing individual allocator calls, backed by
+// the TSC on x86-64 and the virtual counter on aarch64. Other platforms fall
+// back to `std::chrono::steady_clock`, counting in nanoseconds.
+//
+// Timed regions should be bracketed by `Start()` and `Stop()`, which include
+// the fences needed to keep the measured code from being reordered around the
+// counter reads.
+class TscClock {
+ public:
+  // Returns the process-wide calibrated clock, calibrating it on first use.
+  static const TscClock& Get();
+
+  BENCH_ALWAYS_INLINE static uint64_t Start() {
+#if defined(__x86_64__)
+    _mm_lfence();
+    uint64_t ticks = __rdtsc();
+    _mm_lfence();
+    return ticks;
+#elif defined(__aarch64__)
+    uint64_t ticks;
+    asm volatile("isb; mrs %0, cntvct_el0" : "=r"(ticks)::"memory");
+    return ticks;
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+#endif
+  }
+
+  BENCH_ALWAYS_INLINE static uint64_t Stop() {
+#if defined(__x86_64__)
+    uint32_t aux;
+    uint64_t ticks = __rdtscp(&aux);
+    _mm_lfence();
+    return ticks;
+#else
+    return Start();
+#endif
+  }
+
+  // Converts the ticks elapsed between a `Start()` and `Stop()` to
+  // nanoseconds, subtracting the measured overhead of the clock reads
+  // themselves.
+  double ElapsedNanos(uint64_t start, uint64_t stop) const {
+    const uint64_t ticks = stop - start;
+    return ticks > overhead_ticks_ ? (ticks - overhead_ticks_) / ticks_per_ns_
+                                   : 0;
+  }
+
+  // Converts a raw tick count (e.g. a timestamp difference) to nanoseconds.
+  double ToNanos(uint64_t ticks) const {
+    return ticks / ticks_per_ns_;
+  }
+
+  double TicksPerNano() const {
+    return ticks_per_ns_;
+  }
+
+  uint64_t OverheadTicks() const {
+    return overhead_ticks_;
+  }
+
+ private:
+  TscClock(double ticks_per_ns, uint64_t overhead_ticks)
+      : ticks_per_ns_(ticks_per_ns), overhead_ticks_(overhead_ticks) {}
+
+  static TscClock Calibrate();
+
+  const double ticks_per_ns_;
+  // The minimum observed ticks between back-to-back `Start()` and `Stop()`
+  // calls.
+  const uint64_t overhead_ticks_;
+};
+
+}  // namespace bench
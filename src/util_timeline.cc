@@ -0,0 +1,173 @@
+#include "src/util_timeline.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/strings/strip.h"
+
+#include "src/heap_interface.h"
+
+namespace bench {
+
+namespace {
+
+// The number of pages checked per `mincore` call.
+constexpr size_t kMincoreBatch = 4096;
+
+constexpr char kSmaps[] = "/proc/self/smaps";
+
+// Parses the header line of a mapping in `/proc/self/smaps`, e.g.
+// "7f0000000000-7f0000021000 rw-p 00000000 00:00 0    [heap]", returning
+// whether it is a line of that form.
+bool ParseMappingHeader(absl::string_view line, AnonymousMapping& mapping,
+                        bool& anonymous) {
+  const std::vector<absl::string_view> fields =
+      absl::StrSplit(line, ' ', absl::SkipWhitespace());
+  if (fields.size() < 5) {
+    return false;
+  }
+  const std::pair<absl::string_view, absl::string_view> range =
+      absl::StrSplit(fields[0], absl::MaxSplits('-', 1));
+  if (!absl::SimpleHexAtoi(range.first, &mapping.start) ||
+      !absl::SimpleHexAtoi(range.second, &mapping.end)) {
+    return false;
+  }
+  mapping.resident_bytes = 0;
+
+  // Anonymous mappings have inode 0 and no path, unless named with
+  // `PR_SET_VMA_ANON_NAME`.
+  const absl::string_view perms = fields[1];
+  anonymous = perms.size() == 4 && perms[3] == 'p' && fields[4] == "0" &&
+              (fields.size() == 5 || absl::StartsWith(fields[5], "[anon:"));
+  return true;
+}
+
+}  // namespace
+
+uint64_t UtilSample::TotalLiveBytes() const {
+  uint64_t total = 0;
+  for (uint64_t bytes : live_bytes) {
+    total += bytes;
+  }
+  return total;
+}
+
+uint64_t UtilSample::TotalUsableBytes() const {
+  uint64_t total = 0;
+  for (uint64_t bytes : usable_bytes) {
+    total += bytes;
+  }
+  return total;
+}
+
+template <typename Fn>
+double UtilTimeline::AverageFraction(const Fn& fn) const {
+  double total = 0;
+  size_t n = 0;
+  for (const UtilSample& sample : samples_) {
+    if (sample.heap_bytes == 0) {
+      continue;
+    }
+    total += static_cast<double>(fn(sample)) / sample.heap_bytes;
+    n++;
+  }
+  return n != 0 ? total / n : -1;
+}
+
+double UtilTimeline::AverageUtilization() const {
+  return AverageFraction(
+      [](const UtilSample& sample) { return sample.TotalLiveBytes(); });
+}
+
+double UtilTimeline::AverageInternalFragmentation(size_t size_bucket) const {
+  return AverageFraction([size_bucket](const UtilSample& sample) {
+    return sample.usable_bytes[size_bucket] - sample.live_bytes[size_bucket];
+  });
+}
+
+double UtilTimeline::AverageExternalFragmentation() const {
+  return AverageFraction([](const UtilSample& sample) {
+    const uint64_t usable = sample.TotalUsableBytes();
+    return sample.heap_bytes > usable ? sample.heap_bytes - usable : 0;
+  });
+}
+
+uint64_t ResidentBytes(const void* start, size_t size) {
+  static const uintptr_t page_size = sysconf(_SC_PAGESIZE);
+  // `mincore` requires a page-aligned start.
+  const uintptr_t addr = reinterpret_cast<uintptr_t>(start);
+  const uintptr_t first_page = addr & ~(page_size - 1);
+  const size_t pages = (addr + size - first_page + page_size - 1) / page_size;
+  // NOLINTNEXTLINE(performance-no-int-to-ptr)
+  uint8_t* const base = reinterpret_cast<uint8_t*>(first_page);
+
+  std::vector<unsigned char> residency(std::min(pages, kMincoreBatch));
+  uint64_t resident_pages = 0;
+  for (size_t page = 0; page < pages; page += kMincoreBatch) {
+    const size_t batch = std::min(pages - page, kMincoreBatch);
+    if (mincore(base + page * page_size, batch * page_size,
+                residency.data()) != 0) {
+      continue;
+    }
+    for (size_t i = 0; i < batch; i++) {
+      resident_pages += residency[i] & 1;
+    }
+  }
+  return resident_pages * page_size;
+}
+
+uint64_t ResidentBytes(const Heap& heap) {
+  return ResidentBytes(heap.Start(), heap.Size());
+}
+
+absl::StatusOr<std::vector<AnonymousMapping>> AnonymousMappings() {
+  std::ifstream smaps(kSmaps);
+  if (!smaps) {
+    return absl::UnavailableError(absl::StrFormat("Failed to open %s", kSmaps));
+  }
+
+  std::vector<AnonymousMapping> mappings;
+  AnonymousMapping mapping;
+  bool anonymous = false;
+  std::string line;
+  while (std::getline(smaps, line)) {
+    absl::string_view rss = line;
+    if (!absl::ConsumePrefix(&rss, "Rss:")) {
+      if (ParseMappingHeader(line, mapping, anonymous) && anonymous) {
+        mappings.push_back(mapping);
+      }
+      continue;
+    }
+    if (!anonymous) {
+      continue;
+    }
+    // The size is in kB, e.g. "Rss:    1234 kB".
+    rss = absl::StripAsciiWhitespace(rss);
+    uint64_t kb;
+    if (!absl::ConsumeSuffix(&rss, "kB") ||
+        !absl::SimpleAtoi(absl::StripAsciiWhitespace(rss), &kb)) {
+      return absl::InternalError(
+          absl::StrFormat("Malformed line in %s: %s", kSmaps, line));
+    }
+    mappings.back().resident_bytes = kb * 1024;
+  }
+  return mappings;
+}
+
+}  // namespace bench
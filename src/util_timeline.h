@@ -0,0 +1,88 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "absl/status/statusor.h"
+
+#include "src/heap_interface.h"
+#include "src/latency_histogram.h"
+
+namespace bench {
+
+// The state of the heap at one point during a utilization test. Live bytes
+// are split into the size ranges of `LatencyProfile::SizeBucket`.
+struct UtilSample {
+  // The number of ops completed when the sample was taken.
+  uint64_t op;
+  // The total size of all heaps.
+  uint64_t heap_bytes;
+  // The bytes of all heaps resident in memory.
+  uint64_t resident_bytes;
+  // The requested bytes of live allocations.
+  std::array<uint64_t, LatencyProfile::kNumSizeBuckets> live_bytes;
+  // The usable bytes of live allocations, as reported by `get_size`, or their
+  // requested size if larger.
+  std::array<uint64_t, LatencyProfile::kNumSizeBuckets> usable_bytes;
+
+  uint64_t TotalLiveBytes() const;
+  uint64_t TotalUsableBytes() const;
+};
+
+// Samples of the heap taken at a fixed interval of ops over a utilization
+// test. Since samples are evenly spaced, averages over them weigh each part of
+// the trace by how many ops it spans, unlike the peak-based utilization which
+// only reflects the moment the heap was largest.
+class UtilTimeline {
+ public:
+  void Add(const UtilSample& sample) {
+    samples_.push_back(sample);
+  }
+
+  const std::vector<UtilSample>& Samples() const {
+    return samples_;
+  }
+
+  // The average fraction of the heap holding live bytes, or -1 if there are
+  // no samples with a nonempty heap.
+  double AverageUtilization() const;
+
+  // The average fraction of the heap lost to internal fragmentation (usable
+  // bytes beyond the requested size) by allocations in `size_bucket`.
+  double AverageInternalFragmentation(size_t size_bucket) const;
+
+  // The average fraction of the heap not usable by any live allocation,
+  // i.e. free or holding allocator metadata.
+  double AverageExternalFragmentation() const;
+
+ private:
+  // Averages `fn(sample) / sample.heap_bytes` over samples with a nonempty
+  // heap.
+  template <typename Fn>
+  double AverageFraction(const Fn& fn) const;
+
+  std::vector<UtilSample> samples_;
+};
+
+// Returns the number of bytes of `[start, start + size)` resident in memory.
+// Pages which aren't mapped are not counted.
+uint64_t ResidentBytes(const void* start, size_t size);
+
+// Returns the number of bytes of `heap` resident in memory.
+uint64_t ResidentBytes(const Heap& heap);
+
+// A private anonymous mapping of this process.
+struct AnonymousMapping {
+  uintptr_t start;
+  uintptr_t end;
+  uint64_t resident_bytes;
+};
+
+// Returns the private anonymous mappings of this process, as reported by
+// `/proc/self/smaps`. Named mappings, such as the brk heap and the main
+// thread's stack, are not included.
+absl::StatusOr<std::vector<AnonymousMapping>> AnonymousMappings();
+
+}  // namespace bench
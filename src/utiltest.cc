@@ -1,26 +1,77 @@
 #include "src/utiltest.h"
 
+#include <unistd.h>
+
+#include <algorithm>
 #include <atomic>
 #include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
 
+#include "absl/base/call_once.h"
 #include "absl/flags/flag.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
 #include "util/absl_util.h"
 
+#include "src/allocator_interface.h"
 #include "src/heap_factory.h"
+#include "src/latency_histogram.h"
 #include "src/malloc_runner.h"
 #include "src/tracefile_executor.h"
 #include "src/tracefile_reader.h"
+#include "src/tracefile_stream_reader.h"
+#include "src/util_timeline.h"
 
 ABSL_FLAG(bool, effective_util, false,
           "If set, uses a \"more fair\" measure of memory utilization, "
           "rounding up each allocation size to its alignment requirement.");
 
+ABSL_FLAG(std::string, util_metric, "heap",
+          "What utilization divides the most bytes ever live by: \"heap\" for "
+          "the largest the heaps ever grew, or \"rss\" for the most memory "
+          "ever resident, which credits allocators that return free pages to "
+          "the OS.");
+
 namespace bench {
 
 namespace {
 
+// The number of ops between samples of resident memory with `--util_metric=rss`
+// when the timeline isn't sampled.
+constexpr uint64_t kRssSampleInterval = 256;
+
+absl::StatusOr<UtilMetric> ParseUtilMetric(absl::string_view metric) {
+  if (metric == "heap") {
+    return UtilMetric::kHeap;
+  }
+  if (metric == "rss") {
+    return UtilMetric::kRss;
+  }
+  return absl::InvalidArgumentError(
+      absl::StrFormat("Unknown --util_metric \"%s\"", metric));
+}
+
+uintptr_t PageSize() {
+  static const uintptr_t page_size = sysconf(_SC_PAGESIZE);
+  return page_size;
+}
+
+// Writes to every page of a new allocation, as the program making it would, so
+// that its pages become resident.
+void TouchPages(void* ptr, size_t size) {
+  const uintptr_t page_size = PageSize();
+  const uintptr_t end = reinterpret_cast<uintptr_t>(ptr) + size;
+  for (uintptr_t addr = reinterpret_cast<uintptr_t>(ptr); addr < end;
+       addr = (addr + page_size) & ~(page_size - 1)) {
+    *reinterpret_cast<volatile uint8_t*>(addr) = 0;
+  }
+}
+
 size_t RoundUp(size_t size) {
   if (!absl::GetFlag(FLAGS_effective_util)) {
     return size;
@@ -34,17 +85,50 @@ size_t RoundUp(size_t size) {
 
 }  // namespace
 
-Utiltest::Utiltest(HeapFactory& heap_factory) : MallocRunner(heap_factory) {}
+Utiltest::Utiltest(HeapFactory& heap_factory, const UtilSampling& sampling)
+    : MallocRunner(heap_factory), sampling_(sampling) {}
 
 /* static */
 absl::StatusOr<double> Utiltest::MeasureUtilization(
     TracefileReader& reader, HeapFactory& heap_factory,
-    const TracefileExecutorOptions& options) {
-  TracefileExecutor<Utiltest> utiltest(reader, std::ref(heap_factory));
+    const TracefileExecutorOptions& options, const UtilSampling& sampling) {
+  TracefileExecutor<Utiltest> utiltest(reader, std::ref(heap_factory),
+                                       sampling);
   RETURN_IF_ERROR(utiltest.Run(options).status());
   return utiltest.Inner().ComputeUtilization();
 }
 
+/* static */
+absl::StatusOr<double> Utiltest::MeasureUtilization(
+    TracefileStreamReader& reader, HeapFactory& heap_factory,
+    const TracefileExecutorOptions& options, const UtilSampling& sampling) {
+  TracefileExecutor<Utiltest> utiltest(reader, std::ref(heap_factory),
+                                       sampling);
+  RETURN_IF_ERROR(utiltest.Run(options).status());
+  return utiltest.Inner().ComputeUtilization();
+}
+
+absl::Status Utiltest::InitializeHeap() {
+  ASSIGN_OR_RETURN(metric_, ParseUtilMetric(absl::GetFlag(FLAGS_util_metric)));
+  sample_interval_ = sampling_.interval;
+  if (metric_ == UtilMetric::kRss) {
+    if (sample_interval_ == 0) {
+      sample_interval_ = kRssSampleInterval;
+    }
+  }
+  return MallocRunner::InitializeHeap();
+}
+
+absl::Status Utiltest::CleanupHeap() {
+  // Memory may have become resident since the last sample, and traces shorter
+  // than the sample interval aren't otherwise sampled at all.
+  if (metric_ == UtilMetric::kRss) {
+    absl::call_once(baseline_once_, &Utiltest::TakeBaseline, this);
+    SampleResident();
+  }
+  return MallocRunner::CleanupHeap();
+}
+
 absl::Status Utiltest::PostAlloc(void* ptr, size_t size,
                                  std::optional<size_t> alignment,
                                  bool is_calloc) {
@@ -55,7 +139,10 @@ absl::Status Utiltest::PostAlloc(void* ptr, size_t size,
   size_t total_allocated_bytes = total_allocated_bytes_.fetch_add(
                                      rounded_size, std::memory_order_relaxed) +
                                  rounded_size;
-  RecomputeMax(total_allocated_bytes);
+  UpdateMaxAllocated(total_allocated_bytes);
+  if (metric_ == UtilMetric::kRss) {
+    TouchPages(ptr, size);
+  }
 
   auto [it, inserted] = size_map_.insert({ ptr, size });
   if (!inserted) {
@@ -65,6 +152,8 @@ absl::Status Utiltest::PostAlloc(void* ptr, size_t size,
                         kFailedTestPrefix, ptr, size, it->first, it->second));
   }
 
+  TrackLive(ptr, rounded_size, /*allocated=*/true);
+  CountOp();
   return absl::OkStatus();
 }
 
@@ -77,6 +166,7 @@ absl::StatusOr<size_t> Utiltest::PreRealloc(void* ptr, size_t size) {
                         kFailedTestPrefix, ptr));
   }
   size_t prev_size = it->second;
+  TrackLive(ptr, RoundUp(prev_size), /*allocated=*/false);
 
   size_t deleted_elems = size_map_.erase(ptr);
   if (deleted_elems != 1) {
@@ -98,7 +188,10 @@ absl::Status Utiltest::PostRealloc(void* new_ptr, void* old_ptr, size_t size,
       total_allocated_bytes_.fetch_add(rounded_size - prev_size,
                                        std::memory_order_relaxed) +
       (rounded_size - prev_size);
-  RecomputeMax(total_allocated_bytes);
+  UpdateMaxAllocated(total_allocated_bytes);
+  if (metric_ == UtilMetric::kRss) {
+    TouchPages(new_ptr, size);
+  }
 
   auto [new_it, inserted] = size_map_.insert({ new_ptr, size });
   if (!inserted) {
@@ -108,10 +201,19 @@ absl::Status Utiltest::PostRealloc(void* new_ptr, void* old_ptr, size_t size,
         kFailedTestPrefix, new_ptr, size, new_it->first, new_it->second));
   }
 
+  TrackLive(new_ptr, rounded_size, /*allocated=*/true);
+  CountOp();
   return absl::OkStatus();
 }
 
+void Utiltest::PreOp() {
+  if (metric_ == UtilMetric::kRss) {
+    absl::call_once(baseline_once_, &Utiltest::TakeBaseline, this);
+  }
+}
+
 absl::Status Utiltest::PreRelease(void* ptr) {
+  CountOp();
   if (ptr == nullptr) {
     return absl::OkStatus();
   }
@@ -123,11 +225,8 @@ absl::Status Utiltest::PreRelease(void* ptr) {
   }
   const size_t old_size = RoundUp(it->second);
 
-  size_t total_allocated_bytes =
-      total_allocated_bytes_.fetch_sub(old_size, std::memory_order_relaxed) -
-      old_size;
-  // Recompute max here in case heap size changed (possible in theory).
-  RecomputeMax(total_allocated_bytes);
+  total_allocated_bytes_.fetch_sub(old_size, std::memory_order_relaxed);
+  TrackLive(ptr, old_size, /*allocated=*/false);
 
   size_t deleted_elems = size_map_.erase(ptr);
   if (deleted_elems != 1) {
@@ -140,25 +239,199 @@ absl::Status Utiltest::PreRelease(void* ptr) {
   return absl::OkStatus();
 }
 
-void Utiltest::RecomputeMax(size_t total_allocated_bytes) {
-  size_t heap_size = 0;
-  HeapFactoryRef().WithInstances<void>([&heap_size](const auto& instances) {
-    for (const auto& heap : instances) {
-      heap_size += heap->Size();
-    }
-  });
-
-  // Update the max total allocated bytes and total heap size:
+void Utiltest::UpdateMaxAllocated(size_t total_allocated_bytes) {
   size_t prev_max;
   while ((prev_max = max_allocated_bytes_.exchange(total_allocated_bytes,
                                                    std::memory_order_relaxed)) >
          total_allocated_bytes) {
     total_allocated_bytes = prev_max;
   }
-  while ((prev_max = max_heap_size_.exchange(
-              heap_size, std::memory_order_release)) > heap_size) {
-    heap_size = prev_max;
+}
+
+void Utiltest::TrackLive(void* ptr, size_t size, bool allocated) {
+  if (sampling_.timeline == nullptr) {
+    return;
+  }
+
+  const size_t bucket = LatencyProfile::SizeBucket(size);
+  const uint64_t usable =
+      std::max<uint64_t>(size, ptr != nullptr ? bench::get_size(ptr) : 0);
+  if (allocated) {
+    live_bytes_[bucket].fetch_add(size, std::memory_order_relaxed);
+    usable_bytes_[bucket].fetch_add(usable, std::memory_order_relaxed);
+  } else {
+    live_bytes_[bucket].fetch_sub(size, std::memory_order_relaxed);
+    usable_bytes_[bucket].fetch_sub(usable, std::memory_order_relaxed);
+  }
+}
+
+void Utiltest::CountOp() {
+  if (sample_interval_ == 0) {
+    return;
+  }
+  const uint64_t op = ops_.fetch_add(1, std::memory_order_relaxed) + 1;
+  if (op % sample_interval_ == 0) {
+    TakeSample(op);
+  } else if (metric_ == UtilMetric::kRss && ResidentMayHaveGrown()) {
+    SampleResident();
+  }
+}
+
+void Utiltest::TakeSample(uint64_t op) {
+  UtilSample sample = {
+    .op = op,
+    .heap_bytes = 0,
+    .resident_bytes = 0,
+    .live_bytes = {},
+    .usable_bytes = {},
+  };
+  HeapRanges heap_ranges;
+  HeapFactoryRef().WithInstances<void>(
+      [&sample, &heap_ranges](const auto& instances) {
+        for (const auto& heap : instances) {
+          sample.heap_bytes += heap->Size();
+          sample.resident_bytes += ResidentBytes(*heap);
+          const uintptr_t start = reinterpret_cast<uintptr_t>(heap->Start());
+          heap_ranges.emplace_back(start, start + heap->MaxSize());
+        }
+      });
+
+  if (metric_ == UtilMetric::kRss) {
+    UpdateMaxResident(sample.resident_bytes, std::move(heap_ranges));
+  }
+  if (sampling_.timeline == nullptr) {
+    return;
+  }
+
+  for (size_t bucket = 0; bucket < LatencyProfile::kNumSizeBuckets;
+       bucket++) {
+    sample.live_bytes[bucket] =
+        live_bytes_[bucket].load(std::memory_order_relaxed);
+    sample.usable_bytes[bucket] =
+        usable_bytes_[bucket].load(std::memory_order_relaxed);
+  }
+
+  absl::MutexLock lock(&sample_mutex_);
+  sampling_.timeline->Add(sample);
+}
+
+void Utiltest::SampleResident() {
+  uint64_t resident_bytes = 0;
+  HeapRanges heap_ranges;
+  HeapFactoryRef().WithInstances<void>(
+      [&resident_bytes, &heap_ranges](const auto& instances) {
+        for (const auto& heap : instances) {
+          resident_bytes += ResidentBytes(*heap);
+          const uintptr_t start = reinterpret_cast<uintptr_t>(heap->Start());
+          heap_ranges.emplace_back(start, start + heap->MaxSize());
+        }
+      });
+  UpdateMaxResident(resident_bytes, std::move(heap_ranges));
+}
+
+void Utiltest::UpdateMaxResident(uint64_t resident_bytes,
+                                 HeapRanges heap_ranges) {
+  HeapFactoryRef().WithMetadataInstances<void>(
+      [&resident_bytes, &heap_ranges](const auto& instances) {
+        for (const auto& heap : instances) {
+          resident_bytes += ResidentBytes(*heap);
+          const uintptr_t start = reinterpret_cast<uintptr_t>(heap->Start());
+          heap_ranges.emplace_back(start, start + heap->MaxSize());
+        }
+      });
+  resident_bytes += OutOfHeapResidentBytes(heap_ranges);
+  uint64_t prev_max;
+  while ((prev_max = max_resident_bytes_.exchange(
+              resident_bytes, std::memory_order_relaxed)) > resident_bytes) {
+    resident_bytes = prev_max;
+  }
+}
+
+bool Utiltest::ResidentMayHaveGrown() {
+  const size_t max_allocated_bytes =
+      max_allocated_bytes_.load(std::memory_order_relaxed);
+  const size_t footprint =
+      HeapFactoryRef().TotalSize() + HeapFactoryRef().MetadataSize();
+  const size_t sampled_footprint =
+      sampled_footprint_.load(std::memory_order_relaxed);
+  if (max_allocated_bytes <
+          sampled_max_allocated_bytes_.load(std::memory_order_relaxed) +
+              PageSize() &&
+      footprint < sampled_footprint +
+                      std::max<size_t>(PageSize(), sampled_footprint / 64)) {
+    return false;
+  }
+  sampled_max_allocated_bytes_.store(max_allocated_bytes,
+                                     std::memory_order_relaxed);
+  sampled_footprint_.store(footprint, std::memory_order_relaxed);
+  return true;
+}
+
+/* static */
+std::vector<AnonymousMapping> Utiltest::OutOfHeapResidency(
+    const HeapRanges& heap_ranges) {
+  absl::StatusOr<std::vector<AnonymousMapping>> mappings = AnonymousMappings();
+  if (!mappings.ok()) {
+    return {};
+  }
+  for (AnonymousMapping& mapping : mappings.value()) {
+    // Adjacent mappings may be merged, so a heap may share a mapping with
+    // other memory.
+    for (const auto& [heap_start, heap_end] : heap_ranges) {
+      const uintptr_t start = std::max(heap_start, mapping.start);
+      const uintptr_t end = std::min(heap_end, mapping.end);
+      if (start >= end) {
+        continue;
+      }
+      // NOLINTNEXTLINE(performance-no-int-to-ptr)
+      const uint64_t heap_bytes =
+          ResidentBytes(reinterpret_cast<void*>(start), end - start);
+      mapping.resident_bytes -= std::min(mapping.resident_bytes, heap_bytes);
+    }
+  }
+  return std::move(mappings.value());
+}
+
+void Utiltest::TakeBaseline() {
+  HeapRanges heap_ranges;
+  const auto add_ranges = [&heap_ranges](const auto& instances) {
+    for (const auto& heap : instances) {
+      const uintptr_t start = reinterpret_cast<uintptr_t>(heap->Start());
+      heap_ranges.emplace_back(start, start + heap->MaxSize());
+    }
+  };
+  HeapFactoryRef().WithInstances<void>(add_ranges);
+  HeapFactoryRef().WithMetadataInstances<void>(add_ranges);
+  base_mapping_residency_ = OutOfHeapResidency(heap_ranges);
+}
+
+uint64_t Utiltest::OutOfHeapResidentBytes(const HeapRanges& heap_ranges) const {
+  // Both lists are sorted by address, as `/proc/self/smaps` is.
+  uint64_t added_bytes = 0;
+  auto base = base_mapping_residency_.begin();
+  for (const AnonymousMapping& mapping : OutOfHeapResidency(heap_ranges)) {
+    while (base != base_mapping_residency_.end() &&
+           base->end <= mapping.start) {
+      ++base;
+    }
+    // Mappings may have grown, merged or been split since the baseline, so
+    // credit each with the baseline residency of the addresses it overlaps,
+    // taking residency to be spread evenly over each baseline mapping.
+    uint64_t base_bytes = 0;
+    for (auto it = base;
+         it != base_mapping_residency_.end() && it->start < mapping.end;
+         ++it) {
+      const uintptr_t overlap =
+          std::min(it->end, mapping.end) - std::max(it->start, mapping.start);
+      base_bytes += static_cast<uint64_t>(
+          static_cast<double>(it->resident_bytes) * overlap /
+          (it->end - it->start));
+    }
+    if (mapping.resident_bytes > base_bytes) {
+      added_bytes += mapping.resident_bytes - base_bytes;
+    }
   }
+  return added_bytes;
 }
 
 absl::StatusOr<double> Utiltest::ComputeUtilization() const {
@@ -167,11 +440,17 @@ absl::StatusOr<double> Utiltest::ComputeUtilization() const {
         "Tracefile does not free all the memory it allocates.");
   }
 
-  size_t max_heap_size = max_heap_size_.load(std::memory_order_acquire);
+  // The heap factory tracks the high-water mark of the heaps and metadata
+  // heaps as they grow, so nothing needs to be scanned per op. Resident memory
+  // can only be sampled.
+  size_t max_footprint =
+      metric_ == UtilMetric::kRss
+          ? max_resident_bytes_.load(std::memory_order_relaxed)
+          : HeapFactoryRef().PeakFootprint();
   size_t max_allocated_bytes =
       max_allocated_bytes_.load(std::memory_order_relaxed);
-  return max_heap_size != 0
-             ? static_cast<double>(max_allocated_bytes) / max_heap_size
+  return max_footprint != 0
+             ? static_cast<double>(max_allocated_bytes) / max_footprint
              : -1;
 }
 
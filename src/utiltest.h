@@ -1,23 +1,71 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "absl/base/call_once.h"
+#include "absl/base/thread_annotations.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
 #include "folly/concurrency/ConcurrentHashMap.h"
 
 #include "src/heap_factory.h"
+#include "src/latency_histogram.h"
 #include "src/malloc_runner.h"
 #include "src/tracefile_executor.h"
 #include "src/tracefile_reader.h"
+#include "src/tracefile_stream_reader.h"
+#include "src/util_timeline.h"
 
 namespace bench {
 
+// Where and how often a utilization test samples the heap.
+struct UtilSampling {
+  // The number of ops between samples, or 0 to not sample.
+  uint64_t interval = 0;
+  UtilTimeline* timeline = nullptr;
+};
+
+// What a utilization test divides the most bytes ever live by.
+enum class UtilMetric {
+  // The largest the heaps and metadata heaps together ever were, by their
+  // breaks.
+  kHeap,
+  // The most memory ever resident: the resident pages of the heaps and
+  // metadata heaps, plus anonymous memory outside of them which became
+  // resident after the first op (e.g. allocator metadata mapped separately).
+  // Allocators which return free pages to the OS get credit for them.
+  kRss,
+};
+
 class Utiltest : public MallocRunner<size_t> {
  public:
-  explicit Utiltest(HeapFactory& heap_factory);
+  explicit Utiltest(HeapFactory& heap_factory,
+                    const UtilSampling& sampling = UtilSampling());
 
+  // Returns the peak utilization over a run of the trace, the most bytes ever
+  // live divided by the largest the heaps and the allocator's metadata heaps
+  // ever were (see `HeapFactory::NewMetadataInstance`), or by the peak resident
+  // memory with `--util_metric=rss`. If `sampling` is set, the heap is also
+  // sampled into its timeline over the run.
   static absl::StatusOr<double> MeasureUtilization(
       TracefileReader& reader, HeapFactory& heap_factory,
-      const TracefileExecutorOptions& options = TracefileExecutorOptions());
+      const TracefileExecutorOptions& options = TracefileExecutorOptions(),
+      const UtilSampling& sampling = UtilSampling());
+  static absl::StatusOr<double> MeasureUtilization(
+      TracefileStreamReader& reader, HeapFactory& heap_factory,
+      const TracefileExecutorOptions& options = TracefileExecutorOptions(),
+      const UtilSampling& sampling = UtilSampling());
+
+  absl::Status InitializeHeap();
+
+  // Takes a last sample of resident memory with `--util_metric=rss`.
+  absl::Status CleanupHeap();
 
   absl::Status PostAlloc(void* ptr, size_t size,
                          std::optional<size_t> alignment,
@@ -30,16 +78,90 @@ class Utiltest : public MallocRunner<size_t> {
 
   absl::Status PreRelease(void* ptr) override;
 
+  void PreOp() override;
+
  private:
-  void RecomputeMax(size_t total_allocated_bytes);
+  // The address ranges of heaps or metadata heaps.
+  using HeapRanges = std::vector<std::pair<uintptr_t, uintptr_t>>;
+
+  void UpdateMaxAllocated(size_t total_allocated_bytes);
 
   absl::StatusOr<double> ComputeUtilization() const;
 
+  // Accounts for an allocation of `size` (rounded) bytes at `ptr` being made
+  // or released in the sampled live bytes, if sampling.
+  void TrackLive(void* ptr, size_t size, bool allocated);
+
+  // Counts a completed op, sampling the heap every `sampling_.interval` ops.
+  // With `UtilMetric::kRss`, resident memory is also sampled whenever
+  // `ResidentMayHaveGrown()`, so the peak doesn't fall between samples.
+  void CountOp();
+
+  void TakeSample(uint64_t op);
+
+  // Samples the memory resident with `UtilMetric::kRss`.
+  void SampleResident();
+
+  // Adds the memory resident in the metadata heaps and outside of any heap to
+  // `resident_bytes`, the bytes resident in the heaps `heap_ranges`, and
+  // raises `max_resident_bytes_` to the total.
+  void UpdateMaxResident(uint64_t resident_bytes, HeapRanges heap_ranges);
+
+  // Returns true if, since this last returned true, the most bytes ever live
+  // grew by at least a page, or the heaps and metadata heaps grew by at least
+  // a page or 1/64th of their size. Memory only becomes resident as pages are
+  // touched, so this is when the peak resident memory may have grown. Heaps
+  // are checked more coarsely, as allocators which never return memory grow
+  // them on nearly every op, and their peak is caught by the last sample.
+  bool ResidentMayHaveGrown();
+
+  // Returns the anonymous mappings, with the resident bytes of the heaps in
+  // `heap_ranges` which fall within each one taken out.
+  static std::vector<AnonymousMapping> OutOfHeapResidency(
+      const HeapRanges& heap_ranges);
+
+  // Records the out-of-heap residency before the first op, once everything
+  // the test harness needs to replay the trace has been set up.
+  void TakeBaseline();
+
+  // Resident memory outside of the heaps `heap_ranges` which mappings gained
+  // since the first op. Only anonymous mappings are counted, and each one is
+  // compared against the residency of the same addresses before the first
+  // op, so memory the test harness frees can't offset memory the allocator
+  // maps, and mappings which grew or merged since are only charged for what
+  // they gained. Memory the harness allocates in new mappings during the run
+  // (e.g. stacks of worker threads) is still included, so this is an upper
+  // bound on the allocator's own out-of-heap memory.
+  uint64_t OutOfHeapResidentBytes(const HeapRanges& heap_ranges) const;
+
   folly::ConcurrentHashMap<void*, size_t> size_map_;
 
   std::atomic<size_t> total_allocated_bytes_ = 0;
   std::atomic<size_t> max_allocated_bytes_ = 0;
-  std::atomic<size_t> max_heap_size_ = 0;
+
+  UtilMetric metric_ = UtilMetric::kHeap;
+  // `OutOfHeapResidency()` just before the first op, sorted by address.
+  absl::once_flag baseline_once_;
+  std::vector<AnonymousMapping> base_mapping_residency_;
+  // With `UtilMetric::kRss`, the most memory resident at any sample.
+  std::atomic<uint64_t> max_resident_bytes_ = 0;
+  // The most bytes ever live and the size of the heaps and metadata heaps when
+  // `ResidentMayHaveGrown()` last returned true.
+  std::atomic<size_t> sampled_max_allocated_bytes_ = 0;
+  std::atomic<size_t> sampled_footprint_ = 0;
+
+  const UtilSampling sampling_;
+  // The number of ops between samples, which are also taken to find the peak
+  // resident memory with `UtilMetric::kRss`.
+  uint64_t sample_interval_ = 0;
+  std::atomic<uint64_t> ops_ = 0;
+  // Requested and usable bytes of live allocations by size range, only
+  // tracked when sampling.
+  std::array<std::atomic<uint64_t>, LatencyProfile::kNumSizeBuckets>
+      live_bytes_ = {};
+  std::array<std::atomic<uint64_t>, LatencyProfile::kNumSizeBuckets>
+      usable_bytes_ = {};
+  absl::Mutex sample_mutex_;
 };
 
 }  // namespace bench
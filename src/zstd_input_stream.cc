@@ -0,0 +1,302 @@
+#include "src/zstd_input_stream.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
+#include "util/absl_util.h"
+#include "zstd.h"
+
+namespace bench {
+
+namespace {
+
+// Reads the little-endian magic number at the start of a frame.
+uint32_t FrameMagic(absl::string_view frame) {
+  uint32_t magic = 0;
+  for (size_t i = 0; i < std::min<size_t>(frame.size(), 4); i++) {
+    magic |= static_cast<uint32_t>(static_cast<uint8_t>(frame[i])) << (8 * i);
+  }
+  return magic;
+}
+
+bool IsSkippableFrame(absl::string_view frame) {
+  return frame.size() >= 4 &&
+         (FrameMagic(frame) & ZSTD_MAGIC_SKIPPABLE_MASK) ==
+             ZSTD_MAGIC_SKIPPABLE_START;
+}
+
+absl::Status ZstdError(size_t code) {
+  return absl::InvalidArgumentError(
+      absl::StrFormat("zstd error: %s", ZSTD_getErrorName(code)));
+}
+
+}  // namespace
+
+bool IsZstdMagic(absl::string_view header) {
+  return header.size() >= 4 &&
+         (FrameMagic(header) == ZSTD_MAGICNUMBER || IsSkippableFrame(header));
+}
+
+ZstdDictionary::~ZstdDictionary() {
+  ZSTD_freeDDict(ddict_);
+}
+
+/* static */
+absl::StatusOr<std::shared_ptr<const ZstdDictionary>> ZstdDictionary::Load(
+    const std::string& filename) {
+  std::ifstream file(filename, std::ios::binary);
+  if (!file.is_open()) {
+    return absl::InternalError(
+        absl::StrFormat("Failed to open zstd dictionary %s", filename));
+  }
+  const std::string contents((std::istreambuf_iterator<char>(file)),
+                             std::istreambuf_iterator<char>());
+
+  ZSTD_DDict* ddict = ZSTD_createDDict(contents.data(), contents.size());
+  if (ddict == nullptr) {
+    return absl::InvalidArgumentError(
+        absl::StrFormat("Failed to load zstd dictionary %s", filename));
+  }
+  return std::shared_ptr<const ZstdDictionary>(new ZstdDictionary(ddict));
+}
+
+ZstdInputStream::~ZstdInputStream() {
+  for (ZSTD_DCtx* dctx : dctxs_) {
+    ZSTD_freeDCtx(dctx);
+  }
+}
+
+/* static */
+absl::StatusOr<std::unique_ptr<ZstdInputStream>> ZstdInputStream::Create(
+    absl::string_view data, std::shared_ptr<const ZstdDictionary> dictionary,
+    uint32_t threads) {
+  std::vector<absl::string_view> frames;
+  for (size_t pos = 0; pos < data.size();) {
+    const size_t frame_size =
+        ZSTD_findFrameCompressedSize(data.data() + pos, data.size() - pos);
+    if (ZSTD_isError(frame_size)) {
+      return absl::InvalidArgumentError(
+          absl::StrFormat("Malformed zstd frame at offset %v: %s", pos,
+                          ZSTD_getErrorName(frame_size)));
+    }
+    const absl::string_view frame = data.substr(pos, frame_size);
+    if (!IsSkippableFrame(frame)) {
+      frames.push_back(frame);
+    }
+    pos += frame_size;
+  }
+  // A single frame can only be decompressed serially, and is done so
+  // incrementally rather than all at once.
+  if (threads <= 1 || frames.size() <= 1) {
+    frames.clear();
+    threads = 1;
+  }
+  threads = std::min<uint32_t>(threads, std::max<size_t>(frames.size(), 1));
+
+  std::unique_ptr<ZstdInputStream> stream(new ZstdInputStream(
+      data, std::move(dictionary), std::move(frames), threads));
+  for (uint32_t i = 0; i < threads; i++) {
+    ZSTD_DCtx* dctx = ZSTD_createDCtx();
+    if (dctx == nullptr) {
+      return absl::ResourceExhaustedError(
+          "Failed to create zstd decompression context");
+    }
+    stream->dctxs_.push_back(dctx);
+    if (stream->dictionary_ != nullptr) {
+      const size_t result =
+          ZSTD_DCtx_refDDict(dctx, stream->dictionary_->ddict());
+      if (ZSTD_isError(result)) {
+        return ZstdError(result);
+      }
+    }
+  }
+  return stream;
+}
+
+bool ZstdInputStream::Next(const void** data, int* size) {
+  if (block_pos_ == block_.size()) {
+    if (!(frames_.empty() ? FillIncremental() : FillParallel())) {
+      return false;
+    }
+  }
+
+  *data = block_.data() + block_pos_;
+  *size = static_cast<int>(block_.size() - block_pos_);
+  block_pos_ = block_.size();
+  byte_count_ += *size;
+  return true;
+}
+
+void ZstdInputStream::BackUp(int count) {
+  block_pos_ -= count;
+  byte_count_ -= count;
+}
+
+bool ZstdInputStream::Skip(int count) {
+  while (count > 0) {
+    const void* data;
+    int size;
+    if (!Next(&data, &size)) {
+      return false;
+    }
+    if (size > count) {
+      BackUp(size - count);
+      return true;
+    }
+    count -= size;
+  }
+  return true;
+}
+
+int64_t ZstdInputStream::ByteCount() const {
+  return byte_count_;
+}
+
+ZstdInputStream::ZstdInputStream(
+    absl::string_view data, std::shared_ptr<const ZstdDictionary> dictionary,
+    std::vector<absl::string_view> frames, uint32_t threads)
+    : data_(data),
+      dictionary_(std::move(dictionary)),
+      frames_(std::move(frames)),
+      threads_(threads) {
+  if (frames_.empty()) {
+    buffer_.resize(ZSTD_DStreamOutSize());
+  }
+}
+
+bool ZstdInputStream::FillIncremental() {
+  ZSTD_inBuffer in = { .src = data_.data(),
+                       .size = data_.size(),
+                       .pos = input_pos_ };
+  ZSTD_outBuffer out = { .dst = buffer_.data(),
+                         .size = buffer_.size(),
+                         .pos = 0 };
+  while (out.pos == 0) {
+    if (in.pos == in.size && last_result_ == 0) {
+      return false;
+    }
+    const size_t prev_pos = in.pos;
+    const size_t result = ZSTD_decompressStream(dctxs_[0], &out, &in);
+    if (ZSTD_isError(result)) {
+      status_ = ZstdError(result);
+      return false;
+    }
+    last_result_ = result;
+    if (out.pos == 0 && in.pos == prev_pos) {
+      status_ = absl::DataLossError("Truncated zstd frame");
+      return false;
+    }
+  }
+
+  input_pos_ = in.pos;
+  block_ = absl::string_view(buffer_.data(), out.pos);
+  block_pos_ = 0;
+  return true;
+}
+
+bool ZstdInputStream::FillParallel() {
+  while (true) {
+    if (output_idx_ < frame_outputs_.size()) {
+      block_ = frame_outputs_[output_idx_++];
+      block_pos_ = 0;
+      if (!block_.empty()) {
+        return true;
+      }
+      continue;
+    }
+    if (next_frame_ == frames_.size()) {
+      return false;
+    }
+
+    const size_t n_frames =
+        std::min<size_t>(threads_, frames_.size() - next_frame_);
+    frame_outputs_.assign(n_frames, std::string());
+    std::vector<absl::Status> statuses(n_frames);
+    const auto decompress = [this, &statuses](size_t i) {
+      statuses[i] = DecompressFrame(dctxs_[i], frames_[next_frame_ + i],
+                                    frame_outputs_[i]);
+    };
+
+    std::vector<std::thread> workers;
+    workers.reserve(n_frames - 1);
+    for (size_t i = 1; i < n_frames; i++) {
+      workers.emplace_back(decompress, i);
+    }
+    decompress(0);
+    for (std::thread& worker : workers) {
+      worker.join();
+    }
+
+    for (const absl::Status& status : statuses) {
+      if (!status.ok()) {
+        status_ = status;
+        return false;
+      }
+    }
+    next_frame_ += n_frames;
+    output_idx_ = 0;
+  }
+}
+
+absl::Status ZstdInputStream::DecompressFrame(ZSTD_DCtx* dctx,
+                                              absl::string_view frame,
+                                              std::string& output) const {
+  RETURN_IF_ERROR(ResetContext(dctx));
+
+  const unsigned long long content_size =
+      ZSTD_getFrameContentSize(frame.data(), frame.size());
+  size_t capacity = ZSTD_DStreamOutSize();
+  if (content_size != ZSTD_CONTENTSIZE_UNKNOWN &&
+      content_size != ZSTD_CONTENTSIZE_ERROR) {
+    capacity = std::max<size_t>(capacity, content_size);
+  }
+  output.resize(capacity);
+
+  ZSTD_inBuffer in = { .src = frame.data(), .size = frame.size(), .pos = 0 };
+  size_t written = 0;
+  while (true) {
+    if (written == output.size()) {
+      output.resize(2 * output.size());
+    }
+    ZSTD_outBuffer out = { .dst = output.data(),
+                           .size = output.size(),
+                           .pos = written };
+    const size_t result = ZSTD_decompressStream(dctx, &out, &in);
+    if (ZSTD_isError(result)) {
+      return ZstdError(result);
+    }
+    written = out.pos;
+    if (result == 0) {
+      break;
+    }
+    // With room left in the output, the decoder only stops for more input.
+    if (in.pos == in.size && out.pos < out.size) {
+      return absl::DataLossError("Truncated zstd frame");
+    }
+  }
+  output.resize(written);
+  return absl::OkStatus();
+}
+
+absl::Status ZstdInputStream::ResetContext(ZSTD_DCtx* dctx) const {
+  // Resetting only the session keeps the referenced dictionary.
+  const size_t result = ZSTD_DCtx_reset(dctx, ZSTD_reset_session_only);
+  if (ZSTD_isError(result)) {
+    return ZstdError(result);
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace bench
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "google/protobuf/io/zero_copy_stream.h"
+#include "zstd.h"
+
+namespace bench {
+
+// Returns true if `header` starts with the magic number of a zstd frame or a
+// skippable frame.
+bool IsZstdMagic(absl::string_view header);
+
+// A digested zstd dictionary (e.g. made by `zstd --train`), which can be
+// shared by any number of streams.
+class ZstdDictionary {
+ public:
+  ZstdDictionary(const ZstdDictionary&) = delete;
+  ~ZstdDictionary();
+
+  static absl::StatusOr<std::shared_ptr<const ZstdDictionary>> Load(
+      const std::string& filename);
+
+  const ZSTD_DDict* ddict() const {
+    return ddict_;
+  }
+
+ private:
+  explicit ZstdDictionary(ZSTD_DDict* ddict) : ddict_(ddict) {}
+
+  ZSTD_DDict* const ddict_;
+};
+
+// A `ZeroCopyInputStream` over the decompressed contents of zstd-compressed
+// `data`, which must outlive the stream.
+//
+// zstd can't split a single frame across threads, but files made of several
+// independent frames (e.g. by `pzstd`) are decompressed up to `threads` frames
+// at a time in parallel. Otherwise, the data is decompressed incrementally.
+class ZstdInputStream : public google::protobuf::io::ZeroCopyInputStream {
+ public:
+  ~ZstdInputStream() override;
+
+  // If `dictionary` is set, frames are decompressed with it.
+  static absl::StatusOr<std::unique_ptr<ZstdInputStream>> Create(
+      absl::string_view data, std::shared_ptr<const ZstdDictionary> dictionary,
+      uint32_t threads);
+
+  bool Next(const void** data, int* size) override;
+  void BackUp(int count) override;
+  bool Skip(int count) override;
+  int64_t ByteCount() const override;
+
+  // The error which ended the stream early, if any.
+  const absl::Status& status() const {
+    return status_;
+  }
+
+ private:
+  ZstdInputStream(absl::string_view data,
+                  std::shared_ptr<const ZstdDictionary> dictionary,
+                  std::vector<absl::string_view> frames, uint32_t threads);
+
+  // Decompresses the next block of data into `buffer_`, returning false at the
+  // end of the data or on error.
+  bool FillIncremental();
+
+  // Decompresses the next `threads_` frames in parallel into `frame_outputs_`,
+  // returning false if there are none left or on error.
+  bool FillParallel();
+
+  // Decompresses all of `frame` into `output` with `dctx`.
+  absl::Status DecompressFrame(ZSTD_DCtx* dctx, absl::string_view frame,
+                               std::string& output) const;
+
+  absl::Status ResetContext(ZSTD_DCtx* dctx) const;
+
+  const absl::string_view data_;
+  const std::shared_ptr<const ZstdDictionary> dictionary_;
+  // The data frames of `data_`, if decompressing them in parallel.
+  const std::vector<absl::string_view> frames_;
+  const uint32_t threads_;
+  // One per thread.
+  std::vector<ZSTD_DCtx*> dctxs_;
+
+  // For incremental decompression, the position in `data_`.
+  size_t input_pos_ = 0;
+  // The result of the last `ZSTD_decompressStream` call, nonzero if a frame is
+  // partially decoded.
+  size_t last_result_ = 0;
+  std::vector<char> buffer_;
+
+  // For parallel decompression, the index of the next frame to decompress and
+  // the outputs of the last batch of frames.
+  size_t next_frame_ = 0;
+  std::vector<std::string> frame_outputs_;
+  size_t output_idx_ = 0;
+
+  // The block last returned by `Next()`, and how much of it has been consumed.
+  absl::string_view block_;
+  size_t block_pos_ = 0;
+  int64_t byte_count_ = 0;
+  absl::Status status_;
+};
+
+}  // namespace bench
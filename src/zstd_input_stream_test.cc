@@ -0,0 +1,148 @@
+#include "src/zstd_input_stream.h"
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+
+#include "absl/status/statusor.h"
+#include "gtest/gtest.h"
+#include "util/gtest_util.h"
+#include "zstd.h"
+
+namespace bench {
+
+class TestZstdInputStream : public ::testing::Test {
+ public:
+  static std::string Compress(const std::string& data) {
+    std::string compressed(ZSTD_compressBound(data.size()), '\0');
+    const size_t size = ZSTD_compress(compressed.data(), compressed.size(),
+                                      data.data(), data.size(), /*level=*/3);
+    EXPECT_FALSE(ZSTD_isError(size));
+    compressed.resize(size);
+    return compressed;
+  }
+
+  // Returns every byte of `stream`, backing up part of each block to check
+  // that it is returned again.
+  static std::string ReadAll(ZstdInputStream& stream) {
+    std::string result;
+    const void* data;
+    int size;
+    while (stream.Next(&data, &size)) {
+      if (size > 1) {
+        stream.BackUp(size / 2);
+        size -= size / 2;
+      }
+      result.append(static_cast<const char*>(data), size);
+    }
+    EXPECT_EQ(stream.ByteCount(), static_cast<int64_t>(result.size()));
+    return result;
+  }
+
+  static std::string MakeData(size_t size, uint32_t seed) {
+    std::string data(size, '\0');
+    for (size_t i = 0; i < size; i++) {
+      seed = seed * 1103515245 + 12345;
+      data[i] = static_cast<char>('a' + (seed >> 16) % 8);
+    }
+    return data;
+  }
+};
+
+TEST_F(TestZstdInputStream, SingleFrame) {
+  const std::string data = MakeData(1 << 20, 1);
+  const std::string compressed = Compress(data);
+  for (uint32_t threads : { 1, 4 }) {
+    absl::StatusOr<std::unique_ptr<ZstdInputStream>> stream =
+        ZstdInputStream::Create(compressed, nullptr, threads);
+    ASSERT_THAT(stream, util::IsOk());
+    EXPECT_EQ(ReadAll(**stream), data);
+    EXPECT_THAT((*stream)->status(), util::IsOk());
+  }
+}
+
+TEST_F(TestZstdInputStream, ParallelFrames) {
+  std::string data;
+  std::string compressed;
+  for (uint32_t frame = 0; frame < 7; frame++) {
+    const std::string frame_data = MakeData(100000 + frame, frame);
+    data += frame_data;
+    compressed += Compress(frame_data);
+  }
+  // Skippable frames, as written by `pzstd`, are ignored.
+  const std::string skippable("\x50\x2a\x4d\x18\x04\x00\x00\x00"
+                              "abcd",
+                              12);
+  compressed = skippable + compressed;
+
+  for (uint32_t threads : { 1, 3, 16 }) {
+    absl::StatusOr<std::unique_ptr<ZstdInputStream>> stream =
+        ZstdInputStream::Create(compressed, nullptr, threads);
+    ASSERT_THAT(stream, util::IsOk());
+    EXPECT_EQ(ReadAll(**stream), data);
+    EXPECT_THAT((*stream)->status(), util::IsOk());
+  }
+}
+
+TEST_F(TestZstdInputStream, Dictionary) {
+  const std::string dictionary = MakeData(4096, 4);
+  const std::string dictionary_path = ::testing::TempDir() + "/zstd_dict";
+  std::ofstream(dictionary_path, std::ios::binary) << dictionary;
+
+  const std::string data = dictionary + MakeData(1000, 5) + dictionary;
+  std::string compressed(ZSTD_compressBound(data.size()), '\0');
+  ZSTD_CCtx* cctx = ZSTD_createCCtx();
+  const size_t size = ZSTD_compress_usingDict(
+      cctx, compressed.data(), compressed.size(), data.data(), data.size(),
+      dictionary.data(), dictionary.size(), /*compressionLevel=*/3);
+  ZSTD_freeCCtx(cctx);
+  ASSERT_FALSE(ZSTD_isError(size));
+  compressed.resize(size);
+
+  absl::StatusOr<std::shared_ptr<const ZstdDictionary>> ddict =
+      ZstdDictionary::Load(dictionary_path);
+  ASSERT_THAT(ddict, util::IsOk());
+  absl::StatusOr<std::unique_ptr<ZstdInputStream>> stream =
+      ZstdInputStream::Create(compressed, *ddict, 1);
+  ASSERT_THAT(stream, util::IsOk());
+  EXPECT_EQ(ReadAll(**stream), data);
+  EXPECT_THAT((*stream)->status(), util::IsOk());
+}
+
+TEST_F(TestZstdInputStream, Empty) {
+  absl::StatusOr<std::unique_ptr<ZstdInputStream>> stream =
+      ZstdInputStream::Create("", nullptr, 1);
+  ASSERT_THAT(stream, util::IsOk());
+  EXPECT_EQ(ReadAll(**stream), "");
+}
+
+TEST_F(TestZstdInputStream, TruncatedFrame) {
+  const std::string compressed = Compress(MakeData(1 << 16, 2));
+  EXPECT_FALSE(
+      ZstdInputStream::Create(compressed.substr(0, compressed.size() / 2),
+                              nullptr, 1)
+          .ok());
+}
+
+TEST_F(TestZstdInputStream, CorruptFrame) {
+  const std::string data = MakeData(1 << 16, 3);
+  std::string compressed = Compress(data);
+  compressed[compressed.size() / 2] ^= 0x55;
+  compressed[compressed.size() / 2 + 1] ^= 0x55;
+
+  absl::StatusOr<std::unique_ptr<ZstdInputStream>> stream =
+      ZstdInputStream::Create(compressed, nullptr, 1);
+  ASSERT_THAT(stream, util::IsOk());
+  EXPECT_NE(ReadAll(**stream), data);
+  EXPECT_FALSE((*stream)->status().ok());
+}
+
+TEST_F(TestZstdInputStream, IsZstdMagic) {
+  EXPECT_TRUE(IsZstdMagic(Compress("hello")));
+  EXPECT_TRUE(IsZstdMagic(std::string("\x5f\x2a\x4d\x18", 4)));
+  EXPECT_FALSE(IsZstdMagic(std::string("\x1f\x8b\x08\x00", 4)));
+  EXPECT_FALSE(IsZstdMagic("\x28\xb5"));
+}
+
+}  // namespace bench